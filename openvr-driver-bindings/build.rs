@@ -74,6 +74,10 @@ pub fn main() -> Result<(), Box<dyn std::error::Error>> {
         "IVRResources",
         "IVRDriverInput",
         "IVRDisplayComponent",
+        "IVRCameraComponent",
+        "IVRVirtualDisplay",
+        "IVRDriverDirectModeComponent",
+        "IVRIPCResourceManagerClient",
         "IVRDriverLog",
         "IVRSettings",
         "IVRProperties",
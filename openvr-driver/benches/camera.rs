@@ -0,0 +1,193 @@
+//! Camera pixel conversion benchmarks
+//!
+//! Converts a side-by-side stereo capture, two 1280x960 sensors, into each
+//! stream format vrserver can ask for, once per backend the CPU supports
+//! and once end to end through the `IVRCameraComponent` vtable. At 60 Hz a
+//! frame has 16.7 ms. Run with `cargo bench -p openvr-driver --bench camera`.
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use openvr_driver::camera::{
+    convert_image_with, image_data_size, CameraFrameInfo, CameraStream, ConvertBackend, SourceImage,
+};
+use openvr_driver::interfaces::{CameraComponent, CameraComponentExt};
+use openvr_driver::sys;
+use std::ffi::c_void;
+use std::hint::black_box;
+use std::sync::Arc;
+
+use sys::root::vr::{ECameraVideoStreamFormat, IVRCameraComponent};
+
+/// One sensor of the stereo pair
+const EYE_WIDTH: u32 = 1280;
+const EYE_HEIGHT: u32 = 960;
+
+/// Formats a passthrough stream is commonly requested in
+const TARGETS: [ECameraVideoStreamFormat; 5] = [
+    ECameraVideoStreamFormat::CVS_FORMAT_RGB24,
+    ECameraVideoStreamFormat::CVS_FORMAT_RGBX32,
+    ECameraVideoStreamFormat::CVS_FORMAT_NV12,
+    ECameraVideoStreamFormat::CVS_FORMAT_NV12_2,
+    ECameraVideoStreamFormat::CVS_FORMAT_YUYV16,
+];
+
+/// Frame size of a stream format for the stereo capture
+fn frame_size(format: ECameraVideoStreamFormat) -> (u32, u32) {
+    match format {
+        // Two images stacked, so each is one sensor wide
+        ECameraVideoStreamFormat::CVS_FORMAT_NV12_2 => (EYE_WIDTH, EYE_HEIGHT),
+        _ => (EYE_WIDTH * 2, EYE_HEIGHT),
+    }
+}
+
+fn format_name(format: ECameraVideoStreamFormat) -> &'static str {
+    match format {
+        ECameraVideoStreamFormat::CVS_FORMAT_RGB24 => "rgb24",
+        ECameraVideoStreamFormat::CVS_FORMAT_RGBX32 => "rgbx32",
+        ECameraVideoStreamFormat::CVS_FORMAT_NV12 => "nv12",
+        ECameraVideoStreamFormat::CVS_FORMAT_NV12_2 => "nv12_2",
+        ECameraVideoStreamFormat::CVS_FORMAT_YUYV16 => "yuyv16",
+        _ => "other",
+    }
+}
+
+/// A captured stereo frame in a sensor format, filled with a gradient
+fn capture(format: ECameraVideoStreamFormat) -> Vec<u8> {
+    let size = image_data_size(format, EYE_WIDTH * 2, EYE_HEIGHT).expect("sensor format");
+    (0..size as usize)
+        .map(|i| (i.wrapping_mul(7919) % 251) as u8)
+        .collect()
+}
+
+fn bench_convert(c: &mut Criterion) {
+    let mut group = c.benchmark_group("camera/convert");
+    group.throughput(Throughput::Elements((EYE_WIDTH * 2 * EYE_HEIGHT) as u64));
+    group.sample_size(20);
+
+    for source in [
+        ECameraVideoStreamFormat::CVS_FORMAT_YUYV16,
+        ECameraVideoStreamFormat::CVS_FORMAT_NV12,
+    ] {
+        let data = capture(source);
+        let src = SourceImage::new(source, EYE_WIDTH * 2, EYE_HEIGHT, &data);
+
+        for target in TARGETS {
+            let (width, height) = frame_size(target);
+            let mut dst = vec![0u8; image_data_size(target, width, height).unwrap() as usize];
+
+            for backend in ConvertBackend::available() {
+                let id = format!("{}_to_{}", format_name(source), format_name(target));
+                group.bench_function(BenchmarkId::new(id, format!("{:?}", backend)), |b| {
+                    b.iter(|| {
+                        convert_image_with(backend, &src, target, width, height, &mut dst)
+                            .expect("conversion")
+                    })
+                });
+            }
+        }
+    }
+
+    group.finish();
+}
+
+/// Camera that accepts every target format at the stereo frame size
+struct BenchCamera {
+    stream: CameraStream,
+}
+
+impl CameraComponent for BenchCamera {
+    fn stream(&self) -> &CameraStream {
+        &self.stream
+    }
+
+    fn frame_dimensions(&self, format: ECameraVideoStreamFormat) -> Option<(u32, u32)> {
+        TARGETS.contains(&format).then(|| frame_size(format))
+    }
+}
+
+/// A camera vtable as handed to vrserver, with the buffers it would allocate
+struct Vtable {
+    camera: Arc<BenchCamera>,
+    this: *mut IVRCameraComponent,
+    _buffers: Vec<Vec<u8>>,
+}
+
+impl Vtable {
+    fn start(format: ECameraVideoStreamFormat) -> Self {
+        let camera = Arc::new(BenchCamera {
+            stream: CameraStream::new(),
+        });
+        let this = camera.clone().create_camera_vtable() as *mut IVRCameraComponent;
+
+        unsafe {
+            let vtable = &*(*this).vtable_;
+            assert!((vtable.IVRCameraComponent_SetCameraVideoStreamFormat)(
+                this, format
+            ));
+            let (mut count, mut size) = (0, 0);
+            assert!((vtable
+                .IVRCameraComponent_GetCameraFrameBufferingRequirements)(
+                this, &mut count, &mut size
+            ));
+
+            let mut buffers: Vec<Vec<u8>> = (0..count).map(|_| vec![0u8; size as usize]).collect();
+            let mut pointers: Vec<*mut c_void> = buffers
+                .iter_mut()
+                .map(|buffer| buffer.as_mut_ptr() as *mut c_void)
+                .collect();
+            assert!((vtable.IVRCameraComponent_SetCameraFrameBuffering)(
+                this,
+                count,
+                pointers.as_mut_ptr(),
+                size
+            ));
+            assert!((vtable.IVRCameraComponent_StartVideoStream)(this));
+
+            Self {
+                camera,
+                this,
+                _buffers: buffers,
+            }
+        }
+    }
+
+    /// Capture one frame into the ring and let the runtime take and release it
+    #[inline]
+    fn deliver(&self, src: &SourceImage<'_>) {
+        let mut frame = self.camera.stream.begin_frame().expect("free buffer");
+        frame.write_image(src).expect("conversion");
+        frame.commit(&CameraFrameInfo::default());
+
+        unsafe {
+            let vtable = &*(*self.this).vtable_;
+            let image = (vtable.IVRCameraComponent_GetVideoStreamFrame)(self.this);
+            black_box((*image).m_nImageDataSize);
+            (vtable.IVRCameraComponent_ReleaseVideoStreamFrame)(self.this, image);
+        }
+    }
+}
+
+fn bench_frame_delivery(c: &mut Criterion) {
+    let mut group = c.benchmark_group("camera/frame");
+    group.throughput(Throughput::Elements((EYE_WIDTH * 2 * EYE_HEIGHT) as u64));
+    group.sample_size(20);
+
+    let data = capture(ECameraVideoStreamFormat::CVS_FORMAT_YUYV16);
+    let src = SourceImage::new(
+        ECameraVideoStreamFormat::CVS_FORMAT_YUYV16,
+        EYE_WIDTH * 2,
+        EYE_HEIGHT,
+        &data,
+    );
+
+    for target in TARGETS {
+        let vtable = Vtable::start(target);
+        group.bench_function(BenchmarkId::new("yuyv16", format_name(target)), |b| {
+            b.iter(|| vtable.deliver(&src))
+        });
+    }
+
+    group.finish();
+}
+
+criterion_group!(benches, bench_convert, bench_frame_delivery);
+criterion_main!(benches);
@@ -0,0 +1,336 @@
+//! Display component thunk benchmarks
+//!
+//! Calls the `IVRDisplayComponent` vtable the way vrserver does, through the
+//! C ABI, for an identity display, a polynomial lens evaluated directly and
+//! the same lens served from a precomputed grid. Run with
+//! `cargo bench -p openvr-driver --bench display`.
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use openvr_driver::display::{
+    DistortionCacheConfig, DistortionGrid, InverseDistortion, InverseDistortionConfig,
+    LensDistortion, LensModel, StereoLens,
+};
+use openvr_driver::{sys, Component, DisplayComponent, Eye, HmdMatrix34};
+use std::hint::black_box;
+use std::sync::Arc;
+
+use sys::root::vr::{EVREye, HmdVector2_t, IVRDisplayComponent};
+
+/// Distortion mesh resolutions comparable to what the compositor builds
+const MESH_SIZES: [u32; 3] = [33, 65, 129];
+
+/// Display used by every benchmark, differing only in how it distorts
+struct BenchDisplay {
+    lenses: Option<StereoLens>,
+    cached: bool,
+}
+
+impl BenchDisplay {
+    fn identity() -> Self {
+        Self {
+            lenses: None,
+            cached: false,
+        }
+    }
+
+    fn polynomial(cached: bool) -> Self {
+        Self {
+            lenses: Some(polynomial_lenses()),
+            cached,
+        }
+    }
+}
+
+fn polynomial_lenses() -> StereoLens {
+    StereoLens::symmetric(LensDistortion::new(LensModel::RadialPolynomial([
+        [0.22, 0.05, 0.0, 0.0],
+        [0.24, 0.05, 0.0, 0.0],
+        [0.26, 0.05, 0.0, 0.0],
+    ])))
+}
+
+impl DisplayComponent for BenchDisplay {
+    fn get_window_bounds(&self) -> (i32, i32, i32, i32) {
+        (0, 0, 2880, 1600)
+    }
+
+    fn get_recommended_render_target_size(&self) -> (u32, u32) {
+        (2016, 2240)
+    }
+
+    fn get_eye_to_head_transform(&self, eye: Eye) -> HmdMatrix34 {
+        let x = match eye {
+            Eye::Left => -0.0315,
+            Eye::Right => 0.0315,
+        };
+        HmdMatrix34 {
+            m: [
+                [1.0, 0.0, 0.0, x],
+                [0.0, 1.0, 0.0, 0.0],
+                [0.0, 0.0, 1.0, 0.0],
+            ],
+        }
+    }
+
+    fn compute_distortion(&self, eye: Eye, u: f32, v: f32) -> (f32, f32, f32, f32, f32, f32) {
+        match &self.lenses {
+            Some(lenses) => lenses.compute_distortion(eye, u, v),
+            None => (u, v, u, v, u, v),
+        }
+    }
+
+    fn compute_distortion_row(&self, eye: Eye, u: &[f32], v: f32, out: &mut [[f32; 6]]) {
+        match &self.lenses {
+            Some(lenses) => lenses.compute_distortion_row(eye, u, v, out),
+            None => {
+                for (u, out) in u.iter().zip(out.iter_mut()) {
+                    *out = [*u, v, *u, v, *u, v];
+                }
+            }
+        }
+    }
+
+    fn distortion_cache(&self) -> Option<DistortionCacheConfig> {
+        let lenses = self.lenses.as_ref().filter(|_| self.cached)?;
+        Some(DistortionCacheConfig {
+            lens_parameters: lenses.parameters(),
+            ..DistortionCacheConfig::default()
+        })
+    }
+}
+
+/// A display vtable as handed to vrserver
+struct Vtable(*mut IVRDisplayComponent);
+
+impl Vtable {
+    fn new(display: BenchDisplay) -> Self {
+        Self(Arc::new(display).create_vtable() as *mut IVRDisplayComponent)
+    }
+
+    #[inline]
+    fn compute_distortion(&self, eye: EVREye, u: f32, v: f32) -> [f32; 6] {
+        unsafe {
+            let f = (*(*self.0).vtable_).IVRDisplayComponent_ComputeDistortion;
+            let c = f(self.0, eye, u, v);
+            [
+                c.rfRed[0],
+                c.rfRed[1],
+                c.rfGreen[0],
+                c.rfGreen[1],
+                c.rfBlue[0],
+                c.rfBlue[1],
+            ]
+        }
+    }
+
+    #[inline]
+    fn compute_inverse_distortion(&self, eye: EVREye, channel: u32, u: f32, v: f32) -> bool {
+        unsafe {
+            let f = (*(*self.0).vtable_).IVRDisplayComponent_ComputeInverseDistortion;
+            let mut result = HmdVector2_t { v: [0.0; 2] };
+            f(self.0, &mut result, eye, channel, u, v)
+        }
+    }
+
+    #[inline]
+    fn get_projection_raw(&self, eye: EVREye) -> [f32; 4] {
+        let mut out = [0.0f32; 4];
+        unsafe {
+            let f = (*(*self.0).vtable_).IVRDisplayComponent_GetProjectionRaw;
+            let [l, r, t, b] = &mut out;
+            f(self.0, eye, l, r, t, b);
+        }
+        out
+    }
+
+    #[inline]
+    fn get_eye_output_viewport(&self, eye: EVREye) -> [u32; 4] {
+        let mut out = [0u32; 4];
+        unsafe {
+            let f = (*(*self.0).vtable_).IVRDisplayComponent_GetEyeOutputViewport;
+            let [x, y, w, h] = &mut out;
+            f(self.0, eye, x, y, w, h);
+        }
+        out
+    }
+}
+
+fn models() -> [(&'static str, fn() -> BenchDisplay); 3] {
+    [
+        ("identity", BenchDisplay::identity),
+        ("polynomial", || BenchDisplay::polynomial(false)),
+        ("grid", || BenchDisplay::polynomial(true)),
+    ]
+}
+
+/// Points spread over the viewport, so calls do not all hit one grid cell
+fn sample_points(count: usize) -> Vec<(f32, f32)> {
+    (0..count)
+        .map(|i| {
+            let t = i as f32 / count as f32;
+            ((t * 7.31).fract(), (t * 3.17).fract())
+        })
+        .collect()
+}
+
+fn bench_per_call(c: &mut Criterion) {
+    let points = sample_points(1024);
+    let mut group = c.benchmark_group("display/per_call");
+    group.throughput(Throughput::Elements(points.len() as u64));
+
+    for (name, make) in models() {
+        let vtable = Vtable::new(make());
+
+        group.bench_function(BenchmarkId::new("ComputeDistortion", name), |b| {
+            b.iter(|| {
+                for &(u, v) in &points {
+                    black_box(vtable.compute_distortion(EVREye::Eye_Left, u, v));
+                }
+            })
+        });
+
+        if name != "identity" {
+            // First call builds the seeds; measure steady-state solves only
+            vtable.compute_inverse_distortion(EVREye::Eye_Left, 1, 0.5, 0.5);
+            group.bench_function(BenchmarkId::new("ComputeInverseDistortion", name), |b| {
+                b.iter(|| {
+                    for &(u, v) in &points {
+                        black_box(vtable.compute_inverse_distortion(EVREye::Eye_Left, 1, u, v));
+                    }
+                })
+            });
+        }
+    }
+
+    let vtable = Vtable::new(BenchDisplay::identity());
+    group.bench_function("GetProjectionRaw", |b| {
+        b.iter(|| {
+            for i in 0..points.len() {
+                let eye = if i & 1 == 0 {
+                    EVREye::Eye_Left
+                } else {
+                    EVREye::Eye_Right
+                };
+                black_box(vtable.get_projection_raw(eye));
+            }
+        })
+    });
+    group.bench_function("GetEyeOutputViewport", |b| {
+        b.iter(|| {
+            for i in 0..points.len() {
+                let eye = if i & 1 == 0 {
+                    EVREye::Eye_Left
+                } else {
+                    EVREye::Eye_Right
+                };
+                black_box(vtable.get_eye_output_viewport(eye));
+            }
+        })
+    });
+
+    group.finish();
+}
+
+fn bench_mesh_fill(c: &mut Criterion) {
+    let mut group = c.benchmark_group("display/mesh_fill");
+    group.sample_size(20);
+
+    for (name, make) in models() {
+        let vtable = Vtable::new(make());
+
+        for size in MESH_SIZES {
+            group.throughput(Throughput::Elements(2 * (size * size) as u64));
+            group.bench_with_input(BenchmarkId::new(name, size), &size, |b, &size| {
+                let step = 1.0 / (size - 1) as f32;
+                b.iter(|| {
+                    for eye in [EVREye::Eye_Left, EVREye::Eye_Right] {
+                        for y in 0..size {
+                            for x in 0..size {
+                                black_box(vtable.compute_distortion(
+                                    eye,
+                                    x as f32 * step,
+                                    y as f32 * step,
+                                ));
+                            }
+                        }
+                    }
+                })
+            });
+        }
+    }
+
+    group.finish();
+}
+
+fn bench_grid_startup(c: &mut Criterion) {
+    let mut group = c.benchmark_group("display/startup");
+    group.sample_size(10);
+
+    // What creating a cached display vtable does before serving its first call
+    let lenses = polynomial_lenses();
+    for size in MESH_SIZES {
+        group.bench_with_input(BenchmarkId::new("grid", size), &size, |b, &size| {
+            b.iter(|| {
+                DistortionGrid::evaluate_rows(size, size, 0, |eye, u, v, out| {
+                    lenses.compute_distortion_row(eye, u, v, out)
+                })
+                .expect("grid evaluation")
+            })
+        });
+    }
+
+    group.finish();
+}
+
+/// Inverse by scanning a dense forward grid, the approach the seeded solver replaces
+fn brute_force_inverse(forward: &StereoLens, steps: u32, u: f32, v: f32) -> [f32; 2] {
+    let step = 1.0 / (steps - 1) as f32;
+    let mut best = ([0.0f32; 2], f32::INFINITY);
+    for y in 0..steps {
+        for x in 0..steps {
+            let (su, sv) = (x as f32 * step, y as f32 * step);
+            let (_, _, gu, gv, _, _) = forward.compute_distortion(Eye::Left, su, sv);
+            let error = (gu - u).powi(2) + (gv - v).powi(2);
+            if error < best.1 {
+                best = ([su, sv], error);
+            }
+        }
+    }
+    best.0
+}
+
+fn bench_inverse_strategies(c: &mut Criterion) {
+    let lenses = polynomial_lenses();
+    let forward = |eye: Eye, u: f32, v: f32| lenses.eye(eye).distort(u, v);
+    let inverse = InverseDistortion::build(InverseDistortionConfig::default(), &forward)
+        .expect("polynomial lens is invertible");
+    let points = sample_points(64);
+
+    let mut group = c.benchmark_group("display/inverse");
+    group.throughput(Throughput::Elements(points.len() as u64));
+    group.bench_function("seeded_newton", |b| {
+        b.iter(|| {
+            for &(u, v) in &points {
+                black_box(inverse.solve(&forward, Eye::Left, 1, u, v));
+            }
+        })
+    });
+    group.sample_size(10);
+    group.bench_function("brute_force_257", |b| {
+        b.iter(|| {
+            for &(u, v) in &points {
+                black_box(brute_force_inverse(&lenses, 257, u, v));
+            }
+        })
+    });
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    bench_per_call,
+    bench_mesh_fill,
+    bench_grid_startup,
+    bench_inverse_strategies
+);
+criterion_main!(benches);
@@ -0,0 +1,103 @@
+//! Fit lens distortion coefficients from a CSV of measured correspondences
+//!
+//! ```text
+//! lens-fit <correspondences.csv> [--terms N] [--fixed-center U,V]
+//!          [--scale X,Y] [--threads N] [--output fit.json]
+//! ```
+//!
+//! See `openvr_driver::display::parse_correspondences` for the input format.
+//! The fit is printed as JSON (or written to `--output`) and a summary of the
+//! residuals goes to stderr.
+
+use openvr_driver::display::{fit_lenses, parse_correspondences, LensFitConfig};
+use std::process::ExitCode;
+use std::time::Instant;
+
+const USAGE: &str = "usage: lens-fit <correspondences.csv> [--terms N] [--fixed-center U,V] [--scale X,Y] [--threads N] [--output fit.json]";
+
+fn parse_pair(value: &str) -> Result<[f32; 2], String> {
+    let mut parts = value.split(',').map(|p| p.trim().parse::<f32>());
+    match (parts.next(), parts.next(), parts.next()) {
+        (Some(Ok(a)), Some(Ok(b)), None) => Ok([a, b]),
+        _ => Err(format!(
+            "expected two comma separated numbers, got '{}'",
+            value
+        )),
+    }
+}
+
+fn run() -> Result<(), String> {
+    let mut args = std::env::args().skip(1);
+    let mut input = None;
+    let mut output = None;
+    let mut config = LensFitConfig::default();
+
+    while let Some(arg) = args.next() {
+        let mut value = |name: &str| args.next().ok_or_else(|| format!("{} needs a value", name));
+        match arg.as_str() {
+            "--terms" => {
+                config.terms = value("--terms")?
+                    .parse()
+                    .map_err(|_| "--terms needs an integer".to_string())?
+            }
+            "--fixed-center" => {
+                config.initial_center = parse_pair(&value("--fixed-center")?)?;
+                config.fit_center = false;
+            }
+            "--scale" => config.scale = parse_pair(&value("--scale")?)?,
+            "--threads" => {
+                config.threads = value("--threads")?
+                    .parse()
+                    .map_err(|_| "--threads needs an integer".to_string())?
+            }
+            "--output" => output = Some(value("--output")?),
+            "-h" | "--help" => {
+                println!("{}", USAGE);
+                return Ok(());
+            }
+            _ if input.is_none() && !arg.starts_with("--") => input = Some(arg),
+            _ => return Err(format!("unexpected argument '{}'\n{}", arg, USAGE)),
+        }
+    }
+
+    let input = input.ok_or_else(|| USAGE.to_string())?;
+    let text = std::fs::read_to_string(&input).map_err(|e| format!("{}: {}", input, e))?;
+    let correspondences = parse_correspondences(&text).map_err(|e| e.to_string())?;
+
+    let started = Instant::now();
+    let fit = fit_lenses(&correspondences, &config).map_err(|e| e.to_string())?;
+    eprintln!(
+        "[LensFit] {} correspondences fitted in {:.1} ms",
+        correspondences.len(),
+        started.elapsed().as_secs_f64() * 1000.0
+    );
+    for (name, eye) in [("left", &fit.left), ("right", &fit.right)] {
+        eprintln!(
+            "[LensFit] {}: {} points, {} iterations, rms {:.2e}, max {:.2e}, center ({:.5}, {:.5})",
+            name,
+            eye.samples,
+            eye.iterations,
+            eye.rms_error,
+            eye.max_error,
+            eye.lens.center[0],
+            eye.lens.center[1]
+        );
+    }
+
+    let json = fit.to_json();
+    match output {
+        Some(path) => std::fs::write(&path, json + "\n").map_err(|e| format!("{}: {}", path, e))?,
+        None => println!("{}", json),
+    }
+    Ok(())
+}
+
+fn main() -> ExitCode {
+    match run() {
+        Ok(()) => ExitCode::SUCCESS,
+        Err(e) => {
+            eprintln!("lens-fit: {}", e);
+            ExitCode::FAILURE
+        }
+    }
+}
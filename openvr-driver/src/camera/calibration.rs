@@ -0,0 +1,432 @@
+//! Camera calibration and undistortion maps
+//!
+//! vrserver calls `GetCameraDistortion` once per point, typically for every
+//! vertex of a mesh, and `GetCameraIntrinsics`/`GetCameraProjection` for
+//! every frame type. `CameraCalibration` describes one camera as pinhole
+//! intrinsics plus an `EVRDistortionFunctionType` model. `CameraRig` holds
+//! the calibrations of all cameras on a device, evaluates each model once
+//! over a regular UV grid when it is built (rows split across cores), and
+//! answers distortion queries by bilinear interpolation.
+
+use crate::display::{LensDistortion, LensModel};
+use crate::interfaces::{CameraConfiguration, CameraIntrinsics};
+use crate::properties::{BinaryPropertyWrite, Properties, PropertyContainer};
+use crate::sys::root::vr::{
+    self, k_unMaxCameras, k_unMaxDistortionFunctionParameters, EVRTrackedCameraFrameType,
+    HmdMatrix44_t,
+};
+use crate::{DistortionFunctionType, DriverError, DriverResult};
+
+/// Coefficients per camera in `Prop_CameraDistortionCoefficients_Float_Array`,
+/// which holds doubles
+const COEFFICIENTS: usize = k_unMaxDistortionFunctionParameters as usize;
+
+/// Pinhole intrinsics and lens distortion of one camera
+///
+/// Intrinsics are in pixels of a `width` x `height` image; the distortion
+/// model acts on normalized image coordinates `((x - cx) / fx, (y - cy) / fy)`.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct CameraCalibration {
+    /// Image width in pixels
+    pub width: u32,
+    /// Image height in pixels
+    pub height: u32,
+    /// Focal length in pixels as `(fx, fy)`
+    pub focal_length: (f32, f32),
+    /// Principal point in pixels as `(cx, cy)`
+    pub center: (f32, f32),
+    /// Distortion function the coefficients belong to
+    pub distortion_type: DistortionFunctionType,
+    /// Distortion coefficients, unused entries zero
+    pub coefficients: [f64; COEFFICIENTS],
+}
+
+impl CameraCalibration {
+    /// A distortion-free pinhole camera
+    pub fn pinhole(width: u32, height: u32, focal_length: (f32, f32), center: (f32, f32)) -> Self {
+        Self {
+            width,
+            height,
+            focal_length,
+            center,
+            distortion_type: DistortionFunctionType::None,
+            coefficients: [0.0; COEFFICIENTS],
+        }
+    }
+
+    /// Add a distortion model; missing coefficients are zero
+    pub fn with_distortion(
+        mut self,
+        distortion_type: DistortionFunctionType,
+        coefficients: &[f64],
+    ) -> Self {
+        self.distortion_type = distortion_type;
+        self.coefficients = std::array::from_fn(|i| coefficients.get(i).copied().unwrap_or(0.0));
+        self
+    }
+
+    /// The distortion model placed on image UVs
+    pub fn lens(&self) -> DriverResult<LensDistortion> {
+        let (fx, fy) = self.focal_length;
+        if self.width == 0 || self.height == 0 || !(fx > 0.0 && fy > 0.0) {
+            return Err(DriverError::invalid_parameter(
+                "Camera calibration needs a nonzero image size and positive focal length",
+            ));
+        }
+
+        let (width, height) = (self.width as f32, self.height as f32);
+        let model = LensModel::from_function_type(self.distortion_type, &self.coefficients)?;
+        Ok(LensDistortion {
+            model,
+            center: [self.center.0 / width, self.center.1 / height],
+            scale: [width / fx, height / fy],
+        })
+    }
+
+    /// Intrinsics as `GetCameraIntrinsics` reports them for a frame type
+    ///
+    /// Undistorted frames share the pinhole but carry no distortion model.
+    pub fn intrinsics(&self, frame_type: EVRTrackedCameraFrameType) -> CameraIntrinsics {
+        let distorted = frame_type == EVRTrackedCameraFrameType::Distorted;
+        CameraIntrinsics {
+            focal_length: self.focal_length,
+            center: self.center,
+            distortion_type: if distorted {
+                self.distortion_type
+            } else {
+                DistortionFunctionType::None
+            },
+            coefficients: if distorted {
+                self.coefficients
+            } else {
+                [0.0; COEFFICIENTS]
+            },
+        }
+    }
+
+    /// Projection matrix of the pinhole
+    ///
+    /// Same convention as `IVRSystem::GetProjectionMatrix`: right handed,
+    /// looking down -Z, mapping depth to 0..1.
+    pub fn projection(&self, z_near: f32, z_far: f32) -> HmdMatrix44_t {
+        let (fx, fy) = self.focal_length;
+        let (cx, cy) = self.center;
+
+        // Tangents of the image edges; image rows grow downwards
+        let left = -cx / fx;
+        let right = (self.width as f32 - cx) / fx;
+        let top = -cy / fy;
+        let bottom = (self.height as f32 - cy) / fy;
+
+        let idx = 1.0 / (right - left);
+        let idy = 1.0 / (bottom - top);
+        let idz = 1.0 / (z_far - z_near);
+        HmdMatrix44_t {
+            m: [
+                [2.0 * idx, 0.0, (right + left) * idx, 0.0],
+                [0.0, 2.0 * idy, (bottom + top) * idy, 0.0],
+                [0.0, 0.0, -z_far * idz, -z_far * z_near * idz],
+                [0.0, 0.0, -1.0, 0.0],
+            ],
+        }
+    }
+}
+
+/// Grid resolution and parallelism for building a `CameraRig`
+#[derive(Debug, Clone)]
+pub struct CameraMapConfig {
+    /// Samples across u (at least 2)
+    pub grid_width: u32,
+    /// Samples across v (at least 2)
+    pub grid_height: u32,
+    /// Worker threads used for evaluation (0 for one per core)
+    pub threads: usize,
+}
+
+impl Default for CameraMapConfig {
+    fn default() -> Self {
+        Self {
+            grid_width: 65,
+            grid_height: 65,
+            threads: 0,
+        }
+    }
+}
+
+/// Calibrations of all cameras on a device with their undistortion maps
+///
+/// Implements the calibration side of `CameraComponent`.
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::camera::{CameraCalibration, CameraMapConfig, CameraRig};
+/// use openvr_driver::DistortionFunctionType;
+///
+/// let eye = CameraCalibration::pinhole(1280, 960, (520.0, 520.0), (640.0, 480.0))
+///     .with_distortion(DistortionFunctionType::FTheta, &[0.02, -0.004, 0.0, 0.0]);
+/// let rig = CameraRig::new(vec![eye, eye], &CameraMapConfig::default())?;
+/// let (u, v) = rig.distortion(0, 0.25, 0.5).unwrap();
+/// # Ok::<(), openvr_driver::DriverError>(())
+/// ```
+#[derive(Debug, Clone)]
+pub struct CameraRig {
+    cameras: Vec<CameraCalibration>,
+    grid_width: u32,
+    grid_height: u32,
+    /// Distorted UVs, one row-major grid per camera back to back
+    samples: Vec<[f32; 2]>,
+}
+
+impl CameraRig {
+    /// Evaluate every camera's distortion over the configured grid
+    ///
+    /// A device has at most `k_unMaxCameras` cameras.
+    pub fn new(cameras: Vec<CameraCalibration>, config: &CameraMapConfig) -> DriverResult<Self> {
+        if cameras.len() > k_unMaxCameras as usize {
+            return Err(DriverError::invalid_parameter(format!(
+                "{} cameras given, a device has at most {}",
+                cameras.len(),
+                k_unMaxCameras
+            )));
+        }
+        let (width, height) = (config.grid_width, config.grid_height);
+        if width < 2 || height < 2 {
+            return Err(DriverError::invalid_parameter(
+                "Camera undistortion map needs at least 2x2 samples",
+            ));
+        }
+        let lenses = cameras
+            .iter()
+            .map(CameraCalibration::lens)
+            .collect::<DriverResult<Vec<_>>>()?;
+
+        let threads = if config.threads == 0 {
+            std::thread::available_parallelism()
+                .map(|n| n.get())
+                .unwrap_or(1)
+        } else {
+            config.threads
+        };
+
+        let row_len = width as usize;
+        let rows = height as usize * lenses.len();
+        let du = 1.0 / (width - 1) as f32;
+        let dv = 1.0 / (height - 1) as f32;
+        let u: Vec<f32> = (0..row_len).map(|x| x as f32 * du).collect();
+
+        // Rows of all cameras form one job list, so a single camera still
+        // uses every worker
+        let mut samples = vec![[0.0f32; 2]; rows * row_len];
+        let rows_per_worker = rows.div_ceil(threads).max(1);
+        std::thread::scope(|scope| {
+            for (chunk_index, chunk) in samples.chunks_mut(rows_per_worker * row_len).enumerate() {
+                let (lenses, u) = (&lenses, &u);
+                scope.spawn(move || {
+                    let mut v = vec![0.0f32; row_len];
+                    let mut distorted = vec![[0.0f32; 6]; row_len];
+                    let first_row = chunk_index * rows_per_worker;
+                    for (offset, row) in chunk.chunks_mut(row_len).enumerate() {
+                        let index = first_row + offset;
+                        let lens = &lenses[index / height as usize];
+                        v.fill((index % height as usize) as f32 * dv);
+                        lens.distort_batch(u, &v, &mut distorted);
+                        // All channels share the coefficients; keep green
+                        for (out, sample) in row.iter_mut().zip(&distorted) {
+                            *out = [sample[2], sample[3]];
+                        }
+                    }
+                });
+            }
+        });
+
+        Ok(Self {
+            cameras,
+            grid_width: width,
+            grid_height: height,
+            samples,
+        })
+    }
+
+    /// Build the rig for the cameras listed in a `CameraConfiguration`
+    pub fn from_configuration(
+        camera: &CameraConfiguration,
+        config: &CameraMapConfig,
+    ) -> DriverResult<Self> {
+        Self::new(camera.calibration.clone(), config)
+    }
+
+    /// Calibrations in camera index order
+    pub fn cameras(&self) -> &[CameraCalibration] {
+        &self.cameras
+    }
+
+    /// Calibration of one camera
+    pub fn camera(&self, camera_index: u32) -> Option<&CameraCalibration> {
+        self.cameras.get(camera_index as usize)
+    }
+
+    /// Same shape as `CameraComponent::camera_distortion`
+    ///
+    /// Coordinates outside 0..1 are clamped to the map edge.
+    #[inline]
+    pub fn distortion(&self, camera_index: u32, u: f32, v: f32) -> Option<(f32, f32)> {
+        self.camera(camera_index)?;
+        let row = self.grid_width as usize;
+        let first = camera_index as usize * row * self.grid_height as usize;
+        let samples = &self.samples[first..first + row * self.grid_height as usize];
+
+        let max_x = (self.grid_width - 1) as f32;
+        let max_y = (self.grid_height - 1) as f32;
+        // f32::max discards NaN, so NaN inputs land on the map origin
+        let fx = u.max(0.0).min(1.0) * max_x;
+        let fy = v.max(0.0).min(1.0) * max_y;
+
+        let x0 = (fx as u32).min(self.grid_width - 2);
+        let y0 = (fy as u32).min(self.grid_height - 2);
+        let tx = fx - x0 as f32;
+        let ty = fy - y0 as f32;
+
+        let i00 = y0 as usize * row + x0 as usize;
+        let [s00, s10, s01, s11] = [
+            samples[i00],
+            samples[i00 + 1],
+            samples[i00 + row],
+            samples[i00 + row + 1],
+        ];
+        let lerp = |c: usize| {
+            let top = s00[c] + (s10[c] - s00[c]) * tx;
+            let bottom = s01[c] + (s11[c] - s01[c]) * tx;
+            top + (bottom - top) * ty
+        };
+        Some((lerp(0), lerp(1)))
+    }
+
+    /// Same shape as `CameraComponent::camera_projection`
+    pub fn projection(
+        &self,
+        camera_index: u32,
+        frame_type: EVRTrackedCameraFrameType,
+        z_near: f32,
+        z_far: f32,
+    ) -> Option<HmdMatrix44_t> {
+        // Every frame type shares the pinhole
+        let _ = frame_type;
+        Some(self.camera(camera_index)?.projection(z_near, z_far))
+    }
+
+    /// Same shape as `CameraComponent::camera_intrinsics`
+    pub fn intrinsics(
+        &self,
+        camera_index: u32,
+        frame_type: EVRTrackedCameraFrameType,
+    ) -> Option<CameraIntrinsics> {
+        Some(self.camera(camera_index)?.intrinsics(frame_type))
+    }
+
+    /// Publish the camera count and distortion models in one property batch
+    ///
+    /// Writes `Prop_NumCameras_Int32`, `Prop_CameraDistortionFunction_Int32_Array`
+    /// and `Prop_CameraDistortionCoefficients_Float_Array`, the latter with
+    /// `k_unMaxDistortionFunctionParameters` doubles per camera, as the
+    /// header declares it despite the name.
+    pub fn write_properties(&self, container: PropertyContainer) -> DriverResult<()> {
+        let count = self.cameras.len() as i32;
+        let functions: Vec<i32> = self
+            .cameras
+            .iter()
+            .map(|camera| camera.distortion_type as i32)
+            .collect();
+        let coefficients: Vec<f64> = self
+            .cameras
+            .iter()
+            .flat_map(|camera| camera.coefficients)
+            .collect();
+
+        use vr::ETrackedDeviceProperty::*;
+        Properties::write_binary_batch(
+            container,
+            &[
+                BinaryPropertyWrite::new(
+                    Prop_NumCameras_Int32,
+                    vr::k_unInt32PropertyTag,
+                    bytes_of(std::slice::from_ref(&count)),
+                ),
+                BinaryPropertyWrite::new(
+                    Prop_CameraDistortionFunction_Int32_Array,
+                    vr::k_unInt32PropertyTag,
+                    bytes_of(&functions),
+                ),
+                BinaryPropertyWrite::new(
+                    Prop_CameraDistortionCoefficients_Float_Array,
+                    vr::k_unDoublePropertyTag,
+                    bytes_of(&coefficients),
+                ),
+            ],
+        )
+    }
+}
+
+/// View plain numbers as their bytes
+fn bytes_of<T: Copy>(values: &[T]) -> &[u8] {
+    // Only used with i32 and f64, which have no padding
+    unsafe {
+        std::slice::from_raw_parts(values.as_ptr() as *const u8, std::mem::size_of_val(values))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn eye() -> CameraCalibration {
+        CameraCalibration::pinhole(1280, 960, (520.0, 520.0), (640.0, 480.0))
+            .with_distortion(DistortionFunctionType::FTheta, &[0.02, -0.004, 0.0, 0.0])
+    }
+
+    #[test]
+    fn map_matches_direct_evaluation() {
+        let camera = eye();
+        let config = CameraMapConfig {
+            grid_width: 129,
+            grid_height: 129,
+            threads: 0,
+        };
+        let rig = CameraRig::new(vec![camera, camera], &config).unwrap();
+        let lens = camera.lens().unwrap();
+
+        let mut seed = 0x2545_f491u32;
+        let mut next = || {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            seed as f32 / u32::MAX as f32
+        };
+        let mut worst = 0.0f32;
+        for _ in 0..20_000 {
+            let (u, v) = (next(), next());
+            let direct = lens.distort(u, v);
+            for index in 0..2 {
+                let (mapped_u, mapped_v) = rig.distortion(index, u, v).unwrap();
+                let error_x = (mapped_u - direct[2]).abs() * camera.width as f32;
+                let error_y = (mapped_v - direct[3]).abs() * camera.height as f32;
+                worst = worst.max(error_x).max(error_y);
+            }
+        }
+        assert!(worst <= 0.02, "worst error {} px", worst);
+    }
+
+    #[test]
+    fn rejects_more_cameras_than_the_runtime_supports() {
+        let config = CameraMapConfig {
+            grid_width: 2,
+            grid_height: 2,
+            threads: 1,
+        };
+        let cameras = vec![eye(); k_unMaxCameras as usize];
+        assert!(CameraRig::new(cameras.clone(), &config).is_ok());
+        let mut too_many = cameras;
+        too_many.push(eye());
+        assert!(CameraRig::new(too_many, &config).is_err());
+    }
+}
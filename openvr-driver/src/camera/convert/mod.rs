@@ -0,0 +1,570 @@
+//! Pixel format conversion for camera frames
+//!
+//! Passthrough sensors usually deliver YUYV or NV12, while vrserver picks
+//! the stream format with `SetCameraVideoStreamFormat`. `convert_image`
+//! converts a captured image into any of the uncompressed
+//! `ECameraVideoStreamFormat` layouts, and `CameraFrame::write_image` does
+//! so straight into a runtime buffer, so a frame is touched exactly once
+//! between the sensor and vrserver.
+//!
+//! Rows are converted by SIMD kernels for the running CPU, picked at
+//! runtime: SSE2 or AVX2 on x86_64. The NEON kernels for aarch64 are only
+//! used when asked for with `convert_image_with` until they have been built
+//! and checked against the portable path on that target. The kernels handle
+//! whole vectors only; the portable lane kernels finish each row and stand
+//! in on other targets. YUV to RGB uses BT.601 limited-range coefficients in
+//! 16-bit fixed point with saturating adds, which every backend computes
+//! bit-identically.
+
+#[cfg(target_arch = "aarch64")]
+mod neon;
+mod portable;
+#[cfg(target_arch = "x86_64")]
+mod x86;
+
+use super::stream::image_data_size;
+use crate::sys::root::vr::ECameraVideoStreamFormat;
+use crate::{DriverError, DriverResult};
+
+/// Fraction bits of the YUV to RGB coefficients
+const FRACTION_BITS: i32 = 6;
+/// 1.164 applied to `Y - 16`, rounded up so Y = 235 reaches white
+const Y_SCALE: i16 = 75;
+/// 1.596 applied to `V - 128` for red
+const V_TO_R: i16 = 102;
+/// 0.391 applied to `U - 128` for green
+const U_TO_G: i16 = 25;
+/// 0.813 applied to `V - 128` for green
+const V_TO_G: i16 = 52;
+/// 2.018 applied to `U - 128` for blue
+const U_TO_B: i16 = 129;
+
+/// Instruction set a conversion runs with
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum ConvertBackend {
+    /// Plain Rust lane kernels, available everywhere
+    Portable,
+    /// x86_64 baseline build
+    Sse2,
+    /// x86_64 build for AVX2, chosen at runtime
+    Avx2,
+    /// aarch64 baseline build
+    Neon,
+}
+
+impl ConvertBackend {
+    /// Fastest verified backend the running CPU supports
+    ///
+    /// `Neon` is not picked yet; see the module documentation.
+    pub fn detect() -> Self {
+        #[cfg(target_arch = "x86_64")]
+        {
+            if is_x86_feature_detected!("avx2") {
+                return Self::Avx2;
+            }
+            Self::Sse2
+        }
+        #[cfg(not(target_arch = "x86_64"))]
+        {
+            Self::Portable
+        }
+    }
+
+    /// Whether the running CPU can use this backend
+    pub fn is_supported(self) -> bool {
+        match self {
+            Self::Portable => true,
+            Self::Sse2 => cfg!(target_arch = "x86_64"),
+            #[cfg(target_arch = "x86_64")]
+            Self::Avx2 => is_x86_feature_detected!("avx2"),
+            #[cfg(not(target_arch = "x86_64"))]
+            Self::Avx2 => false,
+            Self::Neon => cfg!(target_arch = "aarch64"),
+        }
+    }
+
+    /// Every backend the running CPU supports, slowest first
+    pub fn available() -> Vec<Self> {
+        [Self::Portable, Self::Sse2, Self::Avx2, Self::Neon]
+            .into_iter()
+            .filter(|backend| backend.is_supported())
+            .collect()
+    }
+}
+
+/// A captured image to convert from
+///
+/// Only `CVS_FORMAT_YUYV16` and `CVS_FORMAT_NV12` sources are supported.
+/// For NV12 the interleaved chroma plane follows the luma plane and uses the
+/// same stride.
+#[derive(Debug, Clone, Copy)]
+pub struct SourceImage<'a> {
+    /// Sensor format
+    pub format: ECameraVideoStreamFormat,
+    /// Width in pixels, even
+    pub width: u32,
+    /// Height in pixels, even
+    pub height: u32,
+    /// Bytes per row of the packed or luma plane
+    pub stride: usize,
+    /// Image bytes
+    pub data: &'a [u8],
+}
+
+impl<'a> SourceImage<'a> {
+    /// Describe a tightly packed image
+    pub fn new(format: ECameraVideoStreamFormat, width: u32, height: u32, data: &'a [u8]) -> Self {
+        let stride = match format {
+            ECameraVideoStreamFormat::CVS_FORMAT_YUYV16 => width as usize * 2,
+            _ => width as usize,
+        };
+        Self {
+            format,
+            width,
+            height,
+            stride,
+            data,
+        }
+    }
+}
+
+/// Whether `convert_image` can produce `format`
+pub fn is_convertible(format: ECameraVideoStreamFormat) -> bool {
+    use ECameraVideoStreamFormat::*;
+    matches!(
+        format,
+        CVS_FORMAT_NV12
+            | CVS_FORMAT_NV12_2
+            | CVS_FORMAT_RGB24
+            | CVS_FORMAT_YUYV16
+            | CVS_FORMAT_RGBX32
+    )
+}
+
+/// Convert an image into a tightly packed buffer of another format
+///
+/// The destination has the same size as the source, except for
+/// `CVS_FORMAT_NV12_2`, which takes a side-by-side stereo source twice as
+/// wide and stores the left and right halves as two stacked NV12 images.
+///
+/// # Arguments
+/// * `src` - Captured image
+/// * `format` - Destination format
+/// * `width` - Destination width in pixels
+/// * `height` - Destination height in pixels
+/// * `dst` - Destination buffer, at least `image_data_size` bytes
+///
+/// # Returns
+/// * Bytes written to `dst`
+pub fn convert_image(
+    src: &SourceImage<'_>,
+    format: ECameraVideoStreamFormat,
+    width: u32,
+    height: u32,
+    dst: &mut [u8],
+) -> DriverResult<u32> {
+    convert_image_with(ConvertBackend::detect(), src, format, width, height, dst)
+}
+
+/// `convert_image` with an explicit backend
+pub fn convert_image_with(
+    backend: ConvertBackend,
+    src: &SourceImage<'_>,
+    format: ECameraVideoStreamFormat,
+    width: u32,
+    height: u32,
+    dst: &mut [u8],
+) -> DriverResult<u32> {
+    use ECameraVideoStreamFormat::*;
+
+    if !backend.is_supported() {
+        return Err(DriverError::invalid_parameter(format!(
+            "{:?} conversion is not supported on this CPU",
+            backend
+        )));
+    }
+    if !is_convertible(format) {
+        return Err(DriverError::invalid_parameter(format!(
+            "Cannot convert camera frames to {:?}",
+            format
+        )));
+    }
+    if width == 0 || height == 0 || width % 2 != 0 || height % 2 != 0 {
+        return Err(DriverError::invalid_parameter(format!(
+            "Camera frame size {}x{} must be even and non-zero",
+            width, height
+        )));
+    }
+
+    let source_width = if format == CVS_FORMAT_NV12_2 {
+        width * 2
+    } else {
+        width
+    };
+    if src.width != source_width || src.height != height {
+        return Err(DriverError::invalid_parameter(format!(
+            "Source image {}x{} does not match a {}x{} {:?} frame",
+            src.width, src.height, width, height, format
+        )));
+    }
+    let source = Source::new(src)?;
+
+    let size = image_data_size(format, width, height)
+        .ok_or_else(|| DriverError::invalid_parameter("Camera frame size overflows"))?;
+    if dst.len() < size as usize {
+        return Err(DriverError::invalid_parameter(format!(
+            "Frame buffer holds {} bytes, {:?} needs {}",
+            dst.len(),
+            format,
+            size
+        )));
+    }
+    let dst = &mut dst[..size as usize];
+
+    let kernels = Kernels::for_backend(backend);
+    let (width, height) = (width as usize, height as usize);
+    match format {
+        CVS_FORMAT_RGB24 => to_rgb::<3>(&kernels, &source, width, height, dst),
+        CVS_FORMAT_RGBX32 => to_rgb::<4>(&kernels, &source, width, height, dst),
+        CVS_FORMAT_YUYV16 => to_yuyv(&source, width, height, dst),
+        CVS_FORMAT_NV12 => to_nv12(&kernels, &source, 0, width, height, dst),
+        CVS_FORMAT_NV12_2 => {
+            let (left, right) = dst.split_at_mut(dst.len() / 2);
+            to_nv12(&kernels, &source, 0, width, height, left);
+            to_nv12(&kernels, &source, width, width, height, right);
+        }
+        _ => unreachable!("format checked by is_convertible"),
+    }
+    Ok(size)
+}
+
+/// Validated view of a source image
+struct Source<'a> {
+    yuyv: bool,
+    luma: &'a [u8],
+    chroma: &'a [u8],
+    stride: usize,
+}
+
+impl<'a> Source<'a> {
+    fn new(src: &SourceImage<'a>) -> DriverResult<Self> {
+        use ECameraVideoStreamFormat::*;
+
+        let (width, height) = (src.width as usize, src.height as usize);
+        let (yuyv, row_bytes, chroma_rows) = match src.format {
+            CVS_FORMAT_YUYV16 => (true, width * 2, 0),
+            CVS_FORMAT_NV12 => (false, width, height / 2),
+            other => {
+                return Err(DriverError::invalid_parameter(format!(
+                    "Cannot convert camera frames from {:?}",
+                    other
+                )))
+            }
+        };
+        if src.stride < row_bytes {
+            return Err(DriverError::invalid_parameter(format!(
+                "Source stride {} is shorter than a {}-pixel row",
+                src.stride, width
+            )));
+        }
+
+        // The last row of each plane need not be padded out to the stride
+        let luma_bytes = src.stride * (height - 1) + row_bytes;
+        let chroma_bytes = if chroma_rows > 0 {
+            src.stride * (chroma_rows - 1) + row_bytes
+        } else {
+            0
+        };
+        let needed = if yuyv {
+            luma_bytes
+        } else {
+            src.stride * height + chroma_bytes
+        };
+        if src.data.len() < needed {
+            return Err(DriverError::invalid_parameter(format!(
+                "Source image holds {} bytes, needs {}",
+                src.data.len(),
+                needed
+            )));
+        }
+
+        let (luma, chroma) = if yuyv {
+            (&src.data[..luma_bytes], &src.data[..0])
+        } else {
+            let chroma_start = src.stride * height;
+            (
+                &src.data[..luma_bytes],
+                &src.data[chroma_start..chroma_start + chroma_bytes],
+            )
+        };
+        Ok(Self {
+            yuyv,
+            luma,
+            chroma,
+            stride: src.stride,
+        })
+    }
+
+    /// Packed or luma bytes of a row, starting `x` pixels in
+    #[inline(always)]
+    fn row(&self, row: usize, x: usize, width: usize) -> &'a [u8] {
+        let bpp = if self.yuyv { 2 } else { 1 };
+        &self.luma[row * self.stride + x * bpp..][..width * bpp]
+    }
+
+    /// NV12 chroma bytes covering a luma row, starting `x` pixels in
+    #[inline(always)]
+    fn chroma_row(&self, row: usize, x: usize, width: usize) -> &'a [u8] {
+        &self.chroma[row / 2 * self.stride + x..][..width]
+    }
+}
+
+/// Converts the start of a packed row and returns the pixels done
+type PackedRow = unsafe fn(src: &[u8], out: &mut [u8]) -> usize;
+/// Converts the start of an NV12 row and returns the pixels done
+type PlanarRow = unsafe fn(y: &[u8], uv: &[u8], out: &mut [u8]) -> usize;
+/// Splits the start of two YUYV rows into NV12 and returns the pixels done
+type RowPair = unsafe fn(
+    top_src: &[u8],
+    bottom_src: &[u8],
+    top: &mut [u8],
+    bottom: &mut [u8],
+    chroma: &mut [u8],
+) -> usize;
+
+/// SIMD row kernels of one backend
+///
+/// Each kernel converts as many whole vectors as fit in the row; the
+/// portable kernels convert whatever is left.
+struct Kernels {
+    yuyv_to_rgb24: PackedRow,
+    yuyv_to_rgbx32: PackedRow,
+    nv12_to_rgb24: PlanarRow,
+    nv12_to_rgbx32: PlanarRow,
+    yuyv_to_nv12: RowPair,
+}
+
+impl Kernels {
+    /// Kernels for a backend the CPU supports
+    fn for_backend(backend: ConvertBackend) -> Self {
+        unsafe fn none_packed(_: &[u8], _: &mut [u8]) -> usize {
+            0
+        }
+        unsafe fn none_planar(_: &[u8], _: &[u8], _: &mut [u8]) -> usize {
+            0
+        }
+        unsafe fn none_pair(_: &[u8], _: &[u8], _: &mut [u8], _: &mut [u8], _: &mut [u8]) -> usize {
+            0
+        }
+
+        match backend {
+            #[cfg(target_arch = "x86_64")]
+            ConvertBackend::Sse2 => Self {
+                yuyv_to_rgb24: x86::yuyv_to_rgb_sse2::<3>,
+                yuyv_to_rgbx32: x86::yuyv_to_rgb_sse2::<4>,
+                nv12_to_rgb24: x86::nv12_to_rgb_sse2::<3>,
+                nv12_to_rgbx32: x86::nv12_to_rgb_sse2::<4>,
+                yuyv_to_nv12: x86::yuyv_to_nv12_sse2,
+            },
+            #[cfg(target_arch = "x86_64")]
+            ConvertBackend::Avx2 => Self {
+                yuyv_to_rgb24: x86::yuyv_to_rgb_avx2::<3>,
+                yuyv_to_rgbx32: x86::yuyv_to_rgb_avx2::<4>,
+                nv12_to_rgb24: x86::nv12_to_rgb_avx2::<3>,
+                nv12_to_rgbx32: x86::nv12_to_rgb_avx2::<4>,
+                yuyv_to_nv12: x86::yuyv_to_nv12_avx2,
+            },
+            #[cfg(target_arch = "aarch64")]
+            ConvertBackend::Neon => Self {
+                yuyv_to_rgb24: neon::yuyv_to_rgb::<3>,
+                yuyv_to_rgbx32: neon::yuyv_to_rgb::<4>,
+                nv12_to_rgb24: neon::nv12_to_rgb::<3>,
+                nv12_to_rgbx32: neon::nv12_to_rgb::<4>,
+                yuyv_to_nv12: neon::yuyv_to_nv12,
+            },
+            _ => Self {
+                yuyv_to_rgb24: none_packed,
+                yuyv_to_rgbx32: none_packed,
+                nv12_to_rgb24: none_planar,
+                nv12_to_rgbx32: none_planar,
+                yuyv_to_nv12: none_pair,
+            },
+        }
+    }
+}
+
+fn to_rgb<const BPP: usize>(
+    kernels: &Kernels,
+    src: &Source<'_>,
+    width: usize,
+    height: usize,
+    dst: &mut [u8],
+) {
+    let (packed, planar) = if BPP == 3 {
+        (kernels.yuyv_to_rgb24, kernels.nv12_to_rgb24)
+    } else {
+        (kernels.yuyv_to_rgbx32, kernels.nv12_to_rgbx32)
+    };
+
+    for (row, out) in dst.chunks_exact_mut(width * BPP).take(height).enumerate() {
+        // Safe because the kernels were picked for a backend the CPU supports
+        if src.yuyv {
+            let src = src.row(row, 0, width);
+            let done = unsafe { packed(src, out) };
+            portable::yuyv_to_rgb::<BPP>(&src[done * 2..], &mut out[done * BPP..]);
+        } else {
+            let (y, uv) = (src.row(row, 0, width), src.chroma_row(row, 0, width));
+            let done = unsafe { planar(y, uv, out) };
+            portable::nv12_to_rgb::<BPP>(&y[done..], &uv[done..], &mut out[done * BPP..]);
+        }
+    }
+}
+
+fn to_yuyv(src: &Source<'_>, width: usize, height: usize, dst: &mut [u8]) {
+    for (row, out) in dst.chunks_exact_mut(width * 2).take(height).enumerate() {
+        if src.yuyv {
+            out.copy_from_slice(src.row(row, 0, width));
+        } else {
+            portable::nv12_to_yuyv(src.row(row, 0, width), src.chroma_row(row, 0, width), out);
+        }
+    }
+}
+
+/// Write one NV12 image from the `width` source columns starting at `x`
+fn to_nv12(
+    kernels: &Kernels,
+    src: &Source<'_>,
+    x: usize,
+    width: usize,
+    height: usize,
+    dst: &mut [u8],
+) {
+    let (luma, chroma) = dst.split_at_mut(width * height);
+
+    if src.yuyv {
+        for ((pair, luma), chroma) in luma
+            .chunks_exact_mut(width * 2)
+            .enumerate()
+            .zip(chroma.chunks_exact_mut(width))
+        {
+            let (top, bottom) = luma.split_at_mut(width);
+            let top_src = src.row(pair * 2, x, width);
+            let bottom_src = src.row(pair * 2 + 1, x, width);
+            // Safe because the kernels were picked for a backend the CPU supports
+            let done = unsafe { (kernels.yuyv_to_nv12)(top_src, bottom_src, top, bottom, chroma) };
+            portable::yuyv_to_nv12(
+                &top_src[done * 2..],
+                &bottom_src[done * 2..],
+                &mut top[done..],
+                &mut bottom[done..],
+                &mut chroma[done..],
+            );
+        }
+    } else {
+        for (row, out) in luma.chunks_exact_mut(width).enumerate() {
+            out.copy_from_slice(src.row(row, x, width));
+        }
+        for (pair, out) in chroma.chunks_exact_mut(width).enumerate() {
+            out.copy_from_slice(src.chroma_row(pair * 2, x, width));
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use ECameraVideoStreamFormat::*;
+
+    /// Widths that leave a partial vector at the end of each row
+    const WIDTHS: [u32; 7] = [2, 6, 14, 30, 46, 70, 134];
+    const HEIGHT: u32 = 6;
+    /// Row padding, so kernels must honour the stride
+    const PADDING: usize = 6;
+    /// Written after the frame to catch stores past its end
+    const GUARD: u8 = 0xa5;
+
+    fn noise(len: usize, seed: u32) -> Vec<u8> {
+        let mut seed = seed | 1;
+        (0..len)
+            .map(|_| {
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                seed as u8
+            })
+            .collect()
+    }
+
+    fn convert(
+        backend: ConvertBackend,
+        src: &SourceImage<'_>,
+        format: ECameraVideoStreamFormat,
+        width: u32,
+    ) -> Vec<u8> {
+        let size = image_data_size(format, width, HEIGHT).unwrap() as usize;
+        let mut dst = vec![GUARD; size + 64];
+        let written = convert_image_with(backend, src, format, width, HEIGHT, &mut dst).unwrap();
+        assert_eq!(written as usize, size);
+        assert!(
+            dst[size..].iter().all(|&b| b == GUARD),
+            "{:?} wrote past a {}-wide {:?} frame",
+            backend,
+            width,
+            format
+        );
+        dst
+    }
+
+    #[test]
+    fn backends_match_portable() {
+        let backends = ConvertBackend::available();
+        assert!(backends.contains(&ConvertBackend::detect()));
+
+        for source_format in [CVS_FORMAT_YUYV16, CVS_FORMAT_NV12] {
+            for format in [
+                CVS_FORMAT_RGB24,
+                CVS_FORMAT_RGBX32,
+                CVS_FORMAT_YUYV16,
+                CVS_FORMAT_NV12,
+                CVS_FORMAT_NV12_2,
+            ] {
+                for width in WIDTHS {
+                    let source_width = if format == CVS_FORMAT_NV12_2 {
+                        width * 2
+                    } else {
+                        width
+                    };
+                    let row_bytes = match source_format {
+                        CVS_FORMAT_YUYV16 => source_width as usize * 2,
+                        _ => source_width as usize,
+                    };
+                    let stride = row_bytes + PADDING;
+                    let rows = match source_format {
+                        CVS_FORMAT_YUYV16 => HEIGHT as usize,
+                        _ => HEIGHT as usize * 3 / 2,
+                    };
+                    let data = noise(stride * rows, width * 31 + format as u32);
+                    let src = SourceImage {
+                        format: source_format,
+                        width: source_width,
+                        height: HEIGHT,
+                        stride,
+                        data: &data,
+                    };
+
+                    let expected = convert(ConvertBackend::Portable, &src, format, width);
+                    for &backend in &backends {
+                        assert!(
+                            convert(backend, &src, format, width) == expected,
+                            "{:?} differs from Portable for {:?} to {:?} at width {}",
+                            backend,
+                            source_format,
+                            format,
+                            width
+                        );
+                    }
+                }
+            }
+        }
+    }
+}
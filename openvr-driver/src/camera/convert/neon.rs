@@ -0,0 +1,122 @@
+//! NEON conversion kernels
+//!
+//! NEON is part of the aarch64 baseline. The structured loads split YUYV
+//! into even luma, U, odd luma and V for 32 pixels at once, so chroma never
+//! needs duplicating: even and odd pixels are converted separately and
+//! zipped back together on the way out. The math matches the portable
+//! kernels bit for bit.
+
+use super::{FRACTION_BITS, U_TO_B, U_TO_G, V_TO_G, V_TO_R, Y_SCALE};
+use std::arch::aarch64::*;
+
+/// YUV to RGB for eight pixels sharing their chroma position with `u`, `v`
+#[inline(always)]
+unsafe fn rgb_half(y: uint8x8_t, u: uint8x8_t, v: uint8x8_t) -> (uint8x8_t, uint8x8_t, uint8x8_t) {
+    let y = vreinterpretq_s16_u16(vmovl_u8(y));
+    let d = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u)), vdupq_n_s16(128));
+    let e = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v)), vdupq_n_s16(128));
+
+    let c = vaddq_s16(
+        vmulq_n_s16(vsubq_s16(y, vdupq_n_s16(16)), Y_SCALE),
+        vdupq_n_s16(1 << (FRACTION_BITS - 1)),
+    );
+    let r = vqaddq_s16(c, vmulq_n_s16(e, V_TO_R));
+    let g = vqsubq_s16(
+        vqsubq_s16(c, vmulq_n_s16(d, U_TO_G)),
+        vmulq_n_s16(e, V_TO_G),
+    );
+    let b = vqaddq_s16(c, vmulq_n_s16(d, U_TO_B));
+
+    (
+        vqshrun_n_s16::<FRACTION_BITS>(r),
+        vqshrun_n_s16::<FRACTION_BITS>(g),
+        vqshrun_n_s16::<FRACTION_BITS>(b),
+    )
+}
+
+/// YUV to RGB for sixteen pixels at the same chroma positions
+#[inline(always)]
+unsafe fn rgb16(y: uint8x16_t, u: uint8x16_t, v: uint8x16_t) -> [uint8x16_t; 3] {
+    let (r0, g0, b0) = rgb_half(vget_low_u8(y), vget_low_u8(u), vget_low_u8(v));
+    let (r1, g1, b1) = rgb_half(vget_high_u8(y), vget_high_u8(u), vget_high_u8(v));
+    [
+        vcombine_u8(r0, r1),
+        vcombine_u8(g0, g1),
+        vcombine_u8(b0, b1),
+    ]
+}
+
+/// Interleave even and odd pixels and store 32 of them
+#[inline(always)]
+unsafe fn store32<const BPP: usize>(out: *mut u8, even: [uint8x16_t; 3], odd: [uint8x16_t; 3]) {
+    let first = [0, 1, 2].map(|c| vzip1q_u8(even[c], odd[c]));
+    let second = [0, 1, 2].map(|c| vzip2q_u8(even[c], odd[c]));
+
+    if BPP == 4 {
+        let alpha = vdupq_n_u8(0xff);
+        vst4q_u8(out, uint8x16x4_t(first[0], first[1], first[2], alpha));
+        vst4q_u8(
+            out.add(64),
+            uint8x16x4_t(second[0], second[1], second[2], alpha),
+        );
+    } else {
+        vst3q_u8(out, uint8x16x3_t(first[0], first[1], first[2]));
+        vst3q_u8(out.add(48), uint8x16x3_t(second[0], second[1], second[2]));
+    }
+}
+
+pub(super) unsafe fn yuyv_to_rgb<const BPP: usize>(src: &[u8], out: &mut [u8]) -> usize {
+    let done = (src.len() / 2).min(out.len() / BPP) / 32 * 32;
+    let (src, dst) = (src.as_ptr(), out.as_mut_ptr());
+
+    for x in (0..done).step_by(32) {
+        // Y0, U, Y1, V for 32 pixels
+        let yuyv = vld4q_u8(src.add(x * 2));
+        let even = rgb16(yuyv.0, yuyv.1, yuyv.3);
+        let odd = rgb16(yuyv.2, yuyv.1, yuyv.3);
+        store32::<BPP>(dst.add(x * BPP), even, odd);
+    }
+    done
+}
+
+pub(super) unsafe fn nv12_to_rgb<const BPP: usize>(y: &[u8], uv: &[u8], out: &mut [u8]) -> usize {
+    let done = y.len().min(uv.len()).min(out.len() / BPP) / 32 * 32;
+    let (y, uv, dst) = (y.as_ptr(), uv.as_ptr(), out.as_mut_ptr());
+
+    for x in (0..done).step_by(32) {
+        let luma = vld2q_u8(y.add(x));
+        let chroma = vld2q_u8(uv.add(x));
+        let even = rgb16(luma.0, chroma.0, chroma.1);
+        let odd = rgb16(luma.1, chroma.0, chroma.1);
+        store32::<BPP>(dst.add(x * BPP), even, odd);
+    }
+    done
+}
+
+pub(super) unsafe fn yuyv_to_nv12(
+    top_src: &[u8],
+    bottom_src: &[u8],
+    top: &mut [u8],
+    bottom: &mut [u8],
+    chroma: &mut [u8],
+) -> usize {
+    let pixels = (top_src.len().min(bottom_src.len()) / 2)
+        .min(top.len())
+        .min(bottom.len())
+        .min(chroma.len());
+    let done = pixels / 32 * 32;
+
+    for x in (0..done).step_by(32) {
+        let a = vld4q_u8(top_src.as_ptr().add(x * 2));
+        let b = vld4q_u8(bottom_src.as_ptr().add(x * 2));
+
+        vst2q_u8(top.as_mut_ptr().add(x), uint8x16x2_t(a.0, a.2));
+        vst2q_u8(bottom.as_mut_ptr().add(x), uint8x16x2_t(b.0, b.2));
+        // Rounded average of both rows
+        vst2q_u8(
+            chroma.as_mut_ptr().add(x),
+            uint8x16x2_t(vrhaddq_u8(a.1, b.1), vrhaddq_u8(a.3, b.3)),
+        );
+    }
+    done
+}
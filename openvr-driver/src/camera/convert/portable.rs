@@ -0,0 +1,228 @@
+//! Portable conversion kernels
+//!
+//! Plain Rust over fixed-width lanes. These convert whole rows on targets
+//! without SIMD kernels and finish the last few pixels of each row for the
+//! ones that have them, so they must produce bit-identical output.
+
+use super::{U_TO_B, U_TO_G, V_TO_G, V_TO_R, Y_SCALE};
+
+/// Pixels converted together
+const LANES: usize = 16;
+
+/// Rounding term added before the final shift
+const ROUND: i16 = 1 << (super::FRACTION_BITS - 1);
+
+/// Drop the fraction bits and clamp to a byte
+#[inline(always)]
+fn narrow(value: i16) -> u8 {
+    (value >> super::FRACTION_BITS).clamp(0, 255) as u8
+}
+
+/// BT.601 limited-range YUV to RGB for one group of lanes
+///
+/// `u` and `v` hold the chroma sample of each pixel, already duplicated
+/// across pixel pairs. The arithmetic is exactly what the SIMD kernels do.
+#[inline(always)]
+fn yuv_lanes_to_rgb<const BPP: usize>(
+    y: &[u8; LANES],
+    u: &[u8; LANES],
+    v: &[u8; LANES],
+    out: &mut [u8],
+) {
+    let mut r = [0u8; LANES];
+    let mut g = [0u8; LANES];
+    let mut b = [0u8; LANES];
+    for i in 0..LANES {
+        let c = (y[i] as i16 - 16) * Y_SCALE + ROUND;
+        let d = u[i] as i16 - 128;
+        let e = v[i] as i16 - 128;
+        r[i] = narrow(c.saturating_add(V_TO_R * e));
+        g[i] = narrow(c.saturating_sub(U_TO_G * d).saturating_sub(V_TO_G * e));
+        b[i] = narrow(c.saturating_add(U_TO_B * d));
+    }
+
+    let out = &mut out[..LANES * BPP];
+    for i in 0..LANES {
+        out[i * BPP] = r[i];
+        out[i * BPP + 1] = g[i];
+        out[i * BPP + 2] = b[i];
+        if BPP == 4 {
+            out[i * BPP + 3] = 0xff;
+        }
+    }
+}
+
+#[inline(always)]
+fn yuyv_lanes_to_rgb<const BPP: usize>(src: &[u8; LANES * 2], out: &mut [u8]) {
+    let mut y = [0u8; LANES];
+    let mut u = [0u8; LANES];
+    let mut v = [0u8; LANES];
+    for i in 0..LANES {
+        let pair = (i & !1) * 2;
+        y[i] = src[i * 2];
+        u[i] = src[pair + 1];
+        v[i] = src[pair + 3];
+    }
+    yuv_lanes_to_rgb::<BPP>(&y, &u, &v, out);
+}
+
+#[inline(always)]
+fn nv12_lanes_to_rgb<const BPP: usize>(y: &[u8; LANES], uv: &[u8; LANES], out: &mut [u8]) {
+    let mut u = [0u8; LANES];
+    let mut v = [0u8; LANES];
+    for i in 0..LANES {
+        u[i] = uv[i & !1];
+        v[i] = uv[i | 1];
+    }
+    yuv_lanes_to_rgb::<BPP>(y, &u, &v, out);
+}
+
+pub(super) fn yuyv_to_rgb<const BPP: usize>(src: &[u8], out: &mut [u8]) {
+    let pixels = src.len() / 2;
+    let full = pixels / LANES * LANES;
+
+    for (src, out) in src[..full * 2]
+        .chunks_exact(LANES * 2)
+        .zip(out.chunks_exact_mut(LANES * BPP))
+    {
+        yuyv_lanes_to_rgb::<BPP>(src.try_into().unwrap(), out);
+    }
+
+    // Pad the tail out to a full set of lanes
+    let rest = pixels - full;
+    if rest > 0 {
+        let mut tail_src = [0u8; LANES * 2];
+        let mut tail_out = [0u8; LANES * 4];
+        tail_src[..rest * 2].copy_from_slice(&src[full * 2..]);
+        yuyv_lanes_to_rgb::<BPP>(&tail_src, &mut tail_out);
+        out[full * BPP..].copy_from_slice(&tail_out[..rest * BPP]);
+    }
+}
+
+pub(super) fn nv12_to_rgb<const BPP: usize>(y: &[u8], uv: &[u8], out: &mut [u8]) {
+    let pixels = y.len();
+    let full = pixels / LANES * LANES;
+
+    for ((y, uv), out) in y[..full]
+        .chunks_exact(LANES)
+        .zip(uv.chunks_exact(LANES))
+        .zip(out.chunks_exact_mut(LANES * BPP))
+    {
+        nv12_lanes_to_rgb::<BPP>(y.try_into().unwrap(), uv.try_into().unwrap(), out);
+    }
+
+    let rest = pixels - full;
+    if rest > 0 {
+        let mut tail_y = [0u8; LANES];
+        let mut tail_uv = [0u8; LANES];
+        let mut tail_out = [0u8; LANES * 4];
+        tail_y[..rest].copy_from_slice(&y[full..]);
+        tail_uv[..rest].copy_from_slice(&uv[full..]);
+        nv12_lanes_to_rgb::<BPP>(&tail_y, &tail_uv, &mut tail_out);
+        out[full * BPP..].copy_from_slice(&tail_out[..rest * BPP]);
+    }
+}
+
+#[inline(always)]
+fn nv12_lanes_to_yuyv(y: &[u8; LANES], uv: &[u8; LANES], out: &mut [u8; LANES * 2]) {
+    for i in 0..LANES {
+        out[i * 2] = y[i];
+        out[i * 2 + 1] = uv[i];
+    }
+}
+
+pub(super) fn nv12_to_yuyv(y: &[u8], uv: &[u8], out: &mut [u8]) {
+    let pixels = y.len();
+    let full = pixels / LANES * LANES;
+
+    for ((y, uv), out) in y[..full]
+        .chunks_exact(LANES)
+        .zip(uv.chunks_exact(LANES))
+        .zip(out.chunks_exact_mut(LANES * 2))
+    {
+        nv12_lanes_to_yuyv(
+            y.try_into().unwrap(),
+            uv.try_into().unwrap(),
+            out.try_into().unwrap(),
+        );
+    }
+
+    let rest = pixels - full;
+    if rest > 0 {
+        let mut tail_y = [0u8; LANES];
+        let mut tail_uv = [0u8; LANES];
+        let mut tail_out = [0u8; LANES * 2];
+        tail_y[..rest].copy_from_slice(&y[full..]);
+        tail_uv[..rest].copy_from_slice(&uv[full..]);
+        nv12_lanes_to_yuyv(&tail_y, &tail_uv, &mut tail_out);
+        out[full * 2..].copy_from_slice(&tail_out[..rest * 2]);
+    }
+}
+
+/// Split two YUYV rows into NV12 luma rows and their shared chroma row
+///
+/// Each chroma sample is the rounded average of the two rows.
+#[inline(always)]
+fn yuyv_lanes_to_nv12(
+    top_src: &[u8; LANES * 2],
+    bottom_src: &[u8; LANES * 2],
+    top: &mut [u8; LANES],
+    bottom: &mut [u8; LANES],
+    chroma: &mut [u8; LANES],
+) {
+    for i in 0..LANES {
+        top[i] = top_src[i * 2];
+        bottom[i] = bottom_src[i * 2];
+        let a = top_src[i * 2 + 1] as u16;
+        let b = bottom_src[i * 2 + 1] as u16;
+        chroma[i] = ((a + b + 1) >> 1) as u8;
+    }
+}
+
+pub(super) fn yuyv_to_nv12(
+    top_src: &[u8],
+    bottom_src: &[u8],
+    top: &mut [u8],
+    bottom: &mut [u8],
+    chroma: &mut [u8],
+) {
+    let pixels = top.len();
+    let full = pixels / LANES * LANES;
+
+    for ((((top_src, bottom_src), top), bottom), chroma) in top_src[..full * 2]
+        .chunks_exact(LANES * 2)
+        .zip(bottom_src.chunks_exact(LANES * 2))
+        .zip(top.chunks_exact_mut(LANES))
+        .zip(bottom.chunks_exact_mut(LANES))
+        .zip(chroma.chunks_exact_mut(LANES))
+    {
+        yuyv_lanes_to_nv12(
+            top_src.try_into().unwrap(),
+            bottom_src.try_into().unwrap(),
+            top.try_into().unwrap(),
+            bottom.try_into().unwrap(),
+            chroma.try_into().unwrap(),
+        );
+    }
+
+    let rest = pixels - full;
+    if rest > 0 {
+        let mut tail_top_src = [0u8; LANES * 2];
+        let mut tail_bottom_src = [0u8; LANES * 2];
+        let mut tail_top = [0u8; LANES];
+        let mut tail_bottom = [0u8; LANES];
+        let mut tail_chroma = [0u8; LANES];
+        tail_top_src[..rest * 2].copy_from_slice(&top_src[full * 2..]);
+        tail_bottom_src[..rest * 2].copy_from_slice(&bottom_src[full * 2..]);
+        yuyv_lanes_to_nv12(
+            &tail_top_src,
+            &tail_bottom_src,
+            &mut tail_top,
+            &mut tail_bottom,
+            &mut tail_chroma,
+        );
+        top[full..].copy_from_slice(&tail_top[..rest]);
+        bottom[full..].copy_from_slice(&tail_bottom[..rest]);
+        chroma[full..].copy_from_slice(&tail_chroma[..rest]);
+    }
+}
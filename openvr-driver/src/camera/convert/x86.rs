@@ -0,0 +1,297 @@
+//! SSE2 and AVX2 conversion kernels
+//!
+//! SSE2 is part of the x86_64 baseline; the AVX2 kernels are only reached
+//! after `ConvertBackend::is_supported` has checked the CPU. Both widen to
+//! 16-bit lanes and do the YUV to RGB math eight or sixteen pixels at a
+//! time, matching the portable kernels bit for bit.
+
+use super::{FRACTION_BITS, U_TO_B, U_TO_G, V_TO_G, V_TO_R, Y_SCALE};
+use std::arch::x86_64::*;
+
+/// Bytes past the last pixel an RGB24 store writes
+///
+/// RGB24 groups are stored as 16-byte writes 12 bytes apart; the next group
+/// or the portable tail overwrites the spill.
+const RGB24_SPILL: usize = 4;
+
+/// YUV to RGBX for eight pixels
+///
+/// `y` holds eight luma samples and `uv` the four interleaved U, V pairs
+/// covering them, all widened to 16 bits. Returns pixels 0-3 and 4-7.
+#[inline(always)]
+unsafe fn rgbx_sse2(y: __m128i, uv: __m128i) -> (__m128i, __m128i) {
+    let uv = _mm_sub_epi16(uv, _mm_set1_epi16(128));
+    let u = _mm_shufflehi_epi16::<0b10_10_00_00>(_mm_shufflelo_epi16::<0b10_10_00_00>(uv));
+    let v = _mm_shufflehi_epi16::<0b11_11_01_01>(_mm_shufflelo_epi16::<0b11_11_01_01>(uv));
+
+    let c = _mm_add_epi16(
+        _mm_mullo_epi16(
+            _mm_sub_epi16(y, _mm_set1_epi16(16)),
+            _mm_set1_epi16(Y_SCALE),
+        ),
+        _mm_set1_epi16(1 << (FRACTION_BITS - 1)),
+    );
+    let r = _mm_adds_epi16(c, _mm_mullo_epi16(v, _mm_set1_epi16(V_TO_R)));
+    let g = _mm_subs_epi16(
+        _mm_subs_epi16(c, _mm_mullo_epi16(u, _mm_set1_epi16(U_TO_G))),
+        _mm_mullo_epi16(v, _mm_set1_epi16(V_TO_G)),
+    );
+    let b = _mm_adds_epi16(c, _mm_mullo_epi16(u, _mm_set1_epi16(U_TO_B)));
+
+    let rb = _mm_packus_epi16(
+        _mm_srai_epi16::<FRACTION_BITS>(r),
+        _mm_srai_epi16::<FRACTION_BITS>(b),
+    );
+    let ga = _mm_packus_epi16(_mm_srai_epi16::<FRACTION_BITS>(g), _mm_set1_epi16(0xff));
+    let rg = _mm_unpacklo_epi8(rb, ga);
+    let ba = _mm_unpackhi_epi8(rb, ga);
+    (_mm_unpacklo_epi16(rg, ba), _mm_unpackhi_epi16(rg, ba))
+}
+
+/// Pack four RGBX pixels into the low 12 bytes
+#[inline(always)]
+unsafe fn rgbx_to_rgb_sse2(rgbx: __m128i) -> __m128i {
+    let even = _mm_and_si128(rgbx, _mm_set1_epi64x(0x00ff_ffff));
+    let odd = _mm_srli_epi64::<8>(_mm_and_si128(rgbx, _mm_set1_epi64x(0x00ff_ffff_0000_0000)));
+    let pairs = _mm_or_si128(even, odd);
+    _mm_or_si128(
+        _mm_and_si128(pairs, _mm_set_epi64x(0, -1)),
+        _mm_srli_si128::<2>(_mm_and_si128(pairs, _mm_set_epi64x(-1, 0))),
+    )
+}
+
+/// Store eight converted pixels
+#[inline(always)]
+unsafe fn store_sse2<const BPP: usize>(out: *mut u8, lo: __m128i, hi: __m128i) {
+    if BPP == 4 {
+        _mm_storeu_si128(out as *mut __m128i, lo);
+        _mm_storeu_si128(out.add(16) as *mut __m128i, hi);
+    } else {
+        _mm_storeu_si128(out as *mut __m128i, rgbx_to_rgb_sse2(lo));
+        _mm_storeu_si128(out.add(12) as *mut __m128i, rgbx_to_rgb_sse2(hi));
+    }
+}
+
+/// Pixels a kernel can write in steps of `step` without overrunning `out`
+#[inline(always)]
+fn whole_steps<const BPP: usize>(pixels: usize, out: &[u8], step: usize) -> usize {
+    let spill = if BPP == 3 { RGB24_SPILL } else { 0 };
+    let pixels = pixels.min(out.len().saturating_sub(spill) / BPP);
+    pixels / step * step
+}
+
+pub(super) unsafe fn yuyv_to_rgb_sse2<const BPP: usize>(src: &[u8], out: &mut [u8]) -> usize {
+    let done = whole_steps::<BPP>(src.len() / 2, out, 8);
+    let (src, dst) = (src.as_ptr(), out.as_mut_ptr());
+
+    for x in (0..done).step_by(8) {
+        let yuyv = _mm_loadu_si128(src.add(x * 2) as *const __m128i);
+        let y = _mm_and_si128(yuyv, _mm_set1_epi16(0xff));
+        let uv = _mm_srli_epi16::<8>(yuyv);
+        let (lo, hi) = rgbx_sse2(y, uv);
+        store_sse2::<BPP>(dst.add(x * BPP), lo, hi);
+    }
+    done
+}
+
+pub(super) unsafe fn nv12_to_rgb_sse2<const BPP: usize>(
+    y: &[u8],
+    uv: &[u8],
+    out: &mut [u8],
+) -> usize {
+    let done = whole_steps::<BPP>(y.len().min(uv.len()), out, 16);
+    let (y, uv, dst) = (y.as_ptr(), uv.as_ptr(), out.as_mut_ptr());
+    let zero = _mm_setzero_si128();
+
+    for x in (0..done).step_by(16) {
+        let luma = _mm_loadu_si128(y.add(x) as *const __m128i);
+        let chroma = _mm_loadu_si128(uv.add(x) as *const __m128i);
+
+        let (lo, hi) = rgbx_sse2(
+            _mm_unpacklo_epi8(luma, zero),
+            _mm_unpacklo_epi8(chroma, zero),
+        );
+        store_sse2::<BPP>(dst.add(x * BPP), lo, hi);
+        let (lo, hi) = rgbx_sse2(
+            _mm_unpackhi_epi8(luma, zero),
+            _mm_unpackhi_epi8(chroma, zero),
+        );
+        store_sse2::<BPP>(dst.add((x + 8) * BPP), lo, hi);
+    }
+    done
+}
+
+pub(super) unsafe fn yuyv_to_nv12_sse2(
+    top_src: &[u8],
+    bottom_src: &[u8],
+    top: &mut [u8],
+    bottom: &mut [u8],
+    chroma: &mut [u8],
+) -> usize {
+    let pixels = (top_src.len().min(bottom_src.len()) / 2)
+        .min(top.len())
+        .min(bottom.len())
+        .min(chroma.len());
+    let done = pixels / 16 * 16;
+    let luma_mask = _mm_set1_epi16(0xff);
+
+    for x in (0..done).step_by(16) {
+        let a0 = _mm_loadu_si128(top_src.as_ptr().add(x * 2) as *const __m128i);
+        let a1 = _mm_loadu_si128(top_src.as_ptr().add(x * 2 + 16) as *const __m128i);
+        let b0 = _mm_loadu_si128(bottom_src.as_ptr().add(x * 2) as *const __m128i);
+        let b1 = _mm_loadu_si128(bottom_src.as_ptr().add(x * 2 + 16) as *const __m128i);
+
+        let top_y = _mm_packus_epi16(_mm_and_si128(a0, luma_mask), _mm_and_si128(a1, luma_mask));
+        let bottom_y = _mm_packus_epi16(_mm_and_si128(b0, luma_mask), _mm_and_si128(b1, luma_mask));
+        // Rounded average of both rows, then keep the chroma bytes
+        let uv = _mm_packus_epi16(
+            _mm_srli_epi16::<8>(_mm_avg_epu8(a0, b0)),
+            _mm_srli_epi16::<8>(_mm_avg_epu8(a1, b1)),
+        );
+
+        _mm_storeu_si128(top.as_mut_ptr().add(x) as *mut __m128i, top_y);
+        _mm_storeu_si128(bottom.as_mut_ptr().add(x) as *mut __m128i, bottom_y);
+        _mm_storeu_si128(chroma.as_mut_ptr().add(x) as *mut __m128i, uv);
+    }
+    done
+}
+
+/// YUV to RGBX for sixteen pixels
+///
+/// Same as `rgbx_sse2` on each 128-bit half; returns pixels 0-7 and 8-15.
+#[inline(always)]
+unsafe fn rgbx_avx2(y: __m256i, uv: __m256i) -> (__m256i, __m256i) {
+    let uv = _mm256_sub_epi16(uv, _mm256_set1_epi16(128));
+    let u = _mm256_shufflehi_epi16::<0b10_10_00_00>(_mm256_shufflelo_epi16::<0b10_10_00_00>(uv));
+    let v = _mm256_shufflehi_epi16::<0b11_11_01_01>(_mm256_shufflelo_epi16::<0b11_11_01_01>(uv));
+
+    let c = _mm256_add_epi16(
+        _mm256_mullo_epi16(
+            _mm256_sub_epi16(y, _mm256_set1_epi16(16)),
+            _mm256_set1_epi16(Y_SCALE),
+        ),
+        _mm256_set1_epi16(1 << (FRACTION_BITS - 1)),
+    );
+    let r = _mm256_adds_epi16(c, _mm256_mullo_epi16(v, _mm256_set1_epi16(V_TO_R)));
+    let g = _mm256_subs_epi16(
+        _mm256_subs_epi16(c, _mm256_mullo_epi16(u, _mm256_set1_epi16(U_TO_G))),
+        _mm256_mullo_epi16(v, _mm256_set1_epi16(V_TO_G)),
+    );
+    let b = _mm256_adds_epi16(c, _mm256_mullo_epi16(u, _mm256_set1_epi16(U_TO_B)));
+
+    let rb = _mm256_packus_epi16(
+        _mm256_srai_epi16::<FRACTION_BITS>(r),
+        _mm256_srai_epi16::<FRACTION_BITS>(b),
+    );
+    let ga = _mm256_packus_epi16(
+        _mm256_srai_epi16::<FRACTION_BITS>(g),
+        _mm256_set1_epi16(0xff),
+    );
+    let rg = _mm256_unpacklo_epi8(rb, ga);
+    let ba = _mm256_unpackhi_epi8(rb, ga);
+    let lo = _mm256_unpacklo_epi16(rg, ba);
+    let hi = _mm256_unpackhi_epi16(rg, ba);
+    (
+        _mm256_permute2x128_si256::<0x20>(lo, hi),
+        _mm256_permute2x128_si256::<0x31>(lo, hi),
+    )
+}
+
+/// Store eight converted pixels
+#[inline(always)]
+unsafe fn store_avx2<const BPP: usize>(out: *mut u8, rgbx: __m256i) {
+    if BPP == 4 {
+        _mm256_storeu_si256(out as *mut __m256i, rgbx);
+    } else {
+        // Drop every fourth byte within each 128-bit half
+        let rgb = _mm256_shuffle_epi8(
+            rgbx,
+            _mm256_setr_epi8(
+                0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10,
+                12, 13, 14, -1, -1, -1, -1,
+            ),
+        );
+        _mm_storeu_si128(out as *mut __m128i, _mm256_castsi256_si128(rgb));
+        _mm_storeu_si128(
+            out.add(12) as *mut __m128i,
+            _mm256_extracti128_si256::<1>(rgb),
+        );
+    }
+}
+
+#[target_feature(enable = "avx2")]
+pub(super) unsafe fn yuyv_to_rgb_avx2<const BPP: usize>(src: &[u8], out: &mut [u8]) -> usize {
+    let done = whole_steps::<BPP>(src.len() / 2, out, 16);
+    let (src, dst) = (src.as_ptr(), out.as_mut_ptr());
+
+    for x in (0..done).step_by(16) {
+        let yuyv = _mm256_loadu_si256(src.add(x * 2) as *const __m256i);
+        let y = _mm256_and_si256(yuyv, _mm256_set1_epi16(0xff));
+        let uv = _mm256_srli_epi16::<8>(yuyv);
+        let (first, second) = rgbx_avx2(y, uv);
+        store_avx2::<BPP>(dst.add(x * BPP), first);
+        store_avx2::<BPP>(dst.add((x + 8) * BPP), second);
+    }
+    done
+}
+
+#[target_feature(enable = "avx2")]
+pub(super) unsafe fn nv12_to_rgb_avx2<const BPP: usize>(
+    y: &[u8],
+    uv: &[u8],
+    out: &mut [u8],
+) -> usize {
+    let done = whole_steps::<BPP>(y.len().min(uv.len()), out, 16);
+    let (y, uv, dst) = (y.as_ptr(), uv.as_ptr(), out.as_mut_ptr());
+
+    for x in (0..done).step_by(16) {
+        let luma = _mm256_cvtepu8_epi16(_mm_loadu_si128(y.add(x) as *const __m128i));
+        let chroma = _mm256_cvtepu8_epi16(_mm_loadu_si128(uv.add(x) as *const __m128i));
+        let (first, second) = rgbx_avx2(luma, chroma);
+        store_avx2::<BPP>(dst.add(x * BPP), first);
+        store_avx2::<BPP>(dst.add((x + 8) * BPP), second);
+    }
+    done
+}
+
+#[target_feature(enable = "avx2")]
+pub(super) unsafe fn yuyv_to_nv12_avx2(
+    top_src: &[u8],
+    bottom_src: &[u8],
+    top: &mut [u8],
+    bottom: &mut [u8],
+    chroma: &mut [u8],
+) -> usize {
+    let pixels = (top_src.len().min(bottom_src.len()) / 2)
+        .min(top.len())
+        .min(bottom.len())
+        .min(chroma.len());
+    let done = pixels / 32 * 32;
+    let luma_mask = _mm256_set1_epi16(0xff);
+
+    for x in (0..done).step_by(32) {
+        let a0 = _mm256_loadu_si256(top_src.as_ptr().add(x * 2) as *const __m256i);
+        let a1 = _mm256_loadu_si256(top_src.as_ptr().add(x * 2 + 32) as *const __m256i);
+        let b0 = _mm256_loadu_si256(bottom_src.as_ptr().add(x * 2) as *const __m256i);
+        let b1 = _mm256_loadu_si256(bottom_src.as_ptr().add(x * 2 + 32) as *const __m256i);
+
+        // Packing works per 128-bit half; the permute puts the quarters back in order
+        let top_y = _mm256_permute4x64_epi64::<0b11_01_10_00>(_mm256_packus_epi16(
+            _mm256_and_si256(a0, luma_mask),
+            _mm256_and_si256(a1, luma_mask),
+        ));
+        let bottom_y = _mm256_permute4x64_epi64::<0b11_01_10_00>(_mm256_packus_epi16(
+            _mm256_and_si256(b0, luma_mask),
+            _mm256_and_si256(b1, luma_mask),
+        ));
+        let uv = _mm256_permute4x64_epi64::<0b11_01_10_00>(_mm256_packus_epi16(
+            _mm256_srli_epi16::<8>(_mm256_avg_epu8(a0, b0)),
+            _mm256_srli_epi16::<8>(_mm256_avg_epu8(a1, b1)),
+        ));
+
+        _mm256_storeu_si256(top.as_mut_ptr().add(x) as *mut __m256i, top_y);
+        _mm256_storeu_si256(bottom.as_mut_ptr().add(x) as *mut __m256i, bottom_y);
+        _mm256_storeu_si256(chroma.as_mut_ptr().add(x) as *mut __m256i, uv);
+    }
+    done
+}
@@ -0,0 +1,108 @@
+//! Camera frame latency instrumentation
+//!
+//! Latencies are recorded on the runtime's `GetVideoStreamFrame` call, so
+//! the histogram is a fixed array of atomic counters: recording is one
+//! relaxed increment and never locks or allocates.
+
+use crate::display::LatencyPercentiles;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::time::Duration;
+
+/// Buckets per power of two, giving about 20% resolution
+const SUB_BUCKETS: u64 = 4;
+/// Powers of two covered in microseconds, up to about 30 s
+const OCTAVES: usize = 24;
+const BUCKETS: usize = SUB_BUCKETS as usize * OCTAVES;
+
+/// Log-linear histogram of durations in microseconds
+pub(crate) struct LatencyHistogram {
+    buckets: [AtomicU64; BUCKETS],
+}
+
+impl LatencyHistogram {
+    pub(crate) fn new() -> Self {
+        Self {
+            buckets: std::array::from_fn(|_| AtomicU64::new(0)),
+        }
+    }
+
+    /// Record one sample
+    pub(crate) fn record(&self, nanos: u64) {
+        let index = Self::bucket(nanos / 1000).min(BUCKETS - 1);
+        self.buckets[index].fetch_add(1, Ordering::Relaxed);
+    }
+
+    pub(crate) fn reset(&self) {
+        for bucket in &self.buckets {
+            bucket.store(0, Ordering::Relaxed);
+        }
+    }
+
+    /// Percentiles, each rounded up to the top of its bucket
+    pub(crate) fn percentiles(&self) -> LatencyPercentiles {
+        let counts: Vec<u64> = self
+            .buckets
+            .iter()
+            .map(|bucket| bucket.load(Ordering::Relaxed))
+            .collect();
+        let total: u64 = counts.iter().sum();
+        if total == 0 {
+            return LatencyPercentiles::default();
+        }
+
+        let at = |q: f64| {
+            let rank = ((total as f64 * q).ceil() as u64).max(1);
+            let mut seen = 0;
+            for (index, &count) in counts.iter().enumerate() {
+                seen += count;
+                if seen >= rank {
+                    return Duration::from_micros(Self::upper_bound(index));
+                }
+            }
+            Duration::from_micros(Self::upper_bound(BUCKETS - 1))
+        };
+        LatencyPercentiles {
+            p50: at(0.5),
+            p90: at(0.9),
+            p99: at(0.99),
+            max: at(1.0),
+        }
+    }
+
+    fn bucket(micros: u64) -> usize {
+        if micros < SUB_BUCKETS {
+            return micros as usize;
+        }
+        let octave = 63 - micros.leading_zeros() as u64;
+        let sub = (micros >> (octave - 2)) & (SUB_BUCKETS - 1);
+        ((octave - 1) * SUB_BUCKETS + sub) as usize
+    }
+
+    /// Largest value in microseconds that lands in a bucket
+    fn upper_bound(index: usize) -> u64 {
+        let index = index as u64;
+        if index < SUB_BUCKETS {
+            return index;
+        }
+        let octave = index / SUB_BUCKETS + 1;
+        let sub = index % SUB_BUCKETS;
+        ((SUB_BUCKETS + sub + 1) << (octave - 2)) - 1
+    }
+}
+
+/// Frame delivery counters and latencies of a `CameraStream`
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct CameraLatencyStats {
+    /// Times the runtime's sink callback was invoked
+    pub callbacks: u64,
+    /// Commits that skipped the callback because the runtime already had
+    /// an untaken frame it had been told about
+    pub coalesced: u64,
+    /// `begin_frame` calls refused because no format was selected or the
+    /// runtime's buffers were too small for it
+    pub rejected: u64,
+    /// `begin_frame` to `GetVideoStreamFrame`, including conversion
+    pub capture_to_consumer: LatencyPercentiles,
+    /// Commit to `GetVideoStreamFrame`, the wait the sink callback shortens
+    pub commit_to_consumer: LatencyPercentiles,
+}
@@ -0,0 +1,22 @@
+//! Camera frame delivery
+//!
+//! These types back the `IVRCameraComponent` vtable. `CameraStream` holds
+//! the state vrserver controls, and its `CameraFrameRing` lets a capture
+//! thread write frames straight into the runtime's buffers, converting from
+//! the sensor's pixel format on the way with `CameraFrame::write_image`.
+//! Committed frames wake the runtime through its sink callback, and
+//! `CameraLatencyStats` reports how long they waited to be taken.
+//! `CameraRig` answers the calibration queries from precomputed maps.
+
+mod calibration;
+mod convert;
+mod latency;
+mod ring;
+mod stream;
+
+pub use calibration::{CameraCalibration, CameraMapConfig, CameraRig};
+pub use convert::{convert_image, convert_image_with, is_convertible, ConvertBackend, SourceImage};
+pub use latency::CameraLatencyStats;
+pub use ring::{CameraFrameRing, CameraRingStats, FrameWriter, MAX_CAMERA_FRAME_BUFFERS};
+pub(crate) use stream::stream_formats;
+pub use stream::{image_data_size, CameraFrame, CameraFrameInfo, CameraStream};
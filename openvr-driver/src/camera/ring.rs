@@ -0,0 +1,386 @@
+//! Lock-free frame ring over runtime-provided camera buffers
+//!
+//! vrserver allocates the frame buffers and hands them over with
+//! `SetCameraFrameBuffering`. `CameraFrameRing` cycles those buffers between
+//! the capture thread, which writes pixels into them in place, and the
+//! runtime, which holds a frame between `GetVideoStreamFrame` and
+//! `ReleaseVideoStreamFrame`. Free buffers sit on a tagged lock-free stack,
+//! so taking and returning a buffer are both O(1) and never block.
+
+use crate::sys::root::vr::{CameraVideoStreamFrame_t, ETrackingResult};
+use std::cell::UnsafeCell;
+use std::mem::MaybeUninit;
+use std::ptr::addr_of_mut;
+use std::sync::atomic::{AtomicPtr, AtomicU32, AtomicU64, Ordering};
+
+/// Most frame buffers the runtime can hand to a ring
+pub const MAX_CAMERA_FRAME_BUFFERS: usize = 16;
+
+const FREE: u32 = 0;
+const WRITING: u32 = 1;
+const READY: u32 = 2;
+const HELD: u32 = 3;
+
+/// Empty link; slot links and the ready index are stored as index + 1
+const NIL: u32 = 0;
+
+#[repr(align(64))]
+struct Slot {
+    /// Next free slot while on the free stack
+    next: AtomicU32,
+    state: AtomicU32,
+    data: AtomicPtr<u8>,
+    /// Frame description handed to the runtime
+    header: UnsafeCell<CameraVideoStreamFrame_t>,
+}
+
+/// A frame header with every field zeroed or invalid
+fn blank_header() -> CameraVideoStreamFrame_t {
+    let mut header = MaybeUninit::<CameraVideoStreamFrame_t>::zeroed();
+    unsafe {
+        // Zero is not a tracking result, so that field needs a real value
+        addr_of_mut!(
+            (*header.as_mut_ptr())
+                .m_RawTrackedDevicePose
+                .eTrackingResult
+        )
+        .write(ETrackingResult::TrackingResult_Uninitialized);
+        header.assume_init()
+    }
+}
+
+/// Counters for a `CameraFrameRing`
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct CameraRingStats {
+    /// Buffers attached by the runtime
+    pub buffers: u32,
+    /// Frames committed by the capture thread
+    pub committed: u64,
+    /// Frames handed to the runtime
+    pub delivered: u64,
+    /// Committed frames replaced by a newer one before the runtime took them
+    pub superseded: u64,
+    /// Times the capture thread found no free buffer
+    pub starved: u64,
+}
+
+/// Lock-free ring of camera frame buffers
+///
+/// One capture thread writes frames and the runtime consumes them. Only the
+/// newest committed frame is offered to the runtime; an older frame it has
+/// not taken yet goes straight back to the free stack. `FrameWriter::commit`
+/// reports when a frame lands in an empty ready slot, which is the only
+/// time the runtime needs waking.
+pub struct CameraFrameRing {
+    slots: Box<[Slot]>,
+    count: AtomicU32,
+    buffer_size: AtomicU32,
+    /// Free stack head as `(tag << 32) | (index + 1)`
+    free: AtomicU64,
+    /// Newest committed frame not yet taken, as index + 1
+    ready: AtomicU32,
+    committed: AtomicU64,
+    delivered: AtomicU64,
+    superseded: AtomicU64,
+    starved: AtomicU64,
+}
+
+// Slot headers are only touched by whichever side owns the slot
+unsafe impl Send for CameraFrameRing {}
+unsafe impl Sync for CameraFrameRing {}
+
+impl CameraFrameRing {
+    /// Create a ring with no buffers attached
+    pub fn new() -> Self {
+        let slots = (0..MAX_CAMERA_FRAME_BUFFERS)
+            .map(|_| Slot {
+                next: AtomicU32::new(NIL),
+                state: AtomicU32::new(FREE),
+                data: AtomicPtr::new(std::ptr::null_mut()),
+                header: UnsafeCell::new(blank_header()),
+            })
+            .collect();
+
+        Self {
+            slots,
+            count: AtomicU32::new(0),
+            buffer_size: AtomicU32::new(0),
+            free: AtomicU64::new(NIL as u64),
+            ready: AtomicU32::new(NIL),
+            committed: AtomicU64::new(0),
+            delivered: AtomicU64::new(0),
+            superseded: AtomicU64::new(0),
+            starved: AtomicU64::new(0),
+        }
+    }
+
+    /// Number of attached buffers
+    pub fn buffer_count(&self) -> u32 {
+        self.count.load(Ordering::Acquire)
+    }
+
+    /// Size of each attached buffer in bytes
+    pub fn buffer_size(&self) -> u32 {
+        self.buffer_size.load(Ordering::Acquire)
+    }
+
+    /// Replace the buffers frames are written into
+    ///
+    /// Fails without changing anything while a frame is being written or
+    /// is held by the runtime.
+    ///
+    /// # Safety
+    /// Every pointer must reference `buffer_size` writable bytes that stay
+    /// valid until the next successful `attach`.
+    pub unsafe fn attach(&self, buffers: &[*mut u8], buffer_size: u32) -> bool {
+        if buffers.len() > MAX_CAMERA_FRAME_BUFFERS || buffers.iter().any(|b| b.is_null()) {
+            return false;
+        }
+
+        // Take every idle slot out of circulation
+        let mut idle = Vec::with_capacity(MAX_CAMERA_FRAME_BUFFERS);
+        let mut link = self.take_free_stack();
+        while link != NIL {
+            idle.push(link - 1);
+            link = self.slot(link - 1).next.load(Ordering::Relaxed);
+        }
+        let ready = self.ready.swap(NIL, Ordering::AcqRel);
+        if ready != NIL {
+            idle.push(ready - 1);
+        }
+
+        if idle.len() != self.buffer_count() as usize {
+            // Some buffer is still in use; put the idle ones back
+            for index in idle {
+                self.push_free(index);
+            }
+            return false;
+        }
+
+        for (slot, &buffer) in self.slots.iter().zip(buffers) {
+            slot.data.store(buffer, Ordering::Relaxed);
+        }
+        self.buffer_size.store(buffer_size, Ordering::Relaxed);
+        self.count.store(buffers.len() as u32, Ordering::Release);
+        for index in (0..buffers.len() as u32).rev() {
+            self.push_free(index);
+        }
+        true
+    }
+
+    /// Take a free buffer to write a frame into
+    pub fn begin_write(&self) -> Option<FrameWriter<'_>> {
+        match self.pop_free() {
+            Some(index) => {
+                self.slot(index).state.store(WRITING, Ordering::Relaxed);
+                Some(FrameWriter { ring: self, index })
+            }
+            None => {
+                self.starved.fetch_add(1, Ordering::Relaxed);
+                None
+            }
+        }
+    }
+
+    /// Take the newest committed frame for the runtime
+    ///
+    /// The frame stays valid until it is passed to `release`.
+    pub fn acquire(&self) -> Option<*const CameraVideoStreamFrame_t> {
+        let ready = self.ready.swap(NIL, Ordering::AcqRel);
+        if ready == NIL {
+            return None;
+        }
+
+        let slot = self.slot(ready - 1);
+        slot.state.store(HELD, Ordering::Relaxed);
+        self.delivered.fetch_add(1, Ordering::Relaxed);
+        Some(slot.header.get() as *const _)
+    }
+
+    /// Return a frame from `acquire` to the free stack
+    ///
+    /// # Returns
+    /// * `false` if the pointer is not a frame currently held by the runtime
+    pub fn release(&self, frame: *const CameraVideoStreamFrame_t) -> bool {
+        // Recover the slot from the header address, not from the header
+        // contents, which the runtime could have scribbled on
+        let first = self.slots[0].header.get() as usize;
+        let Some(offset) = (frame as usize).checked_sub(first) else {
+            return false;
+        };
+        let stride = std::mem::size_of::<Slot>();
+        let index = offset / stride;
+        if offset % stride != 0 || index >= self.buffer_count() as usize {
+            return false;
+        }
+
+        let released = self
+            .slot(index as u32)
+            .state
+            .compare_exchange(HELD, FREE, Ordering::AcqRel, Ordering::Relaxed)
+            .is_ok();
+        if released {
+            self.push_free(index as u32);
+        }
+        released
+    }
+
+    /// Whether a committed frame is waiting for the runtime
+    pub fn has_pending(&self) -> bool {
+        self.ready.load(Ordering::Acquire) != NIL
+    }
+
+    /// Drop the committed frame the runtime has not taken, if any
+    pub fn discard_pending(&self) {
+        let ready = self.ready.swap(NIL, Ordering::AcqRel);
+        if ready != NIL {
+            self.slot(ready - 1).state.store(FREE, Ordering::Relaxed);
+            self.push_free(ready - 1);
+        }
+    }
+
+    /// Snapshot of the ring counters
+    pub fn stats(&self) -> CameraRingStats {
+        CameraRingStats {
+            buffers: self.buffer_count(),
+            committed: self.committed.load(Ordering::Relaxed),
+            delivered: self.delivered.load(Ordering::Relaxed),
+            superseded: self.superseded.load(Ordering::Relaxed),
+            starved: self.starved.load(Ordering::Relaxed),
+        }
+    }
+
+    #[inline]
+    fn slot(&self, index: u32) -> &Slot {
+        &self.slots[index as usize]
+    }
+
+    /// Make a slot the newest frame, returning whether none was waiting
+    fn publish(&self, index: u32) -> bool {
+        self.slot(index).state.store(READY, Ordering::Relaxed);
+        self.committed.fetch_add(1, Ordering::Relaxed);
+
+        let previous = self.ready.swap(index + 1, Ordering::AcqRel);
+        if previous == NIL {
+            return true;
+        }
+        self.slot(previous - 1).state.store(FREE, Ordering::Relaxed);
+        self.push_free(previous - 1);
+        self.superseded.fetch_add(1, Ordering::Relaxed);
+        false
+    }
+
+    fn push_free(&self, index: u32) {
+        let slot = self.slot(index);
+        let mut head = self.free.load(Ordering::Relaxed);
+        loop {
+            slot.next.store(head as u32, Ordering::Relaxed);
+            let new = ((head >> 32).wrapping_add(1) << 32) | (index + 1) as u64;
+            match self
+                .free
+                .compare_exchange_weak(head, new, Ordering::Release, Ordering::Relaxed)
+            {
+                Ok(_) => return,
+                Err(current) => head = current,
+            }
+        }
+    }
+
+    fn pop_free(&self) -> Option<u32> {
+        let mut head = self.free.load(Ordering::Acquire);
+        loop {
+            let link = head as u32;
+            if link == NIL {
+                return None;
+            }
+            // The tag makes a stale `next` fail the exchange below
+            let next = self.slot(link - 1).next.load(Ordering::Relaxed);
+            let new = ((head >> 32).wrapping_add(1) << 32) | next as u64;
+            match self
+                .free
+                .compare_exchange_weak(head, new, Ordering::Acquire, Ordering::Acquire)
+            {
+                Ok(_) => return Some(link - 1),
+                Err(current) => head = current,
+            }
+        }
+    }
+
+    /// Detach the whole free stack and return its first link
+    fn take_free_stack(&self) -> u32 {
+        let mut head = self.free.load(Ordering::Acquire);
+        loop {
+            let new = (head >> 32).wrapping_add(1) << 32;
+            match self
+                .free
+                .compare_exchange_weak(head, new, Ordering::Acquire, Ordering::Acquire)
+            {
+                Ok(_) => return head as u32,
+                Err(current) => head = current,
+            }
+        }
+    }
+}
+
+impl Default for CameraFrameRing {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// A buffer taken from the ring for writing
+///
+/// Dropping the writer without committing returns the buffer unused.
+pub struct FrameWriter<'a> {
+    ring: &'a CameraFrameRing,
+    index: u32,
+}
+
+impl FrameWriter<'_> {
+    /// Index of the runtime buffer being written
+    pub fn buffer_index(&self) -> u32 {
+        self.index
+    }
+
+    /// The whole runtime buffer
+    pub fn buffer(&mut self) -> &mut [u8] {
+        let data = self.ring.slot(self.index).data.load(Ordering::Relaxed);
+        unsafe { std::slice::from_raw_parts_mut(data, self.ring.buffer_size() as usize) }
+    }
+
+    /// Frame description the runtime will see
+    ///
+    /// Buffer index, buffer count and image pointer are filled in on commit.
+    pub fn header(&mut self) -> &mut CameraVideoStreamFrame_t {
+        unsafe { &mut *self.ring.slot(self.index).header.get() }
+    }
+
+    /// Offer the frame to the runtime
+    ///
+    /// # Returns
+    /// * `true` if the runtime had no frame waiting, so this is the first
+    ///   frame since it last called `acquire`
+    /// * `false` if this replaced a frame the runtime had not taken
+    pub fn commit(mut self) -> bool {
+        let ring = self.ring;
+        let index = self.index;
+        let data = ring.slot(index).data.load(Ordering::Relaxed);
+        let header = self.header();
+        header.m_nBufferIndex = index;
+        header.m_nBufferCount = ring.buffer_count();
+        header.m_pImageData = data as u64;
+
+        std::mem::forget(self);
+        ring.publish(index)
+    }
+}
+
+impl Drop for FrameWriter<'_> {
+    fn drop(&mut self) {
+        self.ring
+            .slot(self.index)
+            .state
+            .store(FREE, Ordering::Relaxed);
+        self.ring.push_free(self.index);
+    }
+}
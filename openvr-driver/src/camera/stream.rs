@@ -0,0 +1,531 @@
+//! Camera video stream state
+//!
+//! `CameraStream` is shared between a camera component's vtable and its
+//! capture thread. The vtable drives format selection, start, stop and
+//! pause on behalf of vrserver; the capture thread writes frames with
+//! `begin_frame` and never waits on the runtime.
+//!
+//! When vrserver registers an `ICameraVideoSinkCallback`, committing a frame
+//! calls it from the capture thread so the runtime fetches the frame right
+//! away instead of on its next poll. A burst of frames committed before the
+//! runtime gets to them produces one callback. The capture thread registers
+//! as a reader around each call, and replacing the callback waits for those
+//! calls to return, so the runtime never sees a call into a callback object
+//! it has already swapped out.
+
+use super::convert::{convert_image, SourceImage};
+use super::latency::{CameraLatencyStats, LatencyHistogram};
+use super::ring::{CameraFrameRing, FrameWriter, MAX_CAMERA_FRAME_BUFFERS};
+use crate::sys::root::vr::{
+    CameraVideoStreamFrame_t, ECameraVideoStreamFormat, ICameraVideoSinkCallback,
+};
+use crate::DriverResult;
+use std::sync::atomic::{AtomicBool, AtomicPtr, AtomicU32, AtomicU64, AtomicUsize, Ordering};
+use std::time::Instant;
+
+/// Bytes one frame of `format` occupies, or `None` for variable-size formats
+///
+/// # Arguments
+/// * `format` - Stream format
+/// * `width` - Frame width in pixels
+/// * `height` - Frame height in pixels
+pub fn image_data_size(format: ECameraVideoStreamFormat, width: u32, height: u32) -> Option<u32> {
+    use ECameraVideoStreamFormat::*;
+
+    let pixels = width.checked_mul(height)?;
+    match format {
+        CVS_FORMAT_RAW10 => pixels.checked_mul(10).map(|bits| bits / 8),
+        CVS_FORMAT_NV12 => pixels.checked_mul(3).map(|bytes| bytes / 2),
+        // Two NV12 images stacked vertically
+        CVS_FORMAT_NV12_2 => pixels.checked_mul(3),
+        CVS_FORMAT_RGB24 => pixels.checked_mul(3),
+        CVS_FORMAT_YUYV16 | CVS_FORMAT_BAYER16BG => pixels.checked_mul(2),
+        CVS_FORMAT_RGBX32 => pixels.checked_mul(4),
+        CVS_FORMAT_MJPEG | CVS_FORMAT_UNKNOWN | CVS_MAX_FORMATS => None,
+    }
+}
+
+/// Every stream format a camera can offer, in enum order
+pub(crate) fn stream_formats() -> impl Iterator<Item = ECameraVideoStreamFormat> {
+    (1..ECameraVideoStreamFormat::CVS_MAX_FORMATS as u32).map(format_from_raw)
+}
+
+/// Convert a stored format back to the enum
+fn format_from_raw(raw: u32) -> ECameraVideoStreamFormat {
+    use ECameraVideoStreamFormat::*;
+
+    match raw {
+        1 => CVS_FORMAT_RAW10,
+        2 => CVS_FORMAT_NV12,
+        3 => CVS_FORMAT_RGB24,
+        4 => CVS_FORMAT_NV12_2,
+        5 => CVS_FORMAT_YUYV16,
+        6 => CVS_FORMAT_BAYER16BG,
+        7 => CVS_FORMAT_MJPEG,
+        8 => CVS_FORMAT_RGBX32,
+        _ => CVS_FORMAT_UNKNOWN,
+    }
+}
+
+/// Capture details recorded with a frame
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct CameraFrameInfo {
+    /// Exposure time in microseconds
+    pub exposure_time: u32,
+    /// Sensor timestamp in the driver's own time base
+    pub isp_timestamp: u32,
+    /// Capture time in seconds in the driver's own time base
+    pub capture_time: f64,
+}
+
+/// State of one camera video stream
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::camera::{CameraFrameInfo, CameraStream};
+///
+/// fn capture_loop(stream: &CameraStream) {
+///     while stream.is_active() {
+///         // Wait for the sensor, then write straight into a runtime buffer
+///         if let Some(mut frame) = stream.begin_frame() {
+///             frame.data().fill(0x80);
+///             frame.commit(&CameraFrameInfo::default());
+///         }
+///     }
+/// }
+/// ```
+pub struct CameraStream {
+    ring: CameraFrameRing,
+    format: AtomicU32,
+    width: AtomicU32,
+    height: AtomicU32,
+    active: AtomicBool,
+    paused: AtomicBool,
+    epoch: Instant,
+    /// Nanoseconds after `epoch` the stream started
+    started_ns: AtomicU64,
+    /// Nanoseconds after `epoch` of the last commit
+    last_commit_ns: AtomicU64,
+    sequence: AtomicU32,
+    /// Runtime callback for new frames, null while polling
+    sink: AtomicPtr<ICameraVideoSinkCallback>,
+    /// Calls into `sink` in flight
+    sink_readers: AtomicUsize,
+    /// `begin_frame` and commit times of the frame in each buffer
+    capture_ns: [AtomicU64; MAX_CAMERA_FRAME_BUFFERS],
+    commit_ns: [AtomicU64; MAX_CAMERA_FRAME_BUFFERS],
+    callbacks: AtomicU64,
+    coalesced: AtomicU64,
+    rejected: AtomicU64,
+    capture_to_consumer: LatencyHistogram,
+    commit_to_consumer: LatencyHistogram,
+}
+
+impl CameraStream {
+    /// Create a stopped stream with no format selected
+    pub fn new() -> Self {
+        Self {
+            ring: CameraFrameRing::new(),
+            format: AtomicU32::new(ECameraVideoStreamFormat::CVS_FORMAT_UNKNOWN as u32),
+            width: AtomicU32::new(0),
+            height: AtomicU32::new(0),
+            active: AtomicBool::new(false),
+            paused: AtomicBool::new(false),
+            epoch: Instant::now(),
+            started_ns: AtomicU64::new(0),
+            last_commit_ns: AtomicU64::new(0),
+            sequence: AtomicU32::new(0),
+            sink: AtomicPtr::new(std::ptr::null_mut()),
+            sink_readers: AtomicUsize::new(0),
+            capture_ns: std::array::from_fn(|_| AtomicU64::new(0)),
+            commit_ns: std::array::from_fn(|_| AtomicU64::new(0)),
+            callbacks: AtomicU64::new(0),
+            coalesced: AtomicU64::new(0),
+            rejected: AtomicU64::new(0),
+            capture_to_consumer: LatencyHistogram::new(),
+            commit_to_consumer: LatencyHistogram::new(),
+        }
+    }
+
+    /// Ring over the runtime's frame buffers
+    pub fn ring(&self) -> &CameraFrameRing {
+        &self.ring
+    }
+
+    /// Format selected by the runtime
+    pub fn format(&self) -> ECameraVideoStreamFormat {
+        format_from_raw(self.format.load(Ordering::Acquire))
+    }
+
+    /// Frame size of the selected format as `(width, height)`
+    pub fn dimensions(&self) -> (u32, u32) {
+        (
+            self.width.load(Ordering::Acquire),
+            self.height.load(Ordering::Acquire),
+        )
+    }
+
+    /// Whether the runtime has started the stream
+    pub fn is_active(&self) -> bool {
+        self.active.load(Ordering::Acquire)
+    }
+
+    /// Whether the runtime has paused the stream
+    pub fn is_paused(&self) -> bool {
+        self.paused.load(Ordering::Acquire)
+    }
+
+    /// Seconds since the stream started
+    pub fn elapsed_seconds(&self) -> f64 {
+        let now = self.now_ns();
+        now.saturating_sub(self.started_ns.load(Ordering::Acquire)) as f64 / 1e9
+    }
+
+    /// Whether the runtime has registered a sink callback
+    pub fn has_sink(&self) -> bool {
+        !self.sink.load(Ordering::Acquire).is_null()
+    }
+
+    /// Callback counts and capture-to-consumer latencies
+    pub fn latency_stats(&self) -> CameraLatencyStats {
+        CameraLatencyStats {
+            callbacks: self.callbacks.load(Ordering::Relaxed),
+            coalesced: self.coalesced.load(Ordering::Relaxed),
+            rejected: self.rejected.load(Ordering::Relaxed),
+            capture_to_consumer: self.capture_to_consumer.percentiles(),
+            commit_to_consumer: self.commit_to_consumer.percentiles(),
+        }
+    }
+
+    /// Clear the counters and latency histograms
+    pub fn reset_latency_stats(&self) {
+        self.callbacks.store(0, Ordering::Relaxed);
+        self.coalesced.store(0, Ordering::Relaxed);
+        self.rejected.store(0, Ordering::Relaxed);
+        self.capture_to_consumer.reset();
+        self.commit_to_consumer.reset();
+    }
+
+    /// Take a runtime buffer to write the next frame into
+    ///
+    /// # Returns
+    /// * `None` if the stream is stopped or paused, or every buffer is in use
+    /// * `None`, counted in `CameraLatencyStats::rejected`, if no format is
+    ///   selected or the runtime's buffers cannot hold a frame of it
+    pub fn begin_frame(&self) -> Option<CameraFrame<'_>> {
+        if !self.is_active() || self.is_paused() {
+            return None;
+        }
+
+        let format = self.format();
+        let (width, height) = self.dimensions();
+        let buffer_size = self.ring.buffer_size();
+        let image_size = match format {
+            // Variable size; `set_image_data_size` records what was written
+            ECameraVideoStreamFormat::CVS_FORMAT_MJPEG => Some(buffer_size),
+            _ => image_data_size(format, width, height).filter(|&size| size <= buffer_size),
+        };
+        let Some(image_size) = image_size else {
+            self.rejected.fetch_add(1, Ordering::Relaxed);
+            return None;
+        };
+
+        let writer = self.ring.begin_write()?;
+        let captured_ns = self.now_ns();
+
+        Some(CameraFrame {
+            stream: self,
+            writer,
+            format,
+            width,
+            height,
+            image_size,
+            captured_ns,
+        })
+    }
+
+    /// Select the format and frame size for subsequent frames
+    pub(crate) fn set_format(&self, format: ECameraVideoStreamFormat, width: u32, height: u32) {
+        self.width.store(width, Ordering::Release);
+        self.height.store(height, Ordering::Release);
+        self.format.store(format as u32, Ordering::Release);
+    }
+
+    pub(crate) fn start(&self) {
+        self.sequence.store(0, Ordering::Relaxed);
+        self.started_ns.store(self.now_ns(), Ordering::Release);
+        self.paused.store(false, Ordering::Release);
+        self.active.store(true, Ordering::Release);
+    }
+
+    pub(crate) fn stop(&self) {
+        self.active.store(false, Ordering::Release);
+        self.paused.store(false, Ordering::Release);
+        self.ring.discard_pending();
+    }
+
+    pub(crate) fn set_paused(&self, paused: bool) {
+        self.paused.store(paused, Ordering::Release);
+    }
+
+    /// Register or clear (with null) the runtime's new-frame callback
+    ///
+    /// Returns once no call into the previous callback is in flight, so the
+    /// runtime may release it as soon as `SetCameraVideoSinkCallback`
+    /// returns. Must not be called from inside the callback.
+    pub(crate) fn set_sink(&self, sink: *mut ICameraVideoSinkCallback) {
+        let previous = self.sink.swap(sink, Ordering::SeqCst);
+        if previous.is_null() {
+            return;
+        }
+        // Only the capture thread reads, one call per commit, so the count
+        // drains between frames; no epoch split as in `Snapshot` is needed
+        while self.sink_readers.load(Ordering::SeqCst) != 0 {
+            std::thread::yield_now();
+        }
+    }
+
+    /// Hand the newest frame to the runtime, recording how long it waited
+    pub(crate) fn acquire_frame(&self) -> Option<*const CameraVideoStreamFrame_t> {
+        let frame = self.ring.acquire()?;
+        let now = self.now_ns();
+
+        // The runtime has not seen the header yet, so it is still ours to read
+        let index = unsafe { (*frame).m_nBufferIndex } as usize;
+        if let (Some(captured), Some(committed)) =
+            (self.capture_ns.get(index), self.commit_ns.get(index))
+        {
+            let captured = captured.load(Ordering::Relaxed);
+            let committed = committed.load(Ordering::Relaxed);
+            self.capture_to_consumer
+                .record(now.saturating_sub(captured));
+            self.commit_to_consumer
+                .record(now.saturating_sub(committed));
+        }
+        Some(frame)
+    }
+
+    /// Tell the runtime a frame is ready, if it asked to be told
+    fn notify_sink(&self) {
+        // Registered before the pointer is read, so `set_sink` replacing it
+        // afterwards waits for this call to return
+        self.sink_readers.fetch_add(1, Ordering::SeqCst);
+        let sink = self.sink.load(Ordering::SeqCst);
+        if !sink.is_null() {
+            self.callbacks.fetch_add(1, Ordering::Relaxed);
+            unsafe {
+                ((*(*sink).vtable_).ICameraVideoSinkCallback_OnCameraVideoSinkCallback)(sink);
+            }
+        }
+        self.sink_readers.fetch_sub(1, Ordering::Release);
+    }
+
+    #[inline]
+    fn now_ns(&self) -> u64 {
+        self.epoch.elapsed().as_nanos() as u64
+    }
+}
+
+impl Default for CameraStream {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// A frame being written into a runtime buffer
+///
+/// Dropping it without committing returns the buffer unused.
+pub struct CameraFrame<'a> {
+    stream: &'a CameraStream,
+    writer: FrameWriter<'a>,
+    format: ECameraVideoStreamFormat,
+    width: u32,
+    height: u32,
+    image_size: u32,
+    /// Nanoseconds after the stream epoch the buffer was taken
+    captured_ns: u64,
+}
+
+impl CameraFrame<'_> {
+    /// Format the frame must be written in
+    pub fn format(&self) -> ECameraVideoStreamFormat {
+        self.format
+    }
+
+    /// Frame width in pixels
+    pub fn width(&self) -> u32 {
+        self.width
+    }
+
+    /// Frame height in pixels
+    pub fn height(&self) -> u32 {
+        self.height
+    }
+
+    /// Image bytes, sized for the format
+    ///
+    /// For variable-size formats this is the whole buffer; call
+    /// `set_image_data_size` with the bytes actually written.
+    pub fn data(&mut self) -> &mut [u8] {
+        let size = self.image_size as usize;
+        &mut self.writer.buffer()[..size]
+    }
+
+    /// Record how many bytes of a variable-size frame were written
+    pub fn set_image_data_size(&mut self, size: u32) {
+        self.image_size = size.min(self.stream.ring.buffer_size());
+    }
+
+    /// Convert a captured image straight into the frame's runtime buffer
+    ///
+    /// See `convert_image` for the supported conversions.
+    pub fn write_image(&mut self, src: &SourceImage<'_>) -> DriverResult<()> {
+        let (format, width, height) = (self.format, self.width, self.height);
+        let size = convert_image(src, format, width, height, self.writer.buffer())?;
+        self.image_size = size;
+        Ok(())
+    }
+
+    /// Offer the frame to the runtime, replacing any frame it has not taken
+    ///
+    /// Calls the runtime's sink callback, if it registered one, unless the
+    /// replaced frame was still waiting for it.
+    pub fn commit(mut self, info: &CameraFrameInfo) {
+        let stream = self.stream;
+        let now = stream.now_ns();
+        let previous = stream.last_commit_ns.swap(now, Ordering::Relaxed);
+        let started = stream.started_ns.load(Ordering::Acquire);
+        let delivery_rate = if previous > started && now > previous {
+            1e9 / (now - previous) as f64
+        } else {
+            0.0
+        };
+
+        let header = self.writer.header();
+        header.m_nStreamFormat = self.format;
+        header.m_nWidth = self.width;
+        header.m_nHeight = self.height;
+        header.m_nImageDataSize = self.image_size;
+        header.m_nFrameSequence = stream.sequence.fetch_add(1, Ordering::Relaxed);
+        header.m_nExposureTime = info.exposure_time;
+        header.m_nISPFrameTimeStamp = info.isp_timestamp;
+        header.m_flFrameElapsedTime = now.saturating_sub(started) as f64 / 1e9;
+        header.m_flFrameDeliveryRate = delivery_rate;
+        header.m_flFrameCaptureTime_DriverAbsolute = info.capture_time;
+
+        // Published by the commit below, before the runtime can take the frame
+        let index = self.writer.buffer_index() as usize;
+        stream.capture_ns[index].store(self.captured_ns, Ordering::Relaxed);
+        stream.commit_ns[index].store(now, Ordering::Relaxed);
+
+        if self.writer.commit() {
+            stream.notify_sink();
+        } else if stream.has_sink() {
+            stream.coalesced.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::sys::root::vr::ICameraVideoSinkCallback__bindgen_vtable;
+
+    const WIDTH: u32 = 64;
+    const HEIGHT: u32 = 48;
+
+    /// A started NV12 stream writing into `buffers`
+    fn stream(buffers: &mut [Vec<u8>; 2]) -> CameraStream {
+        let stream = CameraStream::new();
+        let pointers = buffers.each_mut().map(|buffer| buffer.as_mut_ptr());
+        assert!(unsafe { stream.ring().attach(&pointers, buffers[0].len() as u32) });
+        stream.set_format(ECameraVideoStreamFormat::CVS_FORMAT_NV12, WIDTH, HEIGHT);
+        stream.start();
+        stream
+    }
+
+    #[test]
+    fn begin_frame_rejects_buffers_too_small_for_format() {
+        let needed = image_data_size(ECameraVideoStreamFormat::CVS_FORMAT_NV12, WIDTH, HEIGHT)
+            .unwrap() as usize;
+
+        let mut small = [vec![0u8; needed - 1], vec![0u8; needed - 1]];
+        let stream = stream(&mut small);
+        assert!(stream.begin_frame().is_none());
+        assert_eq!(stream.latency_stats().rejected, 1);
+        // Nothing was taken from the ring
+        assert_eq!(stream.ring().stats().starved, 0);
+
+        let mut fitting = [vec![0u8; needed + 16], vec![0u8; needed + 16]];
+        let stream = self::stream(&mut fitting);
+        let mut frame = stream.begin_frame().unwrap();
+        assert_eq!(frame.data().len(), needed);
+        frame.commit(&CameraFrameInfo::default());
+        assert_eq!(stream.latency_stats().rejected, 0);
+
+        stream.set_format(ECameraVideoStreamFormat::CVS_FORMAT_UNKNOWN, 0, 0);
+        assert!(stream.begin_frame().is_none());
+        assert_eq!(stream.latency_stats().rejected, 1);
+    }
+
+    /// `ICameraVideoSinkCallback` that counts its calls
+    #[repr(C)]
+    struct CountingSink {
+        base: ICameraVideoSinkCallback,
+        calls: AtomicU32,
+    }
+
+    unsafe extern "C" fn on_sink_callback(this: *mut ICameraVideoSinkCallback) {
+        (*(this as *const CountingSink))
+            .calls
+            .fetch_add(1, Ordering::Relaxed);
+    }
+
+    static SINK_VTABLE: ICameraVideoSinkCallback__bindgen_vtable =
+        ICameraVideoSinkCallback__bindgen_vtable {
+            ICameraVideoSinkCallback_OnCameraVideoSinkCallback: on_sink_callback,
+        };
+
+    #[test]
+    fn burst_of_commits_calls_sink_once() {
+        let needed = image_data_size(ECameraVideoStreamFormat::CVS_FORMAT_NV12, WIDTH, HEIGHT)
+            .unwrap() as usize;
+        let mut buffers = [vec![0u8; needed], vec![0u8; needed]];
+        let stream = stream(&mut buffers);
+        let mut sink = CountingSink {
+            base: ICameraVideoSinkCallback {
+                vtable_: &SINK_VTABLE,
+            },
+            calls: AtomicU32::new(0),
+        };
+        stream.set_sink(&mut sink.base);
+
+        for _ in 0..5 {
+            let frame = stream.begin_frame().unwrap();
+            frame.commit(&CameraFrameInfo::default());
+        }
+        let stats = stream.latency_stats();
+        assert_eq!(sink.calls.load(Ordering::Relaxed), 1);
+        assert_eq!((stats.callbacks, stats.coalesced), (1, 4));
+
+        // Taking the frame rearms the callback
+        let frame = stream.acquire_frame().unwrap();
+        stream.ring().release(frame);
+        stream
+            .begin_frame()
+            .unwrap()
+            .commit(&CameraFrameInfo::default());
+        assert_eq!(sink.calls.load(Ordering::Relaxed), 2);
+
+        stream.set_sink(std::ptr::null_mut());
+        let frame = stream.acquire_frame().unwrap();
+        stream.ring().release(frame);
+        stream
+            .begin_frame()
+            .unwrap()
+            .commit(&CameraFrameInfo::default());
+        assert_eq!(sink.calls.load(Ordering::Relaxed), 2);
+        assert_eq!(stream.latency_stats().callbacks, 2);
+    }
+}
@@ -3,8 +3,14 @@
 //! This module provides safe wrappers around OpenVR's driver context
 //! and host interfaces, handling the low-level FFI details.
 
-use crate::{properties, sys, DriverError, DriverResult, TrackedDeviceServerDriver};
+use crate::display::FrameTiming;
+use crate::properties::MappedFile;
+use crate::{
+    properties, sys, DriverError, DriverResult, HmdMatrix34, TrackedDeviceIndex,
+    TrackedDeviceServerDriver,
+};
 use std::ffi::{c_void, CStr, CString};
+use std::path::PathBuf;
 use std::sync::Arc;
 
 /// Driver context for accessing OpenVR interfaces
@@ -20,6 +26,11 @@ pub struct DriverContext {
     properties: Option<*mut sys::root::vr::IVRProperties>,
     /// Driver input interface
     driver_input: Option<*mut sys::root::vr::IVRDriverInput>,
+    /// Resources interface
+    resources: Option<*mut sys::root::vr::IVRResources>,
+    /// IPC resource manager interface
+    #[cfg(target_os = "linux")]
+    ipc_resources: Option<*mut sys::root::vr::IVRIPCResourceManagerClient>,
 }
 
 unsafe impl Send for DriverContext {}
@@ -39,6 +50,9 @@ impl DriverContext {
             host: None,
             properties: None,
             driver_input: None,
+            resources: None,
+            #[cfg(target_os = "linux")]
+            ipc_resources: None,
         };
 
         // Try to get the host interface
@@ -60,6 +74,17 @@ impl DriverContext {
             driver_context.driver_input = Some(input);
         }
 
+        // Try to get resources interface
+        if let Ok(resources) = driver_context.get_resources_interface() {
+            driver_context.resources = Some(resources);
+        }
+
+        // Try to get the IPC resource manager interface
+        #[cfg(target_os = "linux")]
+        if let Ok(ipc_resources) = driver_context.get_ipc_resources_interface() {
+            driver_context.ipc_resources = Some(ipc_resources);
+        }
+
         driver_context
     }
 
@@ -136,6 +161,57 @@ impl DriverContext {
         }
     }
 
+    /// Get the resources interface
+    fn get_resources_interface(&self) -> DriverResult<*mut sys::root::vr::IVRResources> {
+        unsafe {
+            let interface_name = CString::new("IVRResources_001").unwrap();
+            let mut error = sys::root::vr::EVRInitError::None;
+
+            let vtable = (*self.context).vtable_;
+            let get_interface = (*vtable).IVRDriverContext_GetGenericInterface;
+
+            let resources_ptr = get_interface(self.context, interface_name.as_ptr(), &mut error);
+
+            if error != sys::root::vr::EVRInitError::None {
+                return Err(DriverError::InitError(error));
+            }
+
+            if resources_ptr.is_null() {
+                return Err(DriverError::InterfaceNotFound("IVRResources".to_string()));
+            }
+
+            Ok(resources_ptr as *mut sys::root::vr::IVRResources)
+        }
+    }
+
+    /// Get the IPC resource manager interface
+    #[cfg(target_os = "linux")]
+    fn get_ipc_resources_interface(
+        &self,
+    ) -> DriverResult<*mut sys::root::vr::IVRIPCResourceManagerClient> {
+        unsafe {
+            let interface_name = CString::new("IVRIPCResourceManagerClient_001").unwrap();
+            let mut error = sys::root::vr::EVRInitError::None;
+
+            let vtable = (*self.context).vtable_;
+            let get_interface = (*vtable).IVRDriverContext_GetGenericInterface;
+
+            let client_ptr = get_interface(self.context, interface_name.as_ptr(), &mut error);
+
+            if error != sys::root::vr::EVRInitError::None {
+                return Err(DriverError::InitError(error));
+            }
+
+            if client_ptr.is_null() {
+                return Err(DriverError::InterfaceNotFound(
+                    "IVRIPCResourceManagerClient".to_string(),
+                ));
+            }
+
+            Ok(client_ptr as *mut sys::root::vr::IVRIPCResourceManagerClient)
+        }
+    }
+
     /// Register a device with OpenVR
     ///
     /// This method registers a tracked device with the OpenVR system.
@@ -172,6 +248,76 @@ impl DriverContext {
         self.host.as_mut()
     }
 
+    /// Get a `DriverInput` backed by the runtime's IVRDriverInput interface
+    pub fn driver_input(&self) -> Option<crate::input::HostDriverInput> {
+        self.driver_input
+            .map(|input| unsafe { crate::input::HostDriverInput::from_raw(input) })
+    }
+
+    /// Get an `IpcResourceManager` backed by the runtime's IVRIPCResourceManagerClient
+    #[cfg(target_os = "linux")]
+    pub fn ipc_resource_manager(&self) -> Option<crate::ipc::HostIpcResourceManager> {
+        self.ipc_resources
+            .map(|client| unsafe { crate::ipc::HostIpcResourceManager::from_raw(client) })
+    }
+
+    /// Resolve a driver resource to its path on disk
+    ///
+    /// # Arguments
+    /// * `name` - Resource name, such as `{mydriver}/resources/mura/left.bin`
+    /// * `directory` - Resource type subdirectory to search, or `""`
+    pub fn resource_full_path(&self, name: &str, directory: &str) -> DriverResult<PathBuf> {
+        let resources = self
+            .resources
+            .ok_or_else(|| DriverError::InterfaceNotFound("IVRResources".to_string()))?;
+        let name_c = CString::new(name)
+            .map_err(|_| DriverError::invalid_parameter("Resource name contains null byte"))?;
+        let directory_c = CString::new(directory)
+            .map_err(|_| DriverError::invalid_parameter("Resource directory contains null byte"))?;
+
+        unsafe {
+            let vtable = (*resources).vtable_;
+            let get_full_path = (*vtable).IVRResources_GetResourceFullPath;
+
+            // First call reports the required size, including the terminator
+            let required = get_full_path(
+                resources,
+                name_c.as_ptr(),
+                directory_c.as_ptr(),
+                std::ptr::null_mut(),
+                0,
+            );
+            if required <= 1 {
+                return Err(DriverError::operation_failed(format!(
+                    "Resource not found: {}",
+                    name
+                )));
+            }
+
+            let mut buffer = vec![0u8; required as usize];
+            get_full_path(
+                resources,
+                name_c.as_ptr(),
+                directory_c.as_ptr(),
+                buffer.as_mut_ptr() as *mut std::os::raw::c_char,
+                required,
+            );
+
+            let path = CStr::from_bytes_until_nul(&buffer)
+                .map_err(|_| DriverError::operation_failed("Resource path is not terminated"))?;
+            Ok(PathBuf::from(path.to_string_lossy().into_owned()))
+        }
+    }
+
+    /// Map a driver resource for zero-copy binary property writes
+    ///
+    /// # Arguments
+    /// * `name` - Resource name, as for `resource_full_path`
+    /// * `directory` - Resource type subdirectory to search, or `""`
+    pub fn map_resource(&self, name: &str, directory: &str) -> DriverResult<MappedFile> {
+        MappedFile::open(self.resource_full_path(name, directory)?)
+    }
+
     /// Get the raw context pointer
     ///
     /// # Safety
@@ -204,6 +350,7 @@ impl DriverContext {
 ///
 /// This struct provides methods for registering devices and sending
 /// events to the OpenVR runtime.
+#[derive(Clone)]
 pub struct DriverHost {
     /// Raw pointer to IVRServerDriverHost
     host: *mut sys::root::vr::IVRServerDriverHost,
@@ -217,7 +364,7 @@ impl DriverHost {
     ///
     /// # Safety
     /// The provided pointer must be a valid IVRServerDriverHost pointer.
-    unsafe fn from_raw(host: *mut sys::root::vr::IVRServerDriverHost) -> Self {
+    pub(crate) unsafe fn from_raw(host: *mut sys::root::vr::IVRServerDriverHost) -> Self {
         Self { host }
     }
 
@@ -288,6 +435,120 @@ impl DriverHost {
         }
     }
 
+    /// Notify the runtime that the HMD's display hit vsync
+    ///
+    /// Only permitted on devices of the HMD class.
+    ///
+    /// # Arguments
+    /// * `vsync_time_offset_seconds` - When the vsync happened relative to now,
+    ///   negative for a vsync in the past
+    pub fn vsync_event(&self, vsync_time_offset_seconds: f64) {
+        unsafe {
+            let vtable = (*self.host).vtable_;
+            let vsync_event = (*vtable).IVRServerDriverHost_VsyncEvent;
+            vsync_event(self.host, vsync_time_offset_seconds);
+        }
+    }
+
+    /// Notify the runtime that an HMD's eye-to-head transforms changed
+    ///
+    /// Only permitted on devices of the HMD class.
+    ///
+    /// # Arguments
+    /// * `device_index` - The HMD's tracked device index
+    /// * `left` - Left eye to head transform
+    /// * `right` - Right eye to head transform
+    pub fn set_display_eye_to_head(
+        &self,
+        device_index: TrackedDeviceIndex,
+        left: &HmdMatrix34,
+        right: &HmdMatrix34,
+    ) {
+        unsafe {
+            let vtable = (*self.host).vtable_;
+            let set_display_eye_to_head = (*vtable).IVRServerDriverHost_SetDisplayEyeToHead;
+            set_display_eye_to_head(self.host, device_index, left, right);
+        }
+    }
+
+    /// Notify the runtime that an HMD's projection changed
+    ///
+    /// Only permitted on devices of the HMD class.
+    ///
+    /// # Arguments
+    /// * `device_index` - The HMD's tracked device index
+    /// * `left` - Left eye `(left, right, top, bottom)` tangents, as in `GetProjectionRaw`
+    /// * `right` - Right eye tangents
+    pub fn set_display_projection_raw(
+        &self,
+        device_index: TrackedDeviceIndex,
+        left: (f32, f32, f32, f32),
+        right: (f32, f32, f32, f32),
+    ) {
+        let to_rect = |(l, r, t, b): (f32, f32, f32, f32)| sys::root::vr::HmdRect2_t {
+            vTopLeft: sys::root::vr::HmdVector2_t { v: [l, t] },
+            vBottomRight: sys::root::vr::HmdVector2_t { v: [r, b] },
+        };
+        let left = to_rect(left);
+        let right = to_rect(right);
+
+        unsafe {
+            let vtable = (*self.host).vtable_;
+            let set_display_projection_raw = (*vtable).IVRServerDriverHost_SetDisplayProjectionRaw;
+            set_display_projection_raw(self.host, device_index, &left, &right);
+        }
+    }
+
+    /// Notify the runtime that an HMD's recommended render target size changed
+    ///
+    /// Only permitted on devices of the HMD class.
+    ///
+    /// # Arguments
+    /// * `device_index` - The HMD's tracked device index
+    /// * `width` - Recommended per-eye width
+    /// * `height` - Recommended per-eye height
+    pub fn set_recommended_render_target_size(
+        &self,
+        device_index: TrackedDeviceIndex,
+        width: u32,
+        height: u32,
+    ) {
+        unsafe {
+            let vtable = (*self.host).vtable_;
+            let set_recommended_render_target_size =
+                (*vtable).IVRServerDriverHost_SetRecommendedRenderTargetSize;
+            set_recommended_render_target_size(self.host, device_index, width, height);
+        }
+    }
+
+    /// Get the compositor's most recent frame timings
+    ///
+    /// # Arguments
+    /// * `frames` - Number of frames to request
+    ///
+    /// # Returns
+    /// * The frames the compositor returned, empty if it has none yet
+    pub fn get_frame_timings(&self, frames: u32) -> Vec<FrameTiming> {
+        let mut raw: Vec<sys::root::vr::Compositor_FrameTiming> = (0..frames)
+            .map(|_| {
+                let mut timing: sys::root::vr::Compositor_FrameTiming =
+                    unsafe { std::mem::zeroed() };
+                timing.m_nSize =
+                    std::mem::size_of::<sys::root::vr::Compositor_FrameTiming>() as u32;
+                timing
+            })
+            .collect();
+
+        let filled = unsafe {
+            let vtable = (*self.host).vtable_;
+            let get_frame_timings = (*vtable).IVRServerDriverHost_GetFrameTimings;
+            get_frame_timings(self.host, raw.as_mut_ptr(), frames)
+        };
+
+        raw.truncate(filled.min(frames) as usize);
+        raw.iter().map(FrameTiming::from_raw).collect()
+    }
+
     /// Get the raw host pointer
     ///
     /// # Safety
@@ -0,0 +1,595 @@
+//! Lens model fitting from measured correspondences
+//!
+//! Calibration rigs photograph a dot pattern through the lens and record,
+//! for each dot and color channel, where it sits on the panel and where the
+//! runtime has to sample the render target for it to appear undistorted.
+//! `fit_lenses` turns those correspondences into the per-channel radial
+//! polynomial of `LensModel::RadialPolynomial`, optionally together with the
+//! optical center, by Levenberg-Marquardt. The normal equations are
+//! accumulated over the correspondences in parallel, so thousands of points
+//! fit in well under a second.
+//!
+//! Correspondences are read from CSV by `parse_correspondences`; the
+//! `lens-fit` binary wraps both for use from the command line.
+
+use super::{LensDistortion, LensModel, StereoLens};
+use crate::{DriverError, DriverResult, Eye};
+
+/// Largest number of radial terms `LensModel::RadialPolynomial` holds
+const MAX_TERMS: usize = 4;
+
+/// Optical center plus up to four terms for each of three channels
+const MAX_PARAMS: usize = 2 + 3 * MAX_TERMS;
+
+/// Damping beyond which no step will lower the error any more
+const MAX_LAMBDA: f64 = 1.0e12;
+
+/// One measured point: panel position and the render target UV it shows
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct LensCorrespondence {
+    /// Eye the point was measured through
+    pub eye: Eye,
+    /// Color channel: 0 red, 1 green, 2 blue
+    pub channel: usize,
+    /// Position on the eye's output viewport, in UV
+    pub panel: [f32; 2],
+    /// Render target UV the point must be sampled from
+    pub source: [f32; 2],
+}
+
+/// Lens fitting parameters
+#[derive(Debug, Clone)]
+pub struct LensFitConfig {
+    /// Radial terms to fit per channel (1 to 4)
+    pub terms: usize,
+    /// Fit the optical center as well as the coefficients
+    pub fit_center: bool,
+    /// Optical center to start from (or keep, without `fit_center`)
+    pub initial_center: [f32; 2],
+    /// UV to normalized coordinate scale, as in `LensDistortion::scale`
+    pub scale: [f32; 2],
+    /// Iteration limit per eye
+    pub max_iterations: u32,
+    /// Stop once an iteration lowers the squared error by less than this fraction
+    pub tolerance: f64,
+    /// Worker threads (0 for one per core)
+    pub threads: usize,
+}
+
+impl Default for LensFitConfig {
+    fn default() -> Self {
+        Self {
+            terms: 3,
+            fit_center: true,
+            initial_center: [0.5, 0.5],
+            scale: [2.0, 2.0],
+            max_iterations: 100,
+            tolerance: 1.0e-10,
+            threads: 0,
+        }
+    }
+}
+
+/// Fitted lens for one eye
+#[derive(Debug, Clone, PartialEq)]
+pub struct EyeLensFit {
+    /// Fitted lens, ready for `StereoLens`
+    pub lens: LensDistortion,
+    /// Root mean square residual, in UV
+    pub rms_error: f32,
+    /// Largest residual, in UV
+    pub max_error: f32,
+    /// Correspondences used
+    pub samples: usize,
+    /// Iterations run
+    pub iterations: u32,
+}
+
+/// Fitted lenses for both eyes
+#[derive(Debug, Clone, PartialEq)]
+pub struct LensFit {
+    /// Left eye fit
+    pub left: EyeLensFit,
+    /// Right eye fit
+    pub right: EyeLensFit,
+}
+
+impl LensFit {
+    /// Fitted lens pair, for `DisplayComponent::compute_distortion_row` and
+    /// `DistortionCacheConfig::lens_parameters`
+    pub fn lenses(&self) -> StereoLens {
+        StereoLens {
+            left: self.left.lens.clone(),
+            right: self.right.lens.clone(),
+        }
+    }
+
+    /// Fit as JSON, for driver settings files
+    ///
+    /// ```text
+    /// {"left": {"center": [u, v], "scale": [x, y], "radial": [[k1..k4] x 3],
+    ///   "rms_error": e, "max_error": e}, "right": {...}}
+    /// ```
+    pub fn to_json(&self) -> String {
+        fn eye(fit: &EyeLensFit) -> String {
+            let LensModel::RadialPolynomial(k) = &fit.lens.model else {
+                unreachable!("fits are always radial polynomials")
+            };
+            let radial: Vec<String> = k
+                .iter()
+                .map(|c| format!("[{:e}, {:e}, {:e}, {:e}]", c[0], c[1], c[2], c[3]))
+                .collect();
+            format!(
+                "{{\"center\": [{}, {}], \"scale\": [{}, {}], \"radial\": [{}], \"rms_error\": {:e}, \"max_error\": {:e}, \"samples\": {}}}",
+                fit.lens.center[0],
+                fit.lens.center[1],
+                fit.lens.scale[0],
+                fit.lens.scale[1],
+                radial.join(", "),
+                fit.rms_error,
+                fit.max_error,
+                fit.samples
+            )
+        }
+        format!(
+            "{{\"left\": {}, \"right\": {}}}",
+            eye(&self.left),
+            eye(&self.right)
+        )
+    }
+}
+
+/// Fit radial (and chromatic) coefficients for both eyes
+///
+/// Every channel of every eye needs at least `terms` correspondences.
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::display::{fit_lenses, parse_correspondences, LensFitConfig};
+/// # fn example() -> openvr_driver::DriverResult<()> {
+/// let csv = std::fs::read_to_string("dots.csv").unwrap();
+/// let fit = fit_lenses(&parse_correspondences(&csv)?, &LensFitConfig::default())?;
+/// let lenses = fit.lenses();
+/// # Ok(())
+/// # }
+/// ```
+pub fn fit_lenses(
+    correspondences: &[LensCorrespondence],
+    config: &LensFitConfig,
+) -> DriverResult<LensFit> {
+    if !(1..=MAX_TERMS).contains(&config.terms) {
+        return Err(DriverError::invalid_parameter(
+            "Lens fit needs between 1 and 4 radial terms",
+        ));
+    }
+    if let Some(bad) = correspondences.iter().find(|c| c.channel > 2) {
+        return Err(DriverError::invalid_parameter(format!(
+            "Correspondence has channel {}, expected 0 to 2",
+            bad.channel
+        )));
+    }
+
+    let eye = |eye: Eye| -> DriverResult<EyeLensFit> {
+        let points: Vec<LensCorrespondence> = correspondences
+            .iter()
+            .filter(|c| c.eye == eye)
+            .copied()
+            .collect();
+        for channel in 0..3 {
+            let count = points.iter().filter(|c| c.channel == channel).count();
+            if count < config.terms {
+                return Err(DriverError::invalid_parameter(format!(
+                    "{:?} eye channel {} has {} correspondences, need at least {}",
+                    eye, channel, count, config.terms
+                )));
+            }
+        }
+        fit_eye(&points, config)
+    };
+
+    Ok(LensFit {
+        left: eye(Eye::Left)?,
+        right: eye(Eye::Right)?,
+    })
+}
+
+/// Parse correspondences from CSV
+///
+/// One correspondence per line: `eye,channel,panel_u,panel_v,source_u,source_v`,
+/// with `eye` as `left`/`right` (or 0/1) and `channel` as `r`/`g`/`b` (or
+/// 0-2). Blank lines, lines starting with `#` and a header line starting
+/// with `eye` are skipped.
+pub fn parse_correspondences(text: &str) -> DriverResult<Vec<LensCorrespondence>> {
+    let mut out = Vec::new();
+    for (index, line) in text.lines().enumerate() {
+        let line = line.trim();
+        if line.is_empty() || line.starts_with('#') || line.starts_with("eye") {
+            continue;
+        }
+
+        let error = |what: &str| {
+            DriverError::invalid_parameter(format!("Line {}: {}: {}", index + 1, what, line))
+        };
+        let fields: Vec<&str> = line.split(',').map(str::trim).collect();
+        if fields.len() != 6 {
+            return Err(error("expected 6 fields"));
+        }
+
+        let eye = match fields[0].to_ascii_lowercase().as_str() {
+            "left" | "l" | "0" => Eye::Left,
+            "right" | "r" | "1" => Eye::Right,
+            _ => return Err(error("unknown eye")),
+        };
+        let channel = match fields[1].to_ascii_lowercase().as_str() {
+            "red" | "r" | "0" => 0,
+            "green" | "g" | "1" => 1,
+            "blue" | "b" | "2" => 2,
+            _ => return Err(error("unknown channel")),
+        };
+        let mut values = [0.0f32; 4];
+        for (value, field) in values.iter_mut().zip(&fields[2..]) {
+            *value = field.parse().map_err(|_| error("invalid number"))?;
+        }
+
+        out.push(LensCorrespondence {
+            eye,
+            channel,
+            panel: [values[0], values[1]],
+            source: [values[2], values[3]],
+        });
+    }
+    Ok(out)
+}
+
+/// Parameter layout: optional center (cx, cy), then `terms` coefficients per channel
+#[derive(Clone, Copy)]
+struct Layout {
+    terms: usize,
+    fit_center: bool,
+    scale: [f64; 2],
+}
+
+impl Layout {
+    fn len(&self) -> usize {
+        self.k_offset() + 3 * self.terms
+    }
+
+    fn k_offset(&self) -> usize {
+        if self.fit_center {
+            2
+        } else {
+            0
+        }
+    }
+
+    /// Predicted source UV and its derivatives with respect to each parameter
+    ///
+    /// With `x = (u - cx) sx`, `y = (v - cy) sy`, `r2 = x^2 + y^2` and
+    /// `s = 1 + sum k_j r2^j`, the model is `u' = (u - cx) s + cx` (likewise v).
+    fn evaluate(
+        &self,
+        params: &[f64],
+        center: [f64; 2],
+        point: &LensCorrespondence,
+        jacobian: &mut [[f64; 2]; MAX_PARAMS],
+    ) -> [f64; 2] {
+        let [cx, cy] = if self.fit_center {
+            [params[0], params[1]]
+        } else {
+            center
+        };
+        let k = &params[self.k_offset() + point.channel * self.terms..][..self.terms];
+
+        let du = point.panel[0] as f64 - cx;
+        let dv = point.panel[1] as f64 - cy;
+        let (x, y) = (du * self.scale[0], dv * self.scale[1]);
+        let r2 = x * x + y * y;
+
+        // s and ds/dr2
+        let mut s = 1.0;
+        let mut ds = 0.0;
+        let mut power = 1.0;
+        for (j, kj) in k.iter().enumerate() {
+            ds += (j + 1) as f64 * kj * power;
+            power *= r2;
+            s += kj * power;
+        }
+
+        jacobian[..self.len()].fill([0.0; 2]);
+        if self.fit_center {
+            // dr2/dcx = -2 x sx, dr2/dcy = -2 y sy
+            let dr2_dcx = -2.0 * x * self.scale[0];
+            let dr2_dcy = -2.0 * y * self.scale[1];
+            jacobian[0] = [1.0 - s + du * ds * dr2_dcx, dv * ds * dr2_dcx];
+            jacobian[1] = [du * ds * dr2_dcy, 1.0 - s + dv * ds * dr2_dcy];
+        }
+        let mut power = 1.0;
+        for j in 0..self.terms {
+            power *= r2;
+            jacobian[self.k_offset() + point.channel * self.terms + j] = [du * power, dv * power];
+        }
+
+        [du * s + cx, dv * s + cy]
+    }
+}
+
+/// Normal equations accumulated over a set of correspondences
+struct Normal {
+    jtj: [[f64; MAX_PARAMS]; MAX_PARAMS],
+    jtr: [f64; MAX_PARAMS],
+    cost: f64,
+}
+
+impl Normal {
+    fn zero() -> Self {
+        Self {
+            jtj: [[0.0; MAX_PARAMS]; MAX_PARAMS],
+            jtr: [0.0; MAX_PARAMS],
+            cost: 0.0,
+        }
+    }
+
+    fn add(&mut self, other: &Normal, n: usize) {
+        for i in 0..n {
+            for j in 0..n {
+                self.jtj[i][j] += other.jtj[i][j];
+            }
+            self.jtr[i] += other.jtr[i];
+        }
+        self.cost += other.cost;
+    }
+}
+
+fn fit_eye(points: &[LensCorrespondence], config: &LensFitConfig) -> DriverResult<EyeLensFit> {
+    let layout = Layout {
+        terms: config.terms,
+        fit_center: config.fit_center,
+        scale: [config.scale[0] as f64, config.scale[1] as f64],
+    };
+    let n = layout.len();
+    let center = [
+        config.initial_center[0] as f64,
+        config.initial_center[1] as f64,
+    ];
+
+    let threads = if config.threads == 0 {
+        std::thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1)
+    } else {
+        config.threads
+    };
+    let chunk = points.len().div_ceil(threads).max(256);
+
+    // Sum J^T J, J^T r and |r|^2 over all points, one partial sum per worker
+    let accumulate = |params: &[f64], with_jacobian: bool| -> Normal {
+        let partials: Vec<Normal> = std::thread::scope(|scope| {
+            let workers: Vec<_> = points
+                .chunks(chunk)
+                .map(|points| {
+                    scope.spawn(move || {
+                        let mut normal = Normal::zero();
+                        let mut jacobian = [[0.0; 2]; MAX_PARAMS];
+                        for point in points {
+                            let [pu, pv] = layout.evaluate(params, center, point, &mut jacobian);
+                            let r = [pu - point.source[0] as f64, pv - point.source[1] as f64];
+                            normal.cost += r[0] * r[0] + r[1] * r[1];
+                            if !with_jacobian {
+                                continue;
+                            }
+                            for i in 0..n {
+                                let ji = jacobian[i];
+                                if ji == [0.0; 2] {
+                                    continue;
+                                }
+                                normal.jtr[i] += ji[0] * r[0] + ji[1] * r[1];
+                                for j in i..n {
+                                    normal.jtj[i][j] +=
+                                        ji[0] * jacobian[j][0] + ji[1] * jacobian[j][1];
+                                }
+                            }
+                        }
+                        normal
+                    })
+                })
+                .collect();
+            workers
+                .into_iter()
+                .map(|worker| worker.join().expect("lens fit worker panicked"))
+                .collect()
+        });
+
+        let mut total = Normal::zero();
+        for partial in &partials {
+            total.add(partial, n);
+        }
+        for i in 0..n {
+            for j in 0..i {
+                total.jtj[i][j] = total.jtj[j][i];
+            }
+        }
+        total
+    };
+
+    let mut params = vec![0.0f64; n];
+    if layout.fit_center {
+        params[0] = center[0];
+        params[1] = center[1];
+    }
+
+    let mut lambda = 1.0e-3;
+    let mut normal = accumulate(&params, true);
+    let mut iterations = 0;
+
+    while iterations < config.max_iterations {
+        iterations += 1;
+
+        let mut system = normal.jtj;
+        for i in 0..n {
+            system[i][i] += lambda * normal.jtj[i][i].max(1.0e-12);
+        }
+        let rhs: Vec<f64> = normal.jtr[..n].iter().map(|g| -g).collect();
+        let Some(step) = solve(&mut system, rhs, n) else {
+            lambda *= 10.0;
+            if lambda > MAX_LAMBDA {
+                break;
+            }
+            continue;
+        };
+
+        let candidate: Vec<f64> = params.iter().zip(&step).map(|(p, d)| p + d).collect();
+        let trial = accumulate(&candidate, false);
+
+        if trial.cost < normal.cost {
+            let improvement = (normal.cost - trial.cost) / normal.cost.max(f64::MIN_POSITIVE);
+            params = candidate;
+            normal = accumulate(&params, true);
+            lambda = (lambda * 0.1).max(1.0e-12);
+            if improvement < config.tolerance {
+                break;
+            }
+        } else {
+            lambda *= 10.0;
+            if lambda > MAX_LAMBDA {
+                break;
+            }
+        }
+    }
+
+    // Residual statistics at the solution
+    let mut max_error = 0.0f64;
+    let mut jacobian = [[0.0; 2]; MAX_PARAMS];
+    for point in points {
+        let [pu, pv] = layout.evaluate(&params, center, point, &mut jacobian);
+        let error = (pu - point.source[0] as f64).hypot(pv - point.source[1] as f64);
+        max_error = max_error.max(error);
+    }
+    let rms_error = (normal.cost / points.len().max(1) as f64).sqrt();
+
+    let fitted_center = if layout.fit_center {
+        [params[0] as f32, params[1] as f32]
+    } else {
+        config.initial_center
+    };
+    let mut radial = [[0.0f32; MAX_TERMS]; 3];
+    for (channel, k) in radial.iter_mut().enumerate() {
+        for (j, kj) in k.iter_mut().take(layout.terms).enumerate() {
+            *kj = params[layout.k_offset() + channel * layout.terms + j] as f32;
+        }
+    }
+
+    Ok(EyeLensFit {
+        lens: LensDistortion {
+            model: LensModel::RadialPolynomial(radial),
+            center: fitted_center,
+            scale: config.scale,
+        },
+        rms_error: rms_error as f32,
+        max_error: max_error as f32,
+        samples: points.len(),
+        iterations,
+    })
+}
+
+/// Solve `a x = b` for the leading `n` x `n` block by Gaussian elimination
+fn solve(a: &mut [[f64; MAX_PARAMS]; MAX_PARAMS], mut b: Vec<f64>, n: usize) -> Option<Vec<f64>> {
+    for col in 0..n {
+        let pivot = (col..n).max_by(|&i, &j| a[i][col].abs().total_cmp(&a[j][col].abs()))?;
+        if a[pivot][col].abs() < 1.0e-300 {
+            return None;
+        }
+        a.swap(col, pivot);
+        b.swap(col, pivot);
+
+        for row in col + 1..n {
+            let factor = a[row][col] / a[col][col];
+            for k in col..n {
+                a[row][k] -= factor * a[col][k];
+            }
+            b[row] -= factor * b[col];
+        }
+    }
+
+    let mut x = vec![0.0; n];
+    for row in (0..n).rev() {
+        let sum: f64 = (row + 1..n).map(|k| a[row][k] * x[k]).sum();
+        x[row] = (b[row] - sum) / a[row][row];
+    }
+    x.iter().all(|v| v.is_finite()).then_some(x)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Correspondences sampled from a known lens, on a grid per eye and channel
+    fn synthesize(lens: &LensDistortion, per_channel: usize) -> Vec<LensCorrespondence> {
+        let side = (per_channel as f64).sqrt().ceil() as usize;
+        let mut out = Vec::new();
+        for eye in [Eye::Left, Eye::Right] {
+            for channel in 0..3 {
+                for i in 0..per_channel {
+                    let u = 0.05 + 0.9 * (i % side) as f32 / (side - 1) as f32;
+                    let v = 0.05 + 0.9 * (i / side) as f32 / (side - 1) as f32;
+                    let sample = lens.distort(u, v);
+                    out.push(LensCorrespondence {
+                        eye,
+                        channel,
+                        panel: [u, v],
+                        source: [sample[channel * 2], sample[channel * 2 + 1]],
+                    });
+                }
+            }
+        }
+        out
+    }
+
+    #[test]
+    fn recovers_known_coefficients_and_center() {
+        let truth = LensDistortion {
+            model: LensModel::RadialPolynomial([
+                [0.18, 0.040, 0.006, 0.0],
+                [0.20, 0.045, 0.007, 0.0],
+                [0.22, 0.050, 0.008, 0.0],
+            ]),
+            center: [0.52, 0.47],
+            scale: [2.0, 2.0],
+        };
+        let correspondences = synthesize(&truth, 1500);
+        assert_eq!(correspondences.len(), 9000);
+
+        let fit = fit_lenses(&correspondences, &LensFitConfig::default()).unwrap();
+        let LensModel::RadialPolynomial(expected) = truth.model else {
+            unreachable!()
+        };
+        for eye in [&fit.left, &fit.right] {
+            let LensModel::RadialPolynomial(k) = eye.lens.model else {
+                panic!("fit is not a radial polynomial");
+            };
+            for (fitted, expected) in k.iter().zip(&expected) {
+                for (a, b) in fitted.iter().zip(expected) {
+                    assert!((a - b).abs() < 1.0e-4, "coefficient {} != {}", a, b);
+                }
+            }
+            for (a, b) in eye.lens.center.iter().zip(truth.center) {
+                assert!((a - b).abs() < 1.0e-5, "center {} != {}", a, b);
+            }
+            assert!(eye.max_error < 1.0e-5, "max error {}", eye.max_error);
+        }
+    }
+
+    #[test]
+    fn gives_up_once_the_damping_saturates() {
+        let mut correspondences = synthesize(&LensDistortion::new(LensModel::Identity), 16);
+        correspondences.retain(|c| c.eye == Eye::Left);
+        correspondences[0].source[0] = f32::NAN;
+
+        let config = LensFitConfig {
+            max_iterations: 10_000,
+            ..Default::default()
+        };
+        let fit = fit_eye(&correspondences, &config).unwrap();
+        assert!(fit.iterations < 32, "ran {} iterations", fit.iterations);
+    }
+}
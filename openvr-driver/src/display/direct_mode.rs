@@ -0,0 +1,522 @@
+//! Swap texture set tracking for direct mode drivers
+//!
+//! `SwapTextureSetPool` records every swap texture set handed out through
+//! `IVRDriverDirectModeComponent::CreateSwapTextureSet` in a fixed array
+//! allocated up front. Lookups by texture handle and index rotation are
+//! plain atomic operations, so the per-frame `GetNextSwapTextureSetIndex`
+//! and `SubmitLayer` calls never lock or allocate.
+//!
+//! `StandInCompositor` drives a direct mode vtable the way vrserver does, so
+//! a component can be exercised without a GPU or SteamVR.
+
+use crate::interfaces::{DirectModeFrameTiming, SwapTextureSet, SwapTextureSetDesc};
+use crate::{sys, HmdMatrix34};
+use std::ffi::c_void;
+use std::sync::atomic::{AtomicU32, AtomicU64, Ordering};
+use std::sync::Arc;
+
+/// Textures per swap texture set
+pub const SWAP_TEXTURE_COUNT: u32 = 3;
+
+const FREE: u32 = 0;
+const RESERVED: u32 = 1;
+const LIVE: u32 = 2;
+
+/// One pool slot, on its own cache line
+#[repr(align(64))]
+#[derive(Default)]
+struct PoolEntry {
+    state: AtomicU32,
+    pid: AtomicU32,
+    flags: AtomicU32,
+    /// Texture index the application renders into next
+    index: AtomicU32,
+    handles: [AtomicU64; 3],
+}
+
+impl PoolEntry {
+    fn set(&self) -> SwapTextureSet {
+        SwapTextureSet {
+            handles: [
+                self.handles[0].load(Ordering::Relaxed),
+                self.handles[1].load(Ordering::Relaxed),
+                self.handles[2].load(Ordering::Relaxed),
+            ],
+            flags: self.flags.load(Ordering::Relaxed),
+        }
+    }
+
+    /// Position of `handle` in this set, if it belongs to it
+    #[inline]
+    fn position(&self, handle: u64) -> Option<u32> {
+        if self.state.load(Ordering::Acquire) != LIVE {
+            return None;
+        }
+        self.handles
+            .iter()
+            .position(|h| h.load(Ordering::Relaxed) == handle)
+            .map(|i| i as u32)
+    }
+}
+
+/// Where a shared texture handle lives in the pool
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct SwapTextureRef {
+    /// Pool slot of the set
+    pub slot: usize,
+    /// Process the set was created for
+    pub pid: u32,
+    /// Position of the handle within its set
+    pub texture_index: u32,
+}
+
+/// Fixed-capacity registry of live swap texture sets
+///
+/// Cloning shares the same pool.
+#[derive(Clone)]
+pub struct SwapTextureSetPool(Arc<[PoolEntry]>);
+
+impl SwapTextureSetPool {
+    /// Default number of sets a pool can hold
+    pub const DEFAULT_CAPACITY: usize = 64;
+
+    /// Allocate a pool for up to `capacity` sets
+    pub fn new(capacity: usize) -> Self {
+        Self((0..capacity.max(1)).map(|_| PoolEntry::default()).collect())
+    }
+
+    /// Maximum number of live sets
+    pub fn capacity(&self) -> usize {
+        self.0.len()
+    }
+
+    /// Number of live sets
+    pub fn len(&self) -> usize {
+        self.0
+            .iter()
+            .filter(|entry| entry.state.load(Ordering::Acquire) == LIVE)
+            .count()
+    }
+
+    /// Whether no sets are live
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Number of live sets owned by `pid`
+    pub fn sets_for_pid(&self, pid: u32) -> usize {
+        self.0
+            .iter()
+            .filter(|entry| {
+                entry.state.load(Ordering::Acquire) == LIVE
+                    && entry.pid.load(Ordering::Relaxed) == pid
+            })
+            .count()
+    }
+
+    /// Find the set a shared texture handle belongs to
+    #[inline]
+    pub fn lookup(&self, handle: sys::root::vr::SharedTextureHandle_t) -> Option<SwapTextureRef> {
+        if handle == 0 {
+            return None;
+        }
+        self.0.iter().enumerate().find_map(|(slot, entry)| {
+            entry.position(handle).map(|texture_index| SwapTextureRef {
+                slot,
+                pid: entry.pid.load(Ordering::Relaxed),
+                texture_index,
+            })
+        })
+    }
+
+    /// Texture index the application renders into next for a slot
+    pub fn current_index(&self, slot: usize) -> Option<u32> {
+        let entry = self.0.get(slot)?;
+        (entry.state.load(Ordering::Acquire) == LIVE).then(|| entry.index.load(Ordering::Relaxed))
+    }
+
+    /// Claim a free slot before the textures are created
+    pub(crate) fn reserve(&self) -> Option<usize> {
+        self.0.iter().position(|entry| {
+            entry
+                .state
+                .compare_exchange(FREE, RESERVED, Ordering::Acquire, Ordering::Relaxed)
+                .is_ok()
+        })
+    }
+
+    /// Make a reserved slot visible with its textures
+    pub(crate) fn publish(&self, slot: usize, pid: u32, set: &SwapTextureSet) {
+        let entry = &self.0[slot];
+        entry.pid.store(pid, Ordering::Relaxed);
+        entry.flags.store(set.flags, Ordering::Relaxed);
+        entry.index.store(0, Ordering::Relaxed);
+        for (stored, handle) in entry.handles.iter().zip(set.handles) {
+            stored.store(handle, Ordering::Relaxed);
+        }
+        entry.state.store(LIVE, Ordering::Release);
+    }
+
+    /// Return a reserved slot that was never published
+    pub(crate) fn unreserve(&self, slot: usize) {
+        self.0[slot].state.store(FREE, Ordering::Release);
+    }
+
+    /// Remove the set in `slot`, returning it if this call removed it
+    pub(crate) fn take(&self, slot: usize) -> Option<SwapTextureSet> {
+        let entry = &self.0[slot];
+        // Only one caller wins the right to destroy a set
+        entry
+            .state
+            .compare_exchange(LIVE, RESERVED, Ordering::AcqRel, Ordering::Relaxed)
+            .ok()?;
+        let set = entry.set();
+        for handle in &entry.handles {
+            handle.store(0, Ordering::Relaxed);
+        }
+        entry.state.store(FREE, Ordering::Release);
+        Some(set)
+    }
+
+    /// Slots of all live sets owned by `pid`
+    pub(crate) fn slots_for_pid(&self, pid: u32) -> impl Iterator<Item = usize> + '_ {
+        self.0.iter().enumerate().filter_map(move |(slot, entry)| {
+            (entry.state.load(Ordering::Acquire) == LIVE
+                && entry.pid.load(Ordering::Relaxed) == pid)
+                .then_some(slot)
+        })
+    }
+
+    /// Move a slot to its next texture and return the new index
+    #[inline]
+    pub(crate) fn advance(&self, slot: usize) -> u32 {
+        let index = &self.0[slot].index;
+        let previous = index
+            .fetch_update(Ordering::AcqRel, Ordering::Relaxed, |i| {
+                Some((i + 1) % SWAP_TEXTURE_COUNT)
+            })
+            .unwrap_or(0);
+        (previous + 1) % SWAP_TEXTURE_COUNT
+    }
+}
+
+impl Default for SwapTextureSetPool {
+    fn default() -> Self {
+        Self::new(Self::DEFAULT_CAPACITY)
+    }
+}
+
+/// Drives an `IVRDriverDirectModeComponent` vtable like vrserver does
+///
+/// Every call goes through the C ABI, so this exercises the same thunks the
+/// runtime would, with made-up texture handles and no GPU.
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::display::StandInCompositor;
+/// use openvr_driver::interfaces::{DriverDirectModeExt, SwapTextureSetDesc};
+/// # fn example(component: std::sync::Arc<impl DriverDirectModeExt>) {
+/// let compositor = unsafe { StandInCompositor::new(component.create_direct_mode_vtable()) };
+/// let desc = SwapTextureSetDesc { width: 2016, height: 2240, format: 29, sample_count: 1 };
+/// let left = compositor.create_swap_texture_set(1234, &desc);
+/// let right = compositor.create_swap_texture_set(1234, &desc);
+/// for _ in 0..90 {
+///     compositor.submit_frame(&left, &right, &openvr_driver::HmdMatrix34 { m: [[0.0; 4]; 3] });
+/// }
+/// compositor.destroy_all_swap_texture_sets(1234);
+/// # }
+/// ```
+pub struct StandInCompositor {
+    component: *mut sys::root::vr::IVRDriverDirectModeComponent,
+}
+
+impl StandInCompositor {
+    /// Wrap a vtable returned by `create_direct_mode_vtable`
+    ///
+    /// # Safety
+    /// `vtable` must be a live `IVRDriverDirectModeComponent` pointer.
+    pub unsafe fn new(vtable: *mut c_void) -> Self {
+        Self {
+            component: vtable as *mut sys::root::vr::IVRDriverDirectModeComponent,
+        }
+    }
+
+    #[inline]
+    fn vtable(&self) -> &sys::root::vr::IVRDriverDirectModeComponent__bindgen_vtable {
+        unsafe { &*(*self.component).vtable_ }
+    }
+
+    /// `CreateSwapTextureSet`
+    pub fn create_swap_texture_set(&self, pid: u32, desc: &SwapTextureSetDesc) -> SwapTextureSet {
+        let raw_desc = sys::root::vr::IVRDriverDirectModeComponent_SwapTextureSetDesc_t {
+            nWidth: desc.width,
+            nHeight: desc.height,
+            nFormat: desc.format,
+            nSampleCount: desc.sample_count,
+        };
+        let mut raw_set: sys::root::vr::IVRDriverDirectModeComponent_SwapTextureSet_t =
+            unsafe { std::mem::zeroed() };
+        unsafe {
+            (self
+                .vtable()
+                .IVRDriverDirectModeComponent_CreateSwapTextureSet)(
+                self.component,
+                pid,
+                &raw_desc,
+                &mut raw_set,
+            );
+        }
+        SwapTextureSet {
+            handles: raw_set.rSharedTextureHandles,
+            flags: raw_set.unTextureFlags,
+        }
+    }
+
+    /// `DestroySwapTextureSet`
+    pub fn destroy_swap_texture_set(&self, handle: sys::root::vr::SharedTextureHandle_t) {
+        unsafe {
+            (self
+                .vtable()
+                .IVRDriverDirectModeComponent_DestroySwapTextureSet)(
+                self.component, handle
+            );
+        }
+    }
+
+    /// `DestroyAllSwapTextureSets`
+    pub fn destroy_all_swap_texture_sets(&self, pid: u32) {
+        unsafe {
+            (self
+                .vtable()
+                .IVRDriverDirectModeComponent_DestroyAllSwapTextureSets)(
+                self.component, pid
+            );
+        }
+    }
+
+    /// `GetNextSwapTextureSetIndex` for a left and right set
+    pub fn next_indices(&self, left: &SwapTextureSet, right: &SwapTextureSet) -> [u32; 2] {
+        let mut handles = [left.handles[0], right.handles[0]];
+        let mut indices = [0u32; 2];
+        unsafe {
+            (self
+                .vtable()
+                .IVRDriverDirectModeComponent_GetNextSwapTextureSetIndex)(
+                self.component,
+                handles.as_mut_ptr(),
+                &mut indices,
+            );
+        }
+        indices
+    }
+
+    /// Run one frame: pick textures, submit a layer, present and read timing
+    pub fn submit_frame(
+        &self,
+        left: &SwapTextureSet,
+        right: &SwapTextureSet,
+        pose: &HmdMatrix34,
+    ) -> DirectModeFrameTiming {
+        let [left_index, right_index] = self.next_indices(left, right);
+        let eye = |texture| sys::root::vr::IVRDriverDirectModeComponent_SubmitLayerPerEye_t {
+            hTexture: texture,
+            hDepthTexture: 0,
+            bounds: sys::root::vr::VRTextureBounds_t {
+                uMin: 0.0,
+                vMin: 0.0,
+                uMax: 1.0,
+                vMax: 1.0,
+            },
+            mProjection: unsafe { std::mem::zeroed() },
+            mHmdPose: *pose,
+            flHmdPosePredictionTimeInSecondsFromNow: 0.0,
+        };
+        let layer = [
+            eye(left.handles[left_index as usize]),
+            eye(right.handles[right_index as usize]),
+        ];
+        let throttling = sys::root::vr::IVRDriverDirectModeComponent_Throttling_t {
+            nFramesToThrottle: 0,
+            nAdditionalFramesToPredict: 0,
+        };
+        let mut timing: sys::root::vr::DriverDirectMode_FrameTiming = unsafe { std::mem::zeroed() };
+        timing.m_nSize = std::mem::size_of::<sys::root::vr::DriverDirectMode_FrameTiming>() as u32;
+
+        let vtable = self.vtable();
+        unsafe {
+            (vtable.IVRDriverDirectModeComponent_SubmitLayer)(self.component, &layer);
+            (vtable.IVRDriverDirectModeComponent_Present)(self.component, layer[0].hTexture);
+            (vtable.IVRDriverDirectModeComponent_PostPresent)(self.component, &throttling);
+            (vtable.IVRDriverDirectModeComponent_GetFrameTiming)(self.component, &mut timing);
+        }
+
+        DirectModeFrameTiming {
+            num_frame_presents: timing.m_nNumFramePresents,
+            num_mis_presented: timing.m_nNumMisPresented,
+            num_dropped_frames: timing.m_nNumDroppedFrames,
+            reprojection_flags: timing.m_nReprojectionFlags,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::interfaces::{DriverDirectModeComponent, DriverDirectModeExt, LayerEye};
+    use std::sync::Mutex;
+
+    const PID: u32 = 4321;
+    const DESC: SwapTextureSetDesc = SwapTextureSetDesc {
+        width: 64,
+        height: 64,
+        format: 29,
+        sample_count: 1,
+    };
+
+    /// Hands out sequential fake handles and records what the thunks pass on
+    #[derive(Default)]
+    struct FakeComponent {
+        next_handle: AtomicU64,
+        destroyed: Mutex<Vec<SwapTextureSet>>,
+        submitted: Mutex<Vec<u64>>,
+        presents: AtomicU32,
+    }
+
+    impl DriverDirectModeComponent for FakeComponent {
+        fn create_swap_texture_set(
+            &self,
+            _pid: u32,
+            _desc: &SwapTextureSetDesc,
+        ) -> Option<SwapTextureSet> {
+            let first = self.next_handle.fetch_add(3, Ordering::Relaxed) + 1;
+            Some(SwapTextureSet {
+                handles: [first, first + 1, first + 2],
+                flags: 0,
+            })
+        }
+
+        fn destroy_swap_texture_set(&self, set: &SwapTextureSet) {
+            self.destroyed.lock().unwrap().push(*set);
+        }
+
+        fn submit_layer(&self, per_eye: &[LayerEye; 2]) {
+            let mut submitted = self.submitted.lock().unwrap();
+            submitted.extend(per_eye.iter().map(|eye| eye.texture));
+        }
+
+        fn present(&self, _sync_texture: u64) {}
+
+        fn get_frame_timing(&self, timing: &mut DirectModeFrameTiming) {
+            timing.num_frame_presents = self.presents.fetch_add(1, Ordering::Relaxed) + 1;
+            timing.reprojection_flags = 0;
+        }
+    }
+
+    fn compositor() -> (Arc<FakeComponent>, StandInCompositor) {
+        let component = Arc::new(FakeComponent::default());
+        let compositor =
+            unsafe { StandInCompositor::new(component.clone().create_direct_mode_vtable()) };
+        (component, compositor)
+    }
+
+    fn raw_next_indices(
+        compositor: &StandInCompositor,
+        mut handles: [u64; 2],
+        mut indices: [u32; 2],
+    ) -> [u32; 2] {
+        unsafe {
+            (compositor
+                .vtable()
+                .IVRDriverDirectModeComponent_GetNextSwapTextureSetIndex)(
+                compositor.component,
+                handles.as_mut_ptr(),
+                &mut indices,
+            );
+        }
+        indices
+    }
+
+    #[test]
+    fn sets_rotate_and_destroy_through_thunks() {
+        let (component, compositor) = compositor();
+        let left = compositor.create_swap_texture_set(PID, &DESC);
+        let right = compositor.create_swap_texture_set(PID, &DESC);
+        assert_ne!(left.handles, right.handles);
+
+        let pose = HmdMatrix34 { m: [[0.0; 4]; 3] };
+        for frame in 0..4u32 {
+            let timing = compositor.submit_frame(&left, &right, &pose);
+            assert_eq!(timing.num_frame_presents, frame + 1);
+            let expected = ((frame + 1) % SWAP_TEXTURE_COUNT) as usize;
+            let submitted = component.submitted.lock().unwrap();
+            assert_eq!(
+                submitted[submitted.len() - 2..],
+                [left.handles[expected], right.handles[expected]]
+            );
+        }
+
+        // One set shared by both eyes advances once per frame
+        assert_eq!(compositor.next_indices(&left, &left), [2, 2]);
+
+        compositor.destroy_swap_texture_set(left.handles[1]);
+        compositor.destroy_swap_texture_set(left.handles[0]);
+        assert_eq!(*component.destroyed.lock().unwrap(), [left]);
+
+        compositor.destroy_all_swap_texture_sets(PID + 1);
+        assert_eq!(component.destroyed.lock().unwrap().len(), 1);
+        compositor.destroy_all_swap_texture_sets(PID);
+        assert_eq!(*component.destroyed.lock().unwrap(), [left, right]);
+    }
+
+    #[test]
+    fn unknown_handles_keep_caller_indices() {
+        let (_component, compositor) = compositor();
+        let set = compositor.create_swap_texture_set(PID, &DESC);
+
+        assert_eq!(raw_next_indices(&compositor, [999, 0], [2, 1]), [2, 1]);
+        assert_eq!(
+            raw_next_indices(&compositor, [999, set.handles[0]], [2, 2]),
+            [2, 1]
+        );
+        assert_eq!(
+            raw_next_indices(&compositor, [set.handles[0], 999], [0, 0]),
+            [2, 0]
+        );
+    }
+
+    #[test]
+    fn frame_timing_respects_struct_size() {
+        let (_component, compositor) = compositor();
+        let get_frame_timing = |timing: &mut sys::root::vr::DriverDirectMode_FrameTiming| unsafe {
+            (compositor
+                .vtable()
+                .IVRDriverDirectModeComponent_GetFrameTiming)(
+                compositor.component, timing
+            );
+        };
+        let filled = |size: usize| sys::root::vr::DriverDirectMode_FrameTiming {
+            m_nSize: size as u32,
+            m_nNumFramePresents: 0xdead,
+            m_nNumMisPresented: 0xdead,
+            m_nNumDroppedFrames: 0xdead,
+            m_nReprojectionFlags: 0x100,
+        };
+
+        // Full struct: the reprojection flags come back cleared
+        let mut timing = filled(std::mem::size_of::<
+            sys::root::vr::DriverDirectMode_FrameTiming,
+        >());
+        get_frame_timing(&mut timing);
+        assert_eq!(timing.m_nNumFramePresents, 1);
+        assert_eq!(timing.m_nNumMisPresented, 0xdead);
+        assert_eq!(timing.m_nReprojectionFlags, 0);
+
+        // A runtime whose struct ends before the flags gets only its fields
+        let mut timing = filled(8);
+        get_frame_timing(&mut timing);
+        assert_eq!(timing.m_nNumFramePresents, 2);
+        assert_eq!(timing.m_nNumMisPresented, 0xdead);
+        assert_eq!(timing.m_nReprojectionFlags, 0x100);
+    }
+}
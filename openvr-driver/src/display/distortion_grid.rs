@@ -0,0 +1,379 @@
+//! Precomputed distortion lookup grid
+//!
+//! vrserver builds its distortion mesh by calling `ComputeDistortion` tens of
+//! thousands of times. When the lens model is expensive, the display vtable
+//! can instead evaluate it once over a regular grid (in parallel across
+//! cores) and answer every query by bilinear interpolation. Grids can be
+//! persisted to disk, keyed by a hash of the lens parameters, so later
+//! startups skip evaluation entirely.
+
+use crate::{DriverError, DriverResult, Eye};
+use std::fs;
+use std::io::{self, Read, Write};
+use std::path::{Path, PathBuf};
+
+/// File magic for persisted grids
+const GRID_MAGIC: &[u8; 8] = b"OVRDGRID";
+
+/// Persisted grid format version
+const GRID_VERSION: u32 = 1;
+
+/// Distorted coordinates for one sample: red u/v, green u/v, blue u/v
+pub type DistortionSample = [f32; 6];
+
+/// Configuration for serving `compute_distortion` from a grid
+#[derive(Debug, Clone)]
+pub struct DistortionCacheConfig {
+    /// Samples across u (at least 2)
+    pub grid_width: u32,
+    /// Samples across v (at least 2)
+    pub grid_height: u32,
+    /// Worker threads used for evaluation (0 for one per core)
+    pub threads: usize,
+    /// Directory to persist grids in, or `None` to keep them in memory only
+    ///
+    /// Requires `lens_parameters`; building a grid fails without them.
+    pub cache_dir: Option<PathBuf>,
+    /// Lens parameters identifying the model; a grid is reused from disk
+    /// only if these hash to the same key
+    pub lens_parameters: Vec<f32>,
+}
+
+impl Default for DistortionCacheConfig {
+    fn default() -> Self {
+        Self {
+            grid_width: 65,
+            grid_height: 65,
+            threads: 0,
+            cache_dir: None,
+            lens_parameters: Vec::new(),
+        }
+    }
+}
+
+impl DistortionCacheConfig {
+    /// Key identifying a grid built with this configuration
+    pub fn cache_key(&self) -> u64 {
+        let mut hash = Fnv1a::new();
+        hash.write_u32(self.grid_width);
+        hash.write_u32(self.grid_height);
+        for param in &self.lens_parameters {
+            hash.write_u32(param.to_bits());
+        }
+        hash.finish()
+    }
+
+    /// Path a grid with this configuration is persisted to, if persistence is enabled
+    pub fn cache_path(&self) -> Option<PathBuf> {
+        self.cache_dir
+            .as_ref()
+            .map(|dir| dir.join(format!("distortion-{:016x}.grid", self.cache_key())))
+    }
+}
+
+/// FNV-1a, used for cache keys because it is stable across builds
+pub(crate) struct Fnv1a(u64);
+
+impl Fnv1a {
+    pub(crate) fn new() -> Self {
+        Self(0xcbf2_9ce4_8422_2325)
+    }
+
+    pub(crate) fn write(&mut self, bytes: &[u8]) {
+        for byte in bytes {
+            self.0 ^= *byte as u64;
+            self.0 = self.0.wrapping_mul(0x0000_0100_0000_01b3);
+        }
+    }
+
+    pub(crate) fn write_u32(&mut self, value: u32) {
+        self.write(&value.to_le_bytes());
+    }
+
+    pub(crate) fn finish(&self) -> u64 {
+        self.0
+    }
+}
+
+/// Distortion model sampled over a regular UV grid for both eyes
+#[derive(Debug, Clone)]
+pub struct DistortionGrid {
+    width: u32,
+    height: u32,
+    /// Row-major samples per eye, indexed by `Eye as usize`
+    samples: [Vec<DistortionSample>; 2],
+}
+
+impl DistortionGrid {
+    /// Evaluate a distortion function over a `width` x `height` grid
+    ///
+    /// Rows are split across `threads` workers (0 for one per core).
+    pub fn evaluate<F>(width: u32, height: u32, threads: usize, distortion: F) -> DriverResult<Self>
+    where
+        F: Fn(Eye, f32, f32) -> DistortionSample + Sync,
+    {
+        Self::evaluate_rows(width, height, threads, |eye, u, v, out| {
+            for (u, sample) in u.iter().zip(out.iter_mut()) {
+                *sample = distortion(eye, *u, v);
+            }
+        })
+    }
+
+    /// Evaluate a row-at-a-time distortion function over a `width` x `height` grid
+    ///
+    /// `distortion(eye, u, v, out)` fills `out[i]` with the distortion at
+    /// `(u[i], v)`, which lets batch (SIMD) models process a whole row per call.
+    pub fn evaluate_rows<F>(
+        width: u32,
+        height: u32,
+        threads: usize,
+        distortion: F,
+    ) -> DriverResult<Self>
+    where
+        F: Fn(Eye, &[f32], f32, &mut [DistortionSample]) + Sync,
+    {
+        if width < 2 || height < 2 {
+            return Err(DriverError::invalid_parameter(
+                "Distortion grid needs at least 2x2 samples",
+            ));
+        }
+
+        let threads = if threads == 0 {
+            std::thread::available_parallelism()
+                .map(|n| n.get())
+                .unwrap_or(1)
+        } else {
+            threads
+        };
+
+        let row_len = width as usize;
+        let du = 1.0 / (width - 1) as f32;
+        let dv = 1.0 / (height - 1) as f32;
+        let u: Vec<f32> = (0..row_len).map(|x| x as f32 * du).collect();
+
+        let evaluate_eye = |eye: Eye| -> Vec<DistortionSample> {
+            let mut samples = vec![[0.0f32; 6]; row_len * height as usize];
+            let rows_per_worker = (height as usize).div_ceil(threads).max(1);
+
+            std::thread::scope(|scope| {
+                for (chunk_index, chunk) in
+                    samples.chunks_mut(rows_per_worker * row_len).enumerate()
+                {
+                    let distortion = &distortion;
+                    let u = &u;
+                    scope.spawn(move || {
+                        let first_row = chunk_index * rows_per_worker;
+                        for (offset, row) in chunk.chunks_mut(row_len).enumerate() {
+                            let v = (first_row + offset) as f32 * dv;
+                            distortion(eye, u, v, row);
+                        }
+                    });
+                }
+            });
+
+            samples
+        };
+
+        Ok(Self {
+            width,
+            height,
+            samples: [evaluate_eye(Eye::Left), evaluate_eye(Eye::Right)],
+        })
+    }
+
+    /// Load a grid for this configuration from disk, or evaluate and persist it
+    pub fn load_or_evaluate<F>(config: &DistortionCacheConfig, distortion: F) -> DriverResult<Self>
+    where
+        F: Fn(Eye, f32, f32) -> DistortionSample + Sync,
+    {
+        Self::load_or_build(config, || {
+            Self::evaluate(
+                config.grid_width,
+                config.grid_height,
+                config.threads,
+                distortion,
+            )
+        })
+    }
+
+    /// Load a grid for this configuration from disk, or evaluate it row by row and persist it
+    pub fn load_or_evaluate_rows<F>(
+        config: &DistortionCacheConfig,
+        distortion: F,
+    ) -> DriverResult<Self>
+    where
+        F: Fn(Eye, &[f32], f32, &mut [DistortionSample]) + Sync,
+    {
+        Self::load_or_build(config, || {
+            Self::evaluate_rows(
+                config.grid_width,
+                config.grid_height,
+                config.threads,
+                distortion,
+            )
+        })
+    }
+
+    fn load_or_build(
+        config: &DistortionCacheConfig,
+        build: impl FnOnce() -> DriverResult<Self>,
+    ) -> DriverResult<Self> {
+        // Without parameters every lens at this grid size shares one key, so
+        // a persisted grid could belong to a different lens
+        if config.cache_dir.is_some() && config.lens_parameters.is_empty() {
+            return Err(DriverError::invalid_parameter(
+                "Persisting a distortion grid requires lens_parameters to identify the lens",
+            ));
+        }
+
+        let path = config.cache_path();
+
+        if let Some(path) = &path {
+            match Self::load(path, config.cache_key()) {
+                Ok(grid)
+                    if grid.width == config.grid_width && grid.height == config.grid_height =>
+                {
+                    return Ok(grid);
+                }
+                Ok(_) => {}
+                Err(e) if e.kind() == io::ErrorKind::NotFound => {}
+                Err(e) => {
+                    eprintln!(
+                        "[DistortionGrid] Ignoring unreadable cache {}: {}",
+                        path.display(),
+                        e
+                    );
+                }
+            }
+        }
+
+        let grid = build()?;
+
+        if let Some(path) = &path {
+            if let Err(e) = grid.save(path, config.cache_key()) {
+                eprintln!(
+                    "[DistortionGrid] Failed to persist cache {}: {}",
+                    path.display(),
+                    e
+                );
+            }
+        }
+
+        Ok(grid)
+    }
+
+    /// Grid dimensions as (width, height)
+    pub fn dimensions(&self) -> (u32, u32) {
+        (self.width, self.height)
+    }
+
+    /// Interpolate the distortion at (u, v)
+    ///
+    /// Coordinates outside 0..1 are clamped to the grid edge.
+    #[inline]
+    pub fn sample(&self, eye: Eye, u: f32, v: f32) -> DistortionSample {
+        let samples = &self.samples[eye as usize];
+        let max_x = (self.width - 1) as f32;
+        let max_y = (self.height - 1) as f32;
+
+        // f32::max discards NaN, so NaN inputs land on the grid origin
+        let fx = u.max(0.0).min(1.0) * max_x;
+        let fy = v.max(0.0).min(1.0) * max_y;
+
+        let x0 = (fx as u32).min(self.width - 2);
+        let y0 = (fy as u32).min(self.height - 2);
+        let tx = fx - x0 as f32;
+        let ty = fy - y0 as f32;
+
+        let row = self.width as usize;
+        let i00 = y0 as usize * row + x0 as usize;
+        let s00 = &samples[i00];
+        let s10 = &samples[i00 + 1];
+        let s01 = &samples[i00 + row];
+        let s11 = &samples[i00 + row + 1];
+
+        let mut out = [0.0f32; 6];
+        for c in 0..6 {
+            let top = s00[c] + (s10[c] - s00[c]) * tx;
+            let bottom = s01[c] + (s11[c] - s01[c]) * tx;
+            out[c] = top + (bottom - top) * ty;
+        }
+        out
+    }
+
+    /// Persist the grid under `key`
+    ///
+    /// The file is written next to its destination and renamed into place so
+    /// a concurrent reader never sees a partial grid.
+    pub fn save(&self, path: &Path, key: u64) -> io::Result<()> {
+        if let Some(dir) = path.parent() {
+            fs::create_dir_all(dir)?;
+        }
+
+        let mut bytes = Vec::with_capacity(32 + self.samples[0].len() * 2 * 24);
+        bytes.extend_from_slice(GRID_MAGIC);
+        bytes.extend_from_slice(&GRID_VERSION.to_le_bytes());
+        bytes.extend_from_slice(&key.to_le_bytes());
+        bytes.extend_from_slice(&self.width.to_le_bytes());
+        bytes.extend_from_slice(&self.height.to_le_bytes());
+        for eye in &self.samples {
+            for sample in eye {
+                for value in sample {
+                    bytes.extend_from_slice(&value.to_le_bytes());
+                }
+            }
+        }
+
+        let tmp = path.with_extension("tmp");
+        fs::File::create(&tmp)?.write_all(&bytes)?;
+        fs::rename(&tmp, path)
+    }
+
+    /// Load a grid persisted under `key`
+    pub fn load(path: &Path, key: u64) -> io::Result<Self> {
+        let mut bytes = Vec::new();
+        fs::File::open(path)?.read_to_end(&mut bytes)?;
+
+        let invalid = |msg: &str| io::Error::new(io::ErrorKind::InvalidData, msg.to_string());
+        let header_len = 8 + 4 + 8 + 4 + 4;
+        if bytes.len() < header_len || &bytes[0..8] != GRID_MAGIC {
+            return Err(invalid("not a distortion grid"));
+        }
+
+        let read_u32 = |at: usize| u32::from_le_bytes(bytes[at..at + 4].try_into().unwrap());
+        if read_u32(8) != GRID_VERSION {
+            return Err(invalid("unsupported grid version"));
+        }
+        if u64::from_le_bytes(bytes[12..20].try_into().unwrap()) != key {
+            return Err(invalid("grid was built for different lens parameters"));
+        }
+
+        let width = read_u32(20);
+        let height = read_u32(24);
+        if width < 2 || height < 2 {
+            return Err(invalid("grid dimensions too small"));
+        }
+
+        let count = width as usize * height as usize;
+        if bytes.len() != header_len + count * 2 * 24 {
+            return Err(invalid("grid data truncated"));
+        }
+
+        let mut values = bytes[header_len..]
+            .chunks_exact(4)
+            .map(|b| f32::from_le_bytes(b.try_into().unwrap()));
+        let mut read_eye = || -> Vec<DistortionSample> {
+            (0..count)
+                .map(|_| std::array::from_fn(|_| values.next().unwrap()))
+                .collect()
+        };
+        let left = read_eye();
+        let right = read_eye();
+
+        Ok(Self {
+            width,
+            height,
+            samples: [left, right],
+        })
+    }
+}
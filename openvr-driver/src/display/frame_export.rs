@@ -0,0 +1,875 @@
+//! Presented-frame export to an out-of-process encoder
+//!
+//! `FrameExporter` publishes a small descriptor for every presented frame
+//! (the shared backbuffer handle, the compositor frame id, vsync timing and
+//! the pose it was rendered for) into a ring of slots in a sealed memfd. The
+//! encoder process maps the same memfd with `FrameConsumer` and imports the
+//! texture itself; no pixels pass through the driver and descriptors are
+//! written in place in the shared mapping.
+//!
+//! The ring is bounded. When the encoder falls behind, the configured
+//! `ExportDropPolicy` either overwrites the oldest unread frame, refuses the
+//! new one, or blocks the presenting thread for a bounded time. Consumers are
+//! woken through a futex on the shared header or an eventfd.
+//!
+//! # Shared layout
+//!
+//! The memfd holds a 192-byte header followed by `slot_count` 128-byte
+//! slots, all `repr(C)` and described by `EXPORT_MAGIC`/`EXPORT_VERSION`.
+//! Slots follow the `StampedRing` protocol: each carries a stamp,
+//! `2 * sequence + 1` while being written and `2 * sequence + 2` once
+//! complete, so a reader can tell a torn or overwritten slot from a finished
+//! one.
+
+use super::pipeline::{StampedRing, StampedSlot, WhenFull};
+use crate::{DriverError, DriverResult, HmdMatrix34, PresentInfo};
+use std::os::fd::{AsFd, AsRawFd, BorrowedFd, FromRawFd, OwnedFd};
+use std::sync::atomic::{fence, AtomicBool, AtomicU32, AtomicU64, Ordering};
+use std::sync::Arc;
+use std::thread::{self, JoinHandle};
+use std::time::{Duration, Instant};
+
+/// Identifies a frame export mapping ("OVFX")
+pub const EXPORT_MAGIC: u32 = 0x5846_564f;
+/// Layout version of the frame export mapping
+pub const EXPORT_VERSION: u32 = 1;
+
+/// What to do with a new frame when every slot is unread
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum ExportDropPolicy {
+    /// Overwrite the oldest unread frame; the encoder always gets the latest
+    DropOldest,
+    /// Keep the queued frames and drop the new one
+    DropNewest,
+    /// Wait up to the given time for the encoder, then drop the new frame
+    Block(Duration),
+}
+
+/// How a waiting consumer is woken
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub enum ExportSignal {
+    /// Futex on the shared header; needs nothing besides the memfd
+    #[default]
+    Futex,
+    /// An eventfd handed to the consumer along with the memfd
+    EventFd,
+}
+
+/// Configuration for `FrameExporter`
+#[derive(Debug, Clone)]
+pub struct FrameExportConfig {
+    /// Frames buffered between the driver and the encoder
+    pub slots: u32,
+    /// Behaviour when the ring is full
+    pub policy: ExportDropPolicy,
+    /// Consumer wakeup mechanism
+    pub signal: ExportSignal,
+    /// memfd name, visible in `/proc/<pid>/fd`
+    pub name: String,
+}
+
+impl Default for FrameExportConfig {
+    fn default() -> Self {
+        Self {
+            slots: 4,
+            policy: ExportDropPolicy::DropOldest,
+            signal: ExportSignal::default(),
+            name: "openvr-frame-export".to_string(),
+        }
+    }
+}
+
+/// Frame descriptor as stored in a slot
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct ExportedFrame {
+    /// Position in the export stream; gaps mean dropped frames
+    pub sequence: u64,
+    /// Compositor frame index from `PresentInfo_t`
+    pub frame_id: u64,
+    /// Shared handle of the backbuffer texture
+    pub backbuffer: u64,
+    /// Vsync time the frame targets, from `PresentInfo_t`
+    pub vsync_time_seconds: f64,
+    /// `CLOCK_MONOTONIC` time of the present, in nanoseconds
+    pub present_time_ns: u64,
+    /// Virtual display vsync counter at present time
+    pub vsync_counter: u64,
+    /// Head pose the frame was rendered for
+    pub pose: HmdMatrix34,
+    /// `EVSync` value from `PresentInfo_t`
+    pub vsync: u32,
+    _reserved: u32,
+}
+
+impl ExportedFrame {
+    /// Nanoseconds between the present and `now_ns` on `CLOCK_MONOTONIC`
+    pub fn age_ns(&self, now_ns: u64) -> u64 {
+        now_ns.saturating_sub(self.present_time_ns)
+    }
+}
+
+/// Outcome of `FrameExporter::publish`
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum PublishResult {
+    /// The frame was queued
+    Published { sequence: u64 },
+    /// The frame was queued over the oldest unread frame
+    ReplacedOldest { sequence: u64, dropped: u64 },
+    /// The frame was dropped
+    Dropped,
+}
+
+/// Producer-side counters
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct FrameExportStats {
+    /// Frames written to the ring
+    pub published: u64,
+    /// Unread frames overwritten under `DropOldest`
+    pub dropped_oldest: u64,
+    /// New frames refused because the ring was full or busy
+    pub dropped_newest: u64,
+    /// Publishes that had to wait under `Block`
+    pub blocked: u64,
+    /// Times the consumer's read cursor was found outside the ring and reset
+    pub cursor_resets: u64,
+    /// Unread frames in the ring
+    pub depth: u32,
+}
+
+/// Current `CLOCK_MONOTONIC` time in nanoseconds, comparable across processes
+pub fn monotonic_now_ns() -> u64 {
+    let mut now: libc::timespec = unsafe { std::mem::zeroed() };
+    unsafe {
+        libc::clock_gettime(libc::CLOCK_MONOTONIC, &mut now);
+    }
+    now.tv_sec as u64 * 1_000_000_000 + now.tv_nsec as u64
+}
+
+#[repr(C, align(64))]
+struct ProducerLine {
+    write_seq: AtomicU64,
+    /// Bumped on every publish; consumers futex-wait on it
+    produced: AtomicU32,
+    consumer_waiting: AtomicU32,
+}
+
+#[repr(C, align(64))]
+struct ConsumerLine {
+    read_seq: AtomicU64,
+    /// Bumped on every consume; a blocked producer futex-waits on it
+    consumed: AtomicU32,
+    producer_waiting: AtomicU32,
+}
+
+#[repr(C, align(64))]
+struct RingHeader {
+    magic: u32,
+    version: u32,
+    slot_count: u32,
+    slot_size: u32,
+    producer: ProducerLine,
+    consumer: ConsumerLine,
+}
+
+type Slot = StampedSlot<ExportedFrame>;
+
+const _: () = assert!(std::mem::size_of::<RingHeader>() == 192);
+const _: () = assert!(std::mem::size_of::<Slot>() == 128);
+
+fn mapping_len(slots: u32) -> usize {
+    std::mem::size_of::<RingHeader>() + slots as usize * std::mem::size_of::<Slot>()
+}
+
+fn os_error(what: &str) -> DriverError {
+    DriverError::operation_failed(format!("{}: {}", what, std::io::Error::last_os_error()))
+}
+
+/// A shared read-write mapping of the ring
+///
+/// The slot count is kept locally; the other side can write the shared
+/// header, so it is never trusted for indexing.
+struct Ring {
+    ptr: *mut libc::c_void,
+    len: usize,
+    slot_count: u64,
+}
+
+unsafe impl Send for Ring {}
+unsafe impl Sync for Ring {}
+
+impl Ring {
+    fn map(fd: BorrowedFd<'_>, len: usize, slot_count: u32) -> DriverResult<Self> {
+        let ptr = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED,
+                fd.as_raw_fd(),
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(os_error("Failed to map frame export ring"));
+        }
+        Ok(Self {
+            ptr,
+            len,
+            slot_count: slot_count as u64,
+        })
+    }
+
+    #[inline]
+    fn header(&self) -> &RingHeader {
+        unsafe { &*(self.ptr as *const RingHeader) }
+    }
+
+    /// The slots behind the header, as the shared cursors index them
+    #[inline]
+    fn frames(&self) -> StampedRing<'_, ExportedFrame> {
+        let header = self.header();
+        let slots = unsafe {
+            std::slice::from_raw_parts(
+                (self.ptr as *const u8).add(std::mem::size_of::<RingHeader>()) as *const Slot,
+                self.slot_count as usize,
+            )
+        };
+        StampedRing::new(slots, &header.producer.write_seq, &header.consumer.read_seq)
+    }
+}
+
+impl Drop for Ring {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.ptr, self.len);
+        }
+    }
+}
+
+fn futex_wait(word: &AtomicU32, expected: u32, timeout: Option<Duration>) {
+    let timeout = timeout.map(|t| libc::timespec {
+        tv_sec: t.as_secs() as libc::time_t,
+        tv_nsec: t.subsec_nanos() as libc::c_long,
+    });
+    // Shared futex: the word lives in memory mapped by other processes
+    unsafe {
+        libc::syscall(
+            libc::SYS_futex,
+            word as *const AtomicU32,
+            libc::FUTEX_WAIT,
+            expected,
+            timeout
+                .as_ref()
+                .map_or(std::ptr::null(), |t| t as *const libc::timespec),
+        );
+    }
+}
+
+fn futex_wake(word: &AtomicU32) {
+    unsafe {
+        libc::syscall(
+            libc::SYS_futex,
+            word as *const AtomicU32,
+            libc::FUTEX_WAKE,
+            i32::MAX,
+        );
+    }
+}
+
+fn eventfd_signal(fd: &OwnedFd) {
+    let one = 1u64;
+    unsafe {
+        libc::write(
+            fd.as_raw_fd(),
+            &one as *const u64 as *const libc::c_void,
+            std::mem::size_of::<u64>(),
+        );
+    }
+}
+
+/// Wait for the eventfd to become readable and drain it
+fn eventfd_wait(fd: &OwnedFd, timeout: Duration) {
+    let mut poll = libc::pollfd {
+        fd: fd.as_raw_fd(),
+        events: libc::POLLIN,
+        revents: 0,
+    };
+    let millis = timeout.as_millis().clamp(1, i32::MAX as u128) as libc::c_int;
+    unsafe {
+        if libc::poll(&mut poll, 1, millis) > 0 {
+            let mut count = 0u64;
+            libc::read(
+                fd.as_raw_fd(),
+                &mut count as *mut u64 as *mut libc::c_void,
+                std::mem::size_of::<u64>(),
+            );
+        }
+    }
+}
+
+fn dup_fd(fd: BorrowedFd<'_>) -> DriverResult<OwnedFd> {
+    fd.try_clone_to_owned()
+        .map_err(|e| DriverError::operation_failed(format!("Failed to duplicate fd: {}", e)))
+}
+
+/// Producer side of the frame export ring
+///
+/// `publish` may be called from any thread, typically from
+/// `VirtualDisplay::present`. It never takes a lock; a publish racing
+/// another one drops its frame instead of waiting.
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::display::{FrameExportConfig, FrameExporter};
+/// use openvr_driver::{HmdMatrix34, PresentInfo, VirtualDisplay, VsyncTiming};
+///
+/// struct WirelessDisplay {
+///     export: FrameExporter,
+/// }
+///
+/// impl VirtualDisplay for WirelessDisplay {
+///     fn present(&self, info: &PresentInfo) {
+///         let pose = HmdMatrix34 { m: [[0.0; 4]; 3] }; // Pose the frame was rendered for
+///         self.export.publish(info, &pose, 0);
+///     }
+///
+///     fn get_time_since_last_vsync(&self) -> Option<VsyncTiming> {
+///         None
+///     }
+/// }
+///
+/// let export = FrameExporter::new(FrameExportConfig::default()).unwrap();
+/// // Pass export.memfd() to the encoder process, e.g. over a unix socket
+/// ```
+pub struct FrameExporter {
+    config: FrameExportConfig,
+    memfd: OwnedFd,
+    eventfd: Option<OwnedFd>,
+    ring: Ring,
+    publishing: AtomicBool,
+    published: AtomicU64,
+    dropped_oldest: AtomicU64,
+    dropped_newest: AtomicU64,
+    blocked: AtomicU64,
+    cursor_resets: AtomicU64,
+}
+
+impl FrameExporter {
+    /// Create the memfd, size and seal it, and map the ring
+    pub fn new(config: FrameExportConfig) -> DriverResult<Self> {
+        if config.slots == 0 {
+            return Err(DriverError::invalid_parameter(
+                "Frame export needs at least one slot",
+            ));
+        }
+        let name = std::ffi::CString::new(config.name.as_str())
+            .map_err(|_| DriverError::invalid_parameter("memfd name contains null byte"))?;
+        let len = mapping_len(config.slots);
+
+        let memfd = unsafe {
+            let fd = libc::memfd_create(name.as_ptr(), libc::MFD_CLOEXEC | libc::MFD_ALLOW_SEALING);
+            if fd < 0 {
+                return Err(os_error("memfd_create"));
+            }
+            OwnedFd::from_raw_fd(fd)
+        };
+        unsafe {
+            if libc::ftruncate(memfd.as_raw_fd(), len as libc::off_t) != 0 {
+                return Err(os_error("Failed to size frame export memfd"));
+            }
+            // The consumer can write the read cursor but not resize the ring
+            // under us
+            let seals = libc::F_SEAL_SHRINK | libc::F_SEAL_GROW | libc::F_SEAL_SEAL;
+            if libc::fcntl(memfd.as_raw_fd(), libc::F_ADD_SEALS, seals) != 0 {
+                return Err(os_error("Failed to seal frame export memfd"));
+            }
+        }
+
+        let eventfd = match config.signal {
+            ExportSignal::Futex => None,
+            ExportSignal::EventFd => unsafe {
+                let fd = libc::eventfd(0, libc::EFD_CLOEXEC | libc::EFD_NONBLOCK);
+                if fd < 0 {
+                    return Err(os_error("eventfd"));
+                }
+                Some(OwnedFd::from_raw_fd(fd))
+            },
+        };
+
+        // A fresh memfd is zero filled, which is a valid empty ring
+        let ring = Ring::map(memfd.as_fd(), len, config.slots)?;
+        unsafe {
+            let header = ring.ptr as *mut RingHeader;
+            (*header).slot_count = config.slots;
+            (*header).slot_size = std::mem::size_of::<Slot>() as u32;
+            (*header).version = EXPORT_VERSION;
+        }
+        // Magic last: a consumer seeing it sees the rest of the header
+        fence(Ordering::Release);
+        unsafe {
+            (*(ring.ptr as *mut RingHeader)).magic = EXPORT_MAGIC;
+        }
+
+        Ok(Self {
+            config,
+            memfd,
+            eventfd,
+            ring,
+            publishing: AtomicBool::new(false),
+            published: AtomicU64::new(0),
+            dropped_oldest: AtomicU64::new(0),
+            dropped_newest: AtomicU64::new(0),
+            blocked: AtomicU64::new(0),
+            cursor_resets: AtomicU64::new(0),
+        })
+    }
+
+    /// The memfd to hand to the encoder process
+    pub fn memfd(&self) -> BorrowedFd<'_> {
+        self.memfd.as_fd()
+    }
+
+    /// The eventfd to hand to the encoder process, with `ExportSignal::EventFd`
+    pub fn eventfd(&self) -> Option<BorrowedFd<'_>> {
+        self.eventfd.as_ref().map(|fd| fd.as_fd())
+    }
+
+    /// Open a consumer on this ring in the current process
+    ///
+    /// Useful as a stand-in for the encoder in tests and bring-up.
+    pub fn consumer(&self) -> DriverResult<FrameConsumer> {
+        let eventfd = match &self.eventfd {
+            Some(fd) => Some(dup_fd(fd.as_fd())?),
+            None => None,
+        };
+        FrameConsumer::open(dup_fd(self.memfd.as_fd())?, eventfd)
+    }
+
+    /// Publish a presented frame
+    ///
+    /// # Arguments
+    /// * `info` - The frame passed to `present`
+    /// * `pose` - Head pose the frame was rendered for
+    /// * `vsync_counter` - The virtual display's current vsync count
+    pub fn publish(
+        &self,
+        info: &PresentInfo,
+        pose: &HmdMatrix34,
+        vsync_counter: u64,
+    ) -> PublishResult {
+        let present_time_ns = monotonic_now_ns();
+
+        // Single writer; a concurrent publish loses rather than waits
+        if self.publishing.swap(true, Ordering::Acquire) {
+            self.dropped_newest.fetch_add(1, Ordering::Relaxed);
+            return PublishResult::Dropped;
+        }
+        let result = self.publish_exclusive(info, pose, vsync_counter, present_time_ns);
+        self.publishing.store(false, Ordering::Release);
+        result
+    }
+
+    fn publish_exclusive(
+        &self,
+        info: &PresentInfo,
+        pose: &HmdMatrix34,
+        vsync_counter: u64,
+        present_time_ns: u64,
+    ) -> PublishResult {
+        let header = self.ring.header();
+        let frames = self.ring.frames();
+        let mut deadline = None;
+
+        let claim = frames.claim(|read| match self.config.policy {
+            ExportDropPolicy::DropNewest => WhenFull::Reject,
+            ExportDropPolicy::DropOldest => WhenFull::DropOldest,
+            ExportDropPolicy::Block(timeout) => {
+                let deadline = *deadline.get_or_insert_with(|| {
+                    self.blocked.fetch_add(1, Ordering::Relaxed);
+                    Instant::now() + timeout
+                });
+                let remaining = deadline.saturating_duration_since(Instant::now());
+                if remaining.is_zero() {
+                    return WhenFull::Reject;
+                }
+                let seen = header.consumer.consumed.load(Ordering::Acquire);
+                header.consumer.producer_waiting.store(1, Ordering::SeqCst);
+                if header.consumer.read_seq.load(Ordering::SeqCst) == read {
+                    futex_wait(&header.consumer.consumed, seen, Some(remaining));
+                }
+                header.consumer.producer_waiting.store(0, Ordering::Relaxed);
+                WhenFull::Retry
+            }
+        });
+        let Some(claim) = claim else {
+            self.dropped_newest.fetch_add(1, Ordering::Relaxed);
+            return PublishResult::Dropped;
+        };
+        let sequence = claim.sequence;
+        if claim.resynced {
+            self.cursor_resets.fetch_add(1, Ordering::Relaxed);
+        }
+        if claim.dropped.is_some() {
+            self.dropped_oldest.fetch_add(1, Ordering::Relaxed);
+        }
+
+        frames.publish(
+            sequence,
+            ExportedFrame {
+                sequence,
+                frame_id: info.frame_id,
+                backbuffer: info.backbuffer,
+                vsync_time_seconds: info.vsync_time_seconds,
+                present_time_ns,
+                vsync_counter,
+                pose: *pose,
+                vsync: info.vsync as u32,
+                _reserved: 0,
+            },
+        );
+        self.published.fetch_add(1, Ordering::Relaxed);
+
+        header.producer.produced.fetch_add(1, Ordering::SeqCst);
+        if header.producer.consumer_waiting.load(Ordering::SeqCst) != 0 {
+            match &self.eventfd {
+                Some(fd) => eventfd_signal(fd),
+                None => futex_wake(&header.producer.produced),
+            }
+        }
+
+        match claim.dropped {
+            Some(dropped) => PublishResult::ReplacedOldest { sequence, dropped },
+            None => PublishResult::Published { sequence },
+        }
+    }
+
+    /// Snapshot the producer counters
+    pub fn stats(&self) -> FrameExportStats {
+        FrameExportStats {
+            published: self.published.load(Ordering::Relaxed),
+            dropped_oldest: self.dropped_oldest.load(Ordering::Relaxed),
+            dropped_newest: self.dropped_newest.load(Ordering::Relaxed),
+            blocked: self.blocked.load(Ordering::Relaxed),
+            cursor_resets: self.cursor_resets.load(Ordering::Relaxed),
+            depth: self.ring.frames().len() as u32,
+        }
+    }
+}
+
+/// Consumer side of the frame export ring, usually in the encoder process
+///
+/// Only one consumer should read a ring at a time.
+pub struct FrameConsumer {
+    _memfd: OwnedFd,
+    eventfd: Option<OwnedFd>,
+    ring: Ring,
+}
+
+impl FrameConsumer {
+    /// Map a ring received from the driver
+    ///
+    /// # Arguments
+    /// * `memfd` - The exporter's memfd
+    /// * `eventfd` - The exporter's eventfd, if it signals through one
+    pub fn open(memfd: OwnedFd, eventfd: Option<OwnedFd>) -> DriverResult<Self> {
+        let mut stat: libc::stat = unsafe { std::mem::zeroed() };
+        if unsafe { libc::fstat(memfd.as_raw_fd(), &mut stat) } != 0 {
+            return Err(os_error("Failed to stat frame export memfd"));
+        }
+        let len = stat.st_size as usize;
+        if len < std::mem::size_of::<RingHeader>() {
+            return Err(DriverError::invalid_parameter(
+                "Frame export memfd is too small",
+            ));
+        }
+
+        let mut ring = Ring::map(memfd.as_fd(), len, 0)?;
+        let header = ring.header();
+        if unsafe { std::ptr::read_volatile(&header.magic) } != EXPORT_MAGIC {
+            return Err(DriverError::invalid_parameter("Not a frame export ring"));
+        }
+        fence(Ordering::Acquire);
+        let slot_count = header.slot_count;
+        if header.version != EXPORT_VERSION
+            || header.slot_size as usize != std::mem::size_of::<Slot>()
+            || slot_count == 0
+            || mapping_len(slot_count) > len
+        {
+            return Err(DriverError::invalid_parameter(format!(
+                "Unsupported frame export ring (version {}, {} slots of {} bytes)",
+                header.version, slot_count, header.slot_size
+            )));
+        }
+        ring.slot_count = slot_count as u64;
+
+        Ok(Self {
+            _memfd: memfd,
+            eventfd,
+            ring,
+        })
+    }
+
+    /// Take the oldest unread frame without waiting
+    pub fn try_recv(&self) -> Option<ExportedFrame> {
+        let header = self.ring.header();
+        let frame = self.ring.frames().take()?;
+
+        header.consumer.consumed.fetch_add(1, Ordering::SeqCst);
+        if header.consumer.producer_waiting.load(Ordering::SeqCst) != 0 {
+            futex_wake(&header.consumer.consumed);
+        }
+        Some(frame)
+    }
+
+    /// Take the oldest unread frame, waiting up to `timeout` for one
+    pub fn recv_timeout(&self, timeout: Duration) -> Option<ExportedFrame> {
+        let header = self.ring.header();
+        let deadline = Instant::now() + timeout;
+
+        loop {
+            if let Some(frame) = self.try_recv() {
+                return Some(frame);
+            }
+            let remaining = deadline.saturating_duration_since(Instant::now());
+            if remaining.is_zero() {
+                return None;
+            }
+
+            let seen = header.producer.produced.load(Ordering::SeqCst);
+            header.producer.consumer_waiting.store(1, Ordering::SeqCst);
+            if let Some(frame) = self.try_recv() {
+                header.producer.consumer_waiting.store(0, Ordering::Relaxed);
+                return Some(frame);
+            }
+            match &self.eventfd {
+                Some(fd) => eventfd_wait(fd, remaining),
+                None => futex_wait(&header.producer.produced, seen, Some(remaining)),
+            }
+            header.producer.consumer_waiting.store(0, Ordering::Relaxed);
+        }
+    }
+}
+
+/// Counters of a `LoopbackConsumer`
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct LoopbackStats {
+    /// Frames received
+    pub received: u64,
+    /// Frames missing from the received sequence
+    pub skipped: u64,
+    /// Largest present-to-receive delay
+    pub max_latency: Duration,
+}
+
+#[derive(Default)]
+struct LoopbackCounters {
+    received: AtomicU64,
+    skipped: AtomicU64,
+    max_latency_ns: AtomicU64,
+}
+
+/// Encoder stand-in that drains a ring on its own thread
+///
+/// Each frame is held for a fixed simulated encode time, so backpressure and
+/// drop policies can be exercised without a GPU or a second process.
+pub struct LoopbackConsumer {
+    stop: Arc<AtomicBool>,
+    counters: Arc<LoopbackCounters>,
+    handle: Option<JoinHandle<()>>,
+}
+
+impl LoopbackConsumer {
+    /// Start draining `consumer`, spending `encode_time` on every frame
+    pub fn spawn(consumer: FrameConsumer, encode_time: Duration) -> DriverResult<Self> {
+        let stop = Arc::new(AtomicBool::new(false));
+        let counters = Arc::new(LoopbackCounters::default());
+        let thread_stop = stop.clone();
+        let thread_counters = counters.clone();
+
+        let handle = thread::Builder::new()
+            .name("frame-export-loopback".to_string())
+            .spawn(move || {
+                let mut next_sequence = None;
+                while !thread_stop.load(Ordering::Acquire) {
+                    let Some(frame) = consumer.recv_timeout(Duration::from_millis(20)) else {
+                        continue;
+                    };
+                    let latency = frame.age_ns(monotonic_now_ns());
+                    thread_counters.received.fetch_add(1, Ordering::Relaxed);
+                    thread_counters
+                        .max_latency_ns
+                        .fetch_max(latency, Ordering::Relaxed);
+                    if let Some(expected) = next_sequence {
+                        thread_counters
+                            .skipped
+                            .fetch_add(frame.sequence.saturating_sub(expected), Ordering::Relaxed);
+                    }
+                    next_sequence = Some(frame.sequence + 1);
+
+                    if !encode_time.is_zero() {
+                        thread::sleep(encode_time);
+                    }
+                }
+            })
+            .map_err(|e| {
+                DriverError::operation_failed(format!("Failed to spawn loopback consumer: {}", e))
+            })?;
+
+        Ok(Self {
+            stop,
+            counters,
+            handle: Some(handle),
+        })
+    }
+
+    /// Snapshot the counters
+    pub fn stats(&self) -> LoopbackStats {
+        LoopbackStats {
+            received: self.counters.received.load(Ordering::Relaxed),
+            skipped: self.counters.skipped.load(Ordering::Relaxed),
+            max_latency: Duration::from_nanos(self.counters.max_latency_ns.load(Ordering::Relaxed)),
+        }
+    }
+
+    /// Stop the thread and wait for it to exit
+    pub fn stop(mut self) {
+        self.shutdown();
+    }
+
+    fn shutdown(&mut self) {
+        self.stop.store(true, Ordering::Release);
+        if let Some(handle) = self.handle.take() {
+            let _ = handle.join();
+        }
+    }
+}
+
+impl Drop for LoopbackConsumer {
+    fn drop(&mut self) {
+        self.shutdown();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::sys::root::vr;
+
+    const POSE: HmdMatrix34 = HmdMatrix34 { m: [[0.0; 4]; 3] };
+
+    fn info(frame_id: u64) -> PresentInfo {
+        PresentInfo {
+            backbuffer: frame_id,
+            vsync: vr::EVSync::VSync_None,
+            frame_id,
+            vsync_time_seconds: 0.0,
+        }
+    }
+
+    fn exporter(policy: ExportDropPolicy, signal: ExportSignal) -> FrameExporter {
+        FrameExporter::new(FrameExportConfig {
+            slots: 4,
+            policy,
+            signal,
+            name: "frame-export-test".to_string(),
+        })
+        .unwrap()
+    }
+
+    /// Publish faster than the loopback encoder drains and reconcile counts
+    fn run_loopback(policy: ExportDropPolicy, signal: ExportSignal) -> FrameExportStats {
+        const FRAMES: u64 = 400;
+        let export = exporter(policy, signal);
+        let loopback =
+            LoopbackConsumer::spawn(export.consumer().unwrap(), Duration::from_micros(200))
+                .unwrap();
+
+        for i in 0..FRAMES {
+            export.publish(&info(i), &POSE, i);
+            if i % 8 == 0 {
+                thread::sleep(Duration::from_micros(300));
+            }
+        }
+        let deadline = Instant::now() + Duration::from_secs(5);
+        while export.stats().depth > 0 && Instant::now() < deadline {
+            thread::sleep(Duration::from_millis(1));
+        }
+        // Let the encoder finish the frame it took last
+        thread::sleep(Duration::from_millis(20));
+
+        let stats = export.stats();
+        let received = loopback.stats();
+        loopback.stop();
+
+        assert_eq!(stats.depth, 0);
+        assert_eq!(stats.cursor_resets, 0);
+        assert_eq!(stats.published + stats.dropped_newest, FRAMES);
+        assert_eq!(stats.published, received.received + stats.dropped_oldest);
+        // Frames replaced in the ring show up as gaps in the sequence
+        assert_eq!(received.skipped, stats.dropped_oldest);
+        stats
+    }
+
+    #[test]
+    fn loopback_drop_oldest_keeps_latest() {
+        let stats = run_loopback(ExportDropPolicy::DropOldest, ExportSignal::Futex);
+        assert_eq!(stats.dropped_newest, 0);
+        assert!(stats.dropped_oldest > 0);
+    }
+
+    #[test]
+    fn loopback_drop_newest_keeps_queued() {
+        let stats = run_loopback(ExportDropPolicy::DropNewest, ExportSignal::EventFd);
+        assert_eq!(stats.dropped_oldest, 0);
+        assert!(stats.dropped_newest > 0);
+    }
+
+    #[test]
+    fn loopback_block_waits_for_encoder() {
+        let stats = run_loopback(
+            ExportDropPolicy::Block(Duration::from_millis(100)),
+            ExportSignal::Futex,
+        );
+        assert_eq!(stats.dropped_oldest, 0);
+        assert_eq!(stats.dropped_newest, 0);
+        assert!(stats.blocked > 0);
+    }
+
+    #[test]
+    fn corrupt_read_cursor_is_reset() {
+        for policy in [ExportDropPolicy::DropOldest, ExportDropPolicy::DropNewest] {
+            let export = exporter(policy, ExportSignal::Futex);
+            let consumer = export.consumer().unwrap();
+            for i in 0..3 {
+                export.publish(&info(i), &POSE, i);
+            }
+
+            // The consumer writes its cursor past the producer's
+            let header = consumer.ring.header();
+            header.consumer.read_seq.store(1 << 40, Ordering::SeqCst);
+            assert_eq!(export.stats().depth, 0);
+            assert!(consumer.try_recv().is_none());
+
+            assert_eq!(
+                export.publish(&info(3), &POSE, 3),
+                PublishResult::Published { sequence: 3 }
+            );
+            assert_eq!(export.stats().cursor_resets, 1);
+            assert_eq!(consumer.try_recv().unwrap().sequence, 3);
+
+            // And a cursor more than a ring behind
+            export.publish(&info(4), &POSE, 4);
+            header.consumer.read_seq.store(0, Ordering::SeqCst);
+            assert_eq!(export.stats().depth, 0);
+            assert_eq!(
+                export.publish(&info(5), &POSE, 5),
+                PublishResult::Published { sequence: 5 }
+            );
+            assert_eq!(export.stats().cursor_resets, 2);
+            assert_eq!(consumer.try_recv().unwrap().frame_id, 5);
+            assert!(consumer.try_recv().is_none());
+        }
+    }
+}
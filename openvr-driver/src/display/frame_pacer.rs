@@ -0,0 +1,428 @@
+//! Vsync-aligned frame pacing
+//!
+//! `thread::sleep` rounds up to the scheduler's timer slack and wakeup
+//! latency, which on a loaded desktop is often most of a millisecond late.
+//! `FramePacer` sleeps on an absolute `CLOCK_MONOTONIC` deadline, through
+//! `clock_nanosleep` or a timerfd, set a configurable margin ahead of the
+//! target, then spins the remainder. It records how far each wakeup landed
+//! from its target so the margin can be tuned against real machines.
+
+use super::{LatencyPercentiles, VsyncClock};
+use crate::threading::ThreadConfig;
+use crate::{DriverError, DriverResult};
+use std::collections::VecDeque;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use std::thread::{self, JoinHandle};
+use std::time::{Duration, Instant};
+
+/// Kernel timer used for the coarse part of a wait
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub enum PacerTimer {
+    /// `clock_nanosleep` with an absolute deadline
+    #[default]
+    Nanosleep,
+    /// A timerfd armed with an absolute deadline
+    TimerFd,
+    /// `std::thread::sleep`, also used where the others are unavailable
+    Sleep,
+}
+
+/// Configuration for `FramePacer`
+#[derive(Debug, Clone, Copy)]
+pub struct FramePacerConfig {
+    /// Kernel timer for the coarse sleep
+    pub timer: PacerTimer,
+    /// How long before the target the timer fires; the rest is spun
+    pub spin_margin: Duration,
+    /// How long before the predicted vsync `wait_for_vsync` returns
+    pub vsync_lead: Duration,
+    /// Waits kept for the percentile statistics
+    pub stats_window: usize,
+}
+
+impl Default for FramePacerConfig {
+    fn default() -> Self {
+        Self {
+            timer: PacerTimer::default(),
+            spin_margin: Duration::from_micros(200),
+            vsync_lead: Duration::ZERO,
+            stats_window: 1024,
+        }
+    }
+}
+
+/// Pacing statistics
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct FramePacerStats {
+    /// Waits performed
+    pub waits: u64,
+    /// Waits whose target had already passed on entry
+    pub missed: u64,
+    /// How late `wait_until` returned relative to its target
+    pub wake_error: LatencyPercentiles,
+    /// How late the kernel timer fired relative to its own deadline
+    pub timer_overshoot: LatencyPercentiles,
+    /// Mean time spent spinning per wait
+    pub mean_spin: Duration,
+}
+
+/// Samples behind `FramePacerStats`
+#[derive(Default)]
+struct PacerSamples {
+    wake_error: VecDeque<u64>,
+    timer_overshoot: VecDeque<u64>,
+    spin_ns: u64,
+    spins: u64,
+}
+
+/// Sub-millisecond waits on absolute deadlines
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::display::{FramePacer, FramePacerConfig, VsyncClock};
+/// use openvr_driver::{PresentInfo, VirtualDisplay, VsyncTiming};
+///
+/// struct WirelessDisplay {
+///     vsync: VsyncClock,
+///     pacer: FramePacer,
+/// }
+///
+/// impl VirtualDisplay for WirelessDisplay {
+///     fn present(&self, info: &PresentInfo) {}
+///
+///     fn wait_for_present(&self) {
+///         self.pacer.wait_for_vsync(&self.vsync);
+///     }
+///
+///     fn get_time_since_last_vsync(&self) -> Option<VsyncTiming> {
+///         Some(self.vsync.timing())
+///     }
+/// }
+/// ```
+pub struct FramePacer {
+    config: FramePacerConfig,
+    #[cfg(target_os = "linux")]
+    timerfd: Option<Mutex<linux::TimerFd>>,
+    waits: AtomicU64,
+    missed: AtomicU64,
+    samples: Mutex<PacerSamples>,
+}
+
+impl FramePacer {
+    /// Create a pacer
+    ///
+    /// # Returns
+    /// * `Err` if a timerfd was requested and could not be created
+    pub fn new(config: FramePacerConfig) -> DriverResult<Self> {
+        #[cfg(target_os = "linux")]
+        let timerfd = match config.timer {
+            PacerTimer::TimerFd => Some(Mutex::new(linux::TimerFd::new()?)),
+            _ => None,
+        };
+
+        Ok(Self {
+            config,
+            #[cfg(target_os = "linux")]
+            timerfd,
+            waits: AtomicU64::new(0),
+            missed: AtomicU64::new(0),
+            samples: Mutex::new(PacerSamples::default()),
+        })
+    }
+
+    /// Block until `target`
+    ///
+    /// # Returns
+    /// * How late the call returned
+    pub fn wait_until(&self, target: Instant) -> Duration {
+        self.waits.fetch_add(1, Ordering::Relaxed);
+        if Instant::now() >= target {
+            self.missed.fetch_add(1, Ordering::Relaxed);
+            return Instant::now().saturating_duration_since(target);
+        }
+
+        let timer_target = target.checked_sub(self.config.spin_margin);
+        let mut overshoot = None;
+        if let Some(timer_target) = timer_target.filter(|t| *t > Instant::now()) {
+            self.sleep_until(timer_target);
+            overshoot = Some(Instant::now().saturating_duration_since(timer_target));
+        }
+
+        let spin_start = Instant::now();
+        let mut now = spin_start;
+        while now < target {
+            std::hint::spin_loop();
+            now = Instant::now();
+        }
+        let error = now - target;
+
+        // Never make the waiting thread queue behind a stats reader
+        if let Ok(mut samples) = self.samples.try_lock() {
+            let window = self.config.stats_window;
+            if window > 0 {
+                push_bounded(&mut samples.wake_error, window, error.as_nanos() as u64);
+                if let Some(overshoot) = overshoot {
+                    push_bounded(
+                        &mut samples.timer_overshoot,
+                        window,
+                        overshoot.as_nanos() as u64,
+                    );
+                }
+            }
+            samples.spin_ns += (now - spin_start).as_nanos() as u64;
+            samples.spins += 1;
+        }
+
+        error
+    }
+
+    /// Block until `vsync_lead` before the clock's next vsync
+    ///
+    /// If that point has already passed for the upcoming vsync, waits for the
+    /// one after.
+    ///
+    /// # Returns
+    /// * Frame counter of the vsync waited for
+    pub fn wait_for_vsync(&self, clock: &VsyncClock) -> u64 {
+        let (vsync, mut frame) = clock.next_vsync();
+        let mut target = vsync.checked_sub(self.config.vsync_lead).unwrap_or(vsync);
+        if target <= Instant::now() {
+            target += clock.period();
+            frame += 1;
+        }
+        self.wait_until(target);
+        frame
+    }
+
+    #[cfg(target_os = "linux")]
+    fn sleep_until(&self, deadline: Instant) {
+        match self.config.timer {
+            PacerTimer::Nanosleep => linux::nanosleep_until(deadline),
+            PacerTimer::TimerFd => match self.timerfd.as_ref().map(|fd| fd.try_lock()) {
+                Some(Ok(fd)) => fd.sleep_until(deadline),
+                // Another thread owns the timer; don't wait for it
+                _ => linux::nanosleep_until(deadline),
+            },
+            PacerTimer::Sleep => thread::sleep(deadline.saturating_duration_since(Instant::now())),
+        }
+    }
+
+    #[cfg(not(target_os = "linux"))]
+    fn sleep_until(&self, deadline: Instant) {
+        thread::sleep(deadline.saturating_duration_since(Instant::now()));
+    }
+
+    /// Snapshot the pacing statistics
+    pub fn stats(&self) -> FramePacerStats {
+        let samples = self.samples.lock().unwrap();
+        FramePacerStats {
+            waits: self.waits.load(Ordering::Relaxed),
+            missed: self.missed.load(Ordering::Relaxed),
+            wake_error: LatencyPercentiles::from_samples(&samples.wake_error),
+            timer_overshoot: LatencyPercentiles::from_samples(&samples.timer_overshoot),
+            mean_spin: Duration::from_nanos(samples.spin_ns / samples.spins.max(1)),
+        }
+    }
+
+    /// Clear the statistics, e.g. after changing the spin margin
+    pub fn reset_stats(&self) {
+        self.waits.store(0, Ordering::Relaxed);
+        self.missed.store(0, Ordering::Relaxed);
+        *self.samples.lock().unwrap() = PacerSamples::default();
+    }
+
+    /// Run `on_vsync` on a dedicated thread at every vsync
+    ///
+    /// Useful for emitting `VsyncEvent`s or kicking an encoder. The thread
+    /// applies `thread`, so realtime scheduling can be requested there
+    /// without touching vrserver's threads.
+    ///
+    /// # Arguments
+    /// * `name` - Thread name
+    /// * `clock` - Vsync estimate to follow
+    /// * `thread` - CPU placement and priority
+    /// * `on_vsync` - Called with each vsync's frame counter
+    pub fn spawn(
+        self: Arc<Self>,
+        name: &str,
+        clock: Arc<VsyncClock>,
+        thread: ThreadConfig,
+        mut on_vsync: impl FnMut(u64) + Send + 'static,
+    ) -> DriverResult<VsyncThread> {
+        let stop = Arc::new(AtomicBool::new(false));
+        let thread_stop = stop.clone();
+        let thread_name = name.to_string();
+
+        let handle = thread::Builder::new()
+            .name(thread_name.clone())
+            .spawn(move || {
+                thread.apply_to_current(&thread_name);
+                prepare_current_thread();
+
+                while !thread_stop.load(Ordering::Acquire) {
+                    let frame = self.wait_for_vsync(&clock);
+                    on_vsync(frame);
+                }
+            })
+            .map_err(|e| {
+                DriverError::operation_failed(format!("Failed to spawn {}: {}", name, e))
+            })?;
+
+        Ok(VsyncThread {
+            stop,
+            handle: Some(handle),
+        })
+    }
+}
+
+/// Tighten timer wakeups on a thread that will pace with a `FramePacer`
+pub(crate) fn prepare_current_thread() {
+    #[cfg(target_os = "linux")]
+    linux::minimize_timer_slack();
+}
+
+fn push_bounded(samples: &mut VecDeque<u64>, window: usize, value: u64) {
+    if samples.len() == window {
+        samples.pop_front();
+    }
+    samples.push_back(value);
+}
+
+/// Thread started by `FramePacer::spawn`
+///
+/// Stops after its current wait when dropped.
+pub struct VsyncThread {
+    stop: Arc<AtomicBool>,
+    handle: Option<JoinHandle<()>>,
+}
+
+impl VsyncThread {
+    /// Stop the thread and wait for it to exit
+    pub fn stop(mut self) {
+        self.shutdown();
+    }
+
+    fn shutdown(&mut self) {
+        self.stop.store(true, Ordering::Release);
+        if let Some(handle) = self.handle.take() {
+            let _ = handle.join();
+        }
+    }
+}
+
+impl Drop for VsyncThread {
+    fn drop(&mut self) {
+        self.shutdown();
+    }
+}
+
+#[cfg(target_os = "linux")]
+mod linux {
+    use crate::{DriverError, DriverResult};
+    use std::time::Instant;
+
+    /// Translate an `Instant` into an absolute `CLOCK_MONOTONIC` time
+    ///
+    /// `Instant` is backed by the same clock but does not expose its value,
+    /// so both are sampled together and the remaining delay is added.
+    fn monotonic_deadline(deadline: Instant) -> libc::timespec {
+        let mut now: libc::timespec = unsafe { std::mem::zeroed() };
+        unsafe {
+            libc::clock_gettime(libc::CLOCK_MONOTONIC, &mut now);
+        }
+        let delay = deadline.saturating_duration_since(Instant::now());
+
+        let nanos = now.tv_nsec as u64 + delay.subsec_nanos() as u64;
+        libc::timespec {
+            tv_sec: now.tv_sec
+                + delay.as_secs() as libc::time_t
+                + (nanos / 1_000_000_000) as libc::time_t,
+            tv_nsec: (nanos % 1_000_000_000) as libc::c_long,
+        }
+    }
+
+    pub(super) fn nanosleep_until(deadline: Instant) {
+        let deadline = monotonic_deadline(deadline);
+        loop {
+            let result = unsafe {
+                libc::clock_nanosleep(
+                    libc::CLOCK_MONOTONIC,
+                    libc::TIMER_ABSTIME,
+                    &deadline,
+                    std::ptr::null_mut(),
+                )
+            };
+            if result != libc::EINTR {
+                break;
+            }
+        }
+    }
+
+    /// Ask for the smallest timer slack on the calling thread
+    ///
+    /// The default 50 µs slack lets the kernel batch our wakeup with others.
+    pub(super) fn minimize_timer_slack() {
+        unsafe {
+            libc::prctl(libc::PR_SET_TIMERSLACK, 1 as libc::c_ulong);
+        }
+    }
+
+    pub(super) struct TimerFd(libc::c_int);
+
+    impl TimerFd {
+        pub(super) fn new() -> DriverResult<Self> {
+            let fd = unsafe { libc::timerfd_create(libc::CLOCK_MONOTONIC, libc::TFD_CLOEXEC) };
+            if fd < 0 {
+                return Err(DriverError::operation_failed(format!(
+                    "timerfd_create: {}",
+                    std::io::Error::last_os_error()
+                )));
+            }
+            Ok(Self(fd))
+        }
+
+        pub(super) fn sleep_until(&self, deadline: Instant) {
+            let spec = libc::itimerspec {
+                it_interval: libc::timespec {
+                    tv_sec: 0,
+                    tv_nsec: 0,
+                },
+                it_value: monotonic_deadline(deadline),
+            };
+            unsafe {
+                if libc::timerfd_settime(
+                    self.0,
+                    libc::TFD_TIMER_ABSTIME,
+                    &spec,
+                    std::ptr::null_mut(),
+                ) != 0
+                {
+                    return;
+                }
+                let mut expirations = 0u64;
+                loop {
+                    let read = libc::read(
+                        self.0,
+                        &mut expirations as *mut u64 as *mut libc::c_void,
+                        std::mem::size_of::<u64>(),
+                    );
+                    if read >= 0
+                        || std::io::Error::last_os_error().raw_os_error() != Some(libc::EINTR)
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    impl Drop for TimerFd {
+        fn drop(&mut self) {
+            unsafe {
+                libc::close(self.0);
+            }
+        }
+    }
+}
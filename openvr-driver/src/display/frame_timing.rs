@@ -0,0 +1,377 @@
+//! Frame timing driven render target sizing
+//!
+//! `AdaptiveRenderTarget` periodically reads the compositor's frame timings
+//! through `IVRServerDriverHost::GetFrameTimings` and scales the recommended
+//! render target between configured bounds: down when frames are dropped or
+//! the GPU runs close to the frame budget, up again once there has been
+//! sustained headroom. Separate thresholds and consecutive-sample
+//! requirements in each direction keep it from oscillating.
+
+use super::{DisplayGeometry, DisplayUpdater};
+use crate::{sys, DriverHost};
+use std::time::{Duration, Instant};
+
+/// One frame of compositor timing, copied out of `Compositor_FrameTiming`
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct FrameTiming {
+    /// Compositor frame index
+    pub frame_index: u32,
+    /// Times this frame was presented
+    pub num_frame_presents: u32,
+    /// Times this frame was presented on a vsync other than the intended one
+    pub num_mis_presented: u32,
+    /// Additional times the previous frame was scanned out
+    pub num_dropped_frames: u32,
+    /// `VRCompositor_ReprojectionReason_*` flags
+    pub reprojection_flags: u32,
+    /// System time when the frame began
+    pub system_time_seconds: f64,
+    /// Application GPU time before submit
+    pub pre_submit_gpu_ms: f32,
+    /// Application GPU time after submit
+    pub post_submit_gpu_ms: f32,
+    /// GPU time from the start of application work to the end of the
+    /// compositor's
+    pub total_render_gpu_ms: f32,
+    /// Compositor GPU time
+    pub compositor_render_gpu_ms: f32,
+    /// Compositor CPU time
+    pub compositor_render_cpu_ms: f32,
+    /// Time between the application's frame submissions
+    pub client_frame_interval_ms: f32,
+}
+
+impl FrameTiming {
+    /// Copy the fields out of the packed runtime struct
+    pub fn from_raw(raw: &sys::root::vr::Compositor_FrameTiming) -> Self {
+        Self {
+            frame_index: raw.m_nFrameIndex,
+            num_frame_presents: raw.m_nNumFramePresents,
+            num_mis_presented: raw.m_nNumMisPresented,
+            num_dropped_frames: raw.m_nNumDroppedFrames,
+            reprojection_flags: raw.m_nReprojectionFlags,
+            system_time_seconds: raw.m_flSystemTimeInSeconds,
+            pre_submit_gpu_ms: raw.m_flPreSubmitGpuMs,
+            post_submit_gpu_ms: raw.m_flPostSubmitGpuMs,
+            total_render_gpu_ms: raw.m_flTotalRenderGpuMs,
+            compositor_render_gpu_ms: raw.m_flCompositorRenderGpuMs,
+            compositor_render_cpu_ms: raw.m_flCompositorRenderCpuMs,
+            client_frame_interval_ms: raw.m_flClientFrameIntervalMs,
+        }
+    }
+
+    /// Whether the frame missed its vsync
+    pub fn missed(&self) -> bool {
+        self.num_dropped_frames > 0 || self.num_mis_presented > 0
+    }
+
+    /// GPU time of the frame, from the start of application work to the
+    /// end of the compositor's, so compositor time is already included
+    pub fn gpu_ms(&self) -> f32 {
+        self.total_render_gpu_ms
+    }
+}
+
+/// Adaptive render target configuration
+#[derive(Debug, Clone)]
+pub struct AdaptiveRenderTargetConfig {
+    /// Time between frame timing samples
+    pub sample_interval: Duration,
+    /// Frames requested from the compositor per sample
+    pub frames_per_sample: u32,
+    /// Display refresh rate, for the frame budget
+    pub display_frequency: f32,
+    /// Smallest linear scale of the base size
+    pub min_scale: f32,
+    /// Largest linear scale of the base size
+    pub max_scale: f32,
+    /// Linear scale change per adjustment
+    pub step: f32,
+    /// Missed frame fraction above which a sample counts as pressure
+    pub max_missed_fraction: f32,
+    /// GPU time, as a fraction of the budget, above which a sample counts as pressure
+    pub high_gpu_load: f32,
+    /// GPU time, as a fraction of the budget, below which a sample counts as headroom
+    pub low_gpu_load: f32,
+    /// Consecutive pressure samples before scaling down
+    pub samples_to_decrease: u32,
+    /// Consecutive headroom samples before scaling up
+    pub samples_to_increase: u32,
+    /// Round each dimension to a multiple of this
+    pub alignment: u32,
+}
+
+impl Default for AdaptiveRenderTargetConfig {
+    fn default() -> Self {
+        Self {
+            sample_interval: Duration::from_millis(500),
+            frames_per_sample: 64,
+            display_frequency: 90.0,
+            min_scale: 0.6,
+            max_scale: 1.0,
+            step: 0.05,
+            max_missed_fraction: 0.02,
+            high_gpu_load: 0.9,
+            low_gpu_load: 0.7,
+            samples_to_decrease: 2,
+            samples_to_increase: 6,
+            alignment: 4,
+        }
+    }
+}
+
+/// Summary of one batch of frame timings
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct FrameTimingSample {
+    /// Frames in the sample
+    pub frames: u32,
+    /// Frames that missed their vsync
+    pub missed: u32,
+    /// Mean GPU time as a fraction of the frame budget
+    pub gpu_load: f32,
+}
+
+/// Counters describing controller activity
+#[derive(Debug, Clone, Copy, Default)]
+pub struct AdaptiveRenderTargetStats {
+    /// Samples that contained new frames
+    pub samples: u64,
+    /// Times the render target was scaled up
+    pub increases: u64,
+    /// Times the render target was scaled down
+    pub decreases: u64,
+    /// Times frame indices restarted, as when the compositor restarts
+    pub restarts: u64,
+    /// Most recent sample
+    pub last_sample: FrameTimingSample,
+}
+
+/// Scales the recommended render target from compositor frame timings
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::display::{
+///     AdaptiveRenderTarget, AdaptiveRenderTargetConfig, DisplayUpdateConfig, DisplayUpdater,
+///     SharedDisplayGeometry,
+/// };
+/// # fn example(host: openvr_driver::DriverHost, geometry: SharedDisplayGeometry) {
+/// let mut updater = DisplayUpdater::new(host.clone(), 0, geometry.clone(), DisplayUpdateConfig::default());
+/// let mut adaptive = AdaptiveRenderTarget::from_geometry(
+///     host,
+///     &geometry.load().unwrap(),
+///     AdaptiveRenderTargetConfig::default(),
+/// );
+///
+/// // In run_frame:
+/// adaptive.tick(&mut updater);
+/// updater.flush();
+/// # }
+/// ```
+pub struct AdaptiveRenderTarget {
+    host: DriverHost,
+    config: AdaptiveRenderTargetConfig,
+    base_size: (u32, u32),
+    scale: f32,
+    last_frame_index: Option<u32>,
+    last_sample_at: Option<Instant>,
+    pressure_samples: u32,
+    headroom_samples: u32,
+    stats: AdaptiveRenderTargetStats,
+}
+
+impl AdaptiveRenderTarget {
+    /// Create a controller scaling `base_size`, starting at scale 1 (clamped to the bounds)
+    pub fn new(
+        host: DriverHost,
+        base_size: (u32, u32),
+        config: AdaptiveRenderTargetConfig,
+    ) -> Self {
+        let scale = 1.0f32.clamp(config.min_scale, config.max_scale.max(config.min_scale));
+        Self {
+            host,
+            config,
+            base_size,
+            scale,
+            last_frame_index: None,
+            last_sample_at: None,
+            pressure_samples: 0,
+            headroom_samples: 0,
+            stats: AdaptiveRenderTargetStats::default(),
+        }
+    }
+
+    /// Create a controller scaling the geometry's current render target size
+    pub fn from_geometry(
+        host: DriverHost,
+        geometry: &DisplayGeometry,
+        config: AdaptiveRenderTargetConfig,
+    ) -> Self {
+        Self::new(host, geometry.render_target_size, config)
+    }
+
+    /// Sample frame timings if `sample_interval` has passed, staging any new size
+    ///
+    /// Call this once per `run_frame`; the size is pushed by the updater's
+    /// next `flush`.
+    ///
+    /// # Returns
+    /// * The newly staged size, if the scale changed
+    pub fn tick(&mut self, updater: &mut DisplayUpdater) -> Option<(u32, u32)> {
+        if let Some(last) = self.last_sample_at {
+            if last.elapsed() < self.config.sample_interval {
+                return None;
+            }
+        }
+        self.last_sample_at = Some(Instant::now());
+
+        let timings = self.host.get_frame_timings(self.config.frames_per_sample);
+        let size = self.observe(&timings)?;
+        updater.set_render_target_size(size.0, size.1);
+        Some(size)
+    }
+
+    /// Feed a batch of frame timings, ignoring frames seen before
+    ///
+    /// Frame indices start again from 0 when the compositor restarts. A batch
+    /// whose newest frame is more than a batch behind the last one seen is
+    /// taken as such a restart and starts the filter over.
+    ///
+    /// # Returns
+    /// * The new render target size, if the scale changed
+    pub fn observe(&mut self, timings: &[FrameTiming]) -> Option<(u32, u32)> {
+        let newest = timings.iter().map(|t| t.frame_index).max()?;
+        if let Some(last) = self.last_frame_index {
+            if newest.saturating_add(self.config.frames_per_sample.max(1)) < last {
+                self.last_frame_index = None;
+                self.pressure_samples = 0;
+                self.headroom_samples = 0;
+                self.stats.restarts += 1;
+            }
+        }
+
+        let last = self.last_frame_index;
+        let fresh = timings
+            .iter()
+            .filter(|t| last.map_or(true, |last| t.frame_index > last));
+
+        let budget_ms = 1000.0 / self.config.display_frequency.max(1.0);
+        let mut sample = FrameTimingSample::default();
+        let mut gpu_ms = 0.0f32;
+        for timing in fresh {
+            sample.frames += 1;
+            sample.missed += timing.missed() as u32;
+            gpu_ms += timing.gpu_ms();
+            self.last_frame_index = Some(
+                self.last_frame_index
+                    .map_or(timing.frame_index, |i| i.max(timing.frame_index)),
+            );
+        }
+        if sample.frames == 0 {
+            return None;
+        }
+        sample.gpu_load = gpu_ms / sample.frames as f32 / budget_ms;
+
+        self.stats.samples += 1;
+        self.stats.last_sample = sample;
+
+        let missed_fraction = sample.missed as f32 / sample.frames as f32;
+        let pressure = missed_fraction > self.config.max_missed_fraction
+            || sample.gpu_load > self.config.high_gpu_load;
+        let headroom = sample.missed == 0 && sample.gpu_load < self.config.low_gpu_load;
+
+        if pressure {
+            self.pressure_samples += 1;
+            self.headroom_samples = 0;
+        } else if headroom {
+            self.headroom_samples += 1;
+            self.pressure_samples = 0;
+        } else {
+            self.pressure_samples = 0;
+            self.headroom_samples = 0;
+        }
+
+        let max_scale = self.config.max_scale.max(self.config.min_scale);
+        let next = if self.pressure_samples >= self.config.samples_to_decrease {
+            (self.scale - self.config.step).max(self.config.min_scale)
+        } else if self.headroom_samples >= self.config.samples_to_increase {
+            (self.scale + self.config.step).min(max_scale)
+        } else {
+            return None;
+        };
+
+        self.pressure_samples = 0;
+        self.headroom_samples = 0;
+        if (next - self.scale).abs() < f32::EPSILON {
+            return None;
+        }
+
+        if next < self.scale {
+            self.stats.decreases += 1;
+        } else {
+            self.stats.increases += 1;
+        }
+        self.scale = next;
+        Some(self.size())
+    }
+
+    /// Current linear scale of the base size
+    pub fn scale(&self) -> f32 {
+        self.scale
+    }
+
+    /// Render target size at the current scale
+    pub fn size(&self) -> (u32, u32) {
+        let align = self.config.alignment.max(1);
+        let dimension = |base: u32| {
+            let scaled = (base as f32 * self.scale).round().max(1.0) as u32;
+            scaled.div_ceil(align) * align
+        };
+        (dimension(self.base_size.0), dimension(self.base_size.1))
+    }
+
+    /// Get the controller counters
+    pub fn stats(&self) -> AdaptiveRenderTargetStats {
+        self.stats
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn batch(first: u32, frames: u32, gpu_ms: f32) -> Vec<FrameTiming> {
+        (first..first + frames)
+            .map(|frame_index| FrameTiming {
+                frame_index,
+                num_frame_presents: 1,
+                total_render_gpu_ms: gpu_ms,
+                ..Default::default()
+            })
+            .collect()
+    }
+
+    #[test]
+    fn keeps_adapting_after_a_compositor_restart() {
+        let host = unsafe { DriverHost::from_raw(std::ptr::null_mut()) };
+        let config = AdaptiveRenderTargetConfig::default();
+        let frames = config.frames_per_sample;
+        let mut adaptive = AdaptiveRenderTarget::new(host, (2000, 2000), config);
+
+        // Over budget at 90 Hz
+        assert_eq!(adaptive.observe(&batch(5000, frames, 14.0)), None);
+        // Overlapping batch: only the new frames count
+        adaptive.observe(&batch(5000 + frames / 2, frames, 14.0));
+        assert_eq!(adaptive.stats().samples, 2);
+        assert!(adaptive.scale() < 1.0);
+        let scale = adaptive.scale();
+
+        // Indices start over; these frames must not be dropped as stale
+        adaptive.observe(&batch(0, frames, 14.0));
+        assert_eq!(adaptive.stats().restarts, 1);
+        assert_eq!(adaptive.stats().samples, 3);
+        adaptive.observe(&batch(frames, frames, 14.0));
+        assert_eq!(adaptive.stats().samples, 4);
+        assert!(adaptive.scale() < scale);
+    }
+}
@@ -0,0 +1,155 @@
+//! Display geometry snapshot
+//!
+//! vrserver queries viewports and projections far more often than they
+//! change. `DisplayGeometry` captures everything the display thunks serve in
+//! one immutable value, derived from the `DisplayComponent` trait when the
+//! component is created, so the thunks only read plain fields. The snapshot
+//! lives in a `SharedDisplayGeometry` so a `DisplayUpdater` can replace it at
+//! runtime without the thunks ever taking a lock.
+
+use crate::snapshot::Snapshot;
+use crate::{DisplayComponent, Eye, HmdMatrix34};
+use std::sync::Arc;
+
+/// Per-eye part of a display geometry snapshot
+#[derive(Debug, Clone, Copy)]
+pub struct EyeGeometry {
+    /// Projection as tangents of the half angles: (left, right, top, bottom)
+    ///
+    /// Uses the OpenVR convention of `GetProjectionRaw`, where +y points
+    /// down, so `top` is negative for a frustum that extends above the axis.
+    pub projection_raw: (f32, f32, f32, f32),
+    /// Output viewport on the display: (x, y, width, height)
+    pub viewport: (u32, u32, u32, u32),
+    /// Transform from eye space to head space
+    pub eye_to_head: HmdMatrix34,
+}
+
+/// Immutable snapshot of everything the display component serves
+#[derive(Debug, Clone, Copy)]
+pub struct DisplayGeometry {
+    /// Window position and size on the desktop: (x, y, width, height)
+    pub window_bounds: (i32, i32, i32, i32),
+    /// Recommended render target size per eye
+    pub render_target_size: (u32, u32),
+    /// Render target size giving one texel per panel pixel at the lens
+    /// centers, when sized through `DisplayComponent::render_target_sizing`
+    pub native_render_target_size: Option<(u32, u32)>,
+    /// Whether the display is an extended mode monitor
+    pub is_on_desktop: bool,
+    /// Whether the display is physical hardware
+    pub is_real: bool,
+    /// Per-eye geometry, indexed by `Eye as usize`
+    pub eyes: [EyeGeometry; 2],
+}
+
+impl DisplayGeometry {
+    /// Query a display component once for everything it serves
+    pub fn from_component<T: DisplayComponent + ?Sized>(component: &T) -> Self {
+        let eye = |eye: Eye| EyeGeometry {
+            projection_raw: component.get_projection_raw(eye),
+            viewport: component.get_eye_output_viewport(eye),
+            eye_to_head: component.get_eye_to_head_transform(eye),
+        };
+
+        let sized = component.render_target_sizing().and_then(|sizing| {
+            let sized = sizing.compute(component);
+            if sized.is_none() {
+                eprintln!(
+                    "[DisplayComponent] Distortion is degenerate at the lens center, using the configured render target size"
+                );
+            }
+            sized
+        });
+        let (render_target_size, native_render_target_size) = match sized {
+            Some((size, native)) => (size, Some(native)),
+            None => (component.get_recommended_render_target_size(), None),
+        };
+
+        Self {
+            window_bounds: component.get_window_bounds(),
+            render_target_size,
+            native_render_target_size,
+            is_on_desktop: component.is_display_on_desktop(),
+            is_real: component.is_display_real(),
+            eyes: [eye(Eye::Left), eye(Eye::Right)],
+        }
+    }
+
+    /// Geometry for one eye
+    #[inline]
+    pub fn eye(&self, eye: Eye) -> &EyeGeometry {
+        &self.eyes[eye as usize]
+    }
+}
+
+/// Display geometry shared between a display vtable and a `DisplayUpdater`
+///
+/// Starts empty; the display vtable publishes the geometry derived from the
+/// trait when it is created, unless something was published earlier.
+#[derive(Clone, Default)]
+pub struct SharedDisplayGeometry(Arc<Snapshot<DisplayGeometry>>);
+
+impl SharedDisplayGeometry {
+    /// Create an empty shared geometry
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Copy out the current geometry, if published
+    #[inline]
+    pub fn load(&self) -> Option<DisplayGeometry> {
+        self.0.load()
+    }
+
+    /// Replace the current geometry
+    pub fn store(&self, geometry: DisplayGeometry) {
+        self.0.store(geometry);
+    }
+
+    /// Publish `geometry` unless a geometry was already published
+    pub(crate) fn store_if_empty(&self, geometry: DisplayGeometry) -> bool {
+        self.0.store_if_empty(geometry)
+    }
+}
+
+/// Recover `GetProjectionRaw` tangents from an OpenGL-style projection matrix
+///
+/// For a frustum with tangents l, r (x) and b, t (y, up), row 0 of the matrix
+/// is `[2/(r-l), 0, (r+l)/(r-l), 0]` and row 1 is `[0, 2/(t-b), (t+b)/(t-b), 0]`,
+/// independent of the near plane. The y tangents are flipped into OpenVR's
+/// y-down convention.
+///
+/// # Returns
+/// * `(left, right, top, bottom)`, or a symmetric 90 degree frustum if the
+///   matrix is degenerate
+pub fn projection_to_raw(projection: &HmdMatrix34) -> (f32, f32, f32, f32) {
+    let m = &projection.m;
+    let (sx, ox) = (m[0][0], m[0][2]);
+    let (sy, oy) = (m[1][1], m[1][2]);
+
+    if sx.abs() < f32::EPSILON || sy.abs() < f32::EPSILON {
+        return (-1.0, 1.0, -1.0, 1.0);
+    }
+
+    let left = (ox - 1.0) / sx;
+    let right = (ox + 1.0) / sx;
+    let bottom_up = (oy - 1.0) / sy;
+    let top_up = (oy + 1.0) / sy;
+
+    (left, right, -top_up, -bottom_up)
+}
+
+/// Side-by-side viewport for an eye: each eye gets half the window width
+pub fn side_by_side_viewport(
+    window_bounds: (i32, i32, i32, i32),
+    eye: Eye,
+) -> (u32, u32, u32, u32) {
+    let (_, _, width, height) = window_bounds;
+    let half = width.max(0) as u32 / 2;
+    let x = match eye {
+        Eye::Left => 0,
+        Eye::Right => half,
+    };
+    (x, 0, half, height.max(0) as u32)
+}
@@ -0,0 +1,396 @@
+//! Hidden area mesh generation
+//!
+//! Applications stencil out the render target pixels that the lenses never
+//! show using the hidden area mesh published in the
+//! `Prop_DisplayHiddenArea_Binary_*` properties. This module derives those
+//! meshes from a lens model: a visible circle on the panel is mapped through
+//! the distortion into render target UV, and the area between that outline and
+//! the viewport edge is triangulated.
+
+use super::{LensDistortion, StereoLens};
+use crate::properties::{Properties, PropertyContainer};
+use crate::{sys, DriverError, DriverResult, Eye};
+
+/// Kind of hidden area mesh, matching `EHiddenAreaMeshType`
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum HiddenAreaMeshType {
+    /// Triangles covering the hidden pixels
+    Standard = 0,
+    /// Triangles covering the visible pixels
+    Inverse = 1,
+    /// Outline of the visible area as a closed line loop
+    LineLoop = 2,
+}
+
+impl HiddenAreaMeshType {
+    /// All mesh types in property order
+    pub const ALL: [Self; 3] = [Self::Standard, Self::Inverse, Self::LineLoop];
+
+    /// Property id holding this mesh for an eye
+    ///
+    /// Same layout as `CVRHiddenAreaHelpers::GetPropertyEnum`.
+    pub fn property_id(self, eye: Eye) -> u32 {
+        sys::root::vr::ETrackedDeviceProperty::Prop_DisplayHiddenArea_Binary_Start as u32
+            + self as u32 * 2
+            + eye as u32
+    }
+}
+
+/// Hidden area generation parameters
+#[derive(Debug, Clone, Copy)]
+pub struct HiddenAreaConfig {
+    /// Radius of the visible panel area, in the lens's normalized units
+    /// (1.0 reaches the viewport edge with the default lens scale)
+    pub visible_radius: f32,
+    /// Points on the visible outline
+    pub segments: u32,
+}
+
+impl Default for HiddenAreaConfig {
+    fn default() -> Self {
+        Self {
+            visible_radius: 1.0,
+            segments: 64,
+        }
+    }
+}
+
+/// A hidden area mesh in render target UV
+///
+/// Triangle meshes store three vertices per triangle, as OpenVR expects;
+/// line loops store one vertex per outline point.
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct HiddenAreaMesh {
+    /// Vertices in 0..1 UV
+    pub vertices: Vec<[f32; 2]>,
+}
+
+impl HiddenAreaMesh {
+    /// Number of triangles, for triangle meshes
+    pub fn triangle_count(&self) -> usize {
+        self.vertices.len() / 3
+    }
+
+    /// Vertex data as `HmdVector2_t` bytes
+    pub fn to_bytes(&self) -> Vec<u8> {
+        let mut bytes = Vec::with_capacity(self.vertices.len() * 8);
+        for [u, v] in &self.vertices {
+            bytes.extend_from_slice(&u.to_ne_bytes());
+            bytes.extend_from_slice(&v.to_ne_bytes());
+        }
+        bytes
+    }
+}
+
+/// Hidden area meshes for one eye
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct EyeHiddenArea {
+    /// Hidden pixels
+    pub standard: HiddenAreaMesh,
+    /// Visible pixels
+    pub inverse: HiddenAreaMesh,
+    /// Visible outline
+    pub line_loop: HiddenAreaMesh,
+}
+
+impl EyeHiddenArea {
+    /// Generate the meshes for one lens
+    pub fn generate(lens: &LensDistortion, config: &HiddenAreaConfig) -> DriverResult<Self> {
+        let outline = visible_outline(lens, config)?;
+        let center = clamp_uv(lens.center);
+
+        Ok(Self {
+            standard: HiddenAreaMesh {
+                vertices: triangulate_hidden(center, &outline),
+            },
+            inverse: HiddenAreaMesh {
+                vertices: triangulate_visible(center, &outline),
+            },
+            line_loop: HiddenAreaMesh { vertices: outline },
+        })
+    }
+
+    /// Mesh of one type
+    pub fn mesh(&self, mesh_type: HiddenAreaMeshType) -> &HiddenAreaMesh {
+        match mesh_type {
+            HiddenAreaMeshType::Standard => &self.standard,
+            HiddenAreaMeshType::Inverse => &self.inverse,
+            HiddenAreaMeshType::LineLoop => &self.line_loop,
+        }
+    }
+}
+
+/// Hidden area meshes for both eyes
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::display::{HiddenAreaConfig, LensDistortion, LensModel, StereoHiddenArea, StereoLens};
+/// # fn activate(container: openvr_driver::PropertyContainer) -> openvr_driver::DriverResult<()> {
+/// let lenses = StereoLens::symmetric(LensDistortion::new(LensModel::Identity));
+/// let hidden_area = StereoHiddenArea::generate(&lenses, &HiddenAreaConfig::default())?;
+/// hidden_area.upload(container)?;
+/// # Ok(())
+/// # }
+/// ```
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct StereoHiddenArea {
+    /// Left eye meshes
+    pub left: EyeHiddenArea,
+    /// Right eye meshes
+    pub right: EyeHiddenArea,
+}
+
+impl StereoHiddenArea {
+    /// Generate the meshes for both lenses
+    pub fn generate(lenses: &StereoLens, config: &HiddenAreaConfig) -> DriverResult<Self> {
+        Ok(Self {
+            left: EyeHiddenArea::generate(&lenses.left, config)?,
+            right: EyeHiddenArea::generate(&lenses.right, config)?,
+        })
+    }
+
+    /// Meshes for one eye
+    pub fn eye(&self, eye: Eye) -> &EyeHiddenArea {
+        match eye {
+            Eye::Left => &self.left,
+            Eye::Right => &self.right,
+        }
+    }
+
+    /// Write all six meshes to the HMD's property container
+    ///
+    /// Call this from `activate`, before the compositor first queries them.
+    pub fn upload(&self, container: PropertyContainer) -> DriverResult<()> {
+        for eye in [Eye::Left, Eye::Right] {
+            for mesh_type in HiddenAreaMeshType::ALL {
+                Properties::set_binary_raw(
+                    container,
+                    mesh_type.property_id(eye),
+                    sys::root::vr::k_unHiddenAreaPropertyTag,
+                    &self.eye(eye).mesh(mesh_type).to_bytes(),
+                )?;
+            }
+        }
+        Ok(())
+    }
+}
+
+/// Map the visible panel circle into render target UV
+///
+/// For each outline point the channel that lands farthest from the lens
+/// center is kept, so no channel's visible pixels get stenciled out.
+fn visible_outline(
+    lens: &LensDistortion,
+    config: &HiddenAreaConfig,
+) -> DriverResult<Vec<[f32; 2]>> {
+    if config.segments < 3 {
+        return Err(DriverError::invalid_parameter(
+            "Hidden area outline needs at least 3 segments",
+        ));
+    }
+    if !(config.visible_radius > 0.0) {
+        return Err(DriverError::invalid_parameter(
+            "Hidden area visible radius must be positive",
+        ));
+    }
+
+    let [cx, cy] = lens.center;
+    let [sx, sy] = lens.scale;
+    let count = config.segments as usize;
+
+    let mut u = Vec::with_capacity(count);
+    let mut v = Vec::with_capacity(count);
+    for i in 0..count {
+        let angle = i as f32 * std::f32::consts::TAU / count as f32;
+        u.push(cx + config.visible_radius * angle.cos() / sx);
+        v.push(cy + config.visible_radius * angle.sin() / sy);
+    }
+
+    let mut distorted = vec![[0.0f32; 6]; count];
+    lens.distort_batch(&u, &v, &mut distorted);
+
+    Ok(distorted
+        .iter()
+        .map(|sample| {
+            let farthest = (0..3)
+                .map(|c| [sample[c * 2], sample[c * 2 + 1]])
+                .max_by(|a, b| {
+                    let da = (a[0] - cx).powi(2) + (a[1] - cy).powi(2);
+                    let db = (b[0] - cx).powi(2) + (b[1] - cy).powi(2);
+                    da.total_cmp(&db)
+                })
+                .unwrap_or([cx, cy]);
+            clamp_uv(farthest)
+        })
+        .collect())
+}
+
+fn clamp_uv([u, v]: [f32; 2]) -> [f32; 2] {
+    [u.clamp(0.0, 1.0), v.clamp(0.0, 1.0)]
+}
+
+/// Twice the signed area of a triangle
+fn doubled_area(a: [f32; 2], b: [f32; 2], c: [f32; 2]) -> f32 {
+    (b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1])
+}
+
+/// Push a triangle unless it is degenerate (for example clamped onto an edge)
+fn push_triangle(out: &mut Vec<[f32; 2]>, a: [f32; 2], b: [f32; 2], c: [f32; 2]) {
+    if doubled_area(a, b, c).abs() > 1.0e-9 {
+        out.extend([a, b, c]);
+    }
+}
+
+/// Fan from the lens center over the outline
+fn triangulate_visible(center: [f32; 2], outline: &[[f32; 2]]) -> Vec<[f32; 2]> {
+    let mut out = Vec::with_capacity(outline.len() * 3);
+    for i in 0..outline.len() {
+        let next = outline[(i + 1) % outline.len()];
+        push_triangle(&mut out, center, outline[i], next);
+    }
+    out
+}
+
+/// Where the ray from `center` through `point` leaves the unit square
+fn project_to_border(center: [f32; 2], point: [f32; 2]) -> [f32; 2] {
+    let d = [point[0] - center[0], point[1] - center[1]];
+    let mut t = f32::INFINITY;
+    for axis in 0..2 {
+        if d[axis] > f32::EPSILON {
+            t = t.min((1.0 - center[axis]) / d[axis]);
+        } else if d[axis] < -f32::EPSILON {
+            t = t.min(-center[axis] / d[axis]);
+        }
+    }
+    if !t.is_finite() {
+        return point;
+    }
+    clamp_uv([center[0] + d[0] * t, center[1] + d[1] * t])
+}
+
+/// Viewport corners in border order; corner `k` sits at border position `k`
+const BORDER_CORNERS: [[f32; 2]; 4] = [[1.0, 0.0], [1.0, 1.0], [0.0, 1.0], [0.0, 0.0]];
+
+/// Position of a border point along the viewport edge, in 0..4
+///
+/// Increases with the angle around the lens center, the direction the
+/// outline is generated in.
+fn border_position([u, v]: [f32; 2]) -> f32 {
+    let on = |x: f32, value: f32| (x - value).abs() < 1.0e-6;
+    if on(u, 1.0) {
+        v
+    } else if on(v, 1.0) {
+        2.0 - u
+    } else if on(u, 0.0) {
+        3.0 - v
+    } else {
+        3.0 + u
+    }
+}
+
+/// Square corners passed, in order, walking the border from `a` to `b` the short way
+fn corners_between(a: [f32; 2], b: [f32; 2]) -> Vec<[f32; 2]> {
+    const EPSILON: f32 = 1.0e-6;
+
+    let start = border_position(a);
+    let forward = (border_position(b) - start).rem_euclid(4.0);
+    let (mut k, step, end) = if forward <= 2.0 {
+        ((start + EPSILON).floor() + 1.0, 1.0, start + forward)
+    } else {
+        ((start - EPSILON).ceil() - 1.0, -1.0, start + forward - 4.0)
+    };
+
+    let mut corners = Vec::new();
+    while (end - k) * step > EPSILON {
+        corners.push(BORDER_CORNERS[(k as i32).rem_euclid(4) as usize]);
+        k += step;
+    }
+    corners
+}
+
+/// Triangulate the band between the outline and the viewport border
+///
+/// Each outline point is projected outward onto the border; every outline
+/// segment then yields one quad (two triangles), with the border side fanned
+/// out over each viewport corner the projected segment wraps. Coarse outlines
+/// can wrap more than one.
+fn triangulate_hidden(center: [f32; 2], outline: &[[f32; 2]]) -> Vec<[f32; 2]> {
+    let border: Vec<[f32; 2]> = outline
+        .iter()
+        .map(|p| project_to_border(center, *p))
+        .collect();
+
+    let mut out = Vec::with_capacity(outline.len() * 9);
+    for i in 0..outline.len() {
+        let j = (i + 1) % outline.len();
+        let (p0, p1) = (outline[i], outline[j]);
+        let (q0, q1) = (border[i], border[j]);
+
+        let mut previous = q0;
+        for corner in corners_between(q0, q1) {
+            push_triangle(&mut out, p0, previous, corner);
+            previous = corner;
+        }
+        push_triangle(&mut out, p0, previous, q1);
+        push_triangle(&mut out, p0, q1, p1);
+    }
+    out
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::display::LensModel;
+
+    fn area(mesh: &HiddenAreaMesh) -> f32 {
+        mesh.vertices
+            .chunks_exact(3)
+            .map(|t| doubled_area(t[0], t[1], t[2]).abs() / 2.0)
+            .sum()
+    }
+
+    #[test]
+    fn meshes_cover_the_viewport_at_any_segment_count() {
+        let lenses = [
+            LensDistortion::new(LensModel::Identity),
+            LensDistortion {
+                model: LensModel::RadialPolynomial([[0.2, 0.05, 0.0, 0.0]; 3]),
+                center: [0.45, 0.55],
+                scale: [2.0, 2.0],
+            },
+        ];
+
+        for lens in &lenses {
+            for segments in [3, 4, 5, 6, 8, 64] {
+                let config = HiddenAreaConfig {
+                    visible_radius: 0.6,
+                    segments,
+                };
+                let eye = EyeHiddenArea::generate(lens, &config).unwrap();
+                let total = area(&eye.standard) + area(&eye.inverse);
+                assert!(
+                    (total - 1.0).abs() < 1.0e-4,
+                    "{} segments cover {} of the viewport",
+                    segments,
+                    total
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn walks_every_wrapped_corner() {
+        // Right edge to the bottom of the left edge passes (1, 1) and (0, 1)
+        assert_eq!(
+            corners_between([1.0, 0.5], [0.0, 0.8]),
+            vec![[1.0, 1.0], [0.0, 1.0]]
+        );
+        // The short way round may run backwards
+        assert_eq!(
+            corners_between([0.0, 0.8], [1.0, 0.5]),
+            vec![[0.0, 1.0], [1.0, 1.0]]
+        );
+        assert!(corners_between([1.0, 0.2], [1.0, 0.7]).is_empty());
+    }
+}
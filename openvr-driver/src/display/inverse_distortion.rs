@@ -0,0 +1,314 @@
+//! Inverse lens distortion
+//!
+//! `ComputeInverseDistortion` asks for the undistorted UV that a given
+//! color channel maps to a distorted UV. Any forward model can be inverted
+//! numerically: a coarse inverse grid is solved once with continuation from
+//! neighbouring points, and each query is then seeded by interpolating that
+//! grid and refined with a few Newton iterations using a finite-difference
+//! Jacobian. A good seed means queries converge in one or two iterations.
+
+use super::DistortionSample;
+use crate::{DriverError, DriverResult, Eye};
+
+/// Step used for the finite-difference Jacobian
+const JACOBIAN_STEP: f32 = 1.0e-3;
+
+/// Iteration limit when solving the seed grid from scratch
+const SEED_ITERATIONS: u32 = 32;
+
+/// Solver settings for `InverseDistortion`
+#[derive(Debug, Clone, Copy)]
+pub struct InverseDistortionConfig {
+    /// Seed grid samples per axis (at least 2)
+    pub grid_size: u32,
+    /// Maximum Newton iterations per query
+    pub max_iterations: u32,
+    /// Residual (in UV units) below which a solution is accepted
+    pub tolerance: f32,
+}
+
+impl Default for InverseDistortionConfig {
+    fn default() -> Self {
+        Self {
+            grid_size: 17,
+            max_iterations: 8,
+            tolerance: 1.0e-5,
+        }
+    }
+}
+
+/// Per-channel inverse of a forward distortion model
+///
+/// The forward model is passed to every call instead of being stored, so the
+/// same solver works over a component's `compute_distortion` or over a
+/// `DistortionGrid`.
+#[derive(Debug, Clone)]
+pub struct InverseDistortion {
+    config: InverseDistortionConfig,
+    /// Undistorted UV seeds, indexed by `[eye][channel][row * grid_size + column]`
+    seeds: [[Vec<[f32; 2]>; 3]; 2],
+}
+
+impl InverseDistortion {
+    /// Solve the coarse inverse grid for both eyes and all three channels
+    pub fn build<F>(config: InverseDistortionConfig, forward: &F) -> DriverResult<Self>
+    where
+        F: Fn(Eye, f32, f32) -> DistortionSample,
+    {
+        if config.grid_size < 2 {
+            return Err(DriverError::invalid_parameter(
+                "Inverse distortion grid needs at least 2x2 samples",
+            ));
+        }
+
+        let n = config.grid_size as usize;
+        let step = 1.0 / (n - 1) as f32;
+        let seed_solver = Newton {
+            max_iterations: SEED_ITERATIONS,
+            tolerance: config.tolerance,
+        };
+
+        let solve_channel = |eye: Eye, channel: usize| -> Vec<[f32; 2]> {
+            let mut seeds = vec![[0.0f32; 2]; n * n];
+            for row in 0..n {
+                for column in 0..n {
+                    let target = [column as f32 * step, row as f32 * step];
+
+                    // Continue from a solved neighbour; the identity is a
+                    // reasonable start only for the first point
+                    let start = if column > 0 {
+                        seeds[row * n + column - 1]
+                    } else if row > 0 {
+                        seeds[(row - 1) * n]
+                    } else {
+                        target
+                    };
+
+                    seeds[row * n + column] = seed_solver
+                        .solve(forward, eye, channel, target, start)
+                        .unwrap_or(start);
+                }
+            }
+            seeds
+        };
+
+        Ok(Self {
+            config,
+            seeds: [Eye::Left, Eye::Right]
+                .map(|eye| [0, 1, 2].map(|channel| solve_channel(eye, channel))),
+        })
+    }
+
+    /// Solver settings
+    pub fn config(&self) -> &InverseDistortionConfig {
+        &self.config
+    }
+
+    /// Find the undistorted UV that `channel` (0 red, 1 green, 2 blue) maps to (u, v)
+    ///
+    /// # Returns
+    /// * `None` if the channel is invalid or the solve did not converge
+    pub fn solve<F>(&self, forward: &F, eye: Eye, channel: u32, u: f32, v: f32) -> Option<[f32; 2]>
+    where
+        F: Fn(Eye, f32, f32) -> DistortionSample,
+    {
+        let channel = channel as usize;
+        if channel > 2 || !u.is_finite() || !v.is_finite() {
+            return None;
+        }
+
+        let seed = self.seed(eye, channel, u, v);
+        Newton {
+            max_iterations: self.config.max_iterations,
+            tolerance: self.config.tolerance,
+        }
+        .solve(forward, eye, channel, [u, v], seed)
+    }
+
+    /// Interpolate the seed grid at (u, v), clamped to the grid
+    fn seed(&self, eye: Eye, channel: usize, u: f32, v: f32) -> [f32; 2] {
+        let seeds = &self.seeds[eye as usize][channel];
+        let n = self.config.grid_size as usize;
+        let max = (n - 1) as f32;
+
+        let fx = u.clamp(0.0, 1.0) * max;
+        let fy = v.clamp(0.0, 1.0) * max;
+        let x0 = (fx as usize).min(n - 2);
+        let y0 = (fy as usize).min(n - 2);
+        let tx = fx - x0 as f32;
+        let ty = fy - y0 as f32;
+
+        let i = y0 * n + x0;
+        let lerp =
+            |a: [f32; 2], b: [f32; 2], t: f32| [a[0] + (b[0] - a[0]) * t, a[1] + (b[1] - a[1]) * t];
+        let top = lerp(seeds[i], seeds[i + 1], tx);
+        let bottom = lerp(seeds[i + n], seeds[i + n + 1], tx);
+        lerp(top, bottom, ty)
+    }
+}
+
+/// Newton iteration on one color channel of a forward model
+struct Newton {
+    max_iterations: u32,
+    tolerance: f32,
+}
+
+impl Newton {
+    fn solve<F>(
+        &self,
+        forward: &F,
+        eye: Eye,
+        channel: usize,
+        target: [f32; 2],
+        start: [f32; 2],
+    ) -> Option<[f32; 2]>
+    where
+        F: Fn(Eye, f32, f32) -> DistortionSample,
+    {
+        let eval = |p: [f32; 2]| -> [f32; 2] {
+            let sample = forward(eye, p[0], p[1]);
+            [sample[channel * 2], sample[channel * 2 + 1]]
+        };
+
+        let mut p = start;
+        let mut f = eval(p);
+
+        for iteration in 0..=self.max_iterations {
+            let r = [f[0] - target[0], f[1] - target[1]];
+            if r[0].abs() <= self.tolerance && r[1].abs() <= self.tolerance {
+                return Some(p);
+            }
+            if iteration == self.max_iterations {
+                break;
+            }
+
+            // Forward-difference Jacobian: two extra evaluations per iteration
+            let fu = eval([p[0] + JACOBIAN_STEP, p[1]]);
+            let fv = eval([p[0], p[1] + JACOBIAN_STEP]);
+            let j00 = (fu[0] - f[0]) / JACOBIAN_STEP;
+            let j10 = (fu[1] - f[1]) / JACOBIAN_STEP;
+            let j01 = (fv[0] - f[0]) / JACOBIAN_STEP;
+            let j11 = (fv[1] - f[1]) / JACOBIAN_STEP;
+
+            let det = j00 * j11 - j01 * j10;
+            if !det.is_finite() || det.abs() < f32::EPSILON {
+                return None;
+            }
+
+            p = [
+                p[0] - (j11 * r[0] - j01 * r[1]) / det,
+                p[1] - (j00 * r[1] - j10 * r[0]) / det,
+            ];
+            f = eval(p);
+        }
+
+        None
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::display::{BrownConrady, LensDistortion, LensModel, StereoLens};
+
+    /// One instance of every built-in model, with realistic HMD strengths
+    fn models() -> Vec<LensModel> {
+        vec![
+            LensModel::Identity,
+            LensModel::RadialPolynomial([
+                [0.20, 0.04, 0.0, 0.0],
+                [0.22, 0.05, 0.0, 0.0],
+                [0.24, 0.06, 0.0, 0.0],
+            ]),
+            LensModel::BrownConrady([0.20, 0.22, 0.24].map(|k1| BrownConrady {
+                k: [k1, 0.04, 0.0],
+                p: [0.002, -0.001],
+            })),
+            LensModel::FTheta([[0.05, 0.01, 0.0, 0.0]; 3]),
+            LensModel::ExtendedFTheta([[0.05, 0.01, 0.002, 0.0, 0.0, 0.0, 0.0, 0.0]; 3]),
+        ]
+    }
+
+    /// Undistorted UVs on a grid, plus points hugging every edge
+    fn sample_points() -> Vec<[f32; 2]> {
+        let steps = [
+            0.0, 0.001, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999, 1.0,
+        ];
+        steps
+            .iter()
+            .flat_map(|&u| steps.iter().map(move |&v| [u, v]))
+            .collect()
+    }
+
+    /// Largest UV error of distort-then-invert over every eye, channel and point
+    fn round_trip_error(lenses: &StereoLens) -> f32 {
+        let forward = |eye: Eye, u: f32, v: f32| lenses.eye(eye).distort(u, v);
+        let inverse = InverseDistortion::build(InverseDistortionConfig::default(), &forward)
+            .expect("seed grid");
+
+        let mut worst = 0.0f32;
+        for eye in [Eye::Left, Eye::Right] {
+            for channel in 0..3u32 {
+                for [u, v] in sample_points() {
+                    let distorted = forward(eye, u, v);
+                    let (du, dv) = (
+                        distorted[channel as usize * 2],
+                        distorted[channel as usize * 2 + 1],
+                    );
+                    let [su, sv] = inverse
+                        .solve(&forward, eye, channel, du, dv)
+                        .unwrap_or_else(|| {
+                            panic!(
+                                "no solution for {:?} channel {} at ({}, {})",
+                                eye, channel, u, v
+                            )
+                        });
+                    worst = worst.max((su - u).abs()).max((sv - v).abs());
+                }
+            }
+        }
+        worst
+    }
+
+    #[test]
+    fn inverts_every_built_in_model() {
+        for model in models() {
+            let lenses = StereoLens::symmetric(LensDistortion::new(model.clone()));
+            let error = round_trip_error(&lenses);
+            assert!(error < 1.0e-4, "{:?}: max UV error {}", model, error);
+        }
+    }
+
+    #[test]
+    fn inverts_off_center_lenses() {
+        for model in models() {
+            let mut left = LensDistortion::new(model.clone());
+            left.center = [0.54, 0.5];
+            let mut right = left.clone();
+            right.center = [0.46, 0.5];
+            let error = round_trip_error(&StereoLens { left, right });
+            assert!(error < 1.0e-4, "{:?}: max UV error {}", model, error);
+        }
+    }
+
+    #[test]
+    fn rejects_invalid_queries() {
+        let lenses = StereoLens::symmetric(LensDistortion::new(LensModel::Identity));
+        let forward = |eye: Eye, u: f32, v: f32| lenses.eye(eye).distort(u, v);
+        let inverse =
+            InverseDistortion::build(InverseDistortionConfig::default(), &forward).unwrap();
+
+        assert!(inverse.solve(&forward, Eye::Left, 3, 0.5, 0.5).is_none());
+        assert!(inverse
+            .solve(&forward, Eye::Left, 0, f32::NAN, 0.5)
+            .is_none());
+        assert!(InverseDistortion::build(
+            InverseDistortionConfig {
+                grid_size: 1,
+                ..Default::default()
+            },
+            &forward
+        )
+        .is_err());
+    }
+}
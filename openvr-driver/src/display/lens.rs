@@ -0,0 +1,562 @@
+//! Built-in lens distortion models
+//!
+//! `LensDistortion` covers the models most HMD and camera lenses are
+//! described with: a per-channel radial polynomial, Brown-Conrady, and the
+//! `EVRDistortionFunctionType` variants (FTheta and extended FTheta).
+//!
+//! Every model has two evaluation paths. `distort` is the scalar reference,
+//! written directly from the formulas. `distort_batch` evaluates points in
+//! fixed-width lanes laid out for the vectorizer and, on x86_64, dispatches
+//! at runtime to a build of the same kernel compiled for AVX2. The batch path
+//! is what grid precomputation uses; the reference exists to validate it.
+
+use super::DistortionSample;
+use crate::{DistortionFunctionType, DriverError, DriverResult, Eye};
+
+/// Points evaluated together by the batch kernel
+const LANES: usize = 8;
+
+/// Radius below which the FTheta scale factor is taken as its limit of 1
+const FTHETA_MIN_RADIUS: f32 = 1.0e-7;
+
+/// Brown-Conrady coefficients for one color channel
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct BrownConrady {
+    /// Radial coefficients k1, k2, k3
+    pub k: [f32; 3],
+    /// Tangential coefficients p1, p2
+    pub p: [f32; 2],
+}
+
+/// Lens model with per-channel coefficients, indexed red, green, blue
+#[derive(Debug, Clone, PartialEq)]
+pub enum LensModel {
+    /// No distortion
+    Identity,
+    /// `r' = r (1 + k1 r^2 + k2 r^4 + k3 r^6 + k4 r^8)`
+    RadialPolynomial([[f32; 4]; 3]),
+    /// Radial polynomial plus tangential (decentering) terms
+    BrownConrady([BrownConrady; 3]),
+    /// `VRDistortionFunctionType_FTheta`: with `theta = atan(r)`,
+    /// `r' = theta (1 + k1 theta^2 + k2 theta^4 + k3 theta^6 + k4 theta^8)`
+    FTheta([[f32; 4]; 3]),
+    /// `VRDistortionFunctionType_Extended_FTheta`: the FTheta series carried
+    /// to all `k_unMaxDistortionFunctionParameters` coefficients
+    ExtendedFTheta([[f32; 8]; 3]),
+}
+
+impl LensModel {
+    /// Build a model from an OpenVR distortion function type and its coefficients
+    ///
+    /// The same coefficients are used for all three channels. Missing
+    /// coefficients are zero.
+    pub fn from_function_type(
+        function_type: DistortionFunctionType,
+        coefficients: &[f64],
+    ) -> DriverResult<Self> {
+        fn take<const N: usize>(coefficients: &[f64]) -> [f32; N] {
+            std::array::from_fn(|i| coefficients.get(i).copied().unwrap_or(0.0) as f32)
+        }
+
+        match function_type {
+            DistortionFunctionType::None => Ok(Self::Identity),
+            DistortionFunctionType::FTheta => Ok(Self::FTheta([take(coefficients); 3])),
+            DistortionFunctionType::Extended_FTheta => {
+                Ok(Self::ExtendedFTheta([take(coefficients); 3]))
+            }
+            _ => Err(DriverError::invalid_parameter(
+                "Unsupported distortion function type",
+            )),
+        }
+    }
+
+    /// OpenVR function type and coefficients describing this model
+    ///
+    /// OpenVR carries a single coefficient set, so the green channel is used.
+    ///
+    /// # Returns
+    /// * `None` for models OpenVR has no function type for
+    pub fn to_function_type(&self) -> Option<(DistortionFunctionType, [f64; 8])> {
+        let mut coefficients = [0.0f64; 8];
+        match self {
+            Self::Identity => Some((DistortionFunctionType::None, coefficients)),
+            Self::FTheta(k) => {
+                for (out, k) in coefficients.iter_mut().zip(k[1]) {
+                    *out = k as f64;
+                }
+                Some((DistortionFunctionType::FTheta, coefficients))
+            }
+            Self::ExtendedFTheta(k) => {
+                for (out, k) in coefficients.iter_mut().zip(k[1]) {
+                    *out = k as f64;
+                }
+                Some((DistortionFunctionType::Extended_FTheta, coefficients))
+            }
+            Self::RadialPolynomial(_) | Self::BrownConrady(_) => None,
+        }
+    }
+
+    /// Scalar reference: distort a normalized point for one channel
+    fn distort_point(&self, channel: usize, x: f32, y: f32) -> (f32, f32) {
+        match self {
+            Self::Identity => (x, y),
+            Self::RadialPolynomial(k) => {
+                let [k1, k2, k3, k4] = k[channel];
+                let r2 = x * x + y * y;
+                let scale = 1.0 + k1 * r2 + k2 * r2.powi(2) + k3 * r2.powi(3) + k4 * r2.powi(4);
+                (x * scale, y * scale)
+            }
+            Self::BrownConrady(coefficients) => {
+                let BrownConrady {
+                    k: [k1, k2, k3],
+                    p: [p1, p2],
+                } = coefficients[channel];
+                let r2 = x * x + y * y;
+                let radial = 1.0 + k1 * r2 + k2 * r2.powi(2) + k3 * r2.powi(3);
+                (
+                    x * radial + 2.0 * p1 * x * y + p2 * (r2 + 2.0 * x * x),
+                    y * radial + p1 * (r2 + 2.0 * y * y) + 2.0 * p2 * x * y,
+                )
+            }
+            Self::FTheta(k) => ftheta_point(&k[channel], x, y),
+            Self::ExtendedFTheta(k) => ftheta_point(&k[channel], x, y),
+        }
+    }
+
+    /// Batch kernel: distort `LANES` normalized points for one channel
+    #[inline(always)]
+    fn distort_lanes(
+        &self,
+        channel: usize,
+        x: &[f32; LANES],
+        y: &[f32; LANES],
+        out_x: &mut [f32; LANES],
+        out_y: &mut [f32; LANES],
+    ) {
+        match self {
+            Self::Identity => {
+                *out_x = *x;
+                *out_y = *y;
+            }
+            Self::RadialPolynomial(k) => {
+                let [k1, k2, k3, k4] = k[channel];
+                for i in 0..LANES {
+                    let r2 = x[i] * x[i] + y[i] * y[i];
+                    let scale = 1.0 + r2 * (k1 + r2 * (k2 + r2 * (k3 + r2 * k4)));
+                    out_x[i] = x[i] * scale;
+                    out_y[i] = y[i] * scale;
+                }
+            }
+            Self::BrownConrady(coefficients) => {
+                let BrownConrady {
+                    k: [k1, k2, k3],
+                    p: [p1, p2],
+                } = coefficients[channel];
+                for i in 0..LANES {
+                    let (px, py) = (x[i], y[i]);
+                    let r2 = px * px + py * py;
+                    let radial = 1.0 + r2 * (k1 + r2 * (k2 + r2 * k3));
+                    let xy2 = 2.0 * px * py;
+                    out_x[i] = px * radial + p1 * xy2 + p2 * (r2 + 2.0 * px * px);
+                    out_y[i] = py * radial + p1 * (r2 + 2.0 * py * py) + p2 * xy2;
+                }
+            }
+            Self::FTheta(k) => ftheta_lanes(&k[channel], x, y, out_x, out_y),
+            Self::ExtendedFTheta(k) => ftheta_lanes(&k[channel], x, y, out_x, out_y),
+        }
+    }
+
+    /// Coefficients in a fixed order, for cache keys
+    fn push_parameters(&self, out: &mut Vec<f32>) {
+        match self {
+            Self::Identity => out.push(0.0),
+            Self::RadialPolynomial(k) => {
+                out.push(1.0);
+                out.extend(k.iter().flatten());
+            }
+            Self::BrownConrady(coefficients) => {
+                out.push(2.0);
+                for c in coefficients {
+                    out.extend(c.k);
+                    out.extend(c.p);
+                }
+            }
+            Self::FTheta(k) => {
+                out.push(3.0);
+                out.extend(k.iter().flatten());
+            }
+            Self::ExtendedFTheta(k) => {
+                out.push(4.0);
+                out.extend(k.iter().flatten());
+            }
+        }
+    }
+}
+
+/// Scalar reference FTheta
+fn ftheta_point<const N: usize>(k: &[f32; N], x: f32, y: f32) -> (f32, f32) {
+    let r = (x * x + y * y).sqrt();
+    if r < FTHETA_MIN_RADIUS {
+        return (x, y);
+    }
+
+    let theta = r.atan();
+    let mut series = 1.0;
+    for (i, k) in k.iter().enumerate() {
+        series += k * theta.powi(2 * (i as i32 + 1));
+    }
+    let scale = theta * series / r;
+    (x * scale, y * scale)
+}
+
+/// Batch FTheta; uses a polynomial arctangent so the lanes stay branch free
+#[inline(always)]
+fn ftheta_lanes<const N: usize>(
+    k: &[f32; N],
+    x: &[f32; LANES],
+    y: &[f32; LANES],
+    out_x: &mut [f32; LANES],
+    out_y: &mut [f32; LANES],
+) {
+    for i in 0..LANES {
+        let r = (x[i] * x[i] + y[i] * y[i]).sqrt();
+        let theta = atan_positive(r);
+        let theta2 = theta * theta;
+
+        let mut series = k[N - 1];
+        for j in (0..N - 1).rev() {
+            series = k[j] + theta2 * series;
+        }
+        let series = 1.0 + theta2 * series;
+
+        let scale = if r < FTHETA_MIN_RADIUS {
+            1.0
+        } else {
+            theta * series / r
+        };
+        out_x[i] = x[i] * scale;
+        out_y[i] = y[i] * scale;
+    }
+}
+
+/// Arctangent of a non-negative value, absolute error below 1e-5
+#[inline(always)]
+fn atan_positive(value: f32) -> f32 {
+    let invert = value > 1.0;
+    let t = if invert { 1.0 / value } else { value };
+    let t2 = t * t;
+    let p = t
+        * (0.999_977_26
+            + t2 * (-0.332_623_47
+                + t2 * (0.193_543_46
+                    + t2 * (-0.116_432_87 + t2 * (0.052_653_32 + t2 * -0.011_721_2)))));
+    if invert {
+        std::f32::consts::FRAC_PI_2 - p
+    } else {
+        p
+    }
+}
+
+/// A lens model placed on a viewport
+///
+/// Viewport UVs are mapped to normalized lens coordinates with
+/// `(uv - center) * scale`, distorted, and mapped back. With the default
+/// `center` of (0.5, 0.5) and `scale` of (2, 2), the viewport edges sit at
+/// radius 1. FTheta models expect tangent-space coordinates, so set `scale`
+/// to twice the tangent of the half field of view.
+#[derive(Debug, Clone, PartialEq)]
+pub struct LensDistortion {
+    /// Model and coefficients
+    pub model: LensModel,
+    /// Optical center in viewport UV
+    pub center: [f32; 2],
+    /// UV to normalized coordinate scale per axis
+    pub scale: [f32; 2],
+}
+
+impl LensDistortion {
+    /// Place a model at the viewport center with edges at radius 1
+    pub fn new(model: LensModel) -> Self {
+        Self {
+            model,
+            center: [0.5, 0.5],
+            scale: [2.0, 2.0],
+        }
+    }
+
+    /// Scalar reference: distort one viewport UV for all three channels
+    pub fn distort(&self, u: f32, v: f32) -> DistortionSample {
+        let x = (u - self.center[0]) * self.scale[0];
+        let y = (v - self.center[1]) * self.scale[1];
+
+        let mut out = [0.0f32; 6];
+        for channel in 0..3 {
+            let (dx, dy) = self.model.distort_point(channel, x, y);
+            out[channel * 2] = dx / self.scale[0] + self.center[0];
+            out[channel * 2 + 1] = dy / self.scale[1] + self.center[1];
+        }
+        out
+    }
+
+    /// Distort a batch of viewport UVs
+    ///
+    /// # Panics
+    /// If `u`, `v` and `out` differ in length.
+    pub fn distort_batch(&self, u: &[f32], v: &[f32], out: &mut [DistortionSample]) {
+        assert!(
+            u.len() == v.len() && u.len() == out.len(),
+            "distort_batch slices must have equal lengths"
+        );
+
+        #[cfg(target_arch = "x86_64")]
+        {
+            if is_x86_feature_detected!("avx2") {
+                // Safe because the CPU supports the features the copy was built for
+                unsafe { self.distort_batch_avx2(u, v, out) };
+                return;
+            }
+        }
+
+        self.distort_batch_generic(u, v, out);
+    }
+
+    #[cfg(target_arch = "x86_64")]
+    #[target_feature(enable = "avx2")]
+    unsafe fn distort_batch_avx2(&self, u: &[f32], v: &[f32], out: &mut [DistortionSample]) {
+        self.distort_batch_generic(u, v, out);
+    }
+
+    #[inline(always)]
+    fn distort_batch_generic(&self, u: &[f32], v: &[f32], out: &mut [DistortionSample]) {
+        let full = u.len() / LANES * LANES;
+
+        for ((u, v), out) in u[..full]
+            .chunks_exact(LANES)
+            .zip(v[..full].chunks_exact(LANES))
+            .zip(out[..full].chunks_exact_mut(LANES))
+        {
+            self.distort_lanes(
+                u.try_into().unwrap(),
+                v.try_into().unwrap(),
+                out.try_into().unwrap(),
+            );
+        }
+
+        // Pad the tail out to a full set of lanes
+        let rest = u.len() - full;
+        if rest > 0 {
+            let mut tail_u = [self.center[0]; LANES];
+            let mut tail_v = [self.center[1]; LANES];
+            let mut tail_out = [[0.0f32; 6]; LANES];
+            tail_u[..rest].copy_from_slice(&u[full..]);
+            tail_v[..rest].copy_from_slice(&v[full..]);
+            self.distort_lanes(&tail_u, &tail_v, &mut tail_out);
+            out[full..].copy_from_slice(&tail_out[..rest]);
+        }
+    }
+
+    #[inline(always)]
+    fn distort_lanes(
+        &self,
+        u: &[f32; LANES],
+        v: &[f32; LANES],
+        out: &mut [DistortionSample; LANES],
+    ) {
+        let [cx, cy] = self.center;
+        let [sx, sy] = self.scale;
+        let (inv_sx, inv_sy) = (1.0 / sx, 1.0 / sy);
+
+        let mut x = [0.0f32; LANES];
+        let mut y = [0.0f32; LANES];
+        for i in 0..LANES {
+            x[i] = (u[i] - cx) * sx;
+            y[i] = (v[i] - cy) * sy;
+        }
+
+        let mut dx = [0.0f32; LANES];
+        let mut dy = [0.0f32; LANES];
+        for channel in 0..3 {
+            self.model.distort_lanes(channel, &x, &y, &mut dx, &mut dy);
+            for i in 0..LANES {
+                out[i][channel * 2] = dx[i] * inv_sx + cx;
+                out[i][channel * 2 + 1] = dy[i] * inv_sy + cy;
+            }
+        }
+    }
+
+    /// Append this lens's parameters, for `DistortionCacheConfig::lens_parameters`
+    pub fn push_parameters(&self, out: &mut Vec<f32>) {
+        self.model.push_parameters(out);
+        out.extend(self.center);
+        out.extend(self.scale);
+    }
+}
+
+/// Lens pair for a stereo display
+///
+/// Implements the distortion side of `DisplayComponent` for drivers that
+/// describe their optics with one of the built-in models.
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::display::{LensDistortion, LensModel, StereoLens};
+/// use openvr_driver::Eye;
+///
+/// let lens = LensDistortion::new(LensModel::RadialPolynomial([
+///     [0.22, 0.05, 0.0, 0.0],
+///     [0.24, 0.05, 0.0, 0.0],
+///     [0.26, 0.05, 0.0, 0.0],
+/// ]));
+/// let lenses = StereoLens::symmetric(lens);
+/// let (ru, rv, gu, gv, bu, bv) = lenses.compute_distortion(Eye::Left, 0.25, 0.5);
+/// ```
+#[derive(Debug, Clone, PartialEq)]
+pub struct StereoLens {
+    /// Left eye lens
+    pub left: LensDistortion,
+    /// Right eye lens
+    pub right: LensDistortion,
+}
+
+impl StereoLens {
+    /// Use the same lens for both eyes
+    pub fn symmetric(lens: LensDistortion) -> Self {
+        Self {
+            left: lens.clone(),
+            right: lens,
+        }
+    }
+
+    /// Lens for one eye
+    pub fn eye(&self, eye: Eye) -> &LensDistortion {
+        match eye {
+            Eye::Left => &self.left,
+            Eye::Right => &self.right,
+        }
+    }
+
+    /// Same shape as `DisplayComponent::compute_distortion`
+    pub fn compute_distortion(&self, eye: Eye, u: f32, v: f32) -> (f32, f32, f32, f32, f32, f32) {
+        let [ru, rv, gu, gv, bu, bv] = self.eye(eye).distort(u, v);
+        (ru, rv, gu, gv, bu, bv)
+    }
+
+    /// Same shape as `DisplayComponent::compute_distortion_row`
+    pub fn compute_distortion_row(
+        &self,
+        eye: Eye,
+        u: &[f32],
+        v: f32,
+        out: &mut [DistortionSample],
+    ) {
+        // Rows are short, so a stack buffer covers typical grids
+        let v_row = [v; 256];
+        let lens = self.eye(eye);
+        for (u, out) in u.chunks(v_row.len()).zip(out.chunks_mut(v_row.len())) {
+            lens.distort_batch(u, &v_row[..u.len()], out);
+        }
+    }
+
+    /// Parameters of both lenses, for `DistortionCacheConfig::lens_parameters`
+    pub fn parameters(&self) -> Vec<f32> {
+        let mut out = Vec::new();
+        self.left.push_parameters(&mut out);
+        self.right.push_parameters(&mut out);
+        out
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn models() -> Vec<LensModel> {
+        vec![
+            LensModel::Identity,
+            LensModel::RadialPolynomial([
+                [0.20, 0.04, 0.01, 0.002],
+                [0.22, 0.05, 0.01, 0.002],
+                [0.24, 0.06, 0.01, 0.002],
+            ]),
+            LensModel::BrownConrady([0.20, 0.22, 0.24].map(|k1| BrownConrady {
+                k: [k1, 0.04, 0.01],
+                p: [0.002, -0.001],
+            })),
+            LensModel::FTheta([[0.05, 0.01, 0.0, 0.0]; 3]),
+            LensModel::ExtendedFTheta([[0.05, 0.01, 0.002, 0.0005, 0.0, 0.0, 0.0, 0.0]; 3]),
+        ]
+    }
+
+    /// Tolerance covering the FTheta lanes' polynomial arctangent
+    const TOLERANCE: f32 = 2e-6;
+
+    /// Largest per-component difference between the batch and scalar paths
+    fn batch_error(
+        lens: &LensDistortion,
+        points: usize,
+        batch: impl Fn(&[f32], &[f32], &mut [DistortionSample]),
+    ) -> f32 {
+        let mut seed = 0x2545_f491u32;
+        let mut next = || {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            seed as f32 / u32::MAX as f32
+        };
+        let u: Vec<f32> = (0..points).map(|_| next()).collect();
+        let v: Vec<f32> = (0..points).map(|_| next()).collect();
+
+        let mut out = vec![[0.0f32; 6]; points];
+        batch(&u, &v, &mut out);
+
+        let mut worst = 0.0f32;
+        for i in 0..points {
+            let reference = lens.distort(u[i], v[i]);
+            for (a, b) in out[i].iter().zip(reference) {
+                worst = worst.max((a - b).abs());
+            }
+        }
+        worst
+    }
+
+    #[test]
+    fn batch_matches_scalar_for_every_model() {
+        for model in models() {
+            let centered = LensDistortion::new(model.clone());
+            let off_center = LensDistortion {
+                model,
+                center: [0.46, 0.53],
+                scale: [1.8, 2.2],
+            };
+
+            for lens in [centered, off_center] {
+                // Not a multiple of LANES, so the padded tail is exercised
+                let points = 64 * LANES + 5;
+                let dispatched =
+                    batch_error(&lens, points, |u, v, out| lens.distort_batch(u, v, out));
+                let generic = batch_error(&lens, points, |u, v, out| {
+                    lens.distort_batch_generic(u, v, out)
+                });
+                assert!(
+                    dispatched < TOLERANCE && generic < TOLERANCE,
+                    "{:?}: batch error {} (dispatched), {} (generic)",
+                    lens.model,
+                    dispatched,
+                    generic
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn batch_handles_inputs_shorter_than_a_lane() {
+        for model in models() {
+            let lens = LensDistortion::new(model);
+            for points in 0..LANES {
+                let error = batch_error(&lens, points, |u, v, out| lens.distort_batch(u, v, out));
+                assert!(error < TOLERANCE, "{:?}: {} points", lens.model, points);
+            }
+        }
+    }
+}
@@ -0,0 +1,58 @@
+//! Display geometry and lens distortion helpers
+//!
+//! These types back the `IVRDisplayComponent` vtable. Drivers opt into them
+//! through the `DisplayComponent` trait; nothing here is required for a
+//! basic display.
+
+mod calibration;
+mod direct_mode;
+mod distortion_grid;
+#[cfg(target_os = "linux")]
+mod frame_export;
+mod frame_pacer;
+mod frame_timing;
+mod geometry;
+mod hidden_area;
+mod inverse_distortion;
+mod lens;
+mod mura;
+mod pipeline;
+mod present_queue;
+mod render_target;
+mod update;
+mod vsync;
+
+pub use calibration::{
+    fit_lenses, parse_correspondences, EyeLensFit, LensCorrespondence, LensFit, LensFitConfig,
+};
+pub use direct_mode::{StandInCompositor, SwapTextureRef, SwapTextureSetPool, SWAP_TEXTURE_COUNT};
+pub use distortion_grid::{DistortionCacheConfig, DistortionGrid, DistortionSample};
+#[cfg(target_os = "linux")]
+pub use frame_export::{
+    monotonic_now_ns, ExportDropPolicy, ExportSignal, ExportedFrame, FrameConsumer,
+    FrameExportConfig, FrameExportStats, FrameExporter, LoopbackConsumer, LoopbackStats,
+    PublishResult, EXPORT_MAGIC, EXPORT_VERSION,
+};
+pub(crate) use frame_pacer::prepare_current_thread;
+pub use frame_pacer::{FramePacer, FramePacerConfig, FramePacerStats, PacerTimer, VsyncThread};
+pub use frame_timing::{
+    AdaptiveRenderTarget, AdaptiveRenderTargetConfig, AdaptiveRenderTargetStats, FrameTiming,
+    FrameTimingSample,
+};
+pub use geometry::{
+    projection_to_raw, side_by_side_viewport, DisplayGeometry, EyeGeometry, SharedDisplayGeometry,
+};
+pub use hidden_area::{
+    EyeHiddenArea, HiddenAreaConfig, HiddenAreaMesh, HiddenAreaMeshType, StereoHiddenArea,
+};
+pub use inverse_distortion::{InverseDistortion, InverseDistortionConfig};
+pub use lens::{BrownConrady, LensDistortion, LensModel, StereoLens};
+pub use mura::MuraCorrectionImage;
+pub use pipeline::LatencyPercentiles;
+pub use present_queue::{
+    FrameTicket, PresentQueue, PresentQueueConfig, PresentQueueStats, PushResult, QueueDropPolicy,
+    QueuedFrame,
+};
+pub use render_target::RenderTargetSizing;
+pub use update::{DisplayUpdateConfig, DisplayUpdateStats, DisplayUpdater};
+pub use vsync::{VsyncClock, VsyncClockConfig, VsyncJitterStats};
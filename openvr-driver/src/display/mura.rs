@@ -0,0 +1,126 @@
+//! Mura correction image upload
+//!
+//! Panels with per-pixel brightness non-uniformity ship a correction image
+//! that the compositor applies at scanout. The image is published through
+//! `Prop_DisplayMCImageWidth_Int32`, `Prop_DisplayMCImageHeight_Int32`,
+//! `Prop_DisplayMCImageNumChannels_Int32` and the multi-megabyte
+//! `Prop_DisplayMCImageData_Binary`. `MuraCorrectionImage` borrows the pixel
+//! data, typically from a `MappedFile`, and writes it without copying.
+
+use crate::properties::{BinaryPropertyWrite, Properties, PropertyContainer, PropertyTypeTag};
+use crate::{sys, DriverError, DriverResult};
+
+/// A mura correction image borrowed for upload
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::display::MuraCorrectionImage;
+/// # fn activate(context: &openvr_driver::DriverContext, container: openvr_driver::PropertyContainer) -> openvr_driver::DriverResult<()> {
+/// // Driver-defined tag outside the range OpenVR reserves for itself
+/// const MURA_IMAGE_TAG: u32 = 10_001;
+///
+/// let data = context.map_resource("{mydriver}/resources/mura/panel.bin", "")?;
+/// MuraCorrectionImage::new(2880, 1600, 3, &data, MURA_IMAGE_TAG).upload(container)?;
+/// # Ok(())
+/// # }
+/// ```
+#[derive(Debug, Clone, Copy)]
+pub struct MuraCorrectionImage<'a> {
+    /// Image width in pixels
+    pub width: u32,
+    /// Image height in pixels
+    pub height: u32,
+    /// Channels per pixel
+    pub channels: u32,
+    /// Tightly packed pixel data, 1, 2 or 4 bytes per channel
+    pub data: &'a [u8],
+    /// Type tag stored with the pixel data
+    ///
+    /// vrserver does not treat data tagged `k_unInvalidPropertyTag` as a
+    /// stored value, so this must be a real tag: whatever the consumer of the
+    /// image expects, or a driver-defined value outside
+    /// `k_unOpenVRInternalReserved_Start..End`.
+    pub tag: PropertyTypeTag,
+}
+
+impl<'a> MuraCorrectionImage<'a> {
+    /// Describe an image whose pixel data is stored with `tag`
+    pub fn new(
+        width: u32,
+        height: u32,
+        channels: u32,
+        data: &'a [u8],
+        tag: PropertyTypeTag,
+    ) -> Self {
+        Self {
+            width,
+            height,
+            channels,
+            data,
+            tag,
+        }
+    }
+
+    /// Bytes per channel implied by the data length
+    ///
+    /// # Returns
+    /// * `None` if the data does not hold exactly `width * height * channels`
+    ///   values of 1, 2 or 4 bytes
+    pub fn bytes_per_channel(&self) -> Option<usize> {
+        let values = self.width as usize * self.height as usize * self.channels as usize;
+        if values == 0 || self.data.len() % values != 0 {
+            return None;
+        }
+        let size = self.data.len() / values;
+        matches!(size, 1 | 2 | 4).then_some(size)
+    }
+
+    /// Write the image properties to an HMD's container
+    ///
+    /// The dimensions and the data go in one `WritePropertyBatch`, so the
+    /// runtime never holds sizes that do not match the data. The pixel data
+    /// is passed in place.
+    pub fn upload(&self, container: PropertyContainer) -> DriverResult<()> {
+        let dimension = |value: u32, what: &str| {
+            i32::try_from(value).map_err(|_| {
+                DriverError::invalid_parameter(format!("Mura correction {} out of range", what))
+            })
+        };
+        let width = dimension(self.width, "width")?;
+        let height = dimension(self.height, "height")?;
+        let channels = dimension(self.channels, "channel count")?;
+
+        if self.tag == sys::root::vr::k_unInvalidPropertyTag {
+            return Err(DriverError::invalid_parameter(
+                "Mura correction data needs a property type tag",
+            ));
+        }
+        if self.bytes_per_channel().is_none() {
+            return Err(DriverError::invalid_parameter(format!(
+                "Mura correction data is {} bytes, not a whole number of {}x{}x{} 8, 16 or 32-bit values",
+                self.data.len(),
+                self.width,
+                self.height,
+                self.channels
+            )));
+        }
+
+        use sys::root::vr::ETrackedDeviceProperty::*;
+        let int32 = sys::root::vr::k_unInt32PropertyTag;
+        let (width, height, channels) = (
+            width.to_ne_bytes(),
+            height.to_ne_bytes(),
+            channels.to_ne_bytes(),
+        );
+        Properties::write_binary_batch(
+            container,
+            &[
+                BinaryPropertyWrite::new(Prop_DisplayMCImageWidth_Int32, int32, &width),
+                BinaryPropertyWrite::new(Prop_DisplayMCImageHeight_Int32, int32, &height),
+                BinaryPropertyWrite::new(Prop_DisplayMCImageNumChannels_Int32, int32, &channels),
+                BinaryPropertyWrite::new(Prop_DisplayMCImageData_Binary, self.tag, self.data),
+            ],
+        )
+    }
+}
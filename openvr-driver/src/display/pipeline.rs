@@ -0,0 +1,231 @@
+//! Building blocks shared by the frame pipelines
+//!
+//! `StampedRing` is the bounded single-producer ring behind both
+//! `PresentQueue` and the `FrameExporter` memfd. Each slot carries a stamp,
+//! `2 * sequence + 1` while being written and `2 * sequence + 2` once
+//! complete, so a reader can tell a torn or overwritten slot from a finished
+//! one. The ring only borrows its slots and cursors, which lets the exporter
+//! keep them in a shared mapping.
+//!
+//! `LatencyPercentiles` summarizes a window of duration samples for the
+//! pipeline statistics.
+
+use std::cell::UnsafeCell;
+use std::collections::VecDeque;
+use std::sync::atomic::{fence, AtomicU64, Ordering};
+use std::time::Duration;
+
+/// Distribution of a latency over a statistics window
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct LatencyPercentiles {
+    /// Median
+    pub p50: Duration,
+    /// 90th percentile
+    pub p90: Duration,
+    /// 99th percentile
+    pub p99: Duration,
+    /// Worst case
+    pub max: Duration,
+}
+
+impl LatencyPercentiles {
+    /// Percentiles of a window of nanosecond samples
+    pub(crate) fn from_samples(samples: &VecDeque<u64>) -> Self {
+        if samples.is_empty() {
+            return Self::default();
+        }
+        let mut sorted: Vec<u64> = samples.iter().copied().collect();
+        sorted.sort_unstable();
+        let at = |q: f64| Duration::from_nanos(sorted[((sorted.len() - 1) as f64 * q) as usize]);
+        Self {
+            p50: at(0.5),
+            p90: at(0.9),
+            p99: at(0.99),
+            max: at(1.0),
+        }
+    }
+}
+
+/// One ring slot; `repr(C)` because the exporter shares it across processes
+#[repr(C, align(64))]
+pub(crate) struct StampedSlot<T> {
+    stamp: AtomicU64,
+    value: UnsafeCell<T>,
+}
+
+impl<T> StampedSlot<T> {
+    pub(crate) fn new(value: T) -> Self {
+        Self {
+            stamp: AtomicU64::new(0),
+            value: UnsafeCell::new(value),
+        }
+    }
+}
+
+/// What `StampedRing::claim` should do while the ring is full
+pub(crate) enum WhenFull {
+    /// Discard the oldest unread value
+    DropOldest,
+    /// Give up on the new value
+    Reject,
+    /// Check again, after the caller has waited for the consumer
+    Retry,
+}
+
+/// A slot reserved by `StampedRing::claim`
+pub(crate) struct Claim {
+    /// Sequence to pass to `publish`
+    pub sequence: u64,
+    /// Sequence of the unread value discarded to make room, if any
+    pub dropped: Option<u64>,
+    /// The read cursor was outside the ring and was reset to empty
+    pub resynced: bool,
+}
+
+/// Bounded ring of stamped slots with one producer and one consumer
+///
+/// Under `WhenFull::DropOldest` the producer advances the read cursor itself,
+/// so the consumer may find its slot being overwritten; the stamp check and
+/// the cursor CAS in `take` make it retry instead of returning a torn value.
+///
+/// The cursors may live in memory another process can write, so neither side
+/// assumes `read <= write <= read + capacity`. The producer resets a read
+/// cursor outside that window; the consumer treats it as an empty ring.
+pub(crate) struct StampedRing<'a, T> {
+    slots: &'a [StampedSlot<T>],
+    write_seq: &'a AtomicU64,
+    read_seq: &'a AtomicU64,
+}
+
+impl<'a, T: Copy> StampedRing<'a, T> {
+    pub(crate) fn new(
+        slots: &'a [StampedSlot<T>],
+        write_seq: &'a AtomicU64,
+        read_seq: &'a AtomicU64,
+    ) -> Self {
+        Self {
+            slots,
+            write_seq,
+            read_seq,
+        }
+    }
+
+    #[inline]
+    fn slot(&self, sequence: u64) -> &StampedSlot<T> {
+        &self.slots[(sequence % self.slots.len() as u64) as usize]
+    }
+
+    /// Unread values between the cursors, or `None` if they are corrupt
+    #[inline]
+    fn unread(&self, write: u64, read: u64) -> Option<u64> {
+        let unread = write.wrapping_sub(read);
+        (unread <= self.slots.len() as u64).then_some(unread)
+    }
+
+    /// Unread values; zero while the cursors are corrupt
+    pub(crate) fn len(&self) -> u64 {
+        let write = self.write_seq.load(Ordering::Acquire);
+        let read = self.read_seq.load(Ordering::Acquire);
+        self.unread(write, read).unwrap_or(0)
+    }
+
+    /// Reserve the next slot; producer only
+    ///
+    /// `when_full` is called with the read cursor each time the ring is
+    /// found full. A read cursor ahead of the write cursor or more than a
+    /// ring behind it is reset to the write cursor, discarding whatever the
+    /// ring held.
+    ///
+    /// # Returns
+    /// * `None` if `when_full` rejected the value
+    pub(crate) fn claim(&self, mut when_full: impl FnMut(u64) -> WhenFull) -> Option<Claim> {
+        let capacity = self.slots.len() as u64;
+        let sequence = self.write_seq.load(Ordering::Relaxed);
+        loop {
+            let read = self.read_seq.load(Ordering::Acquire);
+            let Some(unread) = self.unread(sequence, read) else {
+                // Only the producer writes `write_seq`, so the read cursor is
+                // the corrupt one. Emptying the ring frees the claimed slot
+                // whatever the other side writes next.
+                self.read_seq.store(sequence, Ordering::SeqCst);
+                return Some(Claim {
+                    sequence,
+                    dropped: None,
+                    resynced: true,
+                });
+            };
+            if unread < capacity {
+                return Some(Claim {
+                    sequence,
+                    dropped: None,
+                    resynced: false,
+                });
+            }
+            match when_full(read) {
+                WhenFull::Reject => return None,
+                WhenFull::Retry => {}
+                WhenFull::DropOldest => {
+                    // Fails only if the consumer took that value meanwhile
+                    if self
+                        .read_seq
+                        .compare_exchange(read, read + 1, Ordering::AcqRel, Ordering::Acquire)
+                        .is_ok()
+                    {
+                        return Some(Claim {
+                            sequence,
+                            dropped: Some(read),
+                            resynced: false,
+                        });
+                    }
+                }
+            }
+        }
+    }
+
+    /// Write a claimed slot and make it visible to the consumer
+    pub(crate) fn publish(&self, sequence: u64, value: T) {
+        let slot = self.slot(sequence);
+        slot.stamp.store(2 * sequence + 1, Ordering::Relaxed);
+        fence(Ordering::Release);
+        unsafe { std::ptr::write_volatile(slot.value.get(), value) };
+        slot.stamp.store(2 * sequence + 2, Ordering::Release);
+        // SeqCst pairs with a consumer that flags itself waiting, then
+        // rechecks the cursors before sleeping
+        self.write_seq.store(sequence + 1, Ordering::SeqCst);
+    }
+
+    /// Take the oldest unread value without waiting; consumer only
+    ///
+    /// Corrupt cursors read as an empty ring until the producer resets them.
+    pub(crate) fn take(&self) -> Option<T> {
+        loop {
+            let read = self.read_seq.load(Ordering::Acquire);
+            let write = self.write_seq.load(Ordering::Acquire);
+            if self.unread(write, read).unwrap_or(0) == 0 {
+                return None;
+            }
+
+            let slot = self.slot(read);
+            let stamp = slot.stamp.load(Ordering::Acquire);
+            if stamp != 2 * read + 2 {
+                // Being overwritten under DropOldest; the cursor has moved on
+                std::hint::spin_loop();
+                continue;
+            }
+            let value = unsafe { std::ptr::read_volatile(slot.value.get()) };
+            fence(Ordering::Acquire);
+            if slot.stamp.load(Ordering::Relaxed) != stamp {
+                continue;
+            }
+
+            // Losing this race means the producer dropped the value we copied
+            if self
+                .read_seq
+                .compare_exchange(read, read + 1, Ordering::AcqRel, Ordering::Acquire)
+                .is_ok()
+            {
+                return Some(value);
+            }
+        }
+    }
+}
@@ -0,0 +1,451 @@
+//! Bounded-latency queue between `Present` and an encode pipeline
+//!
+//! `PresentQueue` sits between `VirtualDisplay::present` on vrserver's
+//! compositor thread and the driver's encode/transmit thread. It holds at
+//! most `max_frames` frames, and frames older than `max_age` are discarded
+//! when dequeued. A network stall therefore costs dropped frames, not a
+//! growing backlog of stale ones. Pushing never blocks or takes a lock.
+//!
+//! Each frame is timestamped at present, dequeue, encode completion and
+//! transmit, and the queue reports percentiles of each stage.
+
+use super::pipeline::{LatencyPercentiles, StampedRing, StampedSlot, WhenFull};
+use crate::PresentInfo;
+use std::collections::VecDeque;
+use std::mem::MaybeUninit;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{Mutex, OnceLock};
+use std::thread::{self, Thread};
+use std::time::{Duration, Instant};
+
+/// What to do with a new frame when the queue is full
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub enum QueueDropPolicy {
+    /// Discard the oldest queued frame to make room
+    #[default]
+    DropOldest,
+    /// Keep the queued frames and discard the new one
+    DropNewest,
+}
+
+/// Configuration for `PresentQueue`
+#[derive(Debug, Clone, Copy)]
+pub struct PresentQueueConfig {
+    /// Most frames held at once
+    pub max_frames: usize,
+    /// Frames older than this when dequeued are discarded
+    pub max_age: Option<Duration>,
+    /// Behaviour when `max_frames` are queued
+    pub policy: QueueDropPolicy,
+    /// Completed frames kept for the latency percentiles
+    pub stats_window: usize,
+}
+
+impl Default for PresentQueueConfig {
+    fn default() -> Self {
+        Self {
+            max_frames: 2,
+            max_age: Some(Duration::from_millis(30)),
+            policy: QueueDropPolicy::default(),
+            stats_window: 512,
+        }
+    }
+}
+
+/// A frame as queued by `push`
+#[derive(Debug, Clone, Copy)]
+pub struct QueuedFrame {
+    /// The frame passed to `present`
+    pub info: PresentInfo,
+    /// Position in the queue's input; gaps mean dropped frames
+    pub sequence: u64,
+    /// When the frame was pushed
+    pub presented_at: Instant,
+}
+
+/// A dequeued frame moving through the encode pipeline
+///
+/// Hand it back to `PresentQueue::complete` once transmitted to record its
+/// latencies.
+#[derive(Debug, Clone, Copy)]
+pub struct FrameTicket {
+    /// The queued frame
+    pub frame: QueuedFrame,
+    /// When the frame was dequeued
+    pub dequeued_at: Instant,
+    /// When encoding finished, if marked
+    pub encoded_at: Option<Instant>,
+}
+
+impl FrameTicket {
+    /// Record that encoding finished now
+    pub fn mark_encoded(&mut self) {
+        self.encoded_at = Some(Instant::now());
+    }
+}
+
+/// Outcome of `PresentQueue::push`
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum PushResult {
+    /// The frame was queued
+    Queued,
+    /// The frame was queued after discarding the oldest one
+    ReplacedOldest,
+    /// The frame was discarded
+    Dropped,
+}
+
+/// Queue counters and latency percentiles
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct PresentQueueStats {
+    /// Frames queued
+    pub pushed: u64,
+    /// Queued frames discarded to make room under `DropOldest`
+    pub dropped_oldest: u64,
+    /// New frames discarded because the queue was full or busy
+    pub dropped_newest: u64,
+    /// Frames discarded at dequeue for exceeding `max_age`
+    pub expired: u64,
+    /// Frames handed back through `complete`
+    pub completed: u64,
+    /// Frames currently queued
+    pub depth: usize,
+    /// Present to dequeue
+    pub queue_wait: LatencyPercentiles,
+    /// Dequeue to encode done
+    pub encode: LatencyPercentiles,
+    /// Encode done (or dequeue) to transmit
+    pub transmit: LatencyPercentiles,
+    /// Present to transmit
+    pub total: LatencyPercentiles,
+}
+
+#[derive(Default)]
+struct LatencySamples {
+    queue_wait: VecDeque<u64>,
+    encode: VecDeque<u64>,
+    transmit: VecDeque<u64>,
+    total: VecDeque<u64>,
+}
+
+/// Lock-free bounded queue of presented frames
+///
+/// Intended for one presenting thread and one consumer thread.
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::display::{PresentQueue, PresentQueueConfig};
+/// use std::sync::Arc;
+/// use std::time::Duration;
+///
+/// let queue = Arc::new(PresentQueue::new(PresentQueueConfig::default()));
+///
+/// // In VirtualDisplay::present:
+/// # let info: openvr_driver::PresentInfo = unimplemented!();
+/// queue.push(&info);
+///
+/// // On the encode thread:
+/// while let Some(mut ticket) = queue.pop_timeout(Duration::from_millis(100)) {
+///     // Encode ticket.frame.info.backbuffer
+///     ticket.mark_encoded();
+///     // Transmit
+///     queue.complete(ticket);
+/// }
+/// ```
+pub struct PresentQueue {
+    config: PresentQueueConfig,
+    slots: Box<[StampedSlot<MaybeUninit<QueuedFrame>>]>,
+    write_seq: AtomicU64,
+    read_seq: AtomicU64,
+    pushing: AtomicBool,
+    consumer: OnceLock<Thread>,
+    consumer_waiting: AtomicBool,
+    pushed: AtomicU64,
+    dropped_oldest: AtomicU64,
+    dropped_newest: AtomicU64,
+    expired: AtomicU64,
+    completed: AtomicU64,
+    samples: Mutex<LatencySamples>,
+}
+
+// Slots are only read or written through `StampedRing`
+unsafe impl Sync for PresentQueue {}
+
+impl PresentQueue {
+    /// Create an empty queue
+    pub fn new(config: PresentQueueConfig) -> Self {
+        let capacity = config.max_frames.max(1);
+        Self {
+            config,
+            slots: (0..capacity)
+                .map(|_| StampedSlot::new(MaybeUninit::uninit()))
+                .collect(),
+            write_seq: AtomicU64::new(0),
+            read_seq: AtomicU64::new(0),
+            pushing: AtomicBool::new(false),
+            consumer: OnceLock::new(),
+            consumer_waiting: AtomicBool::new(false),
+            pushed: AtomicU64::new(0),
+            dropped_oldest: AtomicU64::new(0),
+            dropped_newest: AtomicU64::new(0),
+            expired: AtomicU64::new(0),
+            completed: AtomicU64::new(0),
+            samples: Mutex::new(LatencySamples::default()),
+        }
+    }
+
+    #[inline]
+    fn ring(&self) -> StampedRing<'_, MaybeUninit<QueuedFrame>> {
+        StampedRing::new(&self.slots, &self.write_seq, &self.read_seq)
+    }
+
+    /// Queue a presented frame
+    pub fn push(&self, info: &PresentInfo) -> PushResult {
+        let presented_at = Instant::now();
+
+        // Single producer; a racing push loses rather than waits
+        if self.pushing.swap(true, Ordering::Acquire) {
+            self.dropped_newest.fetch_add(1, Ordering::Relaxed);
+            return PushResult::Dropped;
+        }
+
+        let ring = self.ring();
+        let policy = self.config.policy;
+        let claim = ring.claim(|_| match policy {
+            QueueDropPolicy::DropNewest => WhenFull::Reject,
+            QueueDropPolicy::DropOldest => WhenFull::DropOldest,
+        });
+        let Some(claim) = claim else {
+            self.dropped_newest.fetch_add(1, Ordering::Relaxed);
+            self.pushing.store(false, Ordering::Release);
+            return PushResult::Dropped;
+        };
+        let result = match claim.dropped {
+            Some(_) => {
+                self.dropped_oldest.fetch_add(1, Ordering::Relaxed);
+                PushResult::ReplacedOldest
+            }
+            None => PushResult::Queued,
+        };
+
+        ring.publish(
+            claim.sequence,
+            MaybeUninit::new(QueuedFrame {
+                info: *info,
+                sequence: claim.sequence,
+                presented_at,
+            }),
+        );
+        self.pushing.store(false, Ordering::Release);
+        self.pushed.fetch_add(1, Ordering::Relaxed);
+
+        if self.consumer_waiting.load(Ordering::SeqCst) {
+            if let Some(consumer) = self.consumer.get() {
+                consumer.unpark();
+            }
+        }
+        result
+    }
+
+    /// Take the oldest frame that is still fresh enough
+    pub fn pop(&self) -> Option<FrameTicket> {
+        loop {
+            let frame = self.ring().take()?;
+
+            // `take` only returns slots whose stamp says fully written
+            let frame = unsafe { frame.assume_init() };
+            let dequeued_at = Instant::now();
+            if let Some(max_age) = self.config.max_age {
+                if dequeued_at.duration_since(frame.presented_at) > max_age {
+                    self.expired.fetch_add(1, Ordering::Relaxed);
+                    continue;
+                }
+            }
+            return Some(FrameTicket {
+                frame,
+                dequeued_at,
+                encoded_at: None,
+            });
+        }
+    }
+
+    /// Take the oldest fresh frame, waiting up to `timeout` for one
+    ///
+    /// Must always be called from the same consumer thread.
+    pub fn pop_timeout(&self, timeout: Duration) -> Option<FrameTicket> {
+        let deadline = Instant::now() + timeout;
+        let _ = self.consumer.set(thread::current());
+
+        loop {
+            if let Some(ticket) = self.pop() {
+                return Some(ticket);
+            }
+            let remaining = deadline.saturating_duration_since(Instant::now());
+            if remaining.is_zero() {
+                return None;
+            }
+
+            self.consumer_waiting.store(true, Ordering::SeqCst);
+            if self.read_seq.load(Ordering::SeqCst) >= self.write_seq.load(Ordering::SeqCst) {
+                thread::park_timeout(remaining);
+            }
+            self.consumer_waiting.store(false, Ordering::Relaxed);
+        }
+    }
+
+    /// Record that a dequeued frame has been transmitted
+    pub fn complete(&self, ticket: FrameTicket) {
+        let transmitted_at = Instant::now();
+        self.completed.fetch_add(1, Ordering::Relaxed);
+
+        let window = self.config.stats_window;
+        if window == 0 {
+            return;
+        }
+        let nanos =
+            |from: Instant, to: Instant| to.saturating_duration_since(from).as_nanos() as u64;
+        let encoded_at = ticket.encoded_at.unwrap_or(ticket.dequeued_at);
+
+        let mut samples = self.samples.lock().unwrap();
+        let LatencySamples {
+            queue_wait,
+            encode,
+            transmit,
+            total,
+        } = &mut *samples;
+        for (samples, value) in [
+            (
+                queue_wait,
+                nanos(ticket.frame.presented_at, ticket.dequeued_at),
+            ),
+            (encode, nanos(ticket.dequeued_at, encoded_at)),
+            (transmit, nanos(encoded_at, transmitted_at)),
+            (total, nanos(ticket.frame.presented_at, transmitted_at)),
+        ] {
+            if samples.len() == window {
+                samples.pop_front();
+            }
+            samples.push_back(value);
+        }
+    }
+
+    /// Frames currently queued
+    pub fn len(&self) -> usize {
+        self.ring().len() as usize
+    }
+
+    /// Whether no frames are queued
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Snapshot the counters and latency percentiles
+    pub fn stats(&self) -> PresentQueueStats {
+        let samples = self.samples.lock().unwrap();
+        PresentQueueStats {
+            pushed: self.pushed.load(Ordering::Relaxed),
+            dropped_oldest: self.dropped_oldest.load(Ordering::Relaxed),
+            dropped_newest: self.dropped_newest.load(Ordering::Relaxed),
+            expired: self.expired.load(Ordering::Relaxed),
+            completed: self.completed.load(Ordering::Relaxed),
+            depth: self.len(),
+            queue_wait: LatencyPercentiles::from_samples(&samples.queue_wait),
+            encode: LatencyPercentiles::from_samples(&samples.encode),
+            transmit: LatencyPercentiles::from_samples(&samples.transmit),
+            total: LatencyPercentiles::from_samples(&samples.total),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::sys::root::vr;
+    use std::sync::Arc;
+
+    fn info(frame_id: u64) -> PresentInfo {
+        PresentInfo {
+            backbuffer: frame_id,
+            vsync: vr::EVSync::VSync_None,
+            frame_id,
+            vsync_time_seconds: 0.0,
+        }
+    }
+
+    fn stress(policy: QueueDropPolicy) -> PresentQueueStats {
+        const FRAMES: u64 = 100_000;
+        let queue = Arc::new(PresentQueue::new(PresentQueueConfig {
+            max_frames: 3,
+            max_age: None,
+            policy,
+            stats_window: 64,
+        }));
+
+        let producer = {
+            let queue = queue.clone();
+            thread::spawn(move || {
+                for i in 0..FRAMES {
+                    queue.push(&info(i));
+                }
+            })
+        };
+
+        let mut last = None;
+        let mut received = 0;
+        while let Some(ticket) = queue.pop_timeout(Duration::from_millis(200)) {
+            let frame = ticket.frame;
+            // The slot must hold the frame written for that sequence
+            assert_eq!(frame.info.frame_id, frame.info.backbuffer);
+            if let Some(last) = last {
+                assert!(frame.sequence > last);
+            }
+            last = Some(frame.sequence);
+            received += 1;
+            queue.complete(ticket);
+        }
+        producer.join().unwrap();
+
+        let stats = queue.stats();
+        assert_eq!(stats.depth, 0);
+        assert_eq!(stats.completed, received);
+        assert_eq!(stats.pushed + stats.dropped_newest, FRAMES);
+        assert_eq!(
+            stats.pushed,
+            received + stats.dropped_oldest + stats.expired
+        );
+        stats
+    }
+
+    #[test]
+    fn stress_drop_oldest() {
+        let stats = stress(QueueDropPolicy::DropOldest);
+        assert_eq!(stats.dropped_newest, 0);
+    }
+
+    #[test]
+    fn stress_drop_newest() {
+        let stats = stress(QueueDropPolicy::DropNewest);
+        assert_eq!(stats.dropped_oldest, 0);
+    }
+
+    #[test]
+    fn stale_frames_expire_at_dequeue() {
+        let queue = PresentQueue::new(PresentQueueConfig {
+            max_frames: 4,
+            max_age: Some(Duration::from_millis(20)),
+            ..Default::default()
+        });
+        queue.push(&info(0));
+        queue.push(&info(1));
+        thread::sleep(Duration::from_millis(40));
+        queue.push(&info(2));
+
+        let ticket = queue.pop().unwrap();
+        assert_eq!(ticket.frame.info.frame_id, 2);
+        assert!(queue.pop().is_none());
+        let stats = queue.stats();
+        assert_eq!(stats.expired, 2);
+        assert_eq!(stats.depth, 0);
+    }
+}
@@ -0,0 +1,148 @@
+//! Render target sizing from lens pixel density
+//!
+//! The lenses magnify the panel center, so one panel pixel there covers less
+//! than one render target pixel at a 1:1 size. The derivative of the
+//! distortion at the lens center tells how far the source UV moves per panel
+//! pixel; dividing the viewport by it gives the render target size that
+//! samples the center at exactly one texel per panel pixel.
+
+use super::{DistortionSample, StereoLens};
+use crate::{DisplayComponent, Eye};
+
+/// Automatic render target sizing parameters
+#[derive(Debug, Clone, Copy)]
+pub struct RenderTargetSizing {
+    /// Linear scale applied per axis on top of the 1:1 size (1.0 = 1:1)
+    pub supersample: f32,
+    /// Lens center per eye in viewport UV, indexed by `Eye as usize`
+    pub lens_center: [[f32; 2]; 2],
+    /// Finite difference step, in viewport UV
+    pub step: f32,
+    /// Round each dimension up to a multiple of this
+    pub alignment: u32,
+    /// Largest width or height to recommend
+    pub max_dimension: u32,
+}
+
+impl Default for RenderTargetSizing {
+    fn default() -> Self {
+        Self {
+            supersample: 1.0,
+            lens_center: [[0.5, 0.5]; 2],
+            step: 1.0e-3,
+            alignment: 4,
+            max_dimension: 8192,
+        }
+    }
+}
+
+impl RenderTargetSizing {
+    /// Sizing centered on each lens of a `StereoLens`
+    pub fn for_lenses(lenses: &StereoLens, supersample: f32) -> Self {
+        Self {
+            supersample,
+            lens_center: [lenses.left.center, lenses.right.center],
+            ..Self::default()
+        }
+    }
+
+    /// Measure how far the source UV moves at one eye's lens center
+    ///
+    /// For each axis the source UV displacement per unit of viewport UV is
+    /// taken by central differences, and the channel that moves least (and so
+    /// needs the most texels) wins.
+    ///
+    /// # Returns
+    /// * `(x, y)` - Source UV per viewport UV; below 1 means the center needs
+    ///   more texels than panel pixels
+    /// * `None` if the distortion is degenerate at the center
+    pub fn center_scale<F>(&self, eye: Eye, distort: F) -> Option<(f32, f32)>
+    where
+        F: Fn(Eye, f32, f32) -> DistortionSample,
+    {
+        let [cu, cv] = self.lens_center[eye as usize];
+        let h = self.step;
+
+        let du = [distort(eye, cu + h, cv), distort(eye, cu - h, cv)];
+        let dv = [distort(eye, cu, cv + h), distort(eye, cu, cv - h)];
+
+        let column = |d: &[DistortionSample; 2], channel: usize| {
+            let x = d[0][channel * 2] - d[1][channel * 2];
+            let y = d[0][channel * 2 + 1] - d[1][channel * 2 + 1];
+            (x * x + y * y).sqrt() / (2.0 * h)
+        };
+
+        let mut scale = (f32::INFINITY, f32::INFINITY);
+        for channel in 0..3 {
+            scale.0 = scale.0.min(column(&du, channel));
+            scale.1 = scale.1.min(column(&dv, channel));
+        }
+
+        let valid = |s: f32| s.is_finite() && s > f32::EPSILON;
+        (valid(scale.0) && valid(scale.1)).then_some(scale)
+    }
+
+    /// Render target size for a viewport given the source UV scale per eye
+    ///
+    /// # Arguments
+    /// * `viewport` - `(width, height)` of an eye's output viewport in pixels
+    /// * `scale` - Source UV per viewport UV at the lens center, per eye
+    pub fn size_for(&self, viewport: (u32, u32), scale: [(f32, f32); 2]) -> (u32, u32) {
+        let dimension = |pixels: u32, scale: f32| {
+            let texels = (pixels as f32 * self.supersample / scale).ceil();
+            let align = self.alignment.max(1);
+            let max = self.max_dimension.max(align) / align * align;
+            let aligned = (texels.max(1.0) as u32).div_ceil(align) * align;
+            aligned.min(max)
+        };
+
+        let width = scale
+            .iter()
+            .map(|s| dimension(viewport.0, s.0))
+            .max()
+            .unwrap_or(0);
+        let height = scale
+            .iter()
+            .map(|s| dimension(viewport.1, s.1))
+            .max()
+            .unwrap_or(0);
+        (width, height)
+    }
+
+    /// Compute the recommended size for a display component
+    ///
+    /// Uses the component's output viewports and `compute_distortion`; the
+    /// larger eye wins so both render targets can share one size.
+    ///
+    /// # Returns
+    /// * `Some((sized, native))` - Recommended size and the 1:1 size without
+    ///   supersampling
+    /// * `None` if the distortion is degenerate at either lens center
+    pub fn compute<T: DisplayComponent + ?Sized>(
+        &self,
+        component: &T,
+    ) -> Option<((u32, u32), (u32, u32))> {
+        let distort = |eye: Eye, u: f32, v: f32| {
+            let (ru, rv, gu, gv, bu, bv) = component.compute_distortion(eye, u, v);
+            [ru, rv, gu, gv, bu, bv]
+        };
+        let scale = [
+            self.center_scale(Eye::Left, distort)?,
+            self.center_scale(Eye::Right, distort)?,
+        ];
+
+        let viewport = [Eye::Left, Eye::Right]
+            .iter()
+            .map(|eye| component.get_eye_output_viewport(*eye))
+            .fold((0, 0), |acc, (_, _, w, h)| (acc.0.max(w), acc.1.max(h)));
+
+        let native = Self {
+            supersample: 1.0,
+            ..*self
+        };
+        Some((
+            self.size_for(viewport, scale),
+            native.size_for(viewport, scale),
+        ))
+    }
+}
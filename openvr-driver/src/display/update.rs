@@ -0,0 +1,251 @@
+//! Live display geometry updates
+//!
+//! `DisplayUpdater` changes IPD, projection and render target size while the
+//! HMD is running. Changes are staged and coalesced: only the latest value of
+//! each kind is kept, and at most one batch per `min_interval` is pushed. A
+//! push first swaps the display's geometry snapshot, then notifies vrserver
+//! through `IVRServerDriverHost`, so anything the runtime queries in response
+//! already sees the new values.
+
+use super::{DisplayGeometry, SharedDisplayGeometry};
+use crate::{DriverHost, Eye, HmdMatrix34, TrackedDeviceIndex};
+use std::time::{Duration, Instant};
+
+/// Display updater configuration
+#[derive(Debug, Clone)]
+pub struct DisplayUpdateConfig {
+    /// Minimum time between two pushes to the runtime
+    pub min_interval: Duration,
+}
+
+impl Default for DisplayUpdateConfig {
+    fn default() -> Self {
+        Self {
+            min_interval: Duration::from_millis(100),
+        }
+    }
+}
+
+/// Counters describing updater activity
+#[derive(Debug, Clone, Copy, Default)]
+pub struct DisplayUpdateStats {
+    /// Changes staged through the `set_*` methods
+    pub staged: u64,
+    /// Batches pushed to the runtime
+    pub flushes: u64,
+    /// Calls made on `IVRServerDriverHost`
+    pub host_calls: u64,
+    /// Staged changes that were replaced before being pushed
+    pub coalesced: u64,
+}
+
+/// Changes waiting for the next flush
+#[derive(Default)]
+struct PendingGeometry {
+    eye_to_head: Option<[HmdMatrix34; 2]>,
+    projection_raw: Option<[(f32, f32, f32, f32); 2]>,
+    render_target_size: Option<(u32, u32)>,
+}
+
+impl PendingGeometry {
+    fn is_empty(&self) -> bool {
+        self.eye_to_head.is_none()
+            && self.projection_raw.is_none()
+            && self.render_target_size.is_none()
+    }
+}
+
+/// Pushes display geometry changes to a running HMD
+///
+/// The display component must serve its thunks from the same
+/// `SharedDisplayGeometry` through `DisplayComponent::shared_geometry`.
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::display::{DisplayUpdateConfig, DisplayUpdater, SharedDisplayGeometry};
+/// # fn example(host: openvr_driver::DriverHost, geometry: SharedDisplayGeometry) {
+/// let mut updater = DisplayUpdater::new(host, 0, geometry, DisplayUpdateConfig::default());
+///
+/// // From a settings slider, as often as it fires:
+/// updater.set_ipd(0.065);
+///
+/// // In run_frame:
+/// updater.flush();
+/// # }
+/// ```
+pub struct DisplayUpdater {
+    host: DriverHost,
+    device_index: TrackedDeviceIndex,
+    geometry: SharedDisplayGeometry,
+    config: DisplayUpdateConfig,
+    pending: PendingGeometry,
+    last_flush: Option<Instant>,
+    stats: DisplayUpdateStats,
+}
+
+impl DisplayUpdater {
+    /// Create an updater for the HMD at `device_index`
+    pub fn new(
+        host: DriverHost,
+        device_index: TrackedDeviceIndex,
+        geometry: SharedDisplayGeometry,
+        config: DisplayUpdateConfig,
+    ) -> Self {
+        Self {
+            host,
+            device_index,
+            geometry,
+            config,
+            pending: PendingGeometry::default(),
+            last_flush: None,
+            stats: DisplayUpdateStats::default(),
+        }
+    }
+
+    /// Stage new eye-to-head transforms
+    pub fn set_eye_to_head(&mut self, left: HmdMatrix34, right: HmdMatrix34) {
+        self.note_staged(self.pending.eye_to_head.is_some());
+        self.pending.eye_to_head = Some([left, right]);
+    }
+
+    /// Stage a new IPD, keeping the rest of the eye-to-head transforms
+    ///
+    /// Each eye is moved to -ipd/2 (left) or +ipd/2 (right) along x.
+    ///
+    /// # Returns
+    /// * `true` if the change was staged
+    /// * `false` if there are no transforms to apply it to yet: none are
+    ///   staged and the display has not published its geometry
+    pub fn set_ipd(&mut self, ipd: f32) -> bool {
+        let current = self.pending.eye_to_head.or_else(|| {
+            self.geometry
+                .load()
+                .map(|g| [g.eye(Eye::Left).eye_to_head, g.eye(Eye::Right).eye_to_head])
+        });
+
+        let Some([mut left, mut right]) = current else {
+            return false;
+        };
+        left.m[0][3] = -ipd / 2.0;
+        right.m[0][3] = ipd / 2.0;
+        self.set_eye_to_head(left, right);
+        true
+    }
+
+    /// Stage new projection tangents, `(left, right, top, bottom)` per eye
+    pub fn set_projection_raw(&mut self, left: (f32, f32, f32, f32), right: (f32, f32, f32, f32)) {
+        self.note_staged(self.pending.projection_raw.is_some());
+        self.pending.projection_raw = Some([left, right]);
+    }
+
+    /// Stage a new recommended render target size
+    pub fn set_render_target_size(&mut self, width: u32, height: u32) {
+        self.note_staged(self.pending.render_target_size.is_some());
+        self.pending.render_target_size = Some((width, height));
+    }
+
+    /// Check whether changes are waiting to be pushed
+    pub fn has_pending(&self) -> bool {
+        !self.pending.is_empty()
+    }
+
+    /// Push staged changes if `min_interval` has passed since the last push
+    ///
+    /// Call this once per `run_frame`.
+    ///
+    /// # Returns
+    /// * `true` if a batch was pushed
+    pub fn flush(&mut self) -> bool {
+        if self.pending.is_empty() {
+            return false;
+        }
+        if let Some(last) = self.last_flush {
+            if last.elapsed() < self.config.min_interval {
+                return false;
+            }
+        }
+        self.flush_now()
+    }
+
+    /// Push staged changes immediately
+    ///
+    /// # Returns
+    /// * `true` if a batch was pushed
+    pub fn flush_now(&mut self) -> bool {
+        if self.pending.is_empty() {
+            return false;
+        }
+        let Some(current) = self.geometry.load() else {
+            // The display vtable has not published its geometry yet
+            return false;
+        };
+
+        let pending = std::mem::take(&mut self.pending);
+        let mut next: DisplayGeometry = current;
+
+        let eye_to_head = pending.eye_to_head.filter(|[left, right]| {
+            left.m != current.eyes[0].eye_to_head.m || right.m != current.eyes[1].eye_to_head.m
+        });
+        let projection_raw = pending.projection_raw.filter(|p| {
+            *p != [
+                current.eyes[0].projection_raw,
+                current.eyes[1].projection_raw,
+            ]
+        });
+        let render_target_size = pending
+            .render_target_size
+            .filter(|size| *size != current.render_target_size);
+
+        if let Some([left, right]) = eye_to_head {
+            next.eyes[0].eye_to_head = left;
+            next.eyes[1].eye_to_head = right;
+        }
+        if let Some([left, right]) = projection_raw {
+            next.eyes[0].projection_raw = left;
+            next.eyes[1].projection_raw = right;
+        }
+        if let Some(size) = render_target_size {
+            next.render_target_size = size;
+        }
+
+        self.last_flush = Some(Instant::now());
+        if eye_to_head.is_none() && projection_raw.is_none() && render_target_size.is_none() {
+            return false;
+        }
+
+        // Swap first so the runtime reads the new values when it re-queries
+        self.geometry.store(next);
+
+        if let Some([left, right]) = &eye_to_head {
+            self.host
+                .set_display_eye_to_head(self.device_index, left, right);
+            self.stats.host_calls += 1;
+        }
+        if let Some([left, right]) = projection_raw {
+            self.host
+                .set_display_projection_raw(self.device_index, left, right);
+            self.stats.host_calls += 1;
+        }
+        if let Some((width, height)) = render_target_size {
+            self.host
+                .set_recommended_render_target_size(self.device_index, width, height);
+            self.stats.host_calls += 1;
+        }
+
+        self.stats.flushes += 1;
+        true
+    }
+
+    /// Get the updater counters
+    pub fn stats(&self) -> DisplayUpdateStats {
+        self.stats
+    }
+
+    fn note_staged(&mut self, replaces_pending: bool) {
+        self.stats.staged += 1;
+        if replaces_pending {
+            self.stats.coalesced += 1;
+        }
+    }
+}
@@ -0,0 +1,464 @@
+//! Software vsync clock for virtual displays
+//!
+//! A virtual display has no scanout interrupt to report, so `VsyncClock`
+//! synthesizes one from the monotonic clock. Vsync times reported back by the
+//! remote display, already translated to local `Instant`s, steer a second
+//! order phase-locked loop: each observation nudges the phase by a fraction
+//! of the error and the period by a smaller fraction, so the clock follows
+//! slow drift without reacting to single late packets.
+//!
+//! The phase and period are published through a sequence lock, so
+//! `GetTimeSinceLastVsync` reads them with a few atomic loads and never
+//! waits on the thread feeding observations.
+
+use crate::{DriverHost, VsyncTiming};
+use std::collections::VecDeque;
+use std::sync::atomic::{fence, AtomicI64, AtomicU64, Ordering};
+use std::sync::Mutex;
+use std::time::{Duration, Instant};
+
+/// Configuration for `VsyncClock`
+#[derive(Debug, Clone, Copy)]
+pub struct VsyncClockConfig {
+    /// Refresh rate the clock starts at
+    pub refresh_rate: f64,
+    /// Fraction of the phase error corrected per observation
+    pub phase_gain: f64,
+    /// Fraction of the phase error folded into the period per observation
+    pub frequency_gain: f64,
+    /// Largest allowed deviation of the period from nominal, as a fraction
+    pub max_period_deviation: f64,
+    /// Observations further than this fraction of a period from the
+    /// prediction are rejected as outliers
+    pub outlier_threshold: f64,
+    /// Consecutive outliers after which the loop snaps to the measured phase
+    pub reacquire_after: u32,
+    /// Phase errors kept for jitter statistics
+    pub jitter_window: usize,
+}
+
+impl Default for VsyncClockConfig {
+    fn default() -> Self {
+        Self {
+            refresh_rate: 90.0,
+            phase_gain: 0.1,
+            frequency_gain: 0.0025,
+            max_period_deviation: 0.02,
+            outlier_threshold: 0.25,
+            reacquire_after: 8,
+            jitter_window: 256,
+        }
+    }
+}
+
+/// Phase error statistics over the recent observations
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct VsyncJitterStats {
+    /// Observations accepted by the loop
+    pub observations: u64,
+    /// Observations rejected as outliers
+    pub rejected: u64,
+    /// Times the loop snapped to a measured phase after losing lock
+    pub reacquisitions: u64,
+    /// Current period estimate in seconds
+    pub period_seconds: f64,
+    /// Mean phase error in seconds; positive means vsyncs arrive late
+    pub mean_error: f64,
+    /// Root mean square phase error in seconds
+    pub rms_error: f64,
+    /// 99th percentile of the absolute phase error in seconds
+    pub p99_error: f64,
+    /// Largest absolute phase error in seconds
+    pub max_error: f64,
+}
+
+impl VsyncJitterStats {
+    /// Refresh rate implied by the period estimate
+    pub fn refresh_rate(&self) -> f64 {
+        if self.period_seconds > 0.0 {
+            1.0 / self.period_seconds
+        } else {
+            0.0
+        }
+    }
+}
+
+/// Loop state only touched by writers
+struct LoopState {
+    observations: u64,
+    rejected: u64,
+    consecutive_rejected: u32,
+    reacquisitions: u64,
+    errors: VecDeque<f64>,
+}
+
+/// Phase-locked software vsync clock
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::display::{VsyncClock, VsyncClockConfig};
+/// use openvr_driver::{PresentInfo, VirtualDisplay, VsyncTiming};
+///
+/// struct WirelessDisplay {
+///     vsync: VsyncClock,
+/// }
+///
+/// impl VirtualDisplay for WirelessDisplay {
+///     fn present(&self, info: &PresentInfo) {}
+///
+///     fn get_time_since_last_vsync(&self) -> Option<VsyncTiming> {
+///         Some(self.vsync.timing())
+///     }
+/// }
+///
+/// // On the thread receiving scanout reports from the headset:
+/// # fn on_report(display: &WirelessDisplay, scanout: std::time::Instant) {
+/// display.vsync.observe(scanout);
+/// # }
+/// ```
+pub struct VsyncClock {
+    config: VsyncClockConfig,
+    /// Origin of the nanosecond timestamps below
+    base: Instant,
+    /// Odd while a writer is updating the published estimate
+    sequence: AtomicU64,
+    /// Time of the reference vsync, in nanoseconds since `base`
+    anchor_ns: AtomicI64,
+    /// Frame counter of the reference vsync
+    anchor_count: AtomicU64,
+    /// Period estimate in nanoseconds, stored as `f64` bits
+    period_ns: AtomicU64,
+    /// Highest frame counter handed out by `timing`
+    served: AtomicU64,
+    /// One past the frame counter of the last vsync reported through
+    /// `VsyncEvent`, 0 before the first
+    emitted: AtomicU64,
+    state: Mutex<LoopState>,
+}
+
+impl VsyncClock {
+    /// Start a free-running clock with its first vsync now
+    pub fn new(config: VsyncClockConfig) -> Self {
+        let period_ns = 1e9 / config.refresh_rate.max(1.0);
+        Self {
+            config,
+            base: Instant::now(),
+            sequence: AtomicU64::new(0),
+            anchor_ns: AtomicI64::new(0),
+            anchor_count: AtomicU64::new(0),
+            period_ns: AtomicU64::new(period_ns.to_bits()),
+            served: AtomicU64::new(0),
+            emitted: AtomicU64::new(0),
+            state: Mutex::new(LoopState {
+                observations: 0,
+                rejected: 0,
+                consecutive_rejected: 0,
+                reacquisitions: 0,
+                errors: VecDeque::with_capacity(config.jitter_window),
+            }),
+        }
+    }
+
+    fn to_ns(&self, at: Instant) -> i64 {
+        match at.checked_duration_since(self.base) {
+            Some(after) => after.as_nanos() as i64,
+            None => -(self.base.duration_since(at).as_nanos() as i64),
+        }
+    }
+
+    fn to_instant(&self, ns: i64) -> Instant {
+        if ns >= 0 {
+            self.base + Duration::from_nanos(ns as u64)
+        } else {
+            self.base - Duration::from_nanos(ns.unsigned_abs())
+        }
+    }
+
+    /// Consistent copy of `(anchor_ns, anchor_count, period_ns)`
+    #[inline]
+    fn load(&self) -> (i64, u64, f64) {
+        loop {
+            let before = self.sequence.load(Ordering::Acquire);
+            if before & 1 == 1 {
+                std::hint::spin_loop();
+                continue;
+            }
+            let anchor = self.anchor_ns.load(Ordering::Relaxed);
+            let count = self.anchor_count.load(Ordering::Relaxed);
+            let period = f64::from_bits(self.period_ns.load(Ordering::Relaxed));
+            fence(Ordering::Acquire);
+            if self.sequence.load(Ordering::Relaxed) == before {
+                return (anchor, count, period);
+            }
+        }
+    }
+
+    /// Publish a new estimate; callers hold the `state` lock
+    fn publish(&self, anchor: i64, count: u64, period: f64) {
+        self.sequence.fetch_add(1, Ordering::Relaxed);
+        fence(Ordering::Release);
+        self.anchor_ns.store(anchor, Ordering::Relaxed);
+        self.anchor_count.store(count, Ordering::Relaxed);
+        self.period_ns.store(period.to_bits(), Ordering::Relaxed);
+        self.sequence.fetch_add(1, Ordering::Release);
+    }
+
+    /// Last vsync at or before `now_ns` as `(time_ns, frame_counter, period_ns)`
+    #[inline]
+    fn vsync_before(&self, now_ns: i64) -> (f64, u64, f64) {
+        let (anchor, count, period) = self.load();
+        let elapsed = (now_ns - anchor) as f64;
+        let frames = (elapsed / period).floor();
+        let time = anchor as f64 + frames * period;
+        // The anchor can sit slightly ahead of now right after a correction
+        (time, count.saturating_add_signed(frames as i64), period)
+    }
+
+    /// Time since the last vsync and the vsync count, as served to vrserver
+    ///
+    /// The frame counter never decreases. When a correction moves the phase
+    /// later, queries just after the old boundary would fall one frame back;
+    /// they keep the counter already served and report the vsync as just
+    /// happened.
+    #[inline]
+    pub fn timing(&self) -> VsyncTiming {
+        self.timing_at(self.to_ns(Instant::now()))
+    }
+
+    #[inline]
+    fn timing_at(&self, now: i64) -> VsyncTiming {
+        let (last, frame_counter, _) = self.vsync_before(now);
+        let served = self.served.fetch_max(frame_counter, Ordering::AcqRel);
+        if served > frame_counter {
+            return VsyncTiming {
+                seconds_since_last_vsync: 0.0,
+                frame_counter: served,
+            };
+        }
+        VsyncTiming {
+            seconds_since_last_vsync: ((now as f64 - last) * 1e-9) as f32,
+            frame_counter,
+        }
+    }
+
+    /// The next predicted vsync after now and its frame counter
+    ///
+    /// Like `timing`, never goes back past a counter already served: after
+    /// a correction that moved the phase later, the next vsync is the one
+    /// after the last counter handed out.
+    pub fn next_vsync(&self) -> (Instant, u64) {
+        self.next_vsync_at(self.to_ns(Instant::now()))
+    }
+
+    fn next_vsync_at(&self, now: i64) -> (Instant, u64) {
+        let (last, count, period) = self.vsync_before(now);
+        let next = (count + 1).max(self.served.load(Ordering::Acquire) + 1);
+        let time = last + (next - count) as f64 * period;
+        (self.to_instant(time.round() as i64), next)
+    }
+
+    /// Current period estimate
+    pub fn period(&self) -> Duration {
+        Duration::from_secs_f64(self.load().2 * 1e-9)
+    }
+
+    /// Feed a measured vsync time into the loop
+    ///
+    /// # Arguments
+    /// * `at` - When the remote display scanned out, on the local monotonic clock
+    ///
+    /// # Returns
+    /// * `true` if the observation was used
+    /// * `false` if it was rejected as an outlier
+    pub fn observe(&self, at: Instant) -> bool {
+        let measured = self.to_ns(at);
+        let mut state = self.state.lock().unwrap();
+
+        let (anchor, count, period) = self.load();
+        let frames = ((measured - anchor) as f64 / period).round();
+        let predicted = anchor as f64 + frames * period;
+        let error = measured as f64 - predicted;
+
+        // The first observation and a sustained run of outliers mean the
+        // phase is unknown, so take the measurement as is
+        let unlocked =
+            state.observations == 0 || state.consecutive_rejected >= self.config.reacquire_after;
+        if unlocked {
+            self.publish(measured, count.saturating_add_signed(frames as i64), period);
+            if state.observations > 0 {
+                state.reacquisitions += 1;
+            }
+            state.observations += 1;
+            state.consecutive_rejected = 0;
+            return true;
+        }
+
+        if error.abs() > self.config.outlier_threshold * period {
+            state.rejected += 1;
+            state.consecutive_rejected += 1;
+            return false;
+        }
+        state.consecutive_rejected = 0;
+
+        // Spread the frequency correction over the frames since the anchor
+        // so sparse feedback does not over-steer the period
+        let nominal = 1e9 / self.config.refresh_rate.max(1.0);
+        let deviation = nominal * self.config.max_period_deviation;
+        let period = (period + self.config.frequency_gain * error / frames.abs().max(1.0))
+            .clamp(nominal - deviation, nominal + deviation);
+        let anchor = (predicted + self.config.phase_gain * error).round() as i64;
+        self.publish(anchor, count.saturating_add_signed(frames as i64), period);
+
+        state.observations += 1;
+        if self.config.jitter_window > 0 {
+            if state.errors.len() == self.config.jitter_window {
+                state.errors.pop_front();
+            }
+            state.errors.push_back(error * 1e-9);
+        }
+        true
+    }
+
+    /// Report the last vsync through `IVRServerDriverHost::VsyncEvent`
+    ///
+    /// Only the first call after each vsync sends an event, so this can be
+    /// called from a loop that wakes around every vsync. A vsync older than
+    /// one already reported, as seen after a phase correction, is skipped.
+    ///
+    /// # Returns
+    /// * `true` if an event was sent
+    pub fn emit(&self, host: &DriverHost) -> bool {
+        let now = self.to_ns(Instant::now());
+        let (last, frame_counter, _) = self.vsync_before(now);
+        if self.emitted.fetch_max(frame_counter + 1, Ordering::AcqRel) > frame_counter {
+            return false;
+        }
+        host.vsync_event((last - now as f64) * 1e-9);
+        true
+    }
+
+    /// Phase error statistics over the jitter window
+    pub fn stats(&self) -> VsyncJitterStats {
+        let state = self.state.lock().unwrap();
+        let mut stats = VsyncJitterStats {
+            observations: state.observations,
+            rejected: state.rejected,
+            reacquisitions: state.reacquisitions,
+            period_seconds: self.load().2 * 1e-9,
+            ..Default::default()
+        };
+
+        let count = state.errors.len();
+        if count == 0 {
+            return stats;
+        }
+        let mut magnitudes: Vec<f64> = state.errors.iter().map(|e| e.abs()).collect();
+        magnitudes.sort_by(|a, b| a.total_cmp(b));
+
+        stats.mean_error = state.errors.iter().sum::<f64>() / count as f64;
+        stats.rms_error = (state.errors.iter().map(|e| e * e).sum::<f64>() / count as f64).sqrt();
+        stats.p99_error = magnitudes[((count - 1) as f64 * 0.99).round() as usize];
+        stats.max_error = magnitudes[count - 1];
+        stats
+    }
+}
+
+impl Default for VsyncClock {
+    fn default() -> Self {
+        Self::new(VsyncClockConfig::default())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Observation times of a display running at `rate` Hz, with uniform
+    /// jitter of up to `jitter` seconds either way
+    fn observations(clock: &VsyncClock, rate: f64, jitter: f64, frames: u64) -> Vec<Instant> {
+        let mut seed = 0x9e37_79b9u32;
+        (1..=frames)
+            .map(|frame| {
+                seed ^= seed << 13;
+                seed ^= seed >> 17;
+                seed ^= seed << 5;
+                let noise = (seed as f64 / u32::MAX as f64 * 2.0 - 1.0) * jitter;
+                let at = frame as f64 / rate + noise;
+                clock.to_instant((at * 1e9).round() as i64)
+            })
+            .collect()
+    }
+
+    #[test]
+    fn locks_onto_a_drifting_display() {
+        let clock = VsyncClock::default();
+        let rate = 90.6;
+        for at in observations(&clock, rate, 0.3e-3, 4000) {
+            assert!(clock.observe(at));
+        }
+
+        let stats = clock.stats();
+        assert_eq!(stats.rejected, 0);
+        assert_eq!(stats.reacquisitions, 0);
+        assert!(
+            (stats.refresh_rate() - rate).abs() < 0.05,
+            "locked at {} Hz",
+            stats.refresh_rate()
+        );
+        assert!(stats.max_error < 0.6e-3, "max error {}", stats.max_error);
+    }
+
+    #[test]
+    fn rejects_outliers_then_reacquires() {
+        let clock = VsyncClock::default();
+        let config = VsyncClockConfig::default();
+        let period = 1.0 / config.refresh_rate;
+        let at = |seconds: f64| clock.to_instant((seconds * 1e9).round() as i64);
+
+        for frame in 1..=100 {
+            assert!(clock.observe(at(frame as f64 * period)));
+        }
+        let locked = clock.stats().period_seconds;
+
+        // One late packet is ignored and leaves the estimate alone
+        assert!(!clock.observe(at(101.4 * period)));
+        assert_eq!(clock.stats().rejected, 1);
+        assert_eq!(clock.stats().period_seconds, locked);
+        assert!(clock.observe(at(102.0 * period)));
+
+        // A sustained phase jump is taken once it outlasts reacquire_after
+        let mut frame = 103;
+        for _ in 0..config.reacquire_after {
+            assert!(!clock.observe(at((frame as f64 + 0.4) * period)));
+            frame += 1;
+        }
+        assert!(clock.observe(at((frame as f64 + 0.4) * period)));
+        assert_eq!(clock.stats().reacquisitions, 1);
+        assert!(clock.observe(at((frame as f64 + 1.4) * period)));
+    }
+
+    #[test]
+    fn served_counter_never_goes_back() {
+        let clock = VsyncClock::default();
+        let period = 1e9 / clock.config.refresh_rate;
+        let anchor = (1000.0 * period) as i64;
+        clock.observe(clock.to_instant(anchor));
+        assert_eq!(clock.stats().reacquisitions, 0);
+
+        let now = anchor + (0.01 * period) as i64;
+        let served = clock.timing_at(now).frame_counter;
+
+        // Late by a fifth of a period: the loop moves the phase past `now`
+        assert!(clock.observe(clock.to_instant(anchor + (1.2 * period) as i64)));
+        assert!(clock.vsync_before(now).1 < served);
+
+        let timing = clock.timing_at(now);
+        assert_eq!(timing.frame_counter, served);
+        assert_eq!(timing.seconds_since_last_vsync, 0.0);
+
+        let (next_at, next) = clock.next_vsync_at(now);
+        assert_eq!(next, served + 1);
+        assert!(clock.to_ns(next_at) > now);
+    }
+}
@@ -0,0 +1,319 @@
+//! Event pump for server driver host events
+//!
+//! This module drains `IVRServerDriverHost::PollNextEvent` in a loop and
+//! routes each event to handlers registered per device index or per input
+//! component handle. Decoding and dispatch never allocate: the pump owns a
+//! single event buffer and handlers receive a borrowed, typed view into it.
+
+use crate::{sys, DriverHost, InputComponentHandle, TrackedDeviceIndex};
+use std::collections::HashMap;
+use std::ptr;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::time::{Duration, Instant};
+
+use sys::root::vr::{
+    EVREventType, VREvent_Data_t, VREvent_HapticVibration_t, VREvent_Property_t, VREvent_t,
+};
+
+/// Number of slots in the per-device handler table
+const DEVICE_TABLE_SIZE: usize = sys::root::vr::k_unMaxTrackedDeviceCount as usize;
+
+/// Event handler callback
+///
+/// Handlers run on the thread that drives the pump (usually the RunFrame
+/// thread) and must not block.
+pub type EventHandler = Box<dyn FnMut(&Event<'_>) + Send>;
+
+/// Typed view over the `VREvent_Data_t` union
+#[derive(Clone, Copy)]
+pub enum EventData<'a> {
+    /// `VREvent_Input_HapticVibration`
+    HapticVibration(&'a VREvent_HapticVibration_t),
+    /// `VREvent_PropertyChanged`
+    PropertyChanged(&'a VREvent_Property_t),
+    /// Any other event type; the raw union is left for the handler to interpret
+    Other(&'a VREvent_Data_t),
+}
+
+/// A decoded event borrowed from the pump's event buffer
+#[derive(Clone, Copy)]
+pub struct Event<'a> {
+    /// Raw `EVREventType` value
+    pub event_type: u32,
+    /// Device the event refers to (may be `k_unTrackedDeviceIndexInvalid`)
+    pub device_index: TrackedDeviceIndex,
+    /// Age of the event in seconds when it was polled
+    pub age_seconds: f32,
+    /// Typed event payload
+    pub data: EventData<'a>,
+}
+
+impl<'a> Event<'a> {
+    /// Decode an event from its header fields and an aligned copy of its data
+    fn decode(
+        event_type: u32,
+        device_index: TrackedDeviceIndex,
+        age_seconds: f32,
+        data: &'a VREvent_Data_t,
+    ) -> Self {
+        // Union reads are sound here because the event type tells us which member is active
+        let data = unsafe {
+            if event_type == EVREventType::VREvent_Input_HapticVibration as u32 {
+                EventData::HapticVibration(&data.hapticVibration)
+            } else if event_type == EVREventType::VREvent_PropertyChanged as u32 {
+                EventData::PropertyChanged(&data.property)
+            } else {
+                EventData::Other(data)
+            }
+        };
+
+        Self {
+            event_type,
+            device_index,
+            age_seconds,
+            data,
+        }
+    }
+
+    /// Input component handle this event targets, if any
+    pub fn component_handle(&self) -> Option<InputComponentHandle> {
+        match self.data {
+            EventData::HapticVibration(haptic) => Some(haptic.componentHandle),
+            _ => None,
+        }
+    }
+}
+
+/// Event pump configuration
+#[derive(Debug, Clone)]
+pub struct EventPumpConfig {
+    /// Maximum wall time spent draining events per call to `pump`
+    pub time_budget: Duration,
+    /// Maximum number of events handled per call to `pump` (0 for unlimited)
+    pub max_events_per_frame: usize,
+}
+
+impl Default for EventPumpConfig {
+    fn default() -> Self {
+        Self {
+            time_budget: Duration::from_micros(500),
+            max_events_per_frame: 0,
+        }
+    }
+}
+
+/// Counters describing pump activity
+#[derive(Debug, Clone, Copy, Default)]
+pub struct EventPumpStats {
+    /// Number of calls to `pump`
+    pub frames: u64,
+    /// Total events drained
+    pub total_events: u64,
+    /// Events drained by the most recent call to `pump`
+    pub last_frame_events: u32,
+    /// Highest number of events drained in a single call to `pump`
+    pub max_frame_events: u32,
+    /// Calls to `pump` that stopped because the time or event budget ran out
+    pub budget_exhausted_frames: u64,
+    /// Events that no registered handler received
+    pub unhandled_events: u64,
+}
+
+/// Drains host events and dispatches them to registered handlers
+///
+/// Events targeting an input component (haptic vibrations) go to the handlers
+/// registered for that component handle. All events with a valid device index
+/// then go to the handlers registered for that device. Events that reached no
+/// handler are passed to the fallback handlers.
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::events::{EventData, EventPump, EventPumpConfig};
+/// # fn example(host: &openvr_driver::DriverHost, haptic: u64) {
+/// let mut pump = EventPump::new(host.clone(), EventPumpConfig::default());
+///
+/// pump.on_component(haptic, |event| {
+///     if let EventData::HapticVibration(vibration) = event.data {
+///         // Drive the motor with vibration.fAmplitude etc.
+///     }
+/// });
+///
+/// // In run_frame:
+/// pump.pump();
+/// # }
+/// ```
+pub struct EventPump {
+    host: DriverHost,
+    config: EventPumpConfig,
+    /// Buffer filled by `PollNextEvent`; reused for every event
+    event: VREvent_t,
+    device_handlers: Vec<Vec<EventHandler>>,
+    component_handlers: HashMap<InputComponentHandle, Vec<EventHandler>>,
+    fallback_handlers: Vec<EventHandler>,
+    stats: EventPumpStats,
+}
+
+impl EventPump {
+    /// Create a new event pump polling the given host
+    pub fn new(host: DriverHost, config: EventPumpConfig) -> Self {
+        Self {
+            host,
+            config,
+            event: VREvent_t::default(),
+            device_handlers: (0..DEVICE_TABLE_SIZE).map(|_| Vec::new()).collect(),
+            component_handlers: HashMap::new(),
+            fallback_handlers: Vec::new(),
+            stats: EventPumpStats::default(),
+        }
+    }
+
+    /// Register a handler for events about a tracked device
+    ///
+    /// Indices outside `0..k_unMaxTrackedDeviceCount` are ignored.
+    pub fn on_device<F>(&mut self, device_index: TrackedDeviceIndex, handler: F)
+    where
+        F: FnMut(&Event<'_>) + Send + 'static,
+    {
+        if let Some(slot) = self.device_handlers.get_mut(device_index as usize) {
+            slot.push(Box::new(handler));
+        }
+    }
+
+    /// Register a handler for events targeting an input component
+    pub fn on_component<F>(&mut self, component: InputComponentHandle, handler: F)
+    where
+        F: FnMut(&Event<'_>) + Send + 'static,
+    {
+        self.component_handlers
+            .entry(component)
+            .or_default()
+            .push(Box::new(handler));
+    }
+
+    /// Register a handler for events no other handler received
+    pub fn on_unhandled<F>(&mut self, handler: F)
+    where
+        F: FnMut(&Event<'_>) + Send + 'static,
+    {
+        self.fallback_handlers.push(Box::new(handler));
+    }
+
+    /// Remove all handlers registered for a device
+    pub fn clear_device(&mut self, device_index: TrackedDeviceIndex) {
+        if let Some(slot) = self.device_handlers.get_mut(device_index as usize) {
+            slot.clear();
+        }
+    }
+
+    /// Remove all handlers registered for an input component
+    pub fn clear_component(&mut self, component: InputComponentHandle) {
+        self.component_handlers.remove(&component);
+    }
+
+    /// Get the pump configuration
+    pub fn config(&self) -> &EventPumpConfig {
+        &self.config
+    }
+
+    /// Replace the pump configuration
+    pub fn set_config(&mut self, config: EventPumpConfig) {
+        self.config = config;
+    }
+
+    /// Get the pump counters
+    pub fn stats(&self) -> EventPumpStats {
+        self.stats
+    }
+
+    /// Drain pending events until the queue is empty or the budget runs out
+    ///
+    /// Call this once per `run_frame`, or in a loop from a dedicated thread.
+    ///
+    /// # Returns
+    /// * Number of events dispatched by this call
+    pub fn pump(&mut self) -> u32 {
+        let start = Instant::now();
+        let mut handled: u32 = 0;
+        let mut exhausted = false;
+
+        loop {
+            if self.config.max_events_per_frame != 0
+                && handled as usize >= self.config.max_events_per_frame
+            {
+                exhausted = true;
+                break;
+            }
+
+            if !self.host.poll_next_event(&mut self.event) {
+                break;
+            }
+
+            self.dispatch_current();
+            handled += 1;
+
+            if start.elapsed() >= self.config.time_budget {
+                exhausted = true;
+                break;
+            }
+        }
+
+        self.stats.frames += 1;
+        self.stats.total_events += handled as u64;
+        self.stats.last_frame_events = handled;
+        self.stats.max_frame_events = self.stats.max_frame_events.max(handled);
+        if exhausted {
+            self.stats.budget_exhausted_frames += 1;
+        }
+
+        handled
+    }
+
+    /// Run the pump on the current thread until `stop` is set
+    ///
+    /// Sleeps for `idle` whenever a pass drains no events.
+    pub fn run(&mut self, stop: &AtomicBool, idle: Duration) {
+        while !stop.load(Ordering::Acquire) {
+            if self.pump() == 0 {
+                std::thread::sleep(idle);
+            }
+        }
+    }
+
+    /// Decode the event in the buffer and hand it to the matching handlers
+    fn dispatch_current(&mut self) {
+        // VREvent_t is packed on Linux, so the union is copied out to get an aligned reference
+        let data: VREvent_Data_t = unsafe { ptr::read_unaligned(ptr::addr_of!(self.event.data)) };
+        let event = Event::decode(
+            self.event.eventType,
+            self.event.trackedDeviceIndex,
+            self.event.eventAgeSeconds,
+            &data,
+        );
+
+        let mut delivered = false;
+
+        if let Some(component) = event.component_handle() {
+            if let Some(handlers) = self.component_handlers.get_mut(&component) {
+                for handler in handlers.iter_mut() {
+                    handler(&event);
+                    delivered = true;
+                }
+            }
+        }
+
+        if let Some(handlers) = self.device_handlers.get_mut(event.device_index as usize) {
+            for handler in handlers.iter_mut() {
+                handler(&event);
+                delivered = true;
+            }
+        }
+
+        if !delivered {
+            self.stats.unhandled_events += 1;
+            for handler in self.fallback_handlers.iter_mut() {
+                handler(&event);
+            }
+        }
+    }
+}
@@ -0,0 +1,235 @@
+//! `DriverInput` implementations
+//!
+//! `HostDriverInput` forwards to the runtime's `IVRDriverInput`, while
+//! `LocalDriverInput` is an in-process stand-in that hands out handles and
+//! counts updates.
+
+use crate::{sys, DriverError, DriverInput, DriverResult, InputComponentHandle, PropertyHandle};
+use std::ffi::CString;
+
+use sys::root::vr::{EVRInputError, EVRScalarType, EVRScalarUnits, IVRDriverInput};
+
+/// `DriverInput` backed by the runtime's `IVRDriverInput` interface
+///
+/// Obtain one through `DriverContext::driver_input`.
+#[derive(Clone)]
+pub struct HostDriverInput {
+    input: *mut IVRDriverInput,
+}
+
+unsafe impl Send for HostDriverInput {}
+unsafe impl Sync for HostDriverInput {}
+
+impl HostDriverInput {
+    /// Create a driver input wrapper from a raw pointer
+    ///
+    /// # Safety
+    /// The provided pointer must be a valid IVRDriverInput pointer that
+    /// remains valid for the lifetime of this wrapper.
+    pub unsafe fn from_raw(input: *mut IVRDriverInput) -> Self {
+        Self { input }
+    }
+
+    /// Get the raw driver input pointer
+    ///
+    /// # Safety
+    /// The returned pointer should not be stored beyond the lifetime
+    /// of this HostDriverInput.
+    pub unsafe fn raw_input(&self) -> *mut IVRDriverInput {
+        self.input
+    }
+}
+
+/// Convert an input error to a Result
+fn check_input_error(error: EVRInputError, operation: &str) -> DriverResult<()> {
+    if error == EVRInputError::None {
+        Ok(())
+    } else {
+        Err(DriverError::operation_failed(format!(
+            "{} failed: {:?}",
+            operation, error
+        )))
+    }
+}
+
+impl DriverInput for HostDriverInput {
+    fn create_boolean_component(
+        &mut self,
+        device_handle: PropertyHandle,
+        name: &str,
+    ) -> DriverResult<InputComponentHandle> {
+        let name = CString::new(name)
+            .map_err(|_| DriverError::invalid_parameter("Component name contains null byte"))?;
+        let mut handle: InputComponentHandle = 0;
+
+        unsafe {
+            let vtable = (*self.input).vtable_;
+            let create = (*vtable).IVRDriverInput_CreateBooleanComponent;
+            let error = create(self.input, device_handle, name.as_ptr(), &mut handle);
+            check_input_error(error, "CreateBooleanComponent")?;
+        }
+
+        Ok(handle)
+    }
+
+    fn create_scalar_component(
+        &mut self,
+        device_handle: PropertyHandle,
+        name: &str,
+        scalar_type: EVRScalarType,
+        units: EVRScalarUnits,
+    ) -> DriverResult<InputComponentHandle> {
+        let name = CString::new(name)
+            .map_err(|_| DriverError::invalid_parameter("Component name contains null byte"))?;
+        let mut handle: InputComponentHandle = 0;
+
+        unsafe {
+            let vtable = (*self.input).vtable_;
+            let create = (*vtable).IVRDriverInput_CreateScalarComponent;
+            let error = create(
+                self.input,
+                device_handle,
+                name.as_ptr(),
+                &mut handle,
+                scalar_type,
+                units,
+            );
+            check_input_error(error, "CreateScalarComponent")?;
+        }
+
+        Ok(handle)
+    }
+
+    fn create_haptic_component(
+        &mut self,
+        device_handle: PropertyHandle,
+        name: &str,
+    ) -> DriverResult<InputComponentHandle> {
+        let name = CString::new(name)
+            .map_err(|_| DriverError::invalid_parameter("Component name contains null byte"))?;
+        let mut handle: InputComponentHandle = 0;
+
+        unsafe {
+            let vtable = (*self.input).vtable_;
+            let create = (*vtable).IVRDriverInput_CreateHapticComponent;
+            let error = create(self.input, device_handle, name.as_ptr(), &mut handle);
+            check_input_error(error, "CreateHapticComponent")?;
+        }
+
+        Ok(handle)
+    }
+
+    fn update_boolean_component(
+        &mut self,
+        handle: InputComponentHandle,
+        value: bool,
+        time_offset: f64,
+    ) -> DriverResult<()> {
+        unsafe {
+            let vtable = (*self.input).vtable_;
+            let update = (*vtable).IVRDriverInput_UpdateBooleanComponent;
+            check_input_error(
+                update(self.input, handle, value, time_offset),
+                "UpdateBooleanComponent",
+            )
+        }
+    }
+
+    fn update_scalar_component(
+        &mut self,
+        handle: InputComponentHandle,
+        value: f32,
+        time_offset: f64,
+    ) -> DriverResult<()> {
+        unsafe {
+            let vtable = (*self.input).vtable_;
+            let update = (*vtable).IVRDriverInput_UpdateScalarComponent;
+            check_input_error(
+                update(self.input, handle, value, time_offset),
+                "UpdateScalarComponent",
+            )
+        }
+    }
+}
+
+/// In-process stand-in for `IVRDriverInput`
+///
+/// Hands out sequential component handles and counts updates, so input
+/// pipelines can be exercised and measured without vrserver.
+#[derive(Debug, Default)]
+pub struct LocalDriverInput {
+    next_handle: InputComponentHandle,
+    /// Number of components created
+    pub components_created: u64,
+    /// Number of boolean updates received
+    pub boolean_updates: u64,
+    /// Number of scalar updates received
+    pub scalar_updates: u64,
+}
+
+impl LocalDriverInput {
+    /// Create a new local driver input
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Total number of updates received
+    pub fn total_updates(&self) -> u64 {
+        self.boolean_updates + self.scalar_updates
+    }
+
+    fn allocate_handle(&mut self) -> InputComponentHandle {
+        // Handle 0 is k_ulInvalidInputComponentHandle
+        self.next_handle += 1;
+        self.components_created += 1;
+        self.next_handle
+    }
+}
+
+impl DriverInput for LocalDriverInput {
+    fn create_boolean_component(
+        &mut self,
+        _device_handle: PropertyHandle,
+        _name: &str,
+    ) -> DriverResult<InputComponentHandle> {
+        Ok(self.allocate_handle())
+    }
+
+    fn create_scalar_component(
+        &mut self,
+        _device_handle: PropertyHandle,
+        _name: &str,
+        _scalar_type: EVRScalarType,
+        _units: EVRScalarUnits,
+    ) -> DriverResult<InputComponentHandle> {
+        Ok(self.allocate_handle())
+    }
+
+    fn create_haptic_component(
+        &mut self,
+        _device_handle: PropertyHandle,
+        _name: &str,
+    ) -> DriverResult<InputComponentHandle> {
+        Ok(self.allocate_handle())
+    }
+
+    fn update_boolean_component(
+        &mut self,
+        _handle: InputComponentHandle,
+        _value: bool,
+        _time_offset: f64,
+    ) -> DriverResult<()> {
+        self.boolean_updates += 1;
+        Ok(())
+    }
+
+    fn update_scalar_component(
+        &mut self,
+        _handle: InputComponentHandle,
+        _value: f32,
+        _time_offset: f64,
+    ) -> DriverResult<()> {
+        self.scalar_updates += 1;
+        Ok(())
+    }
+}
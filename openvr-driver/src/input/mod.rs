@@ -0,0 +1,19 @@
+//! Input submission helpers
+//!
+//! This module provides a `DriverInput` implementation backed by the
+//! runtime's `IVRDriverInput` interface, a local stand-in for running
+//! without vrserver, tooling for recording and replaying input traffic, and
+//! a sampling service that submits input independently of `run_frame`.
+
+mod host;
+mod recorder;
+mod replay;
+mod sampler;
+
+pub use host::{HostDriverInput, LocalDriverInput};
+pub use recorder::{InputRecord, InputRecordKind, InputRecorder, RecorderStats};
+pub use replay::{InputRecording, InputReplayer, ReplaySpeed, ReplayStats};
+pub use sampler::{
+    InputSampler, InputSamplerBuilder, InputSamplerStats, InputSource, InputUpdate, SampleSink,
+    SamplerConfig, SamplerStats, SubmitterConfig,
+};
@@ -0,0 +1,462 @@
+//! Input traffic recorder
+//!
+//! `InputRecorder` wraps any `DriverInput`, forwards every call to it and
+//! captures component creations and updates into a compact binary file.
+//! Encoding and file I/O happen on a background writer thread so the input
+//! path only pays for a bounded channel send. Updates are dropped when the
+//! channel is full; component creations wait for room.
+
+use crate::sys::root::vr::{EVRScalarType, EVRScalarUnits};
+use crate::{DriverError, DriverInput, DriverResult, InputComponentHandle, PropertyHandle};
+use std::fs::File;
+use std::io::{self, BufWriter, Read, Write};
+use std::path::Path;
+use std::sync::mpsc::{self, SyncSender, TrySendError};
+use std::thread::JoinHandle;
+use std::time::Instant;
+
+/// File magic for input recordings
+pub(crate) const RECORDING_MAGIC: &[u8; 8] = b"OVRINREC";
+
+/// Recording format version
+pub(crate) const RECORDING_VERSION: u32 = 2;
+
+/// Number of records buffered between the input path and the writer thread
+const CHANNEL_CAPACITY: usize = 16 * 1024;
+
+const TAG_CREATE_BOOLEAN: u8 = 1;
+const TAG_CREATE_SCALAR: u8 = 2;
+const TAG_CREATE_HAPTIC: u8 = 3;
+const TAG_UPDATE_BOOLEAN: u8 = 4;
+const TAG_UPDATE_SCALAR: u8 = 5;
+
+/// What happened to an input component
+#[derive(Debug, Clone, PartialEq)]
+pub enum InputRecordKind {
+    /// A boolean component was created
+    CreateBoolean {
+        container: PropertyHandle,
+        name: String,
+    },
+    /// A scalar component was created
+    CreateScalar {
+        container: PropertyHandle,
+        name: String,
+        scalar_type: EVRScalarType,
+        units: EVRScalarUnits,
+    },
+    /// A haptic component was created
+    CreateHaptic {
+        container: PropertyHandle,
+        name: String,
+    },
+    /// A boolean component was updated
+    UpdateBoolean { value: bool, time_offset: f64 },
+    /// A scalar component was updated
+    UpdateScalar { value: f32, time_offset: f64 },
+}
+
+impl InputRecordKind {
+    /// Whether this record creates a component
+    pub fn is_creation(&self) -> bool {
+        matches!(
+            self,
+            Self::CreateBoolean { .. } | Self::CreateScalar { .. } | Self::CreateHaptic { .. }
+        )
+    }
+}
+
+/// A single captured input event
+#[derive(Debug, Clone, PartialEq)]
+pub struct InputRecord {
+    /// Nanoseconds since the recording started
+    pub timestamp_ns: u64,
+    /// Component handle as seen at record time
+    pub handle: InputComponentHandle,
+    /// What happened
+    pub kind: InputRecordKind,
+}
+
+impl InputRecord {
+    /// Encode this record
+    ///
+    /// Layout (little endian): tag `u8`, timestamp `u64`, handle `u64`, then
+    /// either container `u64` + name length `u16` + UTF-8 name for creations,
+    /// followed by scalar type `u8` + units `u8` for scalars, or value (`u8`
+    /// or `f32`) + time offset `f64` for updates.
+    pub fn write_to<W: Write>(&self, writer: &mut W) -> io::Result<()> {
+        let tag = match self.kind {
+            InputRecordKind::CreateBoolean { .. } => TAG_CREATE_BOOLEAN,
+            InputRecordKind::CreateScalar { .. } => TAG_CREATE_SCALAR,
+            InputRecordKind::CreateHaptic { .. } => TAG_CREATE_HAPTIC,
+            InputRecordKind::UpdateBoolean { .. } => TAG_UPDATE_BOOLEAN,
+            InputRecordKind::UpdateScalar { .. } => TAG_UPDATE_SCALAR,
+        };
+
+        writer.write_all(&[tag])?;
+        writer.write_all(&self.timestamp_ns.to_le_bytes())?;
+        writer.write_all(&self.handle.to_le_bytes())?;
+
+        match &self.kind {
+            InputRecordKind::CreateBoolean { container, name }
+            | InputRecordKind::CreateHaptic { container, name } => {
+                write_name(writer, *container, name)?;
+            }
+            InputRecordKind::CreateScalar {
+                container,
+                name,
+                scalar_type,
+                units,
+            } => {
+                write_name(writer, *container, name)?;
+                writer.write_all(&[*scalar_type as u8, *units as u8])?;
+            }
+            InputRecordKind::UpdateBoolean { value, time_offset } => {
+                writer.write_all(&[*value as u8])?;
+                writer.write_all(&time_offset.to_le_bytes())?;
+            }
+            InputRecordKind::UpdateScalar { value, time_offset } => {
+                writer.write_all(&value.to_le_bytes())?;
+                writer.write_all(&time_offset.to_le_bytes())?;
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Decode the next record
+    ///
+    /// # Returns
+    /// * `Ok(None)` at a clean end of stream
+    pub fn read_from<R: Read>(reader: &mut R) -> io::Result<Option<Self>> {
+        let mut tag = [0u8; 1];
+        if reader.read(&mut tag)? == 0 {
+            return Ok(None);
+        }
+
+        let timestamp_ns = u64::from_le_bytes(read_array(reader)?);
+        let handle = u64::from_le_bytes(read_array(reader)?);
+
+        let kind = match tag[0] {
+            TAG_CREATE_BOOLEAN | TAG_CREATE_SCALAR | TAG_CREATE_HAPTIC => {
+                let container = u64::from_le_bytes(read_array(reader)?);
+                let len = u16::from_le_bytes(read_array(reader)?) as usize;
+                let mut bytes = vec![0u8; len];
+                reader.read_exact(&mut bytes)?;
+                let name = String::from_utf8(bytes).map_err(|_| {
+                    io::Error::new(io::ErrorKind::InvalidData, "component name is not UTF-8")
+                })?;
+
+                match tag[0] {
+                    TAG_CREATE_BOOLEAN => InputRecordKind::CreateBoolean { container, name },
+                    TAG_CREATE_SCALAR => {
+                        let [scalar_type, units] = read_array::<_, 2>(reader)?;
+                        InputRecordKind::CreateScalar {
+                            container,
+                            name,
+                            scalar_type: scalar_type_from(scalar_type)?,
+                            units: scalar_units_from(units)?,
+                        }
+                    }
+                    _ => InputRecordKind::CreateHaptic { container, name },
+                }
+            }
+            TAG_UPDATE_BOOLEAN => {
+                let [value] = read_array::<_, 1>(reader)?;
+                let time_offset = f64::from_le_bytes(read_array(reader)?);
+                InputRecordKind::UpdateBoolean {
+                    value: value != 0,
+                    time_offset,
+                }
+            }
+            TAG_UPDATE_SCALAR => {
+                let value = f32::from_le_bytes(read_array(reader)?);
+                let time_offset = f64::from_le_bytes(read_array(reader)?);
+                InputRecordKind::UpdateScalar { value, time_offset }
+            }
+            other => {
+                return Err(io::Error::new(
+                    io::ErrorKind::InvalidData,
+                    format!("unknown input record tag {}", other),
+                ))
+            }
+        };
+
+        Ok(Some(Self {
+            timestamp_ns,
+            handle,
+            kind,
+        }))
+    }
+}
+
+fn write_name<W: Write>(writer: &mut W, container: PropertyHandle, name: &str) -> io::Result<()> {
+    let bytes = name.as_bytes();
+    let len = u16::try_from(bytes.len())
+        .map_err(|_| io::Error::new(io::ErrorKind::InvalidInput, "component name too long"))?;
+    writer.write_all(&container.to_le_bytes())?;
+    writer.write_all(&len.to_le_bytes())?;
+    writer.write_all(bytes)
+}
+
+fn scalar_type_from(value: u8) -> io::Result<EVRScalarType> {
+    match value {
+        v if v == EVRScalarType::Absolute as u8 => Ok(EVRScalarType::Absolute),
+        v if v == EVRScalarType::Relative as u8 => Ok(EVRScalarType::Relative),
+        other => Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            format!("unknown scalar type {}", other),
+        )),
+    }
+}
+
+fn scalar_units_from(value: u8) -> io::Result<EVRScalarUnits> {
+    match value {
+        v if v == EVRScalarUnits::NormalizedOneSided as u8 => {
+            Ok(EVRScalarUnits::NormalizedOneSided)
+        }
+        v if v == EVRScalarUnits::NormalizedTwoSided as u8 => {
+            Ok(EVRScalarUnits::NormalizedTwoSided)
+        }
+        other => Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            format!("unknown scalar units {}", other),
+        )),
+    }
+}
+
+fn read_array<R: Read, const N: usize>(reader: &mut R) -> io::Result<[u8; N]> {
+    let mut buf = [0u8; N];
+    reader.read_exact(&mut buf)?;
+    Ok(buf)
+}
+
+/// Counters reported when a recording is finished
+#[derive(Debug, Clone, Copy, Default)]
+pub struct RecorderStats {
+    /// Records written to the file
+    pub records_written: u64,
+    /// Update records dropped because the writer thread fell behind
+    ///
+    /// Creation records are never shed; they only count here if the writer
+    /// thread has stopped.
+    pub records_dropped: u64,
+}
+
+/// `DriverInput` wrapper that records all traffic to a file
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::input::{InputRecorder, LocalDriverInput};
+/// use openvr_driver::sys::root::vr::{EVRScalarType, EVRScalarUnits};
+/// use openvr_driver::DriverInput;
+///
+/// let mut input = InputRecorder::create("session.ovrin", LocalDriverInput::new()).unwrap();
+/// let trigger = input
+///     .create_scalar_component(
+///         1,
+///         "/input/trigger/value",
+///         EVRScalarType::Absolute,
+///         EVRScalarUnits::NormalizedOneSided,
+///     )
+///     .unwrap();
+/// input.update_scalar_component(trigger, 0.5, 0.0).unwrap();
+/// let stats = input.finish().unwrap();
+/// ```
+pub struct InputRecorder<I: DriverInput> {
+    inner: I,
+    start: Instant,
+    sender: Option<SyncSender<InputRecord>>,
+    writer: Option<JoinHandle<io::Result<u64>>>,
+    dropped: u64,
+}
+
+impl<I: DriverInput> InputRecorder<I> {
+    /// Start recording to a file, forwarding all calls to `inner`
+    pub fn create(path: impl AsRef<Path>, inner: I) -> DriverResult<Self> {
+        let file = File::create(path.as_ref()).map_err(|e| {
+            DriverError::operation_failed(format!("Failed to create recording: {}", e))
+        })?;
+
+        let (sender, receiver) = mpsc::sync_channel::<InputRecord>(CHANNEL_CAPACITY);
+
+        let writer = std::thread::Builder::new()
+            .name("input-recorder".to_string())
+            .spawn(move || -> io::Result<u64> {
+                let mut out = BufWriter::new(file);
+                out.write_all(RECORDING_MAGIC)?;
+                out.write_all(&RECORDING_VERSION.to_le_bytes())?;
+
+                let mut written = 0u64;
+                for record in receiver {
+                    record.write_to(&mut out)?;
+                    written += 1;
+                }
+
+                out.flush()?;
+                Ok(written)
+            })
+            .map_err(|e| {
+                DriverError::operation_failed(format!("Failed to spawn recorder thread: {}", e))
+            })?;
+
+        Ok(Self {
+            inner,
+            start: Instant::now(),
+            sender: Some(sender),
+            writer: Some(writer),
+            dropped: 0,
+        })
+    }
+
+    /// Get the wrapped input
+    pub fn inner(&self) -> &I {
+        &self.inner
+    }
+
+    /// Get the wrapped input mutably
+    pub fn inner_mut(&mut self) -> &mut I {
+        &mut self.inner
+    }
+
+    /// Stop recording, flush the file and return the counters
+    pub fn finish(mut self) -> DriverResult<RecorderStats> {
+        self.close()
+    }
+
+    fn close(&mut self) -> DriverResult<RecorderStats> {
+        // Dropping the sender ends the writer loop
+        self.sender.take();
+
+        let written = match self.writer.take() {
+            Some(writer) => writer
+                .join()
+                .map_err(|_| DriverError::operation_failed("Recorder thread panicked"))?
+                .map_err(|e| {
+                    DriverError::operation_failed(format!("Failed to write recording: {}", e))
+                })?,
+            None => 0,
+        };
+
+        Ok(RecorderStats {
+            records_written: written,
+            records_dropped: self.dropped,
+        })
+    }
+
+    fn record(&mut self, handle: InputComponentHandle, kind: InputRecordKind) {
+        let Some(sender) = &self.sender else {
+            return;
+        };
+
+        let record = InputRecord {
+            timestamp_ns: self.start.elapsed().as_nanos() as u64,
+            handle,
+            kind,
+        };
+
+        // Replay maps handles through the creation records, so those wait
+        // for room; only updates are shed when the writer falls behind
+        let sent = if record.kind.is_creation() {
+            sender.send(record).is_ok()
+        } else {
+            match sender.try_send(record) {
+                Ok(()) => true,
+                Err(TrySendError::Full(_)) | Err(TrySendError::Disconnected(_)) => false,
+            }
+        };
+        if !sent {
+            self.dropped += 1;
+        }
+    }
+}
+
+impl<I: DriverInput> Drop for InputRecorder<I> {
+    fn drop(&mut self) {
+        if let Err(e) = self.close() {
+            eprintln!("[InputRecorder] {}", e);
+        }
+    }
+}
+
+impl<I: DriverInput> DriverInput for InputRecorder<I> {
+    fn create_boolean_component(
+        &mut self,
+        device_handle: PropertyHandle,
+        name: &str,
+    ) -> DriverResult<InputComponentHandle> {
+        let handle = self.inner.create_boolean_component(device_handle, name)?;
+        self.record(
+            handle,
+            InputRecordKind::CreateBoolean {
+                container: device_handle,
+                name: name.to_string(),
+            },
+        );
+        Ok(handle)
+    }
+
+    fn create_scalar_component(
+        &mut self,
+        device_handle: PropertyHandle,
+        name: &str,
+        scalar_type: EVRScalarType,
+        units: EVRScalarUnits,
+    ) -> DriverResult<InputComponentHandle> {
+        let handle = self
+            .inner
+            .create_scalar_component(device_handle, name, scalar_type, units)?;
+        self.record(
+            handle,
+            InputRecordKind::CreateScalar {
+                container: device_handle,
+                name: name.to_string(),
+                scalar_type,
+                units,
+            },
+        );
+        Ok(handle)
+    }
+
+    fn create_haptic_component(
+        &mut self,
+        device_handle: PropertyHandle,
+        name: &str,
+    ) -> DriverResult<InputComponentHandle> {
+        let handle = self.inner.create_haptic_component(device_handle, name)?;
+        self.record(
+            handle,
+            InputRecordKind::CreateHaptic {
+                container: device_handle,
+                name: name.to_string(),
+            },
+        );
+        Ok(handle)
+    }
+
+    fn update_boolean_component(
+        &mut self,
+        handle: InputComponentHandle,
+        value: bool,
+        time_offset: f64,
+    ) -> DriverResult<()> {
+        self.record(
+            handle,
+            InputRecordKind::UpdateBoolean { value, time_offset },
+        );
+        self.inner
+            .update_boolean_component(handle, value, time_offset)
+    }
+
+    fn update_scalar_component(
+        &mut self,
+        handle: InputComponentHandle,
+        value: f32,
+        time_offset: f64,
+    ) -> DriverResult<()> {
+        self.record(handle, InputRecordKind::UpdateScalar { value, time_offset });
+        self.inner
+            .update_scalar_component(handle, value, time_offset)
+    }
+}
@@ -0,0 +1,312 @@
+//! Input traffic replayer
+//!
+//! Feeds a recording made by `InputRecorder` back through any `DriverInput`,
+//! at the original pace, scaled, or as fast as possible, and reports
+//! throughput and how many updates were redundant.
+
+use super::recorder::{InputRecord, InputRecordKind, RECORDING_MAGIC, RECORDING_VERSION};
+use crate::{DriverError, DriverInput, DriverResult, InputComponentHandle};
+use std::collections::HashMap;
+use std::fs::File;
+use std::io::{BufReader, Read};
+use std::path::Path;
+use std::time::{Duration, Instant};
+
+/// A recording loaded into memory
+#[derive(Debug, Clone, Default)]
+pub struct InputRecording {
+    /// Captured records in recording order
+    pub records: Vec<InputRecord>,
+}
+
+impl InputRecording {
+    /// Load a recording file
+    pub fn load(path: impl AsRef<Path>) -> DriverResult<Self> {
+        let file = File::open(path.as_ref()).map_err(|e| {
+            DriverError::operation_failed(format!("Failed to open recording: {}", e))
+        })?;
+        let mut reader = BufReader::new(file);
+
+        let mut magic = [0u8; 8];
+        let mut version = [0u8; 4];
+        reader
+            .read_exact(&mut magic)
+            .and_then(|_| reader.read_exact(&mut version))
+            .map_err(|e| DriverError::invalid_parameter(format!("Truncated recording: {}", e)))?;
+
+        if &magic != RECORDING_MAGIC {
+            return Err(DriverError::invalid_parameter("Not an input recording"));
+        }
+        if u32::from_le_bytes(version) != RECORDING_VERSION {
+            return Err(DriverError::invalid_parameter(format!(
+                "Unsupported recording version {}",
+                u32::from_le_bytes(version)
+            )));
+        }
+
+        let mut records = Vec::new();
+        loop {
+            match InputRecord::read_from(&mut reader) {
+                Ok(Some(record)) => records.push(record),
+                Ok(None) => break,
+                Err(e) => {
+                    return Err(DriverError::invalid_parameter(format!(
+                        "Corrupt recording after {} records: {}",
+                        records.len(),
+                        e
+                    )))
+                }
+            }
+        }
+
+        Ok(Self { records })
+    }
+
+    /// Recorded duration
+    pub fn duration(&self) -> Duration {
+        self.records
+            .last()
+            .map(|r| Duration::from_nanos(r.timestamp_ns))
+            .unwrap_or_default()
+    }
+}
+
+/// Replay pacing
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum ReplaySpeed {
+    /// Reproduce the recorded timing
+    Original,
+    /// Run the recorded timeline this many times faster; must be positive
+    /// and finite
+    Scaled(f64),
+    /// Submit records back to back without waiting
+    Unthrottled,
+}
+
+/// Results of a replay run
+#[derive(Debug, Clone, Copy, Default)]
+pub struct ReplayStats {
+    /// Components created on the target
+    pub components_created: u64,
+    /// Updates submitted to the target
+    pub updates: u64,
+    /// Updates that repeated the previous value of their component
+    pub redundant_updates: u64,
+    /// Updates whose component was created before the recording started
+    pub unmapped_updates: u64,
+    /// Calls the target rejected
+    pub errors: u64,
+    /// Wall time spent replaying
+    pub elapsed: Duration,
+}
+
+impl ReplayStats {
+    /// Updates submitted per second of wall time
+    pub fn updates_per_second(&self) -> f64 {
+        let secs = self.elapsed.as_secs_f64();
+        if secs > 0.0 {
+            self.updates as f64 / secs
+        } else {
+            0.0
+        }
+    }
+
+    /// Fraction of updates a value-change filter would have suppressed
+    pub fn suppression_ratio(&self) -> f64 {
+        if self.updates > 0 {
+            self.redundant_updates as f64 / self.updates as f64
+        } else {
+            0.0
+        }
+    }
+}
+
+/// Last value submitted for a component, used to detect redundant updates
+#[derive(Clone, Copy, PartialEq)]
+enum LastValue {
+    Boolean(bool),
+    Scalar(u32),
+}
+
+/// Replays a recording through a `DriverInput`
+///
+/// Component creations are replayed first-class: handles from the recording
+/// are remapped to the handles the target returns.
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::input::{InputRecording, InputReplayer, LocalDriverInput, ReplaySpeed};
+///
+/// let recording = InputRecording::load("session.ovrin").unwrap();
+/// let mut target = LocalDriverInput::new();
+/// let stats = InputReplayer::new(&recording, ReplaySpeed::Unthrottled)
+///     .unwrap()
+///     .run(&mut target);
+/// println!(
+///     "{:.0} updates/s, {:.1}% redundant",
+///     stats.updates_per_second(),
+///     stats.suppression_ratio() * 100.0
+/// );
+/// ```
+pub struct InputReplayer<'a> {
+    recording: &'a InputRecording,
+    speed: ReplaySpeed,
+}
+
+impl<'a> InputReplayer<'a> {
+    /// Create a replayer for a recording
+    ///
+    /// # Returns
+    /// * An error if a `ReplaySpeed::Scaled` factor is not positive and finite
+    pub fn new(recording: &'a InputRecording, speed: ReplaySpeed) -> DriverResult<Self> {
+        if let ReplaySpeed::Scaled(factor) = speed {
+            if !(factor.is_finite() && factor > 0.0) {
+                return Err(DriverError::invalid_parameter(format!(
+                    "Replay speed factor must be positive, got {}",
+                    factor
+                )));
+            }
+        }
+        Ok(Self { recording, speed })
+    }
+
+    /// Replay the whole recording into `target`
+    pub fn run<D: DriverInput + ?Sized>(&self, target: &mut D) -> ReplayStats {
+        let mut stats = ReplayStats::default();
+        let mut handles: HashMap<InputComponentHandle, InputComponentHandle> = HashMap::new();
+        let mut last_values: HashMap<InputComponentHandle, LastValue> = HashMap::new();
+
+        let scale = match self.speed {
+            ReplaySpeed::Original => Some(1.0),
+            ReplaySpeed::Scaled(factor) => Some(1.0 / factor),
+            ReplaySpeed::Unthrottled => None,
+        };
+
+        let start = Instant::now();
+
+        for record in &self.recording.records {
+            if let Some(scale) = scale {
+                let due = Duration::from_secs_f64(record.timestamp_ns as f64 * 1e-9 * scale);
+                let now = start.elapsed();
+                if due > now {
+                    std::thread::sleep(due - now);
+                }
+            }
+
+            let result = match &record.kind {
+                InputRecordKind::CreateBoolean { container, name } => target
+                    .create_boolean_component(*container, name)
+                    .map(|handle| {
+                        handles.insert(record.handle, handle);
+                        stats.components_created += 1;
+                    }),
+                InputRecordKind::CreateScalar {
+                    container,
+                    name,
+                    scalar_type,
+                    units,
+                } => target
+                    .create_scalar_component(*container, name, *scalar_type, *units)
+                    .map(|handle| {
+                        handles.insert(record.handle, handle);
+                        stats.components_created += 1;
+                    }),
+                InputRecordKind::CreateHaptic { container, name } => target
+                    .create_haptic_component(*container, name)
+                    .map(|handle| {
+                        handles.insert(record.handle, handle);
+                        stats.components_created += 1;
+                    }),
+                InputRecordKind::UpdateBoolean { value, time_offset } => {
+                    let handle = self.map_handle(&handles, record.handle, &mut stats);
+                    self.note_value(
+                        &mut last_values,
+                        record.handle,
+                        LastValue::Boolean(*value),
+                        &mut stats,
+                    );
+                    target.update_boolean_component(handle, *value, *time_offset)
+                }
+                InputRecordKind::UpdateScalar { value, time_offset } => {
+                    let handle = self.map_handle(&handles, record.handle, &mut stats);
+                    self.note_value(
+                        &mut last_values,
+                        record.handle,
+                        LastValue::Scalar(value.to_bits()),
+                        &mut stats,
+                    );
+                    target.update_scalar_component(handle, *value, *time_offset)
+                }
+            };
+
+            if result.is_err() {
+                stats.errors += 1;
+            }
+        }
+
+        stats.elapsed = start.elapsed();
+        stats
+    }
+
+    fn map_handle(
+        &self,
+        handles: &HashMap<InputComponentHandle, InputComponentHandle>,
+        recorded: InputComponentHandle,
+        stats: &mut ReplayStats,
+    ) -> InputComponentHandle {
+        match handles.get(&recorded) {
+            Some(handle) => *handle,
+            None => {
+                stats.unmapped_updates += 1;
+                recorded
+            }
+        }
+    }
+
+    fn note_value(
+        &self,
+        last_values: &mut HashMap<InputComponentHandle, LastValue>,
+        handle: InputComponentHandle,
+        value: LastValue,
+        stats: &mut ReplayStats,
+    ) {
+        stats.updates += 1;
+        if last_values.insert(handle, value) == Some(value) {
+            stats.redundant_updates += 1;
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::sys::root::vr::{EVRScalarType, EVRScalarUnits};
+
+    #[test]
+    fn scalar_creations_keep_type_and_units() {
+        let record = InputRecord {
+            timestamp_ns: 42,
+            handle: 7,
+            kind: InputRecordKind::CreateScalar {
+                container: 3,
+                name: "/input/joystick/x".to_string(),
+                scalar_type: EVRScalarType::Relative,
+                units: EVRScalarUnits::NormalizedTwoSided,
+            },
+        };
+        let mut bytes = Vec::new();
+        record.write_to(&mut bytes).unwrap();
+        let decoded = InputRecord::read_from(&mut bytes.as_slice()).unwrap();
+        assert_eq!(decoded, Some(record));
+    }
+
+    #[test]
+    fn rejects_non_positive_speed() {
+        let recording = InputRecording::default();
+        for factor in [0.0, -2.0, f64::NAN, f64::INFINITY] {
+            assert!(InputReplayer::new(&recording, ReplaySpeed::Scaled(factor)).is_err());
+        }
+        assert!(InputReplayer::new(&recording, ReplaySpeed::Scaled(4.0)).is_ok());
+    }
+}
@@ -0,0 +1,506 @@
+//! High-rate input sampling service
+//!
+//! By default input is only submitted when the provider's `run_frame` runs,
+//! at vrserver's cadence and under the provider mutex. `InputSampler` moves
+//! hardware reads onto dedicated threads that run at the device's native
+//! rate. Each sampler pushes updates into its own wait-free SPSC queue, and a
+//! single submission thread drains all queues into a `DriverInput` as soon as
+//! updates arrive.
+
+use crate::display::{self, FramePacer, FramePacerConfig};
+use crate::spsc::{self, Consumer, Producer};
+use crate::threading::ThreadConfig;
+use crate::{DriverError, DriverInput, DriverResult, InputComponentHandle};
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::Arc;
+use std::thread::{self, JoinHandle, Thread};
+use std::time::{Duration, Instant};
+
+/// A single input update captured by a sampler thread
+#[derive(Debug, Clone, Copy)]
+pub enum InputUpdate {
+    /// Boolean component update
+    Boolean {
+        handle: InputComponentHandle,
+        value: bool,
+        time_offset: f64,
+        sampled_at: Instant,
+    },
+    /// Scalar component update
+    Scalar {
+        handle: InputComponentHandle,
+        value: f32,
+        time_offset: f64,
+        sampled_at: Instant,
+    },
+}
+
+/// Hardware reader driven by a sampler thread
+pub trait InputSource: Send + 'static {
+    /// Read the hardware and push any changed values into `sink`
+    ///
+    /// With a configured rate this is called once per period. Without one it
+    /// is called in a loop, so it should block on the hardware read.
+    ///
+    /// # Returns
+    /// * `false` to stop this sampler
+    fn sample(&mut self, sink: &mut SampleSink<'_>) -> bool;
+}
+
+/// Queue handle passed to `InputSource::sample`
+pub struct SampleSink<'a> {
+    producer: &'a mut Producer<InputUpdate>,
+    stats: &'a SamplerCounters,
+    submitter: &'a Thread,
+    pushed: bool,
+}
+
+impl SampleSink<'_> {
+    /// Queue a boolean update
+    ///
+    /// `time_offset` is relative to the moment of this call; the submission
+    /// stage accounts for queueing delay.
+    ///
+    /// # Returns
+    /// * `false` if the queue was full and the update was dropped
+    pub fn boolean(&mut self, handle: InputComponentHandle, value: bool, time_offset: f64) -> bool {
+        self.push(InputUpdate::Boolean {
+            handle,
+            value,
+            time_offset,
+            sampled_at: Instant::now(),
+        })
+    }
+
+    /// Queue a scalar update
+    ///
+    /// # Returns
+    /// * `false` if the queue was full and the update was dropped
+    pub fn scalar(&mut self, handle: InputComponentHandle, value: f32, time_offset: f64) -> bool {
+        self.push(InputUpdate::Scalar {
+            handle,
+            value,
+            time_offset,
+            sampled_at: Instant::now(),
+        })
+    }
+
+    fn push(&mut self, update: InputUpdate) -> bool {
+        match self.producer.push(update) {
+            Ok(()) => {
+                self.stats.queued.fetch_add(1, Ordering::Relaxed);
+                self.pushed = true;
+                true
+            }
+            Err(_) => {
+                self.stats.overflows.fetch_add(1, Ordering::Relaxed);
+                false
+            }
+        }
+    }
+
+    /// Wake the submission thread once per sample pass
+    fn flush(&mut self) {
+        if self.pushed {
+            self.submitter.unpark();
+            self.pushed = false;
+        }
+    }
+}
+
+/// Configuration for one sampler thread
+#[derive(Debug, Clone)]
+pub struct SamplerConfig {
+    /// Thread name
+    pub name: String,
+    /// Sampling rate in Hz, or `None` to let the source block on hardware
+    pub rate_hz: Option<f64>,
+    /// Absolute-deadline sleep and spin tail used to hold `rate_hz`
+    pub pacer: FramePacerConfig,
+    /// Updates buffered between this sampler and the submission thread
+    pub queue_capacity: usize,
+    /// CPU placement and priority
+    pub thread: ThreadConfig,
+}
+
+impl Default for SamplerConfig {
+    fn default() -> Self {
+        Self {
+            name: "input-sampler".to_string(),
+            rate_hz: Some(1000.0),
+            pacer: FramePacerConfig::default(),
+            queue_capacity: 1024,
+            thread: ThreadConfig::default(),
+        }
+    }
+}
+
+/// Configuration for the submission thread
+#[derive(Debug, Clone)]
+pub struct SubmitterConfig {
+    /// How long the submission thread parks when all queues are empty
+    ///
+    /// Samplers wake it early whenever they queue an update.
+    pub idle_timeout: Duration,
+    /// CPU placement and priority
+    pub thread: ThreadConfig,
+}
+
+impl Default for SubmitterConfig {
+    fn default() -> Self {
+        Self {
+            idle_timeout: Duration::from_millis(5),
+            thread: ThreadConfig::default(),
+        }
+    }
+}
+
+#[derive(Default)]
+struct SamplerCounters {
+    passes: AtomicU64,
+    queued: AtomicU64,
+    overflows: AtomicU64,
+}
+
+#[derive(Default)]
+struct SubmitterCounters {
+    submitted: AtomicU64,
+    errors: AtomicU64,
+    max_queue_delay_ns: AtomicU64,
+}
+
+/// Counters for one sampler thread
+#[derive(Debug, Clone, Default)]
+pub struct SamplerStats {
+    /// Sampler thread name
+    pub name: String,
+    /// Calls to `InputSource::sample`
+    pub passes: u64,
+    /// Updates queued for submission
+    pub queued: u64,
+    /// Updates dropped because the queue was full
+    pub overflows: u64,
+}
+
+/// Counters for the whole service
+#[derive(Debug, Clone, Default)]
+pub struct InputSamplerStats {
+    /// Per-sampler counters
+    pub samplers: Vec<SamplerStats>,
+    /// Updates passed to the `DriverInput`
+    pub submitted: u64,
+    /// Updates the `DriverInput` rejected
+    pub errors: u64,
+    /// Longest time an update waited between sampling and submission
+    pub max_queue_delay: Duration,
+}
+
+/// Builder for an `InputSampler`
+pub struct InputSamplerBuilder<D: DriverInput> {
+    target: D,
+    submitter: SubmitterConfig,
+    sources: Vec<(SamplerConfig, Box<dyn InputSource>)>,
+}
+
+impl<D: DriverInput> InputSamplerBuilder<D> {
+    /// Configure the submission thread
+    pub fn submitter(mut self, config: SubmitterConfig) -> Self {
+        self.submitter = config;
+        self
+    }
+
+    /// Add a sampler thread for a device or shard of devices
+    pub fn source(mut self, config: SamplerConfig, source: impl InputSource) -> Self {
+        self.sources.push((config, Box::new(source)));
+        self
+    }
+
+    /// Spawn the submission and sampler threads
+    pub fn start(self) -> DriverResult<InputSampler> {
+        let stop = Arc::new(AtomicBool::new(false));
+        let submit_counters = Arc::new(SubmitterCounters::default());
+
+        let mut producers = Vec::with_capacity(self.sources.len());
+        let mut consumers = Vec::with_capacity(self.sources.len());
+        for (config, _) in &self.sources {
+            let (producer, consumer) = spsc::channel(config.queue_capacity);
+            producers.push(producer);
+            consumers.push(consumer);
+        }
+
+        let submitter = {
+            let stop = stop.clone();
+            let counters = submit_counters.clone();
+            let config = self.submitter.clone();
+            let mut target = self.target;
+            thread::Builder::new()
+                .name("input-submit".to_string())
+                .spawn(move || {
+                    config.thread.apply_to_current("input-submit");
+                    submit_loop(&mut target, &mut consumers, &stop, &counters, &config);
+                })
+                .map_err(|e| {
+                    DriverError::operation_failed(format!("Failed to spawn submitter: {}", e))
+                })?
+        };
+
+        let mut sampler = InputSampler {
+            stop,
+            threads: Vec::new(),
+            samplers: Vec::new(),
+            submit_counters,
+            submitter: Some(submitter),
+        };
+
+        for ((config, source), producer) in self.sources.into_iter().zip(producers) {
+            let pacer = FramePacer::new(config.pacer)?;
+            let counters = Arc::new(SamplerCounters::default());
+            let stop = sampler.stop.clone();
+            let submit_thread = sampler.submitter.as_ref().unwrap().thread().clone();
+            let thread_counters = counters.clone();
+            let thread_config = config.clone();
+
+            let handle = thread::Builder::new()
+                .name(config.name.clone())
+                .spawn(move || {
+                    thread_config.thread.apply_to_current(&thread_config.name);
+                    display::prepare_current_thread();
+                    sample_loop(
+                        source,
+                        producer,
+                        &thread_config,
+                        &pacer,
+                        &stop,
+                        &thread_counters,
+                        &submit_thread,
+                    );
+                });
+
+            match handle {
+                Ok(handle) => {
+                    sampler.threads.push(handle);
+                    sampler.samplers.push((config.name, counters));
+                }
+                Err(e) => {
+                    // Dropping the partially built sampler stops what was started
+                    return Err(DriverError::operation_failed(format!(
+                        "Failed to spawn sampler {}: {}",
+                        config.name, e
+                    )));
+                }
+            }
+        }
+
+        Ok(sampler)
+    }
+}
+
+/// Running input sampling service
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::input::{InputSampler, InputSource, SampleSink, SamplerConfig};
+/// # fn example(context: &openvr_driver::DriverContext, trigger: u64) {
+/// struct Controller {
+///     trigger: u64,
+/// }
+///
+/// impl InputSource for Controller {
+///     fn sample(&mut self, sink: &mut SampleSink<'_>) -> bool {
+///         let value = 0.0; // Read the hardware here
+///         sink.scalar(self.trigger, value, 0.0);
+///         true
+///     }
+/// }
+///
+/// let sampler = InputSampler::builder(context.driver_input().unwrap())
+///     .source(SamplerConfig::default(), Controller { trigger })
+///     .start()
+///     .unwrap();
+/// # }
+/// ```
+pub struct InputSampler {
+    stop: Arc<AtomicBool>,
+    threads: Vec<JoinHandle<()>>,
+    samplers: Vec<(String, Arc<SamplerCounters>)>,
+    submit_counters: Arc<SubmitterCounters>,
+    submitter: Option<JoinHandle<()>>,
+}
+
+impl InputSampler {
+    /// Start building a sampler service that submits into `target`
+    pub fn builder<D: DriverInput>(target: D) -> InputSamplerBuilder<D> {
+        InputSamplerBuilder {
+            target,
+            submitter: SubmitterConfig::default(),
+            sources: Vec::new(),
+        }
+    }
+
+    /// Snapshot the service counters
+    pub fn stats(&self) -> InputSamplerStats {
+        InputSamplerStats {
+            samplers: self
+                .samplers
+                .iter()
+                .map(|(name, counters)| SamplerStats {
+                    name: name.clone(),
+                    passes: counters.passes.load(Ordering::Relaxed),
+                    queued: counters.queued.load(Ordering::Relaxed),
+                    overflows: counters.overflows.load(Ordering::Relaxed),
+                })
+                .collect(),
+            submitted: self.submit_counters.submitted.load(Ordering::Relaxed),
+            errors: self.submit_counters.errors.load(Ordering::Relaxed),
+            max_queue_delay: Duration::from_nanos(
+                self.submit_counters
+                    .max_queue_delay_ns
+                    .load(Ordering::Relaxed),
+            ),
+        }
+    }
+
+    /// Stop all threads and wait for them to exit
+    ///
+    /// Updates still queued when the samplers stop are submitted first.
+    pub fn stop(mut self) {
+        self.shutdown();
+    }
+
+    fn shutdown(&mut self) {
+        self.stop.store(true, Ordering::Release);
+
+        for thread in self.threads.drain(..) {
+            let _ = thread.join();
+        }
+
+        if let Some(submitter) = self.submitter.take() {
+            submitter.thread().unpark();
+            let _ = submitter.join();
+        }
+    }
+}
+
+impl Drop for InputSampler {
+    fn drop(&mut self) {
+        self.shutdown();
+    }
+}
+
+fn sample_loop(
+    mut source: Box<dyn InputSource>,
+    mut producer: Producer<InputUpdate>,
+    config: &SamplerConfig,
+    pacer: &FramePacer,
+    stop: &AtomicBool,
+    counters: &SamplerCounters,
+    submitter: &Thread,
+) {
+    let period = config
+        .rate_hz
+        .filter(|rate| *rate > 0.0)
+        .map(|rate| Duration::from_secs_f64(1.0 / rate));
+    let mut next_deadline = Instant::now();
+
+    while !stop.load(Ordering::Acquire) {
+        let mut sink = SampleSink {
+            producer: &mut producer,
+            stats: counters,
+            submitter,
+            pushed: false,
+        };
+
+        let keep_running = source.sample(&mut sink);
+        sink.flush();
+        counters.passes.fetch_add(1, Ordering::Relaxed);
+
+        if !keep_running {
+            break;
+        }
+
+        if let Some(period) = period {
+            next_deadline += period;
+            let now = Instant::now();
+            if next_deadline > now {
+                // Deadlines stay on the period grid, so oversleeping one
+                // pass shortens the next instead of drifting
+                pacer.wait_until(next_deadline);
+            } else {
+                // Fell behind; resynchronise instead of bursting to catch up
+                next_deadline = now;
+            }
+        }
+    }
+}
+
+fn submit_loop<D: DriverInput>(
+    target: &mut D,
+    consumers: &mut [Consumer<InputUpdate>],
+    stop: &AtomicBool,
+    counters: &SubmitterCounters,
+    config: &SubmitterConfig,
+) {
+    loop {
+        // Read the flag before draining so updates queued before stop are not lost
+        let stopping = stop.load(Ordering::Acquire);
+        let mut drained = 0u64;
+
+        for consumer in consumers.iter_mut() {
+            while let Some(update) = consumer.pop() {
+                submit_update(target, update, counters);
+                drained += 1;
+            }
+        }
+
+        if stopping {
+            break;
+        }
+
+        if drained == 0 {
+            thread::park_timeout(config.idle_timeout);
+        }
+    }
+}
+
+fn submit_update<D: DriverInput>(
+    target: &mut D,
+    update: InputUpdate,
+    counters: &SubmitterCounters,
+) {
+    let (result, sampled_at) = match update {
+        InputUpdate::Boolean {
+            handle,
+            value,
+            time_offset,
+            sampled_at,
+        } => {
+            let delay = sampled_at.elapsed().as_secs_f64();
+            (
+                target.update_boolean_component(handle, value, time_offset - delay),
+                sampled_at,
+            )
+        }
+        InputUpdate::Scalar {
+            handle,
+            value,
+            time_offset,
+            sampled_at,
+        } => {
+            let delay = sampled_at.elapsed().as_secs_f64();
+            (
+                target.update_scalar_component(handle, value, time_offset - delay),
+                sampled_at,
+            )
+        }
+    };
+
+    counters
+        .max_queue_delay_ns
+        .fetch_max(sampled_at.elapsed().as_nanos() as u64, Ordering::Relaxed);
+
+    match result {
+        Ok(()) => counters.submitted.fetch_add(1, Ordering::Relaxed),
+        Err(_) => counters.errors.fetch_add(1, Ordering::Relaxed),
+    };
+}
@@ -1,64 +1,188 @@
 //! Camera Component interface
 //!
-//! This interface is implemented by devices that provide camera/passthrough functionality.
+//! This interface is implemented by devices that provide camera/passthrough
+//! functionality. vrserver allocates the frame buffers and polls the driver
+//! for frames; the generated vtable manages both through the component's
+//! `CameraStream`, so the driver only captures and answers calibration
+//! queries.
 
-use super::CameraConfiguration;
-use crate::DriverResult;
+use crate::camera::{image_data_size, CameraStream};
+use crate::sys::root::vr;
+use std::ffi::c_void;
+use std::sync::Arc;
 
 /// Camera component for devices with camera capabilities
 ///
-/// Implement this trait to provide camera/passthrough functionality for your device.
-/// This is typically used for AR passthrough or external camera tracking.
+/// The methods take `&self` and are called without a lock. Frame buffering,
+/// stream state and frame hand-off are handled by the vtable through
+/// `stream()`; the capture thread writes frames with
+/// `CameraStream::begin_frame`.
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::camera::CameraStream;
+/// use openvr_driver::interfaces::CameraComponent;
+/// use openvr_driver::sys::root::vr::ECameraVideoStreamFormat;
+///
+/// struct Passthrough {
+///     stream: CameraStream,
+/// }
+///
+/// impl CameraComponent for Passthrough {
+///     fn stream(&self) -> &CameraStream {
+///         &self.stream
+///     }
+///
+///     fn frame_dimensions(&self, format: ECameraVideoStreamFormat) -> Option<(u32, u32)> {
+///         match format {
+///             ECameraVideoStreamFormat::CVS_FORMAT_NV12 => Some((2560, 960)),
+///             _ => None,
+///         }
+///     }
+/// }
+/// ```
 pub trait CameraComponent: Send + Sync + 'static {
-    /// Get the number of cameras available
-    fn get_camera_count(&self) -> u32 {
-        0
-    }
+    /// Stream state shared with the capture thread
+    fn stream(&self) -> &CameraStream;
 
-    /// Get camera configuration
-    ///
-    /// # Arguments
-    /// * `camera_index` - Index of the camera (0-based)
+    /// Frame size for a stream format
     ///
     /// # Returns
-    /// * Camera configuration if the index is valid
-    fn get_camera_configuration(&self, camera_index: u32) -> Option<CameraConfiguration> {
-        None
-    }
+    /// * `Some((width, height))` if the camera can deliver `format`
+    /// * `None` if the format is not supported
+    fn frame_dimensions(&self, format: vr::ECameraVideoStreamFormat) -> Option<(u32, u32)>;
 
-    /// Start camera streaming
+    /// Bytes each runtime frame buffer must hold for a format
     ///
-    /// # Arguments
-    /// * `camera_index` - Index of the camera to start
-    fn start_streaming(&mut self, camera_index: u32) -> DriverResult<()> {
-        Ok(())
+    /// Override for variable-size formats such as MJPEG.
+    fn frame_buffer_size(&self, format: vr::ECameraVideoStreamFormat) -> Option<u32> {
+        let (width, height) = self.frame_dimensions(format)?;
+        image_data_size(format, width, height)
+    }
+
+    /// Number of frame buffers to ask the runtime for
+    fn frame_queue_size(&self) -> u32 {
+        3
     }
 
-    /// Stop camera streaming
+    /// Start the capture hardware
     ///
-    /// # Arguments
-    /// * `camera_index` - Index of the camera to stop
-    fn stop_streaming(&mut self, camera_index: u32) -> DriverResult<()> {
-        Ok(())
+    /// Called before the stream is marked active.
+    fn start_video_stream(&self) -> bool {
+        true
+    }
+
+    /// Stop the capture hardware
+    fn stop_video_stream(&self) {}
+
+    /// Pause capture without tearing the stream down
+    fn pause_video_stream(&self) -> bool {
+        true
+    }
+
+    /// Resume capture after `pause_video_stream`
+    fn resume_video_stream(&self) -> bool {
+        true
+    }
+
+    /// Enable or disable auto exposure
+    fn set_auto_exposure(&self, enable: bool) -> bool {
+        let _ = enable;
+        false
+    }
+
+    /// Change the ISP and sensor frame rates
+    fn set_frame_rate(&self, isp_frame_rate: i32, sensor_frame_rate: i32) -> bool {
+        let _ = (isp_frame_rate, sensor_frame_rate);
+        false
     }
 
-    /// Get the current camera frame
+    /// Map an undistorted UV coordinate to the distorted image
     ///
-    /// # Arguments
-    /// * `camera_index` - Index of the camera
-    /// * `buffer` - Buffer to write frame data into
+    /// Called once per point; `CameraRig::distortion` answers from a
+    /// precomputed map.
     ///
     /// # Returns
-    /// * Number of bytes written to the buffer
-    fn get_frame(&self, camera_index: u32, buffer: &mut [u8]) -> usize {
-        0
+    /// * `Some((u, v))` for the distorted coordinate
+    /// * `None` if the camera has no distortion model
+    fn camera_distortion(&self, camera_index: u32, u: f32, v: f32) -> Option<(f32, f32)> {
+        let _ = (camera_index, u, v);
+        None
+    }
+
+    /// Projection matrix for a camera and frame type
+    fn camera_projection(
+        &self,
+        camera_index: u32,
+        frame_type: vr::EVRTrackedCameraFrameType,
+        z_near: f32,
+        z_far: f32,
+    ) -> Option<vr::HmdMatrix44_t> {
+        let _ = (camera_index, frame_type, z_near, z_far);
+        None
     }
 
-    /// Check if a camera is currently streaming
+    /// Intrinsics and distortion model for a camera and frame type
+    fn camera_intrinsics(
+        &self,
+        camera_index: u32,
+        frame_type: vr::EVRTrackedCameraFrameType,
+    ) -> Option<CameraIntrinsics> {
+        let _ = (camera_index, frame_type);
+        None
+    }
+
+    /// Valid region of a frame type as `(left, top, width, height)`
     ///
-    /// # Arguments
-    /// * `camera_index` - Index of the camera
-    fn is_streaming(&self, camera_index: u32) -> bool {
+    /// The default reports the whole frame of the current format.
+    fn camera_frame_bounds(
+        &self,
+        frame_type: vr::EVRTrackedCameraFrameType,
+    ) -> Option<(u32, u32, u32, u32)> {
+        let _ = frame_type;
+        let (width, height) = self.stream().dimensions();
+        (width > 0 && height > 0).then_some((0, 0, width, height))
+    }
+
+    /// Current USB compatibility mode
+    fn camera_compatibility_mode(&self) -> Option<vr::ECameraCompatibilityMode> {
+        None
+    }
+
+    /// Switch USB compatibility mode
+    fn set_camera_compatibility_mode(&self, mode: vr::ECameraCompatibilityMode) -> bool {
+        let _ = mode;
         false
     }
 }
+
+/// Pinhole intrinsics and distortion model of one camera
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct CameraIntrinsics {
+    /// Focal length in pixels as `(fx, fy)`
+    pub focal_length: (f32, f32),
+    /// Principal point in pixels as `(cx, cy)`
+    pub center: (f32, f32),
+    /// Distortion function the coefficients belong to
+    pub distortion_type: vr::EVRDistortionFunctionType,
+    /// Distortion coefficients, unused entries zero
+    pub coefficients: [f64; vr::k_unMaxDistortionFunctionParameters as usize],
+}
+
+/// Extension trait exposing a camera implementation as a device component
+pub trait CameraComponentExt: CameraComponent + Sized {
+    /// Component name vrserver passes to `GetComponent`
+    fn camera_component_name() -> &'static str {
+        "IVRCameraComponent_003"
+    }
+
+    /// Create an `IVRCameraComponent` vtable for this component
+    ///
+    /// Return the pointer from `TrackedDeviceServerDriver::get_component`.
+    fn create_camera_vtable(self: Arc<Self>) -> *mut c_void {
+        crate::vtables::create_camera_vtable(self)
+    }
+}
+
+impl<T: CameraComponent> CameraComponentExt for T {}
@@ -0,0 +1,201 @@
+//! Driver Direct Mode Component interface
+//!
+//! Drivers that run their own display pipeline instead of letting the
+//! compositor own the output device implement this component. Applications
+//! render into swap texture sets the driver allocates, and the compositor
+//! submits layers from those textures every frame.
+
+use crate::display::SwapTextureSetPool;
+use crate::sys::root::vr;
+use crate::HmdMatrix34;
+use std::ffi::c_void;
+use std::sync::Arc;
+
+/// Direct mode component interface
+///
+/// The generated vtable tracks every set this component creates in a
+/// `SwapTextureSetPool` and rotates texture indices itself. Only creation
+/// and destruction reach the driver's allocator. The per-frame methods take
+/// `&self` and are called without a lock, on the compositor's thread.
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::interfaces::{DriverDirectModeComponent, SwapTextureSet, SwapTextureSetDesc};
+///
+/// struct DirectMode;
+///
+/// impl DriverDirectModeComponent for DirectMode {
+///     fn create_swap_texture_set(&self, pid: u32, desc: &SwapTextureSetDesc) -> Option<SwapTextureSet> {
+///         // Allocate three shareable textures of desc.width x desc.height
+///         None
+///     }
+///
+///     fn destroy_swap_texture_set(&self, set: &SwapTextureSet) {}
+///
+///     fn present(&self, sync_texture: u64) {}
+/// }
+/// ```
+pub trait DriverDirectModeComponent: Send + Sync + 'static {
+    /// Allocate textures for an application to render into
+    ///
+    /// # Arguments
+    /// * `pid` - Process the set is created for
+    /// * `desc` - Size, format and sample count of the textures
+    ///
+    /// # Returns
+    /// * `Some(set)` with three shared texture handles
+    /// * `None` if the textures could not be created
+    fn create_swap_texture_set(
+        &self,
+        pid: u32,
+        desc: &SwapTextureSetDesc,
+    ) -> Option<SwapTextureSet>;
+
+    /// Release the textures of a set returned by `create_swap_texture_set`
+    fn destroy_swap_texture_set(&self, set: &SwapTextureSet);
+
+    /// One layer of the current frame, with one texture per eye
+    ///
+    /// Called once per layer before `present`.
+    fn submit_layer(&self, per_eye: &[LayerEye; 2]) {
+        let _ = per_eye;
+    }
+
+    /// Display the layers submitted since the last present
+    ///
+    /// # Arguments
+    /// * `sync_texture` - Shared handle the compositor synchronizes on
+    fn present(&self, sync_texture: vr::SharedTextureHandle_t);
+
+    /// Called after `present` once the sync texture has been acquired
+    ///
+    /// # Arguments
+    /// * `throttling` - Per-application throttling, if the compositor sent any
+    fn post_present(&self, throttling: Option<Throttling>) {
+        let _ = throttling;
+    }
+
+    /// Fill in frame timing statistics
+    ///
+    /// `timing.reprojection_flags` arrives holding the compositor's
+    /// `VRCompositor_ReprojectionMotion_*` flags. These overlap the throttle
+    /// mask, so the default clears them, as the C++ default does.
+    fn get_frame_timing(&self, timing: &mut DirectModeFrameTiming) {
+        timing.reprojection_flags = 0;
+    }
+
+    /// Pool to track swap texture sets in
+    ///
+    /// Return a pool shared with the rest of the driver to look up which
+    /// set and texture index a submitted handle belongs to. When `None`, the
+    /// vtable creates a private pool with default capacity.
+    fn swap_texture_pool(&self) -> Option<&SwapTextureSetPool> {
+        None
+    }
+}
+
+/// Requested swap texture set properties
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct SwapTextureSetDesc {
+    /// Texture width in pixels
+    pub width: u32,
+    /// Texture height in pixels
+    pub height: u32,
+    /// Graphics API format (`DXGI_FORMAT` or `VkFormat`)
+    pub format: u32,
+    /// MSAA sample count
+    pub sample_count: u32,
+}
+
+/// Textures of a swap texture set
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct SwapTextureSet {
+    /// Shared handles of the three textures
+    pub handles: [vr::SharedTextureHandle_t; 3],
+    /// `VRSwapTextureFlag` bits
+    pub flags: u32,
+}
+
+/// One eye of a submitted layer
+#[derive(Debug, Clone, Copy)]
+pub struct LayerEye {
+    /// Color texture, from a swap texture set
+    pub texture: vr::SharedTextureHandle_t,
+    /// Depth texture, or 0 if not provided
+    pub depth_texture: vr::SharedTextureHandle_t,
+    /// Valid region as `(u_min, v_min, u_max, v_max)`
+    pub bounds: (f32, f32, f32, f32),
+    /// Projection used to render the depth buffer
+    pub projection: vr::HmdMatrix44_t,
+    /// HMD pose used to render the layer
+    pub hmd_pose: HmdMatrix34,
+    /// Seconds from now the pose was predicted to
+    pub pose_prediction_seconds: f32,
+}
+
+impl From<&vr::IVRDriverDirectModeComponent_SubmitLayerPerEye_t> for LayerEye {
+    fn from(eye: &vr::IVRDriverDirectModeComponent_SubmitLayerPerEye_t) -> Self {
+        Self {
+            texture: eye.hTexture,
+            depth_texture: eye.hDepthTexture,
+            bounds: (
+                eye.bounds.uMin,
+                eye.bounds.vMin,
+                eye.bounds.uMax,
+                eye.bounds.vMax,
+            ),
+            projection: eye.mProjection,
+            hmd_pose: eye.mHmdPose,
+            pose_prediction_seconds: eye.flHmdPosePredictionTimeInSecondsFromNow,
+        }
+    }
+}
+
+/// Per-application throttling passed to `post_present`
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct Throttling {
+    /// Frames to hold each application frame for
+    pub frames_to_throttle: u32,
+    /// Extra frames to extend pose prediction by
+    pub additional_frames_to_predict: u32,
+}
+
+impl From<&vr::IVRDriverDirectModeComponent_Throttling_t> for Throttling {
+    fn from(throttling: &vr::IVRDriverDirectModeComponent_Throttling_t) -> Self {
+        Self {
+            frames_to_throttle: throttling.nFramesToThrottle,
+            additional_frames_to_predict: throttling.nAdditionalFramesToPredict,
+        }
+    }
+}
+
+/// Frame statistics reported through `GetFrameTiming`
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct DirectModeFrameTiming {
+    /// Times the frame was presented
+    pub num_frame_presents: u32,
+    /// Times the frame was presented on a vsync other than predicted
+    pub num_mis_presented: u32,
+    /// Additional times the previous frame was scanned out
+    pub num_dropped_frames: u32,
+    /// Reprojection and throttling flags
+    pub reprojection_flags: u32,
+}
+
+/// Extension trait exposing a direct mode implementation as a device component
+pub trait DriverDirectModeExt: DriverDirectModeComponent + Sized {
+    /// Component name vrserver passes to `GetComponent`
+    fn direct_mode_component_name() -> &'static str {
+        "IVRDriverDirectModeComponent_009"
+    }
+
+    /// Create an `IVRDriverDirectModeComponent` vtable for this component
+    ///
+    /// Return the pointer from `TrackedDeviceServerDriver::get_component`.
+    fn create_direct_mode_vtable(self: Arc<Self>) -> *mut c_void {
+        crate::vtables::create_direct_mode_vtable(self)
+    }
+}
+
+impl<T: DriverDirectModeComponent> DriverDirectModeExt for T {}
@@ -4,6 +4,10 @@
 //! configuration and rendering parameters to OpenVR.
 
 use super::DisplayConfiguration;
+use crate::display::{
+    projection_to_raw, side_by_side_viewport, DistortionCacheConfig, RenderTargetSizing,
+    SharedDisplayGeometry,
+};
 use crate::DriverResult;
 
 /// Display component for HMD devices
@@ -123,6 +127,34 @@ pub trait DisplayComponent: Send + Sync + 'static {
         }
     }
 
+    /// Get the raw projection for an eye
+    ///
+    /// Served by `IVRDisplayComponent::GetProjectionRaw`. The default derives
+    /// the tangents from `get_projection`.
+    ///
+    /// # Arguments
+    /// * `eye` - Which eye to get the projection for
+    ///
+    /// # Returns
+    /// * `(left, right, top, bottom)` - Tangents of the half angles, +y down
+    fn get_projection_raw(&self, eye: Eye) -> (f32, f32, f32, f32) {
+        projection_to_raw(&self.get_projection(eye, 0.1, 1000.0))
+    }
+
+    /// Get the output viewport for an eye
+    ///
+    /// The default splits the window side by side: the left eye gets the left
+    /// half and the right eye the right half.
+    ///
+    /// # Arguments
+    /// * `eye` - Which eye to get the viewport for
+    ///
+    /// # Returns
+    /// * `(x, y, width, height)` - Viewport on the display
+    fn get_eye_output_viewport(&self, eye: Eye) -> (u32, u32, u32, u32) {
+        side_by_side_viewport(self.get_window_bounds(), eye)
+    }
+
     /// Get distortion coordinates for color channels
     ///
     /// This method computes the distorted coordinates for each color channel
@@ -140,6 +172,63 @@ pub trait DisplayComponent: Send + Sync + 'static {
         (u, v, u, v, u, v)
     }
 
+    /// Get distortion coordinates for a row of points
+    ///
+    /// Fills `out[i]` with the distortion at `(u[i], v)`. Used when
+    /// precomputing a distortion grid; override it to evaluate the row in one
+    /// batch, for example with `StereoLens::compute_distortion_row`.
+    ///
+    /// # Arguments
+    /// * `eye` - Which eye
+    /// * `u` - Horizontal coordinates of the row
+    /// * `v` - Vertical coordinate of the row
+    /// * `out` - Distorted red, green and blue coordinates per point
+    fn compute_distortion_row(&self, eye: Eye, u: &[f32], v: f32, out: &mut [[f32; 6]]) {
+        for (u, out) in u.iter().zip(out.iter_mut()) {
+            let (ru, rv, gu, gv, bu, bv) = self.compute_distortion(eye, *u, v);
+            *out = [ru, rv, gu, gv, bu, bv];
+        }
+    }
+
+    /// Opt into serving `compute_distortion` from a precomputed grid
+    ///
+    /// When this returns a configuration, the display vtable evaluates
+    /// `compute_distortion` once over the configured grid when the component
+    /// is created (loading it from `cache_dir` if a grid with the same lens
+    /// parameters was persisted before) and answers vrserver's queries by
+    /// interpolation. Only enable this if `compute_distortion` is a pure
+    /// function of its arguments.
+    ///
+    /// # Returns
+    /// * `None` to call `compute_distortion` directly (the default)
+    fn distortion_cache(&self) -> Option<DistortionCacheConfig> {
+        None
+    }
+
+    /// Opt into sizing the render target from the lens distortion
+    ///
+    /// When this returns a configuration, the recommended render target size
+    /// served to vrserver is computed from the derivative of
+    /// `compute_distortion` at the lens centers, giving one texel per panel
+    /// pixel there times the supersample factor, instead of calling
+    /// `get_recommended_render_target_size`. That method remains the fallback
+    /// if the distortion is degenerate.
+    ///
+    /// # Returns
+    /// * `None` to use `get_recommended_render_target_size` (the default)
+    fn render_target_sizing(&self) -> Option<RenderTargetSizing> {
+        None
+    }
+
+    /// Geometry cell to serve the display thunks from
+    ///
+    /// Return the same `SharedDisplayGeometry` that a `DisplayUpdater` was
+    /// created with to change IPD, projection or render target size at
+    /// runtime. When `None`, the geometry is fixed at activation.
+    fn shared_geometry(&self) -> Option<&SharedDisplayGeometry> {
+        None
+    }
+
     /// Check if the display is on the desktop
     ///
     /// Returns true if this is an extended mode display (appears as a monitor).
@@ -3,6 +3,7 @@
 //! This interface provides methods for creating and managing input components
 //! like buttons, triggers, joysticks, and haptics.
 
+use crate::sys::root::vr::{EVRScalarType, EVRScalarUnits};
 use crate::{DriverResult, InputComponentHandle, PropertyHandle};
 use std::ffi::c_void;
 
@@ -30,11 +31,14 @@ pub trait DriverInput: Send + Sync + 'static {
     /// # Arguments
     /// * `device_handle` - Handle to the device
     /// * `name` - Name of the input component (e.g., "/input/trigger/value")
-    /// * `handle` - Output handle for the created component
+    /// * `scalar_type` - Whether values are absolute or relative
+    /// * `units` - Whether values span 0..1 or -1..1
     fn create_scalar_component(
         &mut self,
         device_handle: PropertyHandle,
         name: &str,
+        scalar_type: EVRScalarType,
+        units: EVRScalarUnits,
     ) -> DriverResult<InputComponentHandle> {
         Ok(0)
     }
@@ -0,0 +1,117 @@
+//! IPC Resource Manager interface
+//!
+//! vrserver shares GPU resources between processes through
+//! `IVRIPCResourceManagerClient`. On Linux this is how a driver hands the
+//! compositor dmabufs without copying them, and how it receives file
+//! descriptors for resources the compositor owns.
+
+use crate::sys::root::vr::{EVRApplicationType, SharedTextureHandle_t};
+use crate::DriverResult;
+use std::os::fd::{BorrowedFd, OwnedFd};
+
+/// Dmabuf side of the IPC resource manager
+///
+/// `HostIpcResourceManager` forwards to vrserver and
+/// `LocalIpcResourceManager` stands in for it in-process. Most drivers use
+/// these through `DmabufExchange`, which caches the capability queries and
+/// releases handles automatically.
+pub trait IpcResourceManager: Send + Sync + 'static {
+    /// DRM formats the compositor can import as dmabufs
+    fn dmabuf_formats(&self) -> DriverResult<Vec<u32>>;
+
+    /// DRM format modifiers the compositor accepts for a format
+    ///
+    /// A single `DRM_FORMAT_MOD_INVALID` entry means only implicit
+    /// modifiers are supported.
+    fn dmabuf_modifiers(&self, app_type: EVRApplicationType, format: u32)
+        -> DriverResult<Vec<u64>>;
+
+    /// Import a dmabuf as a shared texture
+    ///
+    /// The plane descriptors are duplicated; the caller keeps its own.
+    ///
+    /// # Returns
+    /// * A shared handle holding one reference to the imported texture
+    fn import_dmabuf(
+        &self,
+        app_type: EVRApplicationType,
+        attributes: &DmabufAttributes<'_>,
+    ) -> DriverResult<SharedTextureHandle_t>;
+
+    /// Take another reference to a shared resource
+    ///
+    /// # Arguments
+    /// * `handle` - Resource to reference
+    /// * `ipc_handle` - Also create an IPC handle for `receive_shared_fd`
+    ///
+    /// # Returns
+    /// * The new IPC handle if one was requested
+    fn ref_resource(
+        &self,
+        handle: SharedTextureHandle_t,
+        ipc_handle: bool,
+    ) -> DriverResult<Option<u64>>;
+
+    /// Drop a reference taken by `import_dmabuf` or `ref_resource`
+    fn unref_resource(&self, handle: SharedTextureHandle_t) -> DriverResult<()>;
+
+    /// Consume an IPC handle and receive a file descriptor for its resource
+    fn receive_shared_fd(&self, ipc_handle: u64) -> DriverResult<OwnedFd>;
+}
+
+/// One plane of a dmabuf
+#[derive(Debug, Clone, Copy)]
+pub struct DmabufPlane<'a> {
+    /// Dmabuf holding the plane
+    pub fd: BorrowedFd<'a>,
+    /// Byte offset of the plane within the buffer
+    pub offset: u32,
+    /// Bytes per row
+    pub stride: u32,
+}
+
+/// Description of a dmabuf to import
+#[derive(Debug, Clone, Copy)]
+pub struct DmabufAttributes<'a> {
+    /// Width in pixels
+    pub width: u32,
+    /// Height in pixels
+    pub height: u32,
+    /// Depth for 3D images, otherwise 1
+    pub depth: u32,
+    /// Mip level count
+    pub mip_levels: u32,
+    /// Array layer count
+    pub array_layers: u32,
+    /// MSAA sample count
+    pub sample_count: u32,
+    /// DRM fourcc format
+    pub format: u32,
+    /// DRM format modifier
+    pub modifier: u64,
+    /// Planes, at most four
+    pub planes: &'a [DmabufPlane<'a>],
+}
+
+impl<'a> DmabufAttributes<'a> {
+    /// Attributes for a single-sampled 2D image without mips
+    pub fn new(
+        width: u32,
+        height: u32,
+        format: u32,
+        modifier: u64,
+        planes: &'a [DmabufPlane<'a>],
+    ) -> Self {
+        Self {
+            width,
+            height,
+            depth: 1,
+            mip_levels: 1,
+            array_layers: 1,
+            sample_count: 1,
+            format,
+            modifier,
+            planes,
+        }
+    }
+}
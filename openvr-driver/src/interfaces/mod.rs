@@ -6,20 +6,29 @@
 mod camera;
 mod controller;
 mod device;
+mod direct_mode;
 mod display;
 mod driver_input;
+#[cfg(target_os = "linux")]
+mod ipc_resources;
 mod provider;
 mod virtual_display;
 mod watchdog;
 
-pub use camera::CameraComponent;
+pub use camera::{CameraComponent, CameraComponentExt, CameraIntrinsics};
 pub use controller::ControllerComponent;
 pub use device::TrackedDeviceServerDriver;
+pub use direct_mode::{
+    DirectModeFrameTiming, DriverDirectModeComponent, DriverDirectModeExt, LayerEye,
+    SwapTextureSet, SwapTextureSetDesc, Throttling,
+};
 pub use display::DisplayComponent;
 pub use display::Eye;
 pub use driver_input::DriverInput;
+#[cfg(target_os = "linux")]
+pub use ipc_resources::{DmabufAttributes, DmabufPlane, IpcResourceManager};
 pub use provider::ServerTrackedDeviceProvider;
-pub use virtual_display::VirtualDisplay;
+pub use virtual_display::{PresentInfo, VirtualDisplay, VirtualDisplayExt, VsyncTiming};
 pub use watchdog::WatchdogProvider;
 
 use crate::sys::root::vr;
@@ -157,6 +166,8 @@ pub struct CameraConfiguration {
     pub frame_rate: f32,
     pub exposure_time: f32,
     pub gain: f32,
+    /// Intrinsics and distortion of each camera; see `CameraRig::from_configuration`
+    pub calibration: Vec<crate::camera::CameraCalibration>,
 }
 
 // Re-export types from sys that are commonly used
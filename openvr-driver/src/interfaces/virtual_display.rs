@@ -1,62 +1,106 @@
 //! Virtual Display interface
 //!
-//! This interface is implemented by virtual display drivers that don't
-//! correspond to physical hardware.
+//! This interface is implemented by drivers whose display is not driven by
+//! the compositor directly, such as wireless HMDs. vrserver hands every
+//! finished backbuffer to `Present` and paces itself on `WaitForPresent` and
+//! `GetTimeSinceLastVsync`, all from the compositor thread.
 
-use crate::DriverResult;
+use crate::sys::root::vr;
+use std::ffi::c_void;
+use std::sync::Arc;
 
-/// Virtual display interface for software-only displays
+/// Virtual display interface for displays fed by the driver
 ///
-/// Implement this trait to create a virtual display that doesn't correspond
-/// to physical hardware. This is useful for streaming, recording, or testing.
+/// The methods take `&self` and the generated vtable calls them without any
+/// locking, so they run concurrently with whatever the driver's own threads
+/// are doing. Implementations should hand frames to their encoder through
+/// atomics or a wait-free queue such as [`crate::spsc`] rather than a mutex
+/// the encoder may be holding.
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::{PresentInfo, VirtualDisplay, VsyncTiming};
+///
+/// struct WirelessDisplay;
+///
+/// impl VirtualDisplay for WirelessDisplay {
+///     fn present(&self, info: &PresentInfo) {
+///         // Queue info.backbuffer for the encoder
+///     }
+///
+///     fn get_time_since_last_vsync(&self) -> Option<VsyncTiming> {
+///         None
+///     }
+/// }
+/// ```
 pub trait VirtualDisplay: Send + Sync + 'static {
-    /// Present a frame to the virtual display
+    /// Submit a finished backbuffer for display
     ///
     /// # Arguments
-    /// * `sync_texture` - Handle to the texture to present
-    /// * `bounds` - The bounds of the texture to present
-    fn present(&mut self, sync_texture: *mut std::ffi::c_void, bounds: &VirtualDisplayBounds);
+    /// * `info` - The backbuffer and the vsync it was rendered for
+    fn present(&self, info: &PresentInfo);
 
-    /// Wait for the next frame to be presented
+    /// Block until the last presented buffer starts scanning out
     ///
-    /// This method should block until it's time to present the next frame,
-    /// based on the virtual display's refresh rate.
-    fn wait_for_present(&mut self) {
-        // Default implementation doesn't wait
-    }
+    /// The compositor calls this right after `present`. The default returns
+    /// immediately.
+    fn wait_for_present(&self) {}
 
-    /// Get the timing information for the virtual display
-    fn get_timing_info(&self) -> VirtualDisplayTiming {
-        VirtualDisplayTiming::default()
-    }
-}
-
-/// Bounds for virtual display presentation
-#[derive(Debug, Clone, Copy)]
-pub struct VirtualDisplayBounds {
-    pub x: i32,
-    pub y: i32,
-    pub width: u32,
-    pub height: u32,
+    /// Timing of the most recent virtual vsync
+    ///
+    /// # Returns
+    /// * `Some(timing)` once the display is producing vsyncs
+    /// * `None` if no vsync has happened yet
+    fn get_time_since_last_vsync(&self) -> Option<VsyncTiming>;
 }
 
-/// Timing information for virtual displays
-#[derive(Debug, Clone, Copy)]
-pub struct VirtualDisplayTiming {
-    /// Frame duration in seconds
-    pub frame_duration: f64,
-    /// Time until next vsync in seconds
-    pub time_since_last_vsync: f64,
-    /// Display frequency in Hz
-    pub display_frequency: f32,
+/// A frame submitted through `IVRVirtualDisplay::Present`
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct PresentInfo {
+    /// Shared handle of the backbuffer texture
+    pub backbuffer: vr::SharedTextureHandle_t,
+    /// Vsync mode the compositor is running in
+    pub vsync: vr::EVSync,
+    /// Compositor frame index
+    pub frame_id: u64,
+    /// Time of the vsync the frame targets, in seconds
+    pub vsync_time_seconds: f64,
 }
 
-impl Default for VirtualDisplayTiming {
-    fn default() -> Self {
+impl From<&vr::PresentInfo_t> for PresentInfo {
+    fn from(info: &vr::PresentInfo_t) -> Self {
         Self {
-            frame_duration: 1.0 / 90.0, // 90 Hz default
-            time_since_last_vsync: 0.0,
-            display_frequency: 90.0,
+            backbuffer: info.backbufferTextureHandle,
+            vsync: info.vsync,
+            frame_id: info.nFrameId,
+            vsync_time_seconds: info.flVSyncTimeInSeconds,
         }
     }
 }
+
+/// Answer to `IVRVirtualDisplay::GetTimeSinceLastVsync`
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct VsyncTiming {
+    /// Seconds elapsed since the last vsync
+    pub seconds_since_last_vsync: f32,
+    /// Number of vsyncs so far
+    pub frame_counter: u64,
+}
+
+/// Extension trait exposing a virtual display as a device component
+pub trait VirtualDisplayExt: VirtualDisplay + Sized {
+    /// Component name vrserver passes to `GetComponent`
+    fn virtual_display_component_name() -> &'static str {
+        "IVRVirtualDisplay_002"
+    }
+
+    /// Create an `IVRVirtualDisplay` vtable for this display
+    ///
+    /// Return the pointer from `TrackedDeviceServerDriver::get_component`.
+    fn create_virtual_display_vtable(self: Arc<Self>) -> *mut c_void {
+        crate::vtables::create_virtual_display_vtable(self)
+    }
+}
+
+impl<T: VirtualDisplay> VirtualDisplayExt for T {}
@@ -0,0 +1,436 @@
+//! Dmabuf import and export with cached capabilities
+//!
+//! `DmabufExchange` queries the compositor's dmabuf formats and modifiers
+//! once, when it is created, so per-frame imports are validated locally
+//! instead of with an IPC round trip. Shared handles and exported file
+//! descriptors are owned by guards that release them on drop.
+
+use crate::interfaces::{DmabufAttributes, IpcResourceManager};
+use crate::sys::root::vr::{EVRApplicationType, SharedTextureHandle_t};
+use crate::{DriverError, DriverResult};
+use std::os::fd::{AsFd, BorrowedFd, OwnedFd};
+use std::sync::Arc;
+
+/// Modifier meaning the layout is implied by the driver
+pub const DRM_FORMAT_MOD_INVALID: u64 = 0x00ff_ffff_ffff_ffff;
+
+/// Linear, untiled layout
+pub const DRM_FORMAT_MOD_LINEAR: u64 = 0;
+
+/// Most planes a dmabuf import can describe
+pub const MAX_DMABUF_PLANES: usize = 4;
+
+/// DRM fourcc code, e.g. `fourcc(b"XR24")` for `DRM_FORMAT_XRGB8888`
+pub const fn fourcc(code: &[u8; 4]) -> u32 {
+    u32::from_le_bytes(*code)
+}
+
+/// A format the compositor imports and the modifiers it accepts for it
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct DmabufFormat {
+    /// DRM fourcc code
+    pub fourcc: u32,
+    /// Accepted modifiers, sorted
+    pub modifiers: Box<[u64]>,
+}
+
+impl DmabufFormat {
+    /// Whether buffers with `modifier` can be imported
+    pub fn supports_modifier(&self, modifier: u64) -> bool {
+        self.modifiers.binary_search(&modifier).is_ok()
+    }
+
+    /// Whether only implicit modifiers are supported
+    pub fn implicit_only(&self) -> bool {
+        *self.modifiers == [DRM_FORMAT_MOD_INVALID]
+    }
+}
+
+/// Imports and exports dmabufs through an `IpcResourceManager`
+///
+/// # Example
+///
+/// ```no_run
+/// use openvr_driver::ipc::{fourcc, DmabufExchange, DRM_FORMAT_MOD_LINEAR};
+/// use openvr_driver::interfaces::{DmabufAttributes, DmabufPlane};
+/// use openvr_driver::sys::root::vr::EVRApplicationType;
+/// use std::os::fd::AsFd;
+/// # fn example(context: &openvr_driver::DriverContext, frame: std::fs::File) -> openvr_driver::DriverResult<()> {
+/// let manager = std::sync::Arc::new(context.ipc_resource_manager().unwrap());
+/// let exchange = DmabufExchange::new(manager, EVRApplicationType::VRApplication_Scene)?;
+///
+/// let planes = [DmabufPlane { fd: frame.as_fd(), offset: 0, stride: 1920 * 4 }];
+/// let attributes = DmabufAttributes::new(1920, 1080, fourcc(b"XR24"), DRM_FORMAT_MOD_LINEAR, &planes);
+/// let texture = exchange.import(&attributes)?;
+/// // Hand texture.handle() to the compositor; the reference drops with `texture`
+/// # Ok(())
+/// # }
+/// ```
+pub struct DmabufExchange<M: IpcResourceManager> {
+    manager: Arc<M>,
+    app_type: EVRApplicationType,
+    /// Sorted by fourcc
+    formats: Box<[DmabufFormat]>,
+}
+
+impl<M: IpcResourceManager> DmabufExchange<M> {
+    /// Query and cache the compositor's dmabuf capabilities
+    ///
+    /// # Arguments
+    /// * `manager` - Resource manager to import through
+    /// * `app_type` - Application type imports are made on behalf of
+    pub fn new(manager: Arc<M>, app_type: EVRApplicationType) -> DriverResult<Self> {
+        let formats = query_formats(&*manager, app_type)?;
+        Ok(Self {
+            manager,
+            app_type,
+            formats,
+        })
+    }
+
+    /// Query the capabilities again, e.g. after a GPU change
+    pub fn refresh(&mut self) -> DriverResult<()> {
+        self.formats = query_formats(&*self.manager, self.app_type)?;
+        Ok(())
+    }
+
+    /// Cached formats, sorted by fourcc
+    pub fn formats(&self) -> &[DmabufFormat] {
+        &self.formats
+    }
+
+    /// Cached entry for a format
+    pub fn format(&self, fourcc: u32) -> Option<&DmabufFormat> {
+        self.formats
+            .binary_search_by_key(&fourcc, |format| format.fourcc)
+            .ok()
+            .map(|index| &self.formats[index])
+    }
+
+    /// Whether a format and modifier combination can be imported
+    pub fn supports(&self, fourcc: u32, modifier: u64) -> bool {
+        self.format(fourcc)
+            .is_some_and(|format| format.supports_modifier(modifier))
+    }
+
+    /// The resource manager this exchange uses
+    pub fn manager(&self) -> &Arc<M> {
+        &self.manager
+    }
+
+    /// Import a dmabuf as a shared texture
+    ///
+    /// The attributes are checked against the cached capabilities first, so
+    /// unsupported buffers fail without a call into vrserver.
+    ///
+    /// # Returns
+    /// * `Ok(resource)` holding a reference to the imported texture
+    /// * `Err(DriverError)` if the buffer is invalid or the import failed
+    pub fn import(&self, attributes: &DmabufAttributes<'_>) -> DriverResult<SharedResource<M>> {
+        if attributes.planes.is_empty() || attributes.planes.len() > MAX_DMABUF_PLANES {
+            return Err(DriverError::invalid_parameter(format!(
+                "Dmabuf must have 1 to {} planes, got {}",
+                MAX_DMABUF_PLANES,
+                attributes.planes.len()
+            )));
+        }
+        if attributes.width == 0 || attributes.height == 0 {
+            return Err(DriverError::invalid_parameter("Dmabuf has zero size"));
+        }
+        if !self.supports(attributes.format, attributes.modifier) {
+            return Err(DriverError::invalid_parameter(format!(
+                "Dmabuf format {:#010x} with modifier {:#018x} is not supported",
+                attributes.format, attributes.modifier
+            )));
+        }
+
+        let handle = self.manager.import_dmabuf(self.app_type, attributes)?;
+        Ok(SharedResource {
+            manager: Arc::clone(&self.manager),
+            handle,
+        })
+    }
+
+    /// Take a reference to a resource created elsewhere
+    pub fn retain(&self, handle: SharedTextureHandle_t) -> DriverResult<SharedResource<M>> {
+        SharedResource::retain(Arc::clone(&self.manager), handle)
+    }
+}
+
+/// Query formats and the modifiers for each
+fn query_formats<M: IpcResourceManager + ?Sized>(
+    manager: &M,
+    app_type: EVRApplicationType,
+) -> DriverResult<Box<[DmabufFormat]>> {
+    let mut fourccs = manager.dmabuf_formats()?;
+    fourccs.sort_unstable();
+    fourccs.dedup();
+
+    fourccs
+        .into_iter()
+        .map(|fourcc| {
+            let mut modifiers = manager.dmabuf_modifiers(app_type, fourcc)?;
+            modifiers.sort_unstable();
+            modifiers.dedup();
+            Ok(DmabufFormat {
+                fourcc,
+                modifiers: modifiers.into_boxed_slice(),
+            })
+        })
+        .collect()
+}
+
+/// One reference to a shared resource, dropped with the guard
+pub struct SharedResource<M: IpcResourceManager> {
+    manager: Arc<M>,
+    handle: SharedTextureHandle_t,
+}
+
+impl<M: IpcResourceManager> SharedResource<M> {
+    /// Take a new reference to `handle`
+    pub fn retain(manager: Arc<M>, handle: SharedTextureHandle_t) -> DriverResult<Self> {
+        manager.ref_resource(handle, false)?;
+        Ok(Self { manager, handle })
+    }
+
+    /// Shared handle to pass to the compositor
+    pub fn handle(&self) -> SharedTextureHandle_t {
+        self.handle
+    }
+
+    /// Take another reference to the same resource
+    pub fn try_clone(&self) -> DriverResult<Self> {
+        Self::retain(Arc::clone(&self.manager), self.handle)
+    }
+
+    /// Export the resource as a file descriptor
+    ///
+    /// The returned guard holds its own reference, so the descriptor stays
+    /// backed by the resource even if this guard is dropped first.
+    pub fn export_fd(&self) -> DriverResult<SharedFd<M>> {
+        let ipc_handle = self
+            .manager
+            .ref_resource(self.handle, true)?
+            .ok_or_else(|| DriverError::operation_failed("RefResource returned no IPC handle"))?;
+        // Owns the reference just taken, so a failed receive releases it
+        let resource = Self {
+            manager: Arc::clone(&self.manager),
+            handle: self.handle,
+        };
+        let fd = self.manager.receive_shared_fd(ipc_handle)?;
+        Ok(SharedFd { resource, fd })
+    }
+
+    /// Give up the reference without releasing it
+    pub fn into_raw(self) -> SharedTextureHandle_t {
+        let handle = self.handle;
+        std::mem::forget(self);
+        handle
+    }
+}
+
+impl<M: IpcResourceManager> Drop for SharedResource<M> {
+    fn drop(&mut self) {
+        if let Err(e) = self.manager.unref_resource(self.handle) {
+            eprintln!(
+                "[IPC] Failed to release shared resource {:#x}: {}",
+                self.handle, e
+            );
+        }
+    }
+}
+
+/// A file descriptor for a shared resource, with a reference keeping it alive
+pub struct SharedFd<M: IpcResourceManager> {
+    resource: SharedResource<M>,
+    fd: OwnedFd,
+}
+
+impl<M: IpcResourceManager> SharedFd<M> {
+    /// The resource the descriptor refers to
+    pub fn resource(&self) -> &SharedResource<M> {
+        &self.resource
+    }
+
+    /// Split into the reference and the descriptor
+    pub fn into_parts(self) -> (SharedResource<M>, OwnedFd) {
+        (self.resource, self.fd)
+    }
+}
+
+impl<M: IpcResourceManager> AsFd for SharedFd<M> {
+    fn as_fd(&self) -> BorrowedFd<'_> {
+        self.fd.as_fd()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::interfaces::DmabufPlane;
+    use crate::ipc::LocalIpcResourceManager;
+    use std::fs::File;
+    use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+
+    const SCENE: EVRApplicationType = EVRApplicationType::VRApplication_Scene;
+
+    /// `LocalIpcResourceManager` that counts import calls and can refuse
+    /// to hand out descriptors
+    #[derive(Default)]
+    struct Probe {
+        local: LocalIpcResourceManager,
+        import_calls: AtomicU64,
+        fail_receive: AtomicBool,
+    }
+
+    impl IpcResourceManager for Probe {
+        fn dmabuf_formats(&self) -> DriverResult<Vec<u32>> {
+            self.local.dmabuf_formats()
+        }
+
+        fn dmabuf_modifiers(
+            &self,
+            app_type: EVRApplicationType,
+            format: u32,
+        ) -> DriverResult<Vec<u64>> {
+            self.local.dmabuf_modifiers(app_type, format)
+        }
+
+        fn import_dmabuf(
+            &self,
+            app_type: EVRApplicationType,
+            attributes: &DmabufAttributes<'_>,
+        ) -> DriverResult<SharedTextureHandle_t> {
+            self.import_calls.fetch_add(1, Ordering::Relaxed);
+            self.local.import_dmabuf(app_type, attributes)
+        }
+
+        fn ref_resource(
+            &self,
+            handle: SharedTextureHandle_t,
+            ipc_handle: bool,
+        ) -> DriverResult<Option<u64>> {
+            self.local.ref_resource(handle, ipc_handle)
+        }
+
+        fn unref_resource(&self, handle: SharedTextureHandle_t) -> DriverResult<()> {
+            self.local.unref_resource(handle)
+        }
+
+        fn receive_shared_fd(&self, ipc_handle: u64) -> DriverResult<OwnedFd> {
+            if self.fail_receive.load(Ordering::Relaxed) {
+                return Err(DriverError::operation_failed("descriptor refused"));
+            }
+            self.local.receive_shared_fd(ipc_handle)
+        }
+    }
+
+    fn buffer() -> File {
+        File::open("/dev/null").unwrap()
+    }
+
+    fn import<M: IpcResourceManager>(
+        exchange: &DmabufExchange<M>,
+        fd: &File,
+        format: u32,
+        modifier: u64,
+    ) -> DriverResult<SharedResource<M>> {
+        let planes = [DmabufPlane {
+            fd: fd.as_fd(),
+            offset: 0,
+            stride: 256 * 4,
+        }];
+        exchange.import(&DmabufAttributes::new(256, 256, format, modifier, &planes))
+    }
+
+    #[test]
+    fn queries_capabilities_once() {
+        let manager = Arc::new(LocalIpcResourceManager::new());
+        let exchange = DmabufExchange::new(manager.clone(), SCENE).unwrap();
+        let stats = manager.stats();
+        assert_eq!(stats.format_queries, 1);
+        assert_eq!(stats.modifier_queries, exchange.formats().len() as u64);
+
+        let fd = buffer();
+        let resources: Vec<_> = (0..8)
+            .map(|_| import(&exchange, &fd, fourcc(b"XR24"), DRM_FORMAT_MOD_LINEAR).unwrap())
+            .collect();
+        let after = manager.stats();
+        assert_eq!(after.format_queries, stats.format_queries);
+        assert_eq!(after.modifier_queries, stats.modifier_queries);
+        assert_eq!(after.imports, 8);
+        assert_eq!(after.live_resources, resources.len());
+    }
+
+    #[test]
+    fn rejects_unsupported_layouts_locally() {
+        let manager = Arc::new(Probe::default());
+        let exchange = DmabufExchange::new(manager.clone(), SCENE).unwrap();
+        let fd = buffer();
+
+        assert!(import(&exchange, &fd, fourcc(b"YUYV"), DRM_FORMAT_MOD_INVALID).is_err());
+        assert!(import(&exchange, &fd, fourcc(b"NV12"), DRM_FORMAT_MOD_LINEAR).is_err());
+        assert!(import(&exchange, &fd, fourcc(b"XR24"), 0x0100_0000_0000_0001).is_err());
+        assert!(exchange
+            .import(&DmabufAttributes::new(
+                256,
+                256,
+                fourcc(b"XR24"),
+                DRM_FORMAT_MOD_LINEAR,
+                &[]
+            ))
+            .is_err());
+        assert_eq!(manager.import_calls.load(Ordering::Relaxed), 0);
+
+        let _resource = import(&exchange, &fd, fourcc(b"NV12"), DRM_FORMAT_MOD_INVALID).unwrap();
+        assert_eq!(manager.import_calls.load(Ordering::Relaxed), 1);
+    }
+
+    #[test]
+    fn shared_resources_track_references() {
+        let manager = Arc::new(LocalIpcResourceManager::new());
+        let exchange = DmabufExchange::new(manager.clone(), SCENE).unwrap();
+        let fd = buffer();
+
+        let resource = import(&exchange, &fd, fourcc(b"AR24"), DRM_FORMAT_MOD_LINEAR).unwrap();
+        let handle = resource.handle();
+        assert_eq!(manager.ref_count(handle), Some(1));
+
+        let clone = resource.try_clone().unwrap();
+        assert_eq!(clone.handle(), handle);
+        assert_eq!(manager.ref_count(handle), Some(2));
+
+        let retained = exchange.retain(handle).unwrap();
+        assert_eq!(manager.ref_count(handle), Some(3));
+
+        drop(clone);
+        assert_eq!(manager.ref_count(handle), Some(2));
+        drop(retained);
+        assert_eq!(manager.ref_count(handle), Some(1));
+        drop(resource);
+        assert_eq!(manager.ref_count(handle), None);
+        assert_eq!(manager.stats().live_resources, 0);
+    }
+
+    #[test]
+    fn export_fd_holds_one_reference() {
+        let manager = Arc::new(Probe::default());
+        let exchange = DmabufExchange::new(manager.clone(), SCENE).unwrap();
+        let fd = buffer();
+        let resource = import(&exchange, &fd, fourcc(b"AB24"), DRM_FORMAT_MOD_INVALID).unwrap();
+        let handle = resource.handle();
+
+        let shared = resource.export_fd().unwrap();
+        assert_eq!(manager.local.ref_count(handle), Some(2));
+        assert_eq!(manager.local.stats().fds_sent, 1);
+        drop(shared);
+        assert_eq!(manager.local.ref_count(handle), Some(1));
+
+        manager.fail_receive.store(true, Ordering::Relaxed);
+        assert!(resource.export_fd().is_err());
+        assert_eq!(manager.local.ref_count(handle), Some(1));
+
+        drop(resource);
+        assert_eq!(manager.local.ref_count(handle), None);
+    }
+}
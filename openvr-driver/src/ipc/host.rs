@@ -0,0 +1,358 @@
+//! `IpcResourceManager` implementations
+//!
+//! `HostIpcResourceManager` forwards to the runtime's
+//! `IVRIPCResourceManagerClient`, while `LocalIpcResourceManager` is an
+//! in-process stand-in that keeps its own reference counts and descriptors.
+
+use super::dmabuf::{fourcc, DRM_FORMAT_MOD_INVALID, DRM_FORMAT_MOD_LINEAR};
+use crate::interfaces::{DmabufAttributes, IpcResourceManager};
+use crate::{sys, DriverError, DriverResult};
+use std::collections::HashMap;
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd};
+use std::sync::Mutex;
+
+use sys::root::vr::{
+    DmabufAttributes_t, DmabufPlane_t, EVRApplicationType, IVRIPCResourceManagerClient,
+    SharedTextureHandle_t,
+};
+
+/// `IpcResourceManager` backed by the runtime's `IVRIPCResourceManagerClient`
+///
+/// Obtain one through `DriverContext::ipc_resource_manager`.
+#[derive(Clone)]
+pub struct HostIpcResourceManager {
+    client: *mut IVRIPCResourceManagerClient,
+}
+
+unsafe impl Send for HostIpcResourceManager {}
+unsafe impl Sync for HostIpcResourceManager {}
+
+impl HostIpcResourceManager {
+    /// Create a resource manager wrapper from a raw pointer
+    ///
+    /// # Safety
+    /// The provided pointer must be a valid IVRIPCResourceManagerClient
+    /// pointer that remains valid for the lifetime of this wrapper.
+    pub unsafe fn from_raw(client: *mut IVRIPCResourceManagerClient) -> Self {
+        Self { client }
+    }
+
+    /// Get the raw resource manager pointer
+    ///
+    /// # Safety
+    /// The returned pointer should not be stored beyond the lifetime
+    /// of this HostIpcResourceManager.
+    pub unsafe fn raw_client(&self) -> *mut IVRIPCResourceManagerClient {
+        self.client
+    }
+
+    #[inline]
+    fn vtable(&self) -> &sys::root::vr::IVRIPCResourceManagerClient__bindgen_vtable {
+        unsafe { &*(*self.client).vtable_ }
+    }
+}
+
+/// Convert a failed call to an error
+fn check_call(succeeded: bool, operation: &str) -> DriverResult<()> {
+    if succeeded {
+        Ok(())
+    } else {
+        Err(DriverError::operation_failed(format!(
+            "{} failed",
+            operation
+        )))
+    }
+}
+
+/// Run a Vulkan-style count-then-fill query
+fn enumerate<T: Copy + Default>(
+    operation: &str,
+    mut query: impl FnMut(*mut u32, *mut T) -> bool,
+) -> DriverResult<Vec<T>> {
+    let mut count = 0u32;
+    check_call(query(&mut count, std::ptr::null_mut()), operation)?;
+
+    let mut values = vec![T::default(); count as usize];
+    if count > 0 {
+        check_call(query(&mut count, values.as_mut_ptr()), operation)?;
+        values.truncate(count as usize);
+    }
+    Ok(values)
+}
+
+impl IpcResourceManager for HostIpcResourceManager {
+    fn dmabuf_formats(&self) -> DriverResult<Vec<u32>> {
+        let get_formats = self.vtable().IVRIPCResourceManagerClient_GetDmabufFormats;
+        enumerate("GetDmabufFormats", |count, formats| unsafe {
+            get_formats(self.client, count, formats)
+        })
+    }
+
+    fn dmabuf_modifiers(
+        &self,
+        app_type: EVRApplicationType,
+        format: u32,
+    ) -> DriverResult<Vec<u64>> {
+        let get_modifiers = self.vtable().IVRIPCResourceManagerClient_GetDmabufModifiers;
+        enumerate("GetDmabufModifiers", |count, modifiers| unsafe {
+            get_modifiers(self.client, app_type, format, count, modifiers)
+        })
+    }
+
+    fn import_dmabuf(
+        &self,
+        app_type: EVRApplicationType,
+        attributes: &DmabufAttributes<'_>,
+    ) -> DriverResult<SharedTextureHandle_t> {
+        let mut raw: DmabufAttributes_t = unsafe { std::mem::zeroed() };
+        raw.pNext = std::ptr::null_mut();
+        raw.unWidth = attributes.width;
+        raw.unHeight = attributes.height;
+        raw.unDepth = attributes.depth;
+        raw.unMipLevels = attributes.mip_levels;
+        raw.unArrayLayers = attributes.array_layers;
+        raw.unSampleCount = attributes.sample_count;
+        raw.unFormat = attributes.format;
+        raw.ulModifier = attributes.modifier;
+        raw.unPlaneCount = attributes.planes.len().min(raw.plane.len()) as u32;
+        for (raw_plane, plane) in raw.plane.iter_mut().zip(attributes.planes) {
+            *raw_plane = DmabufPlane_t {
+                unOffset: plane.offset,
+                unStride: plane.stride,
+                nFd: plane.fd.as_raw_fd(),
+            };
+        }
+
+        let mut handle: SharedTextureHandle_t = 0;
+        unsafe {
+            let import = self.vtable().IVRIPCResourceManagerClient_ImportDmabuf;
+            check_call(
+                import(self.client, app_type, &mut raw, &mut handle),
+                "ImportDmabuf",
+            )?;
+        }
+        Ok(handle)
+    }
+
+    fn ref_resource(
+        &self,
+        handle: SharedTextureHandle_t,
+        ipc_handle: bool,
+    ) -> DriverResult<Option<u64>> {
+        let mut new_ipc_handle = 0u64;
+        let out = if ipc_handle {
+            &mut new_ipc_handle as *mut u64
+        } else {
+            std::ptr::null_mut()
+        };
+
+        unsafe {
+            let ref_resource = self.vtable().IVRIPCResourceManagerClient_RefResource;
+            check_call(ref_resource(self.client, handle, out), "RefResource")?;
+        }
+        Ok(ipc_handle.then_some(new_ipc_handle))
+    }
+
+    fn unref_resource(&self, handle: SharedTextureHandle_t) -> DriverResult<()> {
+        unsafe {
+            let unref = self.vtable().IVRIPCResourceManagerClient_UnrefResource;
+            check_call(unref(self.client, handle), "UnrefResource")
+        }
+    }
+
+    fn receive_shared_fd(&self, ipc_handle: u64) -> DriverResult<OwnedFd> {
+        let mut fd: std::os::raw::c_int = -1;
+        unsafe {
+            let receive = self.vtable().IVRIPCResourceManagerClient_ReceiveSharedFd;
+            check_call(receive(self.client, ipc_handle, &mut fd), "ReceiveSharedFd")?;
+        }
+        if fd < 0 {
+            return Err(DriverError::operation_failed(
+                "ReceiveSharedFd returned an invalid descriptor",
+            ));
+        }
+        // The runtime transfers ownership of the descriptor to us
+        Ok(unsafe { OwnedFd::from_raw_fd(fd) })
+    }
+}
+
+/// Counters kept by `LocalIpcResourceManager`
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct LocalIpcStats {
+    /// Calls to `dmabuf_formats`
+    pub format_queries: u64,
+    /// Calls to `dmabuf_modifiers`
+    pub modifier_queries: u64,
+    /// Successful imports
+    pub imports: u64,
+    /// Descriptors handed out by `receive_shared_fd`
+    pub fds_sent: u64,
+    /// Resources with at least one reference
+    pub live_resources: usize,
+}
+
+struct LocalResource {
+    refs: u32,
+    fd: OwnedFd,
+}
+
+#[derive(Default)]
+struct LocalState {
+    next_handle: u64,
+    next_ipc_handle: u64,
+    resources: HashMap<SharedTextureHandle_t, LocalResource>,
+    /// IPC handles not yet consumed, by resource
+    pending: HashMap<u64, SharedTextureHandle_t>,
+    stats: LocalIpcStats,
+}
+
+/// In-process stand-in for `IVRIPCResourceManagerClient`
+///
+/// Imports keep a duplicate of the first plane's descriptor, reference
+/// counts are tracked per handle, and `receive_shared_fd` returns another
+/// duplicate. This exercises `DmabufExchange` and its guards without
+/// vrserver or a GPU.
+pub struct LocalIpcResourceManager {
+    formats: Vec<(u32, Vec<u64>)>,
+    state: Mutex<LocalState>,
+}
+
+impl LocalIpcResourceManager {
+    /// Create a stand-in advertising common RGB and NV12 formats
+    pub fn new() -> Self {
+        let modifiers = vec![DRM_FORMAT_MOD_LINEAR, DRM_FORMAT_MOD_INVALID];
+        Self::with_formats(vec![
+            (fourcc(b"XR24"), modifiers.clone()),
+            (fourcc(b"AR24"), modifiers.clone()),
+            (fourcc(b"AB24"), modifiers.clone()),
+            (fourcc(b"NV12"), vec![DRM_FORMAT_MOD_INVALID]),
+        ])
+    }
+
+    /// Create a stand-in advertising the given formats and modifiers
+    pub fn with_formats(formats: Vec<(u32, Vec<u64>)>) -> Self {
+        Self {
+            formats,
+            state: Mutex::new(LocalState::default()),
+        }
+    }
+
+    /// Current counters
+    pub fn stats(&self) -> LocalIpcStats {
+        let state = self.state.lock().unwrap();
+        LocalIpcStats {
+            live_resources: state.resources.len(),
+            ..state.stats
+        }
+    }
+
+    /// Reference count of a resource, or `None` once it is released
+    pub fn ref_count(&self, handle: SharedTextureHandle_t) -> Option<u32> {
+        let state = self.state.lock().unwrap();
+        state.resources.get(&handle).map(|resource| resource.refs)
+    }
+}
+
+impl Default for LocalIpcResourceManager {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl IpcResourceManager for LocalIpcResourceManager {
+    fn dmabuf_formats(&self) -> DriverResult<Vec<u32>> {
+        self.state.lock().unwrap().stats.format_queries += 1;
+        Ok(self.formats.iter().map(|(format, _)| *format).collect())
+    }
+
+    fn dmabuf_modifiers(
+        &self,
+        _app_type: EVRApplicationType,
+        format: u32,
+    ) -> DriverResult<Vec<u64>> {
+        self.state.lock().unwrap().stats.modifier_queries += 1;
+        self.formats
+            .iter()
+            .find(|(candidate, _)| *candidate == format)
+            .map(|(_, modifiers)| modifiers.clone())
+            .ok_or_else(|| DriverError::operation_failed("GetDmabufModifiers failed"))
+    }
+
+    fn import_dmabuf(
+        &self,
+        _app_type: EVRApplicationType,
+        attributes: &DmabufAttributes<'_>,
+    ) -> DriverResult<SharedTextureHandle_t> {
+        let supported = self.formats.iter().any(|(format, modifiers)| {
+            *format == attributes.format && modifiers.contains(&attributes.modifier)
+        });
+        let plane = attributes.planes.first().filter(|_| supported);
+        let Some(plane) = plane else {
+            return Err(DriverError::operation_failed("ImportDmabuf failed"));
+        };
+        // Like vrserver, keep a duplicate and leave the caller's descriptor alone
+        let fd = plane
+            .fd
+            .try_clone_to_owned()
+            .map_err(|e| DriverError::operation_failed(format!("ImportDmabuf failed: {}", e)))?;
+
+        let mut state = self.state.lock().unwrap();
+        state.next_handle += 1;
+        let handle = state.next_handle;
+        state
+            .resources
+            .insert(handle, LocalResource { refs: 1, fd });
+        state.stats.imports += 1;
+        Ok(handle)
+    }
+
+    fn ref_resource(
+        &self,
+        handle: SharedTextureHandle_t,
+        ipc_handle: bool,
+    ) -> DriverResult<Option<u64>> {
+        let mut state = self.state.lock().unwrap();
+        let resource = state
+            .resources
+            .get_mut(&handle)
+            .ok_or_else(|| DriverError::operation_failed("RefResource failed"))?;
+        resource.refs += 1;
+
+        if !ipc_handle {
+            return Ok(None);
+        }
+        state.next_ipc_handle += 1;
+        let ipc = state.next_ipc_handle;
+        state.pending.insert(ipc, handle);
+        Ok(Some(ipc))
+    }
+
+    fn unref_resource(&self, handle: SharedTextureHandle_t) -> DriverResult<()> {
+        let mut state = self.state.lock().unwrap();
+        let resource = state
+            .resources
+            .get_mut(&handle)
+            .ok_or_else(|| DriverError::operation_failed("UnrefResource failed"))?;
+        resource.refs -= 1;
+        if resource.refs == 0 {
+            state.resources.remove(&handle);
+            state.pending.retain(|_, pending| *pending != handle);
+        }
+        Ok(())
+    }
+
+    fn receive_shared_fd(&self, ipc_handle: u64) -> DriverResult<OwnedFd> {
+        let mut state = self.state.lock().unwrap();
+        let resource = state
+            .pending
+            .remove(&ipc_handle)
+            .and_then(|handle| state.resources.get(&handle))
+            .ok_or_else(|| DriverError::operation_failed("ReceiveSharedFd failed"))?;
+        let fd = resource
+            .fd
+            .try_clone()
+            .map_err(|e| DriverError::operation_failed(format!("ReceiveSharedFd failed: {}", e)))?;
+        state.stats.fds_sent += 1;
+        Ok(fd)
+    }
+}
@@ -0,0 +1,15 @@
+//! Zero-copy resource sharing with the compositor
+//!
+//! This module provides an `IpcResourceManager` backed by the runtime's
+//! `IVRIPCResourceManagerClient`, a local stand-in for running without
+//! vrserver, and `DmabufExchange`, which imports and exports dmabufs with
+//! cached capabilities and reference-counted handles.
+
+mod dmabuf;
+mod host;
+
+pub use dmabuf::{
+    fourcc, DmabufExchange, DmabufFormat, SharedFd, SharedResource, DRM_FORMAT_MOD_INVALID,
+    DRM_FORMAT_MOD_LINEAR, MAX_DMABUF_PLANES,
+};
+pub use host::{HostIpcResourceManager, LocalIpcResourceManager, LocalIpcStats};
@@ -46,24 +46,38 @@ pub use openvr_driver_bindings as sys;
 pub use driver_macros as macros;
 
 // Core modules
+pub mod camera;
 pub mod context;
+pub mod display;
 mod entry;
 pub mod error;
+pub mod events;
+pub mod input;
 pub mod interfaces;
+#[cfg(target_os = "linux")]
+pub mod ipc;
 pub mod properties;
+pub mod snapshot;
+pub mod spsc;
+pub mod threading;
 mod vtables;
 
 // Public API exports
 pub use context::{DriverContext, DriverHost};
 pub use entry::create_entry_point;
 pub use error::{DriverError, DriverResult};
-pub use properties::{Property, PropertyContainer, PropertyValue, PropertyWrite};
+pub use events::{Event, EventData, EventPump, EventPumpConfig, EventPumpStats};
+pub use properties::{
+    BinaryPropertyWrite, MappedFile, Property, PropertyContainer, PropertyTypeTag, PropertyValue,
+    PropertyWrite,
+};
 
 // Interface traits that users implement
 pub use interfaces::{
-    CameraComponent, Component, ComponentResult, ControllerComponent, DisplayComponent,
-    DriverInput, Eye, ServerTrackedDeviceProvider, TrackedDeviceServerDriver, VirtualDisplay,
-    WatchdogProvider,
+    CameraComponent, CameraComponentExt, Component, ComponentResult, ControllerComponent,
+    DisplayComponent, DriverDirectModeComponent, DriverDirectModeExt, DriverInput, Eye,
+    PresentInfo, ServerTrackedDeviceProvider, TrackedDeviceServerDriver, VirtualDisplay,
+    VirtualDisplayExt, VsyncTiming, WatchdogProvider,
 };
 
 // Configuration types
@@ -0,0 +1,128 @@
+//! Read-only file mappings for large binary properties
+//!
+//! `MappedFile` exposes a file's contents as a byte slice without reading it
+//! into a heap buffer, so multi-megabyte property payloads such as mura
+//! correction images can be handed to `WritePropertyBatch` straight from the
+//! page cache. On platforms without the mapping path the file is read into
+//! memory instead.
+
+use crate::{DriverError, DriverResult};
+use std::path::Path;
+
+/// A file's contents, mapped read-only where supported
+pub struct MappedFile {
+    #[cfg(target_os = "linux")]
+    ptr: *mut libc::c_void,
+    #[cfg(target_os = "linux")]
+    len: usize,
+    #[cfg(not(target_os = "linux"))]
+    data: Vec<u8>,
+}
+
+// The mapping is read-only and owned by this value
+unsafe impl Send for MappedFile {}
+unsafe impl Sync for MappedFile {}
+
+impl MappedFile {
+    /// Map `path` for reading
+    #[cfg(target_os = "linux")]
+    pub fn open(path: impl AsRef<Path>) -> DriverResult<Self> {
+        use std::os::fd::AsRawFd;
+
+        let path = path.as_ref();
+        let file = std::fs::File::open(path).map_err(|e| {
+            DriverError::operation_failed(format!("Failed to open {}: {}", path.display(), e))
+        })?;
+        let len = file
+            .metadata()
+            .map_err(|e| {
+                DriverError::operation_failed(format!("Failed to stat {}: {}", path.display(), e))
+            })?
+            .len() as usize;
+
+        if len == 0 {
+            return Ok(Self {
+                ptr: std::ptr::null_mut(),
+                len: 0,
+            });
+        }
+
+        // The mapping stays valid after the descriptor is closed
+        let ptr = unsafe {
+            libc::mmap(
+                std::ptr::null_mut(),
+                len,
+                libc::PROT_READ,
+                libc::MAP_PRIVATE,
+                file.as_raw_fd(),
+                0,
+            )
+        };
+        if ptr == libc::MAP_FAILED {
+            return Err(DriverError::operation_failed(format!(
+                "Failed to map {}: {}",
+                path.display(),
+                std::io::Error::last_os_error()
+            )));
+        }
+
+        // The runtime copies the whole buffer once, front to back
+        unsafe {
+            libc::madvise(ptr, len, libc::MADV_SEQUENTIAL);
+            libc::madvise(ptr, len, libc::MADV_WILLNEED);
+        }
+
+        Ok(Self { ptr, len })
+    }
+
+    /// Read `path` into memory
+    #[cfg(not(target_os = "linux"))]
+    pub fn open(path: impl AsRef<Path>) -> DriverResult<Self> {
+        let path = path.as_ref();
+        let data = std::fs::read(path).map_err(|e| {
+            DriverError::operation_failed(format!("Failed to read {}: {}", path.display(), e))
+        })?;
+        Ok(Self { data })
+    }
+
+    /// File contents
+    #[cfg(target_os = "linux")]
+    pub fn as_bytes(&self) -> &[u8] {
+        if self.len == 0 {
+            &[]
+        } else {
+            unsafe { std::slice::from_raw_parts(self.ptr as *const u8, self.len) }
+        }
+    }
+
+    /// File contents
+    #[cfg(not(target_os = "linux"))]
+    pub fn as_bytes(&self) -> &[u8] {
+        &self.data
+    }
+}
+
+impl std::ops::Deref for MappedFile {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        self.as_bytes()
+    }
+}
+
+impl AsRef<[u8]> for MappedFile {
+    fn as_ref(&self) -> &[u8] {
+        self.as_bytes()
+    }
+}
+
+#[cfg(target_os = "linux")]
+impl Drop for MappedFile {
+    fn drop(&mut self) {
+        if self.len != 0 {
+            unsafe {
+                libc::munmap(self.ptr, self.len);
+            }
+        }
+    }
+}
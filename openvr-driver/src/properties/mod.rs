@@ -9,6 +9,10 @@ use std::mem;
 use std::os::raw::{c_char, c_void};
 use std::ptr;
 
+mod mapped;
+
+pub use mapped::MappedFile;
+
 /// Property container handle (usually a device index)
 pub type PropertyContainer = sys::root::vr::PropertyContainerHandle_t;
 
@@ -159,6 +163,53 @@ pub fn get_property_container(device_index: u32) -> PropertyContainer {
     }
 }
 
+/// Property type tag (`k_un*PropertyTag`)
+pub type PropertyTypeTag = sys::root::vr::PropertyTypeTag_t;
+
+/// `PropertyWrite_t` with the property as a plain integer
+///
+/// Some property ranges, such as `Prop_DisplayHiddenArea_Binary_Start..End`,
+/// are addressed by offset and have no enum variant for most of their
+/// members, so they cannot be stored in `PropertyWrite_t::prop`.
+#[repr(C)]
+struct RawPropertyWrite {
+    prop: u32,
+    write_type: sys::root::vr::EPropertyWriteType,
+    set_error: sys::root::vr::ETrackedPropertyError,
+    buffer: *mut c_void,
+    buffer_size: u32,
+    tag: PropertyTypeTag,
+    error: sys::root::vr::ETrackedPropertyError,
+}
+
+const _: () = assert!(
+    mem::size_of::<RawPropertyWrite>() == mem::size_of::<sys::root::vr::PropertyWrite_t>()
+        && mem::align_of::<RawPropertyWrite>() == mem::align_of::<sys::root::vr::PropertyWrite_t>()
+);
+
+/// A binary property write borrowing its payload
+#[derive(Debug, Clone, Copy)]
+pub struct BinaryPropertyWrite<'a> {
+    /// Numeric property id
+    pub prop: u32,
+    /// Type tag describing the payload
+    pub tag: PropertyTypeTag,
+    /// Payload, passed to the runtime in place
+    pub data: &'a [u8],
+}
+
+impl<'a> BinaryPropertyWrite<'a> {
+    /// Write `data` to `prop`
+    pub fn new(prop: PropertyId, tag: PropertyTypeTag, data: &'a [u8]) -> Self {
+        Self::raw(prop as u32, tag, data)
+    }
+
+    /// Write `data` to a property given by its numeric id
+    pub fn raw(prop: u32, tag: PropertyTypeTag, data: &'a [u8]) -> Self {
+        Self { prop, tag, data }
+    }
+}
+
 /// Helper functions for setting device properties
 pub struct Properties;
 
@@ -338,6 +389,102 @@ impl Properties {
         )
     }
 
+    /// Set a binary property from a borrowed buffer
+    ///
+    /// The buffer is handed to the runtime as is, without copying.
+    ///
+    /// # Arguments
+    /// * `container` - Property container
+    /// * `prop` - Property to write
+    /// * `tag` - Type tag describing the buffer contents
+    /// * `data` - Property payload
+    pub fn set_binary(
+        container: PropertyContainer,
+        prop: PropertyId,
+        tag: PropertyTypeTag,
+        data: &[u8],
+    ) -> DriverResult<()> {
+        Self::set_binary_raw(container, prop as u32, tag, data)
+    }
+
+    /// Set a binary property addressed by its numeric id
+    ///
+    /// Use this for ids computed from a range start, like the hidden area
+    /// properties, that have no `PropertyId` variant.
+    pub fn set_binary_raw(
+        container: PropertyContainer,
+        prop: u32,
+        tag: PropertyTypeTag,
+        data: &[u8],
+    ) -> DriverResult<()> {
+        Self::write_binary_batch(container, &[BinaryPropertyWrite::raw(prop, tag, data)])
+    }
+
+    /// Write several binary properties in one batch, without copying
+    ///
+    /// Each buffer is passed to `WritePropertyBatch` where it lies, so a
+    /// payload borrowed from a `MappedFile` goes from the page cache straight
+    /// into the runtime.
+    ///
+    /// # Arguments
+    /// * `container` - Property container
+    /// * `writes` - Properties and the buffers to write to them
+    pub fn write_binary_batch(
+        container: PropertyContainer,
+        writes: &[BinaryPropertyWrite<'_>],
+    ) -> DriverResult<()> {
+        if writes.is_empty() {
+            return Ok(());
+        }
+
+        let mut raw = Vec::with_capacity(writes.len());
+        for write in writes {
+            let size = u32::try_from(write.data.len())
+                .map_err(|_| DriverError::invalid_parameter("Binary property exceeds 4 GiB"))?;
+            raw.push(RawPropertyWrite {
+                prop: write.prop,
+                write_type: sys::root::vr::EPropertyWriteType::PropertyWrite_Set,
+                set_error: sys::root::vr::ETrackedPropertyError::TrackedProp_Success,
+                buffer: write.data.as_ptr() as *mut c_void,
+                buffer_size: size,
+                tag: write.tag,
+                error: sys::root::vr::ETrackedPropertyError::TrackedProp_Success,
+            });
+        }
+
+        unsafe {
+            let properties_ptr = PROPERTIES_INTERFACE
+                .filter(|p| !p.is_null())
+                .ok_or_else(|| DriverError::interface_not_found("IVRProperties not initialized"))?;
+
+            let vtable = (*properties_ptr).vtable_;
+            let write_batch = (*vtable).IVRProperties_WritePropertyBatch;
+
+            // The layouts match (checked above); the runtime only sees the C struct
+            let error = write_batch(
+                properties_ptr,
+                container,
+                raw.as_mut_ptr() as *mut sys::root::vr::PropertyWrite_t,
+                raw.len() as u32,
+            );
+
+            let success = sys::root::vr::ETrackedPropertyError::TrackedProp_Success;
+            if let Some(failed) = raw.iter().find(|w| w.error != success) {
+                return Err(DriverError::operation_failed(format!(
+                    "Failed to write binary property {}: {:?}",
+                    failed.prop, failed.error
+                )));
+            }
+            if error != success {
+                return Err(DriverError::operation_failed(format!(
+                    "WritePropertyBatch failed: {:?}",
+                    error
+                )));
+            }
+            Ok(())
+        }
+    }
+
     /// Set a property from a PropertyValue
     pub fn set_property(
         container: PropertyContainer,
@@ -0,0 +1,179 @@
+//! Atomically replaceable snapshot for read-mostly state
+//!
+//! `Snapshot<T>` holds an immutable value that readers copy out with a
+//! handful of atomic operations and a pointer load, never taking a lock,
+//! while a writer publishes replacements by swapping a pointer.
+//!
+//! Readers register in one of two counters, picked by the parity of an
+//! epoch. After a swap the writer advances the epoch twice, each time
+//! waiting for the counter it just retired to drain, and then frees the old
+//! value. New readers always land in the other counter, so the wait only
+//! covers copies already in flight and the old value is reclaimed even
+//! while reads never stop.
+//!
+//! This is meant for small `Copy` values read from vtable thunks on
+//! vrserver's threads and updated rarely from driver code.
+
+use std::ptr;
+use std::sync::atomic::{AtomicPtr, AtomicUsize, Ordering};
+use std::sync::Mutex;
+
+/// Lock-free readable cell holding the latest published value
+pub struct Snapshot<T: Copy> {
+    current: AtomicPtr<T>,
+    /// Selects the reader counter new readers register in
+    epoch: AtomicUsize,
+    /// Readers between registering and finishing their copy, by epoch parity
+    readers: [AtomicUsize; 2],
+    /// Serializes writers through the grace period
+    writer: Mutex<()>,
+}
+
+unsafe impl<T: Copy + Send> Send for Snapshot<T> {}
+unsafe impl<T: Copy + Send + Sync> Sync for Snapshot<T> {}
+
+impl<T: Copy> Snapshot<T> {
+    /// Create an empty snapshot
+    pub fn empty() -> Self {
+        Self {
+            current: AtomicPtr::new(ptr::null_mut()),
+            epoch: AtomicUsize::new(0),
+            readers: [AtomicUsize::new(0), AtomicUsize::new(0)],
+            writer: Mutex::new(()),
+        }
+    }
+
+    /// Create a snapshot holding `value`
+    pub fn new(value: T) -> Self {
+        let snapshot = Self::empty();
+        snapshot
+            .current
+            .store(Box::into_raw(Box::new(value)), Ordering::Release);
+        snapshot
+    }
+
+    /// Copy out the latest value, or `None` if nothing was published yet
+    #[inline]
+    pub fn load(&self) -> Option<T> {
+        // The registration must be visible before the pointer is read, so a
+        // writer that swaps afterwards waits for this copy before freeing
+        let readers = &self.readers[self.epoch.load(Ordering::SeqCst) & 1];
+        readers.fetch_add(1, Ordering::SeqCst);
+        let current = self.current.load(Ordering::SeqCst);
+        let value = if current.is_null() {
+            None
+        } else {
+            Some(unsafe { *current })
+        };
+        readers.fetch_sub(1, Ordering::Release);
+        value
+    }
+
+    /// Publish a new value
+    ///
+    /// Returns once the replaced value is freed, which waits for reads that
+    /// were already copying it.
+    pub fn store(&self, value: T) {
+        let new = Box::into_raw(Box::new(value));
+        let _writer = self.writer.lock().unwrap_or_else(|e| e.into_inner());
+        let old = self.current.swap(new, Ordering::SeqCst);
+        if !old.is_null() {
+            self.wait_for_readers();
+            drop(unsafe { Box::from_raw(old) });
+        }
+    }
+
+    /// Publish `value` only if nothing was published yet
+    ///
+    /// # Returns
+    /// * `true` if `value` was published
+    pub fn store_if_empty(&self, value: T) -> bool {
+        let new = Box::into_raw(Box::new(value));
+        match self.current.compare_exchange(
+            ptr::null_mut(),
+            new,
+            Ordering::SeqCst,
+            Ordering::SeqCst,
+        ) {
+            Ok(_) => true,
+            Err(_) => {
+                drop(unsafe { Box::from_raw(new) });
+                false
+            }
+        }
+    }
+
+    /// Wait until no reader registered before the last swap is in flight
+    ///
+    /// A reader may have read the epoch just before a flip and register in
+    /// the old counter afterwards, so both counters are drained in turn; each
+    /// only receives such stragglers while it is being waited on.
+    fn wait_for_readers(&self) {
+        for _ in 0..2 {
+            let retired = self.epoch.fetch_add(1, Ordering::SeqCst);
+            let readers = &self.readers[retired & 1];
+            while readers.load(Ordering::SeqCst) != 0 {
+                std::thread::yield_now();
+            }
+        }
+    }
+}
+
+impl<T: Copy> Drop for Snapshot<T> {
+    fn drop(&mut self) {
+        let current = *self.current.get_mut();
+        if !current.is_null() {
+            drop(unsafe { Box::from_raw(current) });
+        }
+    }
+}
+
+impl<T: Copy> Default for Snapshot<T> {
+    fn default() -> Self {
+        Self::empty()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::AtomicBool;
+    use std::sync::Arc;
+
+    #[derive(Clone, Copy)]
+    struct Pair {
+        a: u64,
+        b: u64,
+    }
+
+    #[test]
+    fn stores_complete_under_constant_reads() {
+        let snapshot = Arc::new(Snapshot::new(Pair { a: 0, b: 0 }));
+        let stop = Arc::new(AtomicBool::new(false));
+
+        let readers: Vec<_> = (0..4)
+            .map(|_| {
+                let snapshot = snapshot.clone();
+                let stop = stop.clone();
+                std::thread::spawn(move || {
+                    let mut last = 0;
+                    while !stop.load(Ordering::Relaxed) {
+                        let pair = snapshot.load().unwrap();
+                        assert_eq!(pair.a, pair.b);
+                        assert!(pair.a >= last);
+                        last = pair.a;
+                    }
+                })
+            })
+            .collect();
+
+        for i in 1..=10_000 {
+            snapshot.store(Pair { a: i, b: i });
+        }
+        stop.store(true, Ordering::Relaxed);
+        for reader in readers {
+            reader.join().unwrap();
+        }
+        assert_eq!(snapshot.load().unwrap().a, 10_000);
+    }
+}
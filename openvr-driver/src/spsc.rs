@@ -0,0 +1,119 @@
+//! Bounded single-producer/single-consumer queue
+//!
+//! Both `push` and `pop` are wait-free: each side only ever touches its own
+//! index plus a cached copy of the other side's, so a producer thread sampling
+//! hardware never blocks on the consumer and vice versa.
+
+use std::cell::UnsafeCell;
+use std::mem::MaybeUninit;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+
+/// Pads a value to its own cache line to avoid false sharing
+#[repr(align(64))]
+struct CachePadded<T>(T);
+
+struct Ring<T> {
+    slots: Box<[UnsafeCell<MaybeUninit<T>>]>,
+    mask: usize,
+    /// Next slot to read; written only by the consumer
+    head: CachePadded<AtomicUsize>,
+    /// Next slot to write; written only by the producer
+    tail: CachePadded<AtomicUsize>,
+}
+
+unsafe impl<T: Send> Send for Ring<T> {}
+unsafe impl<T: Send> Sync for Ring<T> {}
+
+/// Create a queue holding at least `capacity` items
+///
+/// The capacity is rounded up to a power of two.
+pub fn channel<T: Copy + Send>(capacity: usize) -> (Producer<T>, Consumer<T>) {
+    let capacity = capacity.max(2).next_power_of_two();
+    let slots = (0..capacity)
+        .map(|_| UnsafeCell::new(MaybeUninit::uninit()))
+        .collect::<Vec<_>>()
+        .into_boxed_slice();
+
+    let ring = Arc::new(Ring {
+        slots,
+        mask: capacity - 1,
+        head: CachePadded(AtomicUsize::new(0)),
+        tail: CachePadded(AtomicUsize::new(0)),
+    });
+
+    (
+        Producer {
+            ring: ring.clone(),
+            tail: 0,
+            cached_head: 0,
+        },
+        Consumer {
+            ring,
+            head: 0,
+            cached_tail: 0,
+        },
+    )
+}
+
+/// Writing half of an SPSC queue
+pub struct Producer<T> {
+    ring: Arc<Ring<T>>,
+    tail: usize,
+    cached_head: usize,
+}
+
+impl<T: Copy + Send> Producer<T> {
+    /// Push an item, handing it back if the queue is full
+    pub fn push(&mut self, value: T) -> Result<(), T> {
+        let capacity = self.ring.mask + 1;
+
+        if self.tail.wrapping_sub(self.cached_head) == capacity {
+            self.cached_head = self.ring.head.0.load(Ordering::Acquire);
+            if self.tail.wrapping_sub(self.cached_head) == capacity {
+                return Err(value);
+            }
+        }
+
+        unsafe {
+            (*self.ring.slots[self.tail & self.ring.mask].get()).write(value);
+        }
+        self.tail = self.tail.wrapping_add(1);
+        self.ring.tail.0.store(self.tail, Ordering::Release);
+        Ok(())
+    }
+
+    /// Number of slots in the queue
+    pub fn capacity(&self) -> usize {
+        self.ring.mask + 1
+    }
+}
+
+/// Reading half of an SPSC queue
+pub struct Consumer<T> {
+    ring: Arc<Ring<T>>,
+    head: usize,
+    cached_tail: usize,
+}
+
+impl<T: Copy + Send> Consumer<T> {
+    /// Pop the oldest item, if any
+    pub fn pop(&mut self) -> Option<T> {
+        if self.head == self.cached_tail {
+            self.cached_tail = self.ring.tail.0.load(Ordering::Acquire);
+            if self.head == self.cached_tail {
+                return None;
+            }
+        }
+
+        let value = unsafe { (*self.ring.slots[self.head & self.ring.mask].get()).assume_init() };
+        self.head = self.head.wrapping_add(1);
+        self.ring.head.0.store(self.head, Ordering::Release);
+        Some(value)
+    }
+
+    /// Check whether the queue currently holds no items
+    pub fn is_empty(&self) -> bool {
+        self.head == self.ring.tail.0.load(Ordering::Acquire)
+    }
+}
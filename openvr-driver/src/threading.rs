@@ -0,0 +1,130 @@
+//! Thread placement and scheduling helpers
+//!
+//! Services that run their own threads (input samplers, frame pacers) use
+//! these helpers to pin themselves to CPUs and raise their priority. On
+//! platforms without support the helpers return `NotImplemented`.
+
+use crate::{DriverError, DriverResult};
+
+/// Scheduling priority for a service thread
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub enum ThreadPriority {
+    /// Leave the thread at its inherited priority
+    #[default]
+    Normal,
+    /// Set the thread's nice value (-20 highest to 19 lowest)
+    Nice(i32),
+    /// Use realtime FIFO scheduling with the given priority (1-99)
+    ///
+    /// Requires `CAP_SYS_NICE` or a suitable `RLIMIT_RTPRIO`.
+    Realtime(i32),
+}
+
+/// Placement and priority for a service thread
+#[derive(Debug, Clone, Default)]
+pub struct ThreadConfig {
+    /// CPUs the thread may run on (empty for no restriction)
+    pub cpu_affinity: Vec<usize>,
+    /// Scheduling priority
+    pub priority: ThreadPriority,
+}
+
+impl ThreadConfig {
+    /// Apply this configuration to the calling thread
+    ///
+    /// Failures are logged rather than returned so a missing permission
+    /// degrades timing instead of stopping the service.
+    pub fn apply_to_current(&self, thread_name: &str) {
+        if !self.cpu_affinity.is_empty() {
+            if let Err(e) = set_current_thread_affinity(&self.cpu_affinity) {
+                eprintln!("[{}] Failed to set CPU affinity: {}", thread_name, e);
+            }
+        }
+
+        if self.priority != ThreadPriority::Normal {
+            if let Err(e) = set_current_thread_priority(self.priority) {
+                eprintln!("[{}] Failed to set thread priority: {}", thread_name, e);
+            }
+        }
+    }
+}
+
+/// Restrict the calling thread to the given CPUs
+#[cfg(target_os = "linux")]
+pub fn set_current_thread_affinity(cpus: &[usize]) -> DriverResult<()> {
+    unsafe {
+        let mut set: libc::cpu_set_t = std::mem::zeroed();
+        libc::CPU_ZERO(&mut set);
+        for &cpu in cpus {
+            if cpu >= libc::CPU_SETSIZE as usize {
+                return Err(DriverError::invalid_parameter(format!(
+                    "CPU index {} out of range",
+                    cpu
+                )));
+            }
+            libc::CPU_SET(cpu, &mut set);
+        }
+
+        if libc::sched_setaffinity(0, std::mem::size_of::<libc::cpu_set_t>(), &set) != 0 {
+            return Err(DriverError::operation_failed(format!(
+                "sched_setaffinity: {}",
+                std::io::Error::last_os_error()
+            )));
+        }
+    }
+
+    Ok(())
+}
+
+/// Restrict the calling thread to the given CPUs
+#[cfg(not(target_os = "linux"))]
+pub fn set_current_thread_affinity(_cpus: &[usize]) -> DriverResult<()> {
+    Err(DriverError::not_implemented(
+        "Thread affinity on this platform",
+    ))
+}
+
+/// Change the scheduling priority of the calling thread
+#[cfg(target_os = "linux")]
+pub fn set_current_thread_priority(priority: ThreadPriority) -> DriverResult<()> {
+    unsafe {
+        match priority {
+            ThreadPriority::Normal => Ok(()),
+            ThreadPriority::Nice(nice) => {
+                let tid = libc::syscall(libc::SYS_gettid) as libc::id_t;
+                if libc::setpriority(libc::PRIO_PROCESS, tid, nice) != 0 {
+                    return Err(DriverError::operation_failed(format!(
+                        "setpriority: {}",
+                        std::io::Error::last_os_error()
+                    )));
+                }
+                Ok(())
+            }
+            ThreadPriority::Realtime(level) => {
+                let param = libc::sched_param {
+                    sched_priority: level,
+                };
+                let result =
+                    libc::pthread_setschedparam(libc::pthread_self(), libc::SCHED_FIFO, &param);
+                if result != 0 {
+                    return Err(DriverError::operation_failed(format!(
+                        "pthread_setschedparam: {}",
+                        std::io::Error::from_raw_os_error(result)
+                    )));
+                }
+                Ok(())
+            }
+        }
+    }
+}
+
+/// Change the scheduling priority of the calling thread
+#[cfg(not(target_os = "linux"))]
+pub fn set_current_thread_priority(priority: ThreadPriority) -> DriverResult<()> {
+    match priority {
+        ThreadPriority::Normal => Ok(()),
+        _ => Err(DriverError::not_implemented(
+            "Thread priority on this platform",
+        )),
+    }
+}
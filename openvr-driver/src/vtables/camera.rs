@@ -0,0 +1,445 @@
+//! Camera vtable generation
+//!
+//! This module handles the creation of vtables for the CameraComponent
+//! interface. Frame buffering and the frame hand-off go straight to the
+//! component's `CameraStream`, so `GetVideoStreamFrame` and
+//! `ReleaseVideoStreamFrame` never lock, copy or allocate. A sink callback
+//! from `SetCameraVideoSinkCallback` is called by the capture thread as
+//! frames are committed.
+
+use crate::camera::{stream_formats, MAX_CAMERA_FRAME_BUFFERS};
+use crate::interfaces::CameraComponent;
+use crate::sys;
+use std::ffi::c_void;
+use std::sync::Arc;
+
+use super::VtableWrapper;
+
+/// Wrapper type the camera thunks receive as `this`
+type CameraWrapper<T> = VtableWrapper<sys::root::vr::IVRCameraComponent__bindgen_vtable, T>;
+
+/// Create a vtable for a CameraComponent implementation
+pub(crate) fn create_camera_vtable<T>(camera: Arc<T>) -> *mut c_void
+where
+    T: CameraComponent + ?Sized,
+{
+    use std::os::raw::c_int;
+    use sys::root::vr::{
+        CameraVideoStreamFrame_t, ECameraCompatibilityMode, ECameraVideoStreamFormat,
+        EVRDistortionFunctionType, EVRTrackedCameraFrameType, HmdMatrix44_t, HmdVector2_t,
+        ICameraVideoSinkCallback, IVRCameraComponent, IVRCameraComponent__bindgen_vtable,
+    };
+
+    unsafe fn component<'a, T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+    ) -> &'a Arc<T> {
+        VtableWrapper::get_data(this as *mut CameraWrapper<T>)
+    }
+
+    unsafe extern "C" fn get_camera_frame_dimensions_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        format: ECameraVideoStreamFormat,
+        width: *mut u32,
+        height: *mut u32,
+    ) -> bool {
+        if width.is_null() || height.is_null() {
+            return false;
+        }
+
+        match component::<T>(this).frame_dimensions(format) {
+            Some((w, h)) => {
+                *width = w;
+                *height = h;
+                true
+            }
+            None => false,
+        }
+    }
+
+    unsafe extern "C" fn get_camera_frame_buffering_requirements_thunk<
+        T: CameraComponent + ?Sized,
+    >(
+        this: *mut IVRCameraComponent,
+        default_frame_queue_size: *mut c_int,
+        frame_buffer_data_size: *mut u32,
+    ) -> bool {
+        if default_frame_queue_size.is_null() || frame_buffer_data_size.is_null() {
+            return false;
+        }
+
+        let camera = component::<T>(this);
+        let size = match camera.stream().format() {
+            // Asked before a format is chosen; fit the largest one offered
+            ECameraVideoStreamFormat::CVS_FORMAT_UNKNOWN => stream_formats()
+                .filter_map(|format| camera.frame_buffer_size(format))
+                .max(),
+            format => camera.frame_buffer_size(format),
+        };
+        let Some(size) = size else {
+            return false;
+        };
+        let queue_size = camera
+            .frame_queue_size()
+            .clamp(1, MAX_CAMERA_FRAME_BUFFERS as u32);
+        *default_frame_queue_size = queue_size as c_int;
+        *frame_buffer_data_size = size;
+        true
+    }
+
+    unsafe extern "C" fn set_camera_frame_buffering_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        frame_buffer_count: c_int,
+        frame_buffers: *mut *mut c_void,
+        frame_buffer_data_size: u32,
+    ) -> bool {
+        if frame_buffers.is_null()
+            || frame_buffer_count <= 0
+            || frame_buffer_count as usize > MAX_CAMERA_FRAME_BUFFERS
+        {
+            return false;
+        }
+
+        let buffers = std::slice::from_raw_parts(
+            frame_buffers as *const *mut u8,
+            frame_buffer_count as usize,
+        );
+        let attached = component::<T>(this)
+            .stream()
+            .ring()
+            .attach(buffers, frame_buffer_data_size);
+        if !attached {
+            eprintln!("[Camera] Frame buffers changed while frames were in use, rejected");
+        }
+        attached
+    }
+
+    unsafe extern "C" fn set_camera_video_stream_format_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        format: ECameraVideoStreamFormat,
+    ) -> bool {
+        let camera = component::<T>(this);
+        match camera.frame_dimensions(format) {
+            Some((width, height)) => {
+                camera.stream().set_format(format, width, height);
+                true
+            }
+            None => false,
+        }
+    }
+
+    unsafe extern "C" fn get_camera_video_stream_format_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+    ) -> ECameraVideoStreamFormat {
+        component::<T>(this).stream().format()
+    }
+
+    unsafe extern "C" fn start_video_stream_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+    ) -> bool {
+        let camera = component::<T>(this);
+        if camera.stream().ring().buffer_count() == 0 || !camera.start_video_stream() {
+            return false;
+        }
+        camera.stream().start();
+        true
+    }
+
+    unsafe extern "C" fn stop_video_stream_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+    ) {
+        let camera = component::<T>(this);
+        camera.stream().stop();
+        camera.stop_video_stream();
+    }
+
+    unsafe extern "C" fn is_video_stream_active_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        paused: *mut bool,
+        elapsed_time: *mut f32,
+    ) -> bool {
+        let stream = component::<T>(this).stream();
+        if !paused.is_null() {
+            *paused = stream.is_paused();
+        }
+        if !elapsed_time.is_null() {
+            *elapsed_time = stream.elapsed_seconds() as f32;
+        }
+        stream.is_active()
+    }
+
+    unsafe extern "C" fn get_video_stream_frame_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+    ) -> *const CameraVideoStreamFrame_t {
+        component::<T>(this)
+            .stream()
+            .acquire_frame()
+            .unwrap_or(std::ptr::null())
+    }
+
+    unsafe extern "C" fn release_video_stream_frame_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        frame_image: *const CameraVideoStreamFrame_t,
+    ) {
+        if !frame_image.is_null() {
+            component::<T>(this).stream().ring().release(frame_image);
+        }
+    }
+
+    unsafe extern "C" fn set_auto_exposure_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        enable: bool,
+    ) -> bool {
+        component::<T>(this).set_auto_exposure(enable)
+    }
+
+    unsafe extern "C" fn pause_video_stream_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+    ) -> bool {
+        let camera = component::<T>(this);
+        if !camera.stream().is_active() || !camera.pause_video_stream() {
+            return false;
+        }
+        camera.stream().set_paused(true);
+        true
+    }
+
+    unsafe extern "C" fn resume_video_stream_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+    ) -> bool {
+        let camera = component::<T>(this);
+        if !camera.stream().is_active() || !camera.resume_video_stream() {
+            return false;
+        }
+        camera.stream().set_paused(false);
+        true
+    }
+
+    unsafe extern "C" fn get_camera_distortion_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        camera_index: u32,
+        input_u: f32,
+        input_v: f32,
+        output_u: *mut f32,
+        output_v: *mut f32,
+    ) -> bool {
+        if output_u.is_null() || output_v.is_null() {
+            return false;
+        }
+
+        match component::<T>(this).camera_distortion(camera_index, input_u, input_v) {
+            Some((u, v)) => {
+                *output_u = u;
+                *output_v = v;
+                true
+            }
+            None => false,
+        }
+    }
+
+    unsafe extern "C" fn get_camera_projection_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        camera_index: u32,
+        frame_type: EVRTrackedCameraFrameType,
+        z_near: f32,
+        z_far: f32,
+        projection: *mut HmdMatrix44_t,
+    ) -> bool {
+        if projection.is_null() {
+            return false;
+        }
+
+        match component::<T>(this).camera_projection(camera_index, frame_type, z_near, z_far) {
+            Some(matrix) => {
+                *projection = matrix;
+                true
+            }
+            None => false,
+        }
+    }
+
+    unsafe extern "C" fn set_frame_rate_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        isp_frame_rate: c_int,
+        sensor_frame_rate: c_int,
+    ) -> bool {
+        component::<T>(this).set_frame_rate(isp_frame_rate, sensor_frame_rate)
+    }
+
+    unsafe extern "C" fn set_camera_video_sink_callback_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        callback: *mut ICameraVideoSinkCallback,
+    ) -> bool {
+        // Null goes back to polling
+        component::<T>(this).stream().set_sink(callback);
+        true
+    }
+
+    unsafe extern "C" fn get_camera_compatibility_mode_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        mode: *mut ECameraCompatibilityMode,
+    ) -> bool {
+        if mode.is_null() {
+            return false;
+        }
+
+        match component::<T>(this).camera_compatibility_mode() {
+            Some(current) => {
+                *mode = current;
+                true
+            }
+            None => false,
+        }
+    }
+
+    unsafe extern "C" fn set_camera_compatibility_mode_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        mode: ECameraCompatibilityMode,
+    ) -> bool {
+        component::<T>(this).set_camera_compatibility_mode(mode)
+    }
+
+    unsafe extern "C" fn get_camera_frame_bounds_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        frame_type: EVRTrackedCameraFrameType,
+        left: *mut u32,
+        top: *mut u32,
+        width: *mut u32,
+        height: *mut u32,
+    ) -> bool {
+        if left.is_null() || top.is_null() || width.is_null() || height.is_null() {
+            return false;
+        }
+
+        match component::<T>(this).camera_frame_bounds(frame_type) {
+            Some((l, t, w, h)) => {
+                *left = l;
+                *top = t;
+                *width = w;
+                *height = h;
+                true
+            }
+            None => false,
+        }
+    }
+
+    unsafe extern "C" fn get_camera_intrinsics_thunk<T: CameraComponent + ?Sized>(
+        this: *mut IVRCameraComponent,
+        camera_index: u32,
+        frame_type: EVRTrackedCameraFrameType,
+        focal_length: *mut HmdVector2_t,
+        center: *mut HmdVector2_t,
+        distortion_type: *mut EVRDistortionFunctionType,
+        coefficients: *mut f64,
+    ) -> bool {
+        if focal_length.is_null()
+            || center.is_null()
+            || distortion_type.is_null()
+            || coefficients.is_null()
+        {
+            return false;
+        }
+
+        match component::<T>(this).camera_intrinsics(camera_index, frame_type) {
+            Some(intrinsics) => {
+                (*focal_length).v = [intrinsics.focal_length.0, intrinsics.focal_length.1];
+                (*center).v = [intrinsics.center.0, intrinsics.center.1];
+                *distortion_type = intrinsics.distortion_type;
+                std::ptr::copy_nonoverlapping(
+                    intrinsics.coefficients.as_ptr(),
+                    coefficients,
+                    intrinsics.coefficients.len(),
+                );
+                true
+            }
+            None => false,
+        }
+    }
+
+    // Create the vtable
+    let vtable = Box::new(IVRCameraComponent__bindgen_vtable {
+        IVRCameraComponent_GetCameraFrameDimensions: get_camera_frame_dimensions_thunk::<T>,
+        IVRCameraComponent_GetCameraFrameBufferingRequirements:
+            get_camera_frame_buffering_requirements_thunk::<T>,
+        IVRCameraComponent_SetCameraFrameBuffering: set_camera_frame_buffering_thunk::<T>,
+        IVRCameraComponent_SetCameraVideoStreamFormat: set_camera_video_stream_format_thunk::<T>,
+        IVRCameraComponent_GetCameraVideoStreamFormat: get_camera_video_stream_format_thunk::<T>,
+        IVRCameraComponent_StartVideoStream: start_video_stream_thunk::<T>,
+        IVRCameraComponent_StopVideoStream: stop_video_stream_thunk::<T>,
+        IVRCameraComponent_IsVideoStreamActive: is_video_stream_active_thunk::<T>,
+        IVRCameraComponent_GetVideoStreamFrame: get_video_stream_frame_thunk::<T>,
+        IVRCameraComponent_ReleaseVideoStreamFrame: release_video_stream_frame_thunk::<T>,
+        IVRCameraComponent_SetAutoExposure: set_auto_exposure_thunk::<T>,
+        IVRCameraComponent_PauseVideoStream: pause_video_stream_thunk::<T>,
+        IVRCameraComponent_ResumeVideoStream: resume_video_stream_thunk::<T>,
+        IVRCameraComponent_GetCameraDistortion: get_camera_distortion_thunk::<T>,
+        IVRCameraComponent_GetCameraProjection: get_camera_projection_thunk::<T>,
+        IVRCameraComponent_SetFrameRate: set_frame_rate_thunk::<T>,
+        IVRCameraComponent_SetCameraVideoSinkCallback: set_camera_video_sink_callback_thunk::<T>,
+        IVRCameraComponent_GetCameraCompatibilityMode: get_camera_compatibility_mode_thunk::<T>,
+        IVRCameraComponent_SetCameraCompatibilityMode: set_camera_compatibility_mode_thunk::<T>,
+        IVRCameraComponent_GetCameraFrameBounds: get_camera_frame_bounds_thunk::<T>,
+        IVRCameraComponent_GetCameraIntrinsics: get_camera_intrinsics_thunk::<T>,
+    });
+
+    let vtable_ptr = Box::into_raw(vtable);
+
+    // Create the wrapper that contains both vtable pointer and data
+    unsafe {
+        let wrapper = VtableWrapper::new(vtable_ptr, camera);
+        wrapper as *mut c_void
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::camera::CameraStream;
+    use crate::sys::root::vr::{ECameraVideoStreamFormat, IVRCameraComponent};
+
+    struct TwoFormats {
+        stream: CameraStream,
+    }
+
+    impl CameraComponent for TwoFormats {
+        fn stream(&self) -> &CameraStream {
+            &self.stream
+        }
+
+        fn frame_dimensions(&self, format: ECameraVideoStreamFormat) -> Option<(u32, u32)> {
+            match format {
+                ECameraVideoStreamFormat::CVS_FORMAT_NV12 => Some((640, 480)),
+                ECameraVideoStreamFormat::CVS_FORMAT_RGB24 => Some((320, 240)),
+                _ => None,
+            }
+        }
+    }
+
+    #[test]
+    fn buffering_requirements_before_format_fit_largest() {
+        let camera = Arc::new(TwoFormats {
+            stream: CameraStream::new(),
+        });
+        let component = create_camera_vtable(camera.clone()) as *mut IVRCameraComponent;
+        let vtable = unsafe { &*(*component).vtable_ };
+        let requirements = || {
+            let (mut queue, mut size) = (0, 0);
+            let ok = unsafe {
+                (vtable.IVRCameraComponent_GetCameraFrameBufferingRequirements)(
+                    component, &mut queue, &mut size,
+                )
+            };
+            ok.then_some(size)
+        };
+
+        // NV12 at 640x480 needs more than RGB24 at 320x240
+        assert_eq!(requirements(), Some(640 * 480 * 3 / 2));
+
+        let set_format = |format| unsafe {
+            (vtable.IVRCameraComponent_SetCameraVideoStreamFormat)(component, format)
+        };
+        assert!(set_format(ECameraVideoStreamFormat::CVS_FORMAT_RGB24));
+        assert_eq!(requirements(), Some(320 * 240 * 3));
+        assert!(!set_format(ECameraVideoStreamFormat::CVS_FORMAT_MJPEG));
+        assert_eq!(requirements(), Some(320 * 240 * 3));
+    }
+}
@@ -0,0 +1,242 @@
+//! Driver direct mode vtable generation
+//!
+//! This module handles the creation of vtables for the DriverDirectModeComponent
+//! interface. Swap texture sets are recorded in a `SwapTextureSetPool`, so the
+//! per-frame thunks resolve handles and rotate indices with atomics alone.
+
+use crate::display::SwapTextureSetPool;
+use crate::interfaces::{
+    DirectModeFrameTiming, DriverDirectModeComponent, LayerEye, SwapTextureSetDesc, Throttling,
+};
+use crate::sys;
+use std::ffi::c_void;
+use std::sync::Arc;
+
+use super::VtableWrapper;
+
+/// Component plus the pool its sets are tracked in
+struct DirectModeState<T: ?Sized> {
+    pool: SwapTextureSetPool,
+    component: Arc<T>,
+}
+
+/// Wrapper type the direct mode thunks receive as `this`
+type DirectModeWrapper<T> =
+    VtableWrapper<sys::root::vr::IVRDriverDirectModeComponent__bindgen_vtable, DirectModeState<T>>;
+
+/// Create a vtable for a DriverDirectModeComponent implementation
+pub(crate) fn create_direct_mode_vtable<T>(component: Arc<T>) -> *mut c_void
+where
+    T: DriverDirectModeComponent + ?Sized,
+{
+    use sys::root::vr::{
+        DriverDirectMode_FrameTiming, IVRDriverDirectModeComponent,
+        IVRDriverDirectModeComponent_SubmitLayerPerEye_t,
+        IVRDriverDirectModeComponent_SwapTextureSetDesc_t,
+        IVRDriverDirectModeComponent_SwapTextureSet_t, IVRDriverDirectModeComponent_Throttling_t,
+        IVRDriverDirectModeComponent__bindgen_vtable, SharedTextureHandle_t,
+    };
+
+    unsafe fn state<'a, T: DriverDirectModeComponent + ?Sized>(
+        this: *mut IVRDriverDirectModeComponent,
+    ) -> &'a DirectModeState<T> {
+        VtableWrapper::get_data(this as *mut DirectModeWrapper<T>)
+    }
+
+    unsafe extern "C" fn create_swap_texture_set_thunk<T: DriverDirectModeComponent + ?Sized>(
+        this: *mut IVRDriverDirectModeComponent,
+        pid: u32,
+        desc: *const IVRDriverDirectModeComponent_SwapTextureSetDesc_t,
+        out_set: *mut IVRDriverDirectModeComponent_SwapTextureSet_t,
+    ) {
+        if desc.is_null() || out_set.is_null() {
+            return;
+        }
+        *out_set = std::mem::zeroed();
+
+        let state = state::<T>(this);
+        // Claim a slot first so a full pool never allocates textures
+        let Some(slot) = state.pool.reserve() else {
+            eprintln!(
+                "[DirectMode] Swap texture pool full ({} sets), refusing pid {}",
+                state.pool.capacity(),
+                pid
+            );
+            return;
+        };
+
+        let desc = SwapTextureSetDesc {
+            width: (*desc).nWidth,
+            height: (*desc).nHeight,
+            format: (*desc).nFormat,
+            sample_count: (*desc).nSampleCount,
+        };
+        match state.component.create_swap_texture_set(pid, &desc) {
+            Some(set) => {
+                state.pool.publish(slot, pid, &set);
+                (*out_set).rSharedTextureHandles = set.handles;
+                (*out_set).unTextureFlags = set.flags;
+            }
+            None => state.pool.unreserve(slot),
+        }
+    }
+
+    unsafe extern "C" fn destroy_swap_texture_set_thunk<T: DriverDirectModeComponent + ?Sized>(
+        this: *mut IVRDriverDirectModeComponent,
+        shared_texture_handle: SharedTextureHandle_t,
+    ) {
+        let state = state::<T>(this);
+        if let Some(set) = state
+            .pool
+            .lookup(shared_texture_handle)
+            .and_then(|found| state.pool.take(found.slot))
+        {
+            state.component.destroy_swap_texture_set(&set);
+        }
+    }
+
+    unsafe extern "C" fn destroy_all_swap_texture_sets_thunk<
+        T: DriverDirectModeComponent + ?Sized,
+    >(
+        this: *mut IVRDriverDirectModeComponent,
+        pid: u32,
+    ) {
+        let state = state::<T>(this);
+        for slot in state.pool.slots_for_pid(pid) {
+            if let Some(set) = state.pool.take(slot) {
+                state.component.destroy_swap_texture_set(&set);
+            }
+        }
+    }
+
+    unsafe extern "C" fn get_next_swap_texture_set_index_thunk<
+        T: DriverDirectModeComponent + ?Sized,
+    >(
+        this: *mut IVRDriverDirectModeComponent,
+        shared_texture_handles: *mut SharedTextureHandle_t,
+        indices: *mut [u32; 2],
+    ) {
+        if shared_texture_handles.is_null() || indices.is_null() {
+            return;
+        }
+
+        let pool = &state::<T>(this).pool;
+        let handles = std::slice::from_raw_parts(shared_texture_handles, 2);
+        let left = pool.lookup(handles[0]).map(|found| found.slot);
+        let right = pool.lookup(handles[1]).map(|found| found.slot);
+
+        // Entries for handles this pool does not know keep the caller's value
+        let indices = &mut *indices;
+        if let Some(slot) = left {
+            indices[0] = pool.advance(slot);
+        }
+        // Both eyes may render into one set; rotate it only once per frame
+        match right {
+            Some(slot) if Some(slot) == left => indices[1] = indices[0],
+            Some(slot) => indices[1] = pool.advance(slot),
+            None => {}
+        }
+    }
+
+    unsafe extern "C" fn submit_layer_thunk<T: DriverDirectModeComponent + ?Sized>(
+        this: *mut IVRDriverDirectModeComponent,
+        per_eye: *const [IVRDriverDirectModeComponent_SubmitLayerPerEye_t; 2],
+    ) {
+        if per_eye.is_null() {
+            return;
+        }
+
+        let per_eye = &*per_eye;
+        let layer = [LayerEye::from(&per_eye[0]), LayerEye::from(&per_eye[1])];
+        state::<T>(this).component.submit_layer(&layer);
+    }
+
+    unsafe extern "C" fn present_thunk<T: DriverDirectModeComponent + ?Sized>(
+        this: *mut IVRDriverDirectModeComponent,
+        sync_texture: SharedTextureHandle_t,
+    ) {
+        state::<T>(this).component.present(sync_texture);
+    }
+
+    unsafe extern "C" fn post_present_thunk<T: DriverDirectModeComponent + ?Sized>(
+        this: *mut IVRDriverDirectModeComponent,
+        throttling: *const IVRDriverDirectModeComponent_Throttling_t,
+    ) {
+        let throttling = throttling.as_ref().map(Throttling::from);
+        state::<T>(this).component.post_present(throttling);
+    }
+
+    unsafe extern "C" fn get_frame_timing_thunk<T: DriverDirectModeComponent + ?Sized>(
+        this: *mut IVRDriverDirectModeComponent,
+        frame_timing: *mut DriverDirectMode_FrameTiming,
+    ) {
+        use std::mem::offset_of;
+
+        if frame_timing.is_null() {
+            return;
+        }
+
+        // Older runtimes may pass a shorter struct, so only the fields within
+        // `m_nSize` are read or written; missing ones read as zero
+        let size = (*frame_timing).m_nSize as usize;
+        let field = |offset: usize| {
+            (offset + std::mem::size_of::<u32>() <= size)
+                .then(|| (frame_timing as *mut u8).add(offset) as *mut u32)
+        };
+        let [presents, mis_presented, dropped, flags] = [
+            offset_of!(DriverDirectMode_FrameTiming, m_nNumFramePresents),
+            offset_of!(DriverDirectMode_FrameTiming, m_nNumMisPresented),
+            offset_of!(DriverDirectMode_FrameTiming, m_nNumDroppedFrames),
+            offset_of!(DriverDirectMode_FrameTiming, m_nReprojectionFlags),
+        ]
+        .map(field);
+        let read = |field: Option<*mut u32>| field.map_or(0, |ptr| ptr.read_unaligned());
+
+        let mut timing = DirectModeFrameTiming {
+            num_frame_presents: read(presents),
+            num_mis_presented: read(mis_presented),
+            num_dropped_frames: read(dropped),
+            reprojection_flags: read(flags),
+        };
+        state::<T>(this).component.get_frame_timing(&mut timing);
+
+        for (field, value) in [
+            (presents, timing.num_frame_presents),
+            (mis_presented, timing.num_mis_presented),
+            (dropped, timing.num_dropped_frames),
+            (flags, timing.reprojection_flags),
+        ] {
+            if let Some(ptr) = field {
+                ptr.write_unaligned(value);
+            }
+        }
+    }
+
+    // Create the vtable
+    let vtable = Box::new(IVRDriverDirectModeComponent__bindgen_vtable {
+        IVRDriverDirectModeComponent_CreateSwapTextureSet: create_swap_texture_set_thunk::<T>,
+        IVRDriverDirectModeComponent_DestroySwapTextureSet: destroy_swap_texture_set_thunk::<T>,
+        IVRDriverDirectModeComponent_DestroyAllSwapTextureSets: destroy_all_swap_texture_sets_thunk::<
+            T,
+        >,
+        IVRDriverDirectModeComponent_GetNextSwapTextureSetIndex:
+            get_next_swap_texture_set_index_thunk::<T>,
+        IVRDriverDirectModeComponent_SubmitLayer: submit_layer_thunk::<T>,
+        IVRDriverDirectModeComponent_Present: present_thunk::<T>,
+        IVRDriverDirectModeComponent_PostPresent: post_present_thunk::<T>,
+        IVRDriverDirectModeComponent_GetFrameTiming: get_frame_timing_thunk::<T>,
+    });
+
+    let vtable_ptr = Box::into_raw(vtable);
+
+    let state = Arc::new(DirectModeState {
+        pool: component.swap_texture_pool().cloned().unwrap_or_default(),
+        component,
+    });
+
+    // Create the wrapper that contains both vtable pointer and data
+    unsafe {
+        let wrapper = VtableWrapper::new(vtable_ptr, state);
+        wrapper as *mut c_void
+    }
+}
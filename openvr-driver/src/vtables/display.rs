@@ -2,23 +2,133 @@
 //!
 //! This module handles the creation of vtables for the DisplayComponent interface.
 
+use crate::display::{
+    DisplayGeometry, DistortionGrid, DistortionSample, InverseDistortion, InverseDistortionConfig,
+    SharedDisplayGeometry,
+};
 use crate::{sys, DisplayComponent, Eye};
 use std::ffi::c_void;
 use std::sync::Arc;
 
 use super::VtableWrapper;
 
+/// Wrapper type the display thunks receive as `this`
+type DisplayWrapper<T> =
+    VtableWrapper<sys::root::vr::IVRDisplayComponent__bindgen_vtable, DisplayState<T>>;
+
+/// Data behind a display component vtable
+pub(crate) struct DisplayState<T> {
+    /// The driver's display component
+    component: Arc<T>,
+    /// Geometry served by the thunks, replaceable through a `DisplayUpdater`
+    geometry: SharedDisplayGeometry,
+    /// Precomputed distortion, if the component opted in
+    distortion: Option<DistortionGrid>,
+    /// Inverse solver, built with the vtable so no query pays for it
+    inverse: Option<InverseDistortion>,
+}
+
+impl<T: DisplayComponent> DisplayState<T> {
+    fn new(component: Arc<T>) -> Self {
+        let distortion = component.distortion_cache().and_then(|config| {
+            let started = std::time::Instant::now();
+            let result = DistortionGrid::load_or_evaluate_rows(&config, |eye, u, v, out| {
+                component.compute_distortion_row(eye, u, v, out)
+            });
+
+            match result {
+                Ok(grid) => {
+                    let (width, height) = grid.dimensions();
+                    eprintln!(
+                        "[DisplayComponent] Distortion grid {}x{} ready in {:.1} ms",
+                        width,
+                        height,
+                        started.elapsed().as_secs_f64() * 1000.0
+                    );
+                    Some(grid)
+                }
+                Err(e) => {
+                    eprintln!(
+                        "[DisplayComponent] Distortion grid disabled, falling back to direct evaluation: {}",
+                        e
+                    );
+                    None
+                }
+            }
+        });
+
+        let geometry = component.shared_geometry().cloned().unwrap_or_default();
+        geometry.store_if_empty(DisplayGeometry::from_component(component.as_ref()));
+
+        let mut state = Self {
+            geometry,
+            component,
+            distortion,
+            inverse: None,
+        };
+
+        let started = std::time::Instant::now();
+        let forward = |eye: Eye, u: f32, v: f32| state.distort(eye, u, v);
+        match InverseDistortion::build(InverseDistortionConfig::default(), &forward) {
+            Ok(inverse) => {
+                eprintln!(
+                    "[DisplayComponent] Inverse distortion seeds ready in {:.1} ms",
+                    started.elapsed().as_secs_f64() * 1000.0
+                );
+                state.inverse = Some(inverse);
+            }
+            Err(e) => eprintln!("[DisplayComponent] Inverse distortion unavailable: {}", e),
+        }
+
+        state
+    }
+
+    /// Current geometry snapshot
+    #[inline]
+    fn geometry(&self) -> DisplayGeometry {
+        // Always published by `new`; the fallback only guards the invariant
+        self.geometry
+            .load()
+            .unwrap_or_else(|| DisplayGeometry::from_component(self.component.as_ref()))
+    }
+
+    /// Forward distortion as served to vrserver
+    fn distort(&self, eye: Eye, u: f32, v: f32) -> DistortionSample {
+        match &self.distortion {
+            Some(grid) => grid.sample(eye, u, v),
+            None => {
+                let (ru, rv, gu, gv, bu, bv) = self.component.compute_distortion(eye, u, v);
+                [ru, rv, gu, gv, bu, bv]
+            }
+        }
+    }
+
+    /// Invert the served distortion for one color channel
+    fn undistort(&self, eye: Eye, channel: u32, u: f32, v: f32) -> Option<[f32; 2]> {
+        let forward = |eye: Eye, u: f32, v: f32| self.distort(eye, u, v);
+        self.inverse.as_ref()?.solve(&forward, eye, channel, u, v)
+    }
+}
+
+/// Map the OpenVR eye enum, treating anything unexpected as the left eye
+#[inline]
+fn to_eye(eye: sys::root::vr::EVREye) -> Eye {
+    match eye {
+        sys::root::vr::EVREye::Eye_Right => Eye::Right,
+        _ => Eye::Left,
+    }
+}
+
 /// Create a vtable for a DisplayComponent implementation
 pub(crate) fn create_display_vtable<T>(component: Arc<T>) -> *mut c_void
 where
     T: DisplayComponent + 'static,
 {
     use sys::root::vr::{
-        DistortionCoordinates_t, EVREye, HmdMatrix34_t, IVRDisplayComponent,
-        IVRDisplayComponent__bindgen_vtable,
+        DistortionCoordinates_t, EVREye, IVRDisplayComponent, IVRDisplayComponent__bindgen_vtable,
     };
 
-    // Create thunk functions that forward to the Rust implementation
+    // Create thunk functions that serve the geometry snapshot
     unsafe extern "C" fn get_window_bounds_thunk<T: DisplayComponent>(
         this: *mut IVRDisplayComponent,
         x: *mut i32,
@@ -30,10 +140,10 @@ where
             return;
         }
 
-        let wrapper = this as *mut VtableWrapper<IVRDisplayComponent__bindgen_vtable, T>;
-        let component = &(*wrapper).data;
+        let wrapper = this as *mut DisplayWrapper<T>;
+        let geometry = VtableWrapper::get_data(wrapper).geometry();
 
-        let (px, py, w, h) = component.get_window_bounds();
+        let (px, py, w, h) = geometry.window_bounds;
         *x = px;
         *y = py;
         *width = w as u32;
@@ -43,17 +153,15 @@ where
     unsafe extern "C" fn is_display_on_desktop_thunk<T: DisplayComponent>(
         this: *mut IVRDisplayComponent,
     ) -> bool {
-        let wrapper = this as *mut VtableWrapper<IVRDisplayComponent__bindgen_vtable, T>;
-        let component = &(*wrapper).data;
-        component.is_display_on_desktop()
+        let wrapper = this as *mut DisplayWrapper<T>;
+        VtableWrapper::get_data(wrapper).geometry().is_on_desktop
     }
 
     unsafe extern "C" fn is_display_real_thunk<T: DisplayComponent>(
         this: *mut IVRDisplayComponent,
     ) -> bool {
-        let wrapper = this as *mut VtableWrapper<IVRDisplayComponent__bindgen_vtable, T>;
-        let component = &(*wrapper).data;
-        component.is_display_real()
+        let wrapper = this as *mut DisplayWrapper<T>;
+        VtableWrapper::get_data(wrapper).geometry().is_real
     }
 
     unsafe extern "C" fn get_recommended_render_target_size_thunk<T: DisplayComponent>(
@@ -65,10 +173,10 @@ where
             return;
         }
 
-        let wrapper = this as *mut VtableWrapper<IVRDisplayComponent__bindgen_vtable, T>;
-        let component = &(*wrapper).data;
+        let wrapper = this as *mut DisplayWrapper<T>;
+        let geometry = VtableWrapper::get_data(wrapper).geometry();
 
-        let (w, h) = component.get_recommended_render_target_size();
+        let (w, h) = geometry.render_target_size;
         *width = w;
         *height = h;
     }
@@ -85,15 +193,14 @@ where
             return;
         }
 
-        let wrapper = this as *mut VtableWrapper<IVRDisplayComponent__bindgen_vtable, T>;
-        let component = &(*wrapper).data;
+        let wrapper = this as *mut DisplayWrapper<T>;
+        let geometry = VtableWrapper::get_data(wrapper).geometry();
 
-        // Default implementation - full viewport for each eye
-        let (_, _, w, h) = component.get_window_bounds();
-        *x = 0;
-        *y = 0;
-        *width = w as u32 / 2; // Half width for each eye
-        *height = h as u32;
+        let (vx, vy, w, h) = geometry.eye(to_eye(eye)).viewport;
+        *x = vx;
+        *y = vy;
+        *width = w;
+        *height = h;
     }
 
     unsafe extern "C" fn get_projection_raw_thunk<T: DisplayComponent>(
@@ -108,26 +215,14 @@ where
             return;
         }
 
-        let wrapper = this as *mut VtableWrapper<IVRDisplayComponent__bindgen_vtable, T>;
-        let component = &(*wrapper).data;
-
-        let eye_enum = match eye {
-            EVREye::Eye_Left => Eye::Left,
-            EVREye::Eye_Right => Eye::Right,
-            _ => Eye::Left,
-        };
+        let wrapper = this as *mut DisplayWrapper<T>;
+        let geometry = VtableWrapper::get_data(wrapper).geometry();
 
-        // Get projection matrix and extract frustum parameters
-        // This is a simplified implementation - you may need to adjust based on your needs
-        let projection = component.get_projection(eye_enum, 0.1, 1000.0);
-
-        // Extract frustum parameters from projection matrix
-        // These formulas assume a standard projection matrix layout
-        let near = 0.1f32;
-        *left = -near;
-        *right = near;
-        *top = near;
-        *bottom = -near;
+        let (l, r, t, b) = geometry.eye(to_eye(eye)).projection_raw;
+        *left = l;
+        *right = r;
+        *top = t;
+        *bottom = b;
     }
 
     unsafe extern "C" fn compute_distortion_thunk<T: DisplayComponent>(
@@ -136,17 +231,12 @@ where
         u: f32,
         v: f32,
     ) -> DistortionCoordinates_t {
-        let wrapper = this as *mut VtableWrapper<IVRDisplayComponent__bindgen_vtable, T>;
-        let component = &(*wrapper).data;
+        let wrapper = this as *mut DisplayWrapper<T>;
+        let state = &(*wrapper).data;
 
-        let eye_enum = match eye {
-            EVREye::Eye_Left => Eye::Left,
-            EVREye::Eye_Right => Eye::Right,
-            _ => Eye::Left,
-        };
+        let eye_enum = to_eye(eye);
 
-        let (red_u, red_v, green_u, green_v, blue_u, blue_v) =
-            component.compute_distortion(eye_enum, u, v);
+        let [red_u, red_v, green_u, green_v, blue_u, blue_v] = state.distort(eye_enum, u, v);
 
         DistortionCoordinates_t {
             rfRed: [red_u, red_v],
@@ -167,13 +257,18 @@ where
             return false;
         }
 
-        let wrapper = this as *mut VtableWrapper<IVRDisplayComponent__bindgen_vtable, T>;
-        let component = &(*wrapper).data;
+        let wrapper = this as *mut DisplayWrapper<T>;
+        let state = &(*wrapper).data;
+
+        let eye_enum = to_eye(eye);
 
-        // Default implementation - no inverse distortion
-        // In a real implementation, this would compute the inverse of the distortion
-        *result = sys::root::vr::HmdVector2_t { v: [u, v] };
-        true
+        match state.undistort(eye_enum, channel, u, v) {
+            Some(uv) => {
+                *result = sys::root::vr::HmdVector2_t { v: uv };
+                true
+            }
+            None => false,
+        }
     }
 
     // Create the vtable
@@ -193,7 +288,7 @@ where
 
     // Create the wrapper that contains both vtable pointer and data
     unsafe {
-        let wrapper = VtableWrapper::new(vtable_ptr, component);
+        let wrapper = VtableWrapper::new(vtable_ptr, Arc::new(DisplayState::new(component)));
         wrapper as *mut c_void
     }
 }
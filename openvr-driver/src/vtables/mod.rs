@@ -4,13 +4,19 @@
 //! required for OpenVR's C++ virtual interfaces. This is an internal module
 //! and should not be used directly by driver developers.
 
+mod camera;
 pub mod device;
+mod direct_mode;
 mod display;
 mod provider;
+mod virtual_display;
 
+pub(crate) use camera::create_camera_vtable;
 pub(crate) use device::create_device_vtable;
+pub(crate) use direct_mode::create_direct_mode_vtable;
 pub(crate) use display::create_display_vtable;
 pub(crate) use provider::create_provider_vtable;
+pub(crate) use virtual_display::create_virtual_display_vtable;
 
 use std::sync::Arc;
 
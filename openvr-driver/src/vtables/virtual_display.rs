@@ -0,0 +1,82 @@
+//! Virtual display vtable generation
+//!
+//! This module handles the creation of vtables for the VirtualDisplay interface.
+//! The thunks forward straight to the shared component without taking a lock,
+//! so the compositor thread calling them never waits on driver threads.
+
+use crate::interfaces::{PresentInfo, VirtualDisplay};
+use crate::sys;
+use std::ffi::c_void;
+use std::sync::Arc;
+
+use super::VtableWrapper;
+
+/// Wrapper type the virtual display thunks receive as `this`
+type VirtualDisplayWrapper<T> = VtableWrapper<sys::root::vr::IVRVirtualDisplay__bindgen_vtable, T>;
+
+/// Create a vtable for a VirtualDisplay implementation
+pub(crate) fn create_virtual_display_vtable<T>(display: Arc<T>) -> *mut c_void
+where
+    T: VirtualDisplay + ?Sized,
+{
+    use sys::root::vr::{IVRVirtualDisplay, IVRVirtualDisplay__bindgen_vtable, PresentInfo_t};
+
+    unsafe extern "C" fn present_thunk<T: VirtualDisplay + ?Sized>(
+        this: *mut IVRVirtualDisplay,
+        present_info: *const PresentInfo_t,
+        present_info_size: u32,
+    ) {
+        // Older runtimes may pass a shorter struct; ignore what we can't read
+        if present_info.is_null()
+            || (present_info_size as usize) < std::mem::size_of::<PresentInfo_t>()
+        {
+            return;
+        }
+
+        let wrapper = this as *mut VirtualDisplayWrapper<T>;
+        let info = PresentInfo::from(&*present_info);
+        VtableWrapper::get_data(wrapper).present(&info);
+    }
+
+    unsafe extern "C" fn wait_for_present_thunk<T: VirtualDisplay + ?Sized>(
+        this: *mut IVRVirtualDisplay,
+    ) {
+        let wrapper = this as *mut VirtualDisplayWrapper<T>;
+        VtableWrapper::get_data(wrapper).wait_for_present();
+    }
+
+    unsafe extern "C" fn get_time_since_last_vsync_thunk<T: VirtualDisplay + ?Sized>(
+        this: *mut IVRVirtualDisplay,
+        seconds_since_last_vsync: *mut f32,
+        frame_counter: *mut u64,
+    ) -> bool {
+        if seconds_since_last_vsync.is_null() || frame_counter.is_null() {
+            return false;
+        }
+
+        let wrapper = this as *mut VirtualDisplayWrapper<T>;
+        match VtableWrapper::get_data(wrapper).get_time_since_last_vsync() {
+            Some(timing) => {
+                *seconds_since_last_vsync = timing.seconds_since_last_vsync;
+                *frame_counter = timing.frame_counter;
+                true
+            }
+            None => false,
+        }
+    }
+
+    // Create the vtable
+    let vtable = Box::new(IVRVirtualDisplay__bindgen_vtable {
+        IVRVirtualDisplay_Present: present_thunk::<T>,
+        IVRVirtualDisplay_WaitForPresent: wait_for_present_thunk::<T>,
+        IVRVirtualDisplay_GetTimeSinceLastVsync: get_time_since_last_vsync_thunk::<T>,
+    });
+
+    let vtable_ptr = Box::into_raw(vtable);
+
+    // Create the wrapper that contains both vtable pointer and data
+    unsafe {
+        let wrapper = VtableWrapper::new(vtable_ptr, display);
+        wrapper as *mut c_void
+    }
+}